@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+
+####
+#
+# Decoder for the files recorded with `proot --trace=FILE`, see
+# src/extension/trace/trace.h for their layout.
+#
+# Usage:
+#  - proot-trace.py FILE                      print all the records
+#  - proot-trace.py --pid 42 FILE             only the records of pid 42
+#  - proot-trace.py --syscall open FILE       only the given syscall(s)
+#  - proot-trace.py --min-latency 100 FILE    only if PRoot spent >= 100 us
+#  - proot-trace.py --path /etc FILE          only if a path starts with /etc
+#  - proot-trace.py --summary FILE            per-syscall count and latency
+#
+####
+
+import argparse
+import struct
+import sys
+
+HEADER = struct.Struct('<8sIIQII')
+RECORD = struct.Struct('<Qq6QIiHH2II')
+SIGNATURE = b'PRTRACE1'
+HAS_RESULT = 0x1
+
+
+def load(path):
+    with open(path, 'rb') as file:
+        data = file.read()
+
+    signature, record_size, nb_records, nb_written, nb_sysnums, names_size = \
+        HEADER.unpack_from(data, 0)
+    if signature != SIGNATURE or record_size != RECORD.size:
+        sys.exit('%s: not a PRoot trace, or unsupported version' % path)
+
+    names_offset = HEADER.size + nb_records * record_size
+    names = data[names_offset:names_offset + names_size].split(b'\0')
+    names = [name.decode() for name in names[:nb_sysnums]]
+
+    try:
+        with open(path + '.paths', 'rb') as file:
+            paths = [''] + file.read().decode(errors='replace').split('\n')
+    except OSError:
+        paths = ['']
+
+    # Oldest records are overwritten once the ring buffer is full.
+    first = max(0, nb_written - nb_records)
+    records = []
+    for index in range(first, nb_written):
+        offset = HEADER.size + (index % nb_records) * record_size
+        records.append(RECORD.unpack_from(data, offset))
+
+    return names, paths, records, first
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Print records of `proot --trace=FILE`.')
+    parser.add_argument('--pid', type=int, action='append')
+    parser.add_argument('--syscall', action='append')
+    parser.add_argument('--min-latency', type=float, default=0, metavar='US')
+    parser.add_argument('--path')
+    parser.add_argument('--summary', action='store_true')
+    parser.add_argument('file')
+    options = parser.parse_args()
+
+    names, paths, records, first = load(options.file)
+    if first > 0:
+        print('# %d oldest records were overwritten' % first, file=sys.stderr)
+
+    summary = {}
+    for record in records:
+        timestamp, result, *args = record[:8]
+        latency, vpid, sysnum, flags, path1, path2 = record[8:14]
+
+        name = names[sysnum] if sysnum < len(names) else str(sysnum)
+        record_paths = [paths[id] for id in (path1, path2) if 0 < id < len(paths)]
+
+        if options.pid and vpid not in options.pid:
+            continue
+        if options.syscall and name not in options.syscall:
+            continue
+        if latency < options.min_latency * 1000:
+            continue
+        if options.path and not any(p.startswith(options.path) for p in record_paths):
+            continue
+
+        if options.summary:
+            count, total, worst = summary.get(name, (0, 0, 0))
+            summary[name] = (count + 1, total + latency, max(worst, latency))
+            continue
+
+        line = '%.6f %d %s(%s)' % (timestamp / 1e9, vpid, name,
+                                   ', '.join('%#x' % arg for arg in args))
+        line += ' = %d' % result if flags & HAS_RESULT else ' = ?'
+        line += ' <%.1f us>' % (latency / 1e3)
+        if record_paths:
+            line += ' ' + ' '.join(record_paths)
+        print(line)
+
+    for name, (count, total, worst) in sorted(summary.items(),
+                                              key=lambda item: -item[1][1]):
+        print('%-20s %8d calls %12.1f us total %10.1f us max'
+              % (name, count, total / 1e3, worst / 1e3))
+
+
+if __name__ == '__main__':
+    main()
@@ -37,6 +37,12 @@ typedef unsigned char byte_t;
 
 #define OFFSETOF_STATX_UID 20
 #define OFFSETOF_STATX_GID 24
+#define OFFSETOF_STATX_MODE 28
+#define OFFSETOF_STATX_INO 32
+#define OFFSETOF_STATX_RDEV_MAJOR 128
+#define OFFSETOF_STATX_RDEV_MINOR 132
+#define OFFSETOF_STATX_DEV_MAJOR 136
+#define OFFSETOF_STATX_DEV_MINOR 140
 
 #if !defined(ARCH_X86_64) && !defined(ARCH_ARM_EABI) && !defined(ARCH_X86) && !defined(ARCH_SH4)
 #    if defined(__x86_64__)
@@ -84,6 +90,12 @@ typedef unsigned char byte_t;
     #define LOADER_ADDRESS 0x600000000000
     #define HAS_LOADER_32BIT true
 
+    #define HAS_PRELOAD_SHIM true
+    #define SHIM_GADGET_ADDRESS 0x6ff000000000
+
+    #define HAS_SYSCALL_BATCH true
+    #define SYSCALL_BATCH_ADDRESS 0x6ff000001000
+
     #define EXEC_PIC_ADDRESS   0x500000000000
     #define INTERP_PIC_ADDRESS 0x6f0000000000
     #define EXEC_PIC_ADDRESS_32   0x0f000000
@@ -84,6 +84,13 @@ static int handle_option_m(Tracee *tracee, const Cli *cli, const char *value)
 	return parse_integer_option(tracee, &options->max_size, value, "-m");
 }
 
+static int handle_option_B(Tracee *tracee UNUSED, const Cli *cli, const char *value)
+{
+	Options *options = talloc_get_type_abort(cli->private, Options);
+	options->base = value;
+	return 0;
+}
+
 static int handle_option_d(Tracee *tracee UNUSED, const Cli *cli, const char *value UNUSED)
 {
 	Options *options = talloc_get_type_abort(cli->private, Options);
@@ -138,6 +145,13 @@ static int handle_option_x(Tracee *tracee UNUSED, const Cli *cli UNUSED, const c
 	return -1;
 }
 
+static int handle_option_X(Tracee *tracee UNUSED, const Cli *cli UNUSED, const char *value)
+{
+	int status = lazy_extract_archive_from_file(value);
+	exit_failure = (status < 0);
+	return -1;
+}
+
 extern unsigned char WEAK _binary_manual_start;
 extern unsigned char WEAK _binary_manual_end;
 
@@ -58,10 +58,12 @@ static int handle_option_r(Tracee *tracee, const Cli *cli, const char *value);
 static int handle_option_p(Tracee *tracee, const Cli *cli, const char *value);
 static int handle_option_e(Tracee *tracee, const Cli *cli, const char *value);
 static int handle_option_m(Tracee *tracee, const Cli *cli, const char *value);
+static int handle_option_B(Tracee *tracee, const Cli *cli, const char *value);
 static int handle_option_d(Tracee *tracee, const Cli *cli, const char *value);
 static int handle_option_v(Tracee *tracee, const Cli *cli, const char *value);
 static int handle_option_V(Tracee *tracee, const Cli *cli, const char *value);
 static int handle_option_x(Tracee *tracee, const Cli *cli, const char *value);
+static int handle_option_X(Tracee *tracee, const Cli *cli, const char *value);
 static int handle_option_h(Tracee *tracee, const Cli *cli, const char *value);
 
 static int pre_initialize_bindings(Tracee *, const Cli *, size_t, char *const *, size_t);
@@ -138,6 +140,15 @@ Copyright (C) 2021 PRoot Developers, licensed under GPL v2 or later.",
 	  .description = "Set the maximum size of archivable files to *value* megabytes.",
 	  .detail = NULL,
 	},
+	{ .class = "Options",
+	  .arguments = {
+		{ .name = "-B", .separator = ' ', .value = "file" },
+		{ .name = "--base", .separator = '=', .value = "file" },
+		{ .name = NULL, .separator = '\0', .value = NULL } },
+	  .handler = handle_option_B,
+	  .description = "Don't archive files that are unchanged from the archive *file*.",
+	  .detail = NULL,
+	},
 	{ .class = "Options",
 	  .arguments = {
 		{ .name = "-d", .separator = '\0', .value = NULL },
@@ -175,6 +186,15 @@ Copyright (C) 2021 PRoot Developers, licensed under GPL v2 or later.",
 	  .description = "Extract content of the archive *file*, then exit.",
 	  .detail = NULL,
 	},
+	{ .class = "Options",
+	  .arguments = {
+		{ .name = "-X", .separator = ' ', .value = "file" },
+		{ .name = "--lazy-extract", .separator = '=', .value = "file" },
+		{ .name = NULL, .separator = '\0', .value = NULL } },
+	  .handler = handle_option_X,
+	  .description = "Like -x but defer the extraction of rootfs files until they are used.",
+	  .detail = NULL,
+	},
 	{ .class = "Options",
 	  .arguments = {
 		{ .name = "-h", .separator = '\0', .value = NULL },
@@ -46,6 +46,7 @@
 #include "path/binding.h"
 #include "path/canon.h"
 #include "path/path.h"
+#include "path/temp.h"
 
 #include "build.h"
 
@@ -482,7 +483,13 @@ int main(int argc, char *const argv[])
 	}
 
 	/* Start tracing the first tracee and all its children.  */
-	exit(event_loop());
+	status = event_loop();
+
+	/* Don't make the parent wait for the removal of temporary
+	 * directories.  */
+	detach_temp_removal();
+
+	exit(status);
 
 error:
 	TALLOC_FREE(tracee);
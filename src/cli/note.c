@@ -20,11 +20,18 @@
  * 02110-1301 USA.
  */
 
-#include <errno.h>  /* errno, */
-#include <string.h> /* strerror(3), */
-#include <stdarg.h> /* va_*, */
-#include <stdio.h>  /* vfprintf(3), */
-#include <limits.h> /* INT_MAX, */
+#include <errno.h>     /* errno, */
+#include <string.h>    /* strerror(3), */
+#include <stdarg.h>    /* va_*, */
+#include <stdio.h>     /* vfprintf(3), */
+#include <limits.h>    /* INT_MAX, */
+#include <stdint.h>    /* uintptr_t, */
+#include <stdbool.h>   /* bool, true, false, */
+#include <pthread.h>   /* pthread_*, */
+#include <semaphore.h> /* sem_*, */
+#include <unistd.h>    /* getpid(2), */
+#include <time.h>      /* clock_gettime(2), nanosleep(2), */
+#include <signal.h>    /* sig*set(3), */
 
 #include "cli/note.h"
 #include "tracee/tracee.h"
@@ -32,28 +39,59 @@
 int global_verbose_level;
 const char *global_tool_name;
 
+/* Notices are formatted by the event loop into a slot of this ring,
+ * then written by a background thread: a tracee that doesn't read
+ * the terminal or the pipe PRoot shares with it can't stall PRoot --
+ * and every other tracee with it -- anymore.  */
+#define NOTE_RING_SIZE	256
+#define NOTE_TEXT_SIZE	1024
+
+typedef struct {
+	const char *tool_name;
+	Severity severity;
+	Origin origin;
+	int error;
+	char text[NOTE_TEXT_SIZE];
+} Note;
+
+static struct {
+	Note slots[NOTE_RING_SIZE];
+
+	/* Only the event loop writes head, only the writer thread
+	 * writes tail: no lock is required.  */
+	unsigned long head;
+	unsigned long tail;
+	unsigned long dropped;
+
+	sem_t pending;
+	pthread_t producer;
+	pthread_t writer;
+	pid_t pid;
+	bool started;
+	bool stopping;
+} ring;
+
+/* A warning emitted from the same place with the same message more
+ * than NOTE_BURST times per second is rate limited, typically
+ * ptrace(PEEKDATA) failures on a tracee that was killed.  */
+#define NOTE_SITES	64
+#define NOTE_BURST	10
+
+static struct {
+	const void *site;
+	const char *message;
+	time_t window;
+	unsigned int count;
+	unsigned int suppressed;
+} sites[NOTE_SITES];
+
 /**
  * Print @message to the standard error stream according to its
  * @severity and @origin.
  */
-void note(const Tracee *tracee, Severity severity, Origin origin, const char *message, ...)
+static void print_note(const char *tool_name, Severity severity, Origin origin,
+		const char *message, va_list extra_params)
 {
-	const char *tool_name;
-	va_list extra_params;
-	int verbose_level;
-
-	if (tracee == NULL) {
-		verbose_level = global_verbose_level;
-		tool_name     = global_tool_name ?: "";
-	}
-	else {
-		verbose_level = tracee->verbose;
-		tool_name     = tracee->tool_name;
-	}
-
-	if (verbose_level < 0 && severity != ERROR)
-		return;
-
 	switch (severity) {
 	case WARNING:
 		fprintf(stderr, "%s warning: ", tool_name);
@@ -72,9 +110,7 @@ void note(const Tracee *tracee, Severity severity, Origin origin, const char *me
 	if (origin == TALLOC)
 		fprintf(stderr, "talloc: ");
 
-	va_start(extra_params, message);
 	vfprintf(stderr, message, extra_params);
-	va_end(extra_params);
 
 	switch (origin) {
 	case SYSTEM:
@@ -91,7 +127,318 @@ void note(const Tracee *tracee, Severity severity, Origin origin, const char *me
 		fprintf(stderr, "\n");
 		break;
 	}
+}
+
+/**
+ * Write the formatted @note to the standard error stream, the prefix
+ * and the error string are generated here rather than by the event
+ * loop.
+ */
+static void write_note(const Note *note)
+{
+	static const char *prefixes[] = {
+		[ERROR]   = "error",
+		[WARNING] = "warning",
+		[INFO]    = "info",
+	};
+
+	/* A single call keeps the line atomic with respect to other
+	 * stdio users.  */
+	fprintf(stderr, "%s %s: %s%s%s%s\n", note->tool_name, prefixes[note->severity],
+		note->origin == TALLOC ? "talloc: " : "", note->text,
+		note->origin == SYSTEM ? ": " : "",
+		note->origin == SYSTEM ? strerror(note->error) : "");
+}
+
+/**
+ * Write all the notices queued in the ring, then report how many
+ * were dropped because it was full.
+ */
+static void drain_ring()
+{
+	unsigned long dropped;
+	unsigned long head;
+	Note note;
+
+	head = __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE);
+	while (ring.tail != head) {
+		write_note(&ring.slots[ring.tail % NOTE_RING_SIZE]);
+		__atomic_store_n(&ring.tail, ring.tail + 1, __ATOMIC_RELEASE);
+		head = __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE);
+	}
 
-	return;
+	dropped = __atomic_exchange_n(&ring.dropped, 0, __ATOMIC_RELAXED);
+	if (dropped == 0)
+		return;
+
+	note.tool_name = global_tool_name ?: "";
+	note.severity  = WARNING;
+	note.origin    = INTERNAL;
+	snprintf(note.text, sizeof(note.text), "%lu notices dropped", dropped);
+	write_note(&note);
+}
+
+/**
+ * Background thread that writes the notices queued by the event loop.
+ */
+static void *note_writer(void *unused UNUSED)
+{
+	while (!__atomic_load_n(&ring.stopping, __ATOMIC_ACQUIRE)) {
+		if (sem_wait(&ring.pending) < 0 && errno != EINTR)
+			break;
+		drain_ring();
+	}
+
+	drain_ring();
+	return NULL;
+}
+
+/**
+ * Make the next notices emitted by the calling thread -- the event
+ * loop -- asynchronous.  Notices are written synchronously if this
+ * function fails or wasn't called.
+ */
+void start_note_writer()
+{
+	sigset_t signals;
+	sigset_t saved;
+	int status;
+
+	if (ring.started)
+		return;
+
+	status = sem_init(&ring.pending, 0, 0);
+	if (status < 0)
+		return;
+
+	ring.producer = pthread_self();
+	ring.pid = getpid();
+
+	/* Signals are for the event loop only, the writer thread
+	 * inherits this mask.  */
+	sigfillset(&signals);
+	pthread_sigmask(SIG_SETMASK, &signals, &saved);
+	status = pthread_create(&ring.writer, NULL, note_writer, NULL);
+	pthread_sigmask(SIG_SETMASK, &saved, NULL);
+	if (status != 0) {
+		sem_destroy(&ring.pending);
+		return;
+	}
+
+	ring.started = true;
+}
+
+/**
+ * Format @message into the next free slot of the ring and wake the
+ * writer thread up.  This function returns false if @message has to
+ * be printed synchronously.
+ */
+static bool queue_note(const char *tool_name, Severity severity, Origin origin,
+		int error, const char *message, va_list extra_params)
+{
+	Note *slot;
+	int size;
+
+	if (ring.head - __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE) >= NOTE_RING_SIZE) {
+		__atomic_add_fetch(&ring.dropped, 1, __ATOMIC_RELAXED);
+		return true;
+	}
+
+	slot = &ring.slots[ring.head % NOTE_RING_SIZE];
+
+	/* Too long to fit in a slot, this is a rare case.  */
+	size = vsnprintf(slot->text, sizeof(slot->text), message, extra_params);
+	if (size < 0 || (size_t) size >= sizeof(slot->text))
+		return false;
+
+	slot->tool_name = tool_name;
+	slot->severity  = severity;
+	slot->origin    = origin;
+	slot->error     = error;
+
+	__atomic_store_n(&ring.head, ring.head + 1, __ATOMIC_RELEASE);
+	sem_post(&ring.pending);
+
+	return true;
 }
 
+/**
+ * Variadic wrapper for queue_note(), used for notices generated by
+ * this module.
+ */
+static void queue_internal_note(const char *tool_name, const char *message, ...) FORMAT(printf, 2, 3);
+static void queue_internal_note(const char *tool_name, const char *message, ...)
+{
+	va_list extra_params;
+
+	va_start(extra_params, message);
+	(void) queue_note(tool_name, WARNING, INTERNAL, 0, message, extra_params);
+	va_end(extra_params);
+}
+
+/**
+ * Report the warnings that were rate limited since their last
+ * occurrence.
+ */
+static void report_suppressed()
+{
+	size_t i;
+
+	for (i = 0; i < NOTE_SITES; i++) {
+		if (sites[i].suppressed == 0)
+			continue;
+
+		queue_internal_note(global_tool_name ?: "", "%u similar warnings suppressed",
+				sites[i].suppressed);
+		sites[i].suppressed = 0;
+	}
+}
+
+/**
+ * Wait for the writer thread to write all the queued notices, then
+ * switch back to synchronous notices.  This function is registered
+ * with atexit(3), and it is safe to call it many times.
+ */
+void stop_note_writer()
+{
+	if (!ring.started || !pthread_equal(pthread_self(), ring.producer) || getpid() != ring.pid)
+		return;
+
+	report_suppressed();
+
+	__atomic_store_n(&ring.stopping, true, __ATOMIC_RELEASE);
+	sem_post(&ring.pending);
+	pthread_join(ring.writer, NULL);
+
+	ring.started  = false;
+	ring.stopping = false;
+	sem_destroy(&ring.pending);
+}
+
+/**
+ * Wait -- at most one second -- for the writer thread to write all
+ * the queued notices.  This is used to keep the order of notices
+ * that have to be written synchronously.
+ */
+static void flush_ring()
+{
+	const struct timespec delay = { .tv_sec = 0, .tv_nsec = 1000000 };
+	int i;
+
+	for (i = 0; i < 1000; i++) {
+		if (__atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE) == ring.head)
+			return;
+		sem_post(&ring.pending);
+		nanosleep(&delay, NULL);
+	}
+}
+
+/**
+ * Check whether the warning emitted from @site with the format
+ * @message has to be suppressed.  When a new one-second window
+ * starts, the number of such warnings that were suppressed during
+ * the previous one is returned in @suppressed.
+ */
+static bool is_rate_limited(const void *site, const char *message, unsigned int *suppressed)
+{
+	struct timespec now;
+	size_t index;
+
+	*suppressed = 0;
+
+	if (clock_gettime(CLOCK_MONOTONIC_COARSE, &now) < 0)
+		return false;
+
+	index = (((uintptr_t) site >> 2) ^ ((uintptr_t) message >> 2)) % NOTE_SITES;
+	if (   sites[index].site != site
+	    || sites[index].message != message
+	    || sites[index].window != now.tv_sec) {
+		*suppressed = sites[index].suppressed;
+
+		sites[index].site       = site;
+		sites[index].message    = message;
+		sites[index].window     = now.tv_sec;
+		sites[index].count      = 0;
+		sites[index].suppressed = 0;
+	}
+
+	if (sites[index].count++ < NOTE_BURST)
+		return false;
+
+	sites[index].suppressed++;
+	return true;
+}
+
+/**
+ * Print @message to the standard error stream according to its
+ * @severity and @origin.  Once start_note_writer() was called, this
+ * is done asynchronously for the notices emitted by the event loop:
+ * @message is formatted in the ring whereas the prefix and the error
+ * string are generated by the writer thread.
+ */
+void note(const Tracee *tracee, Severity severity, Origin origin, const char *message, ...)
+{
+	static bool is_reentrant = false;
+	unsigned int suppressed;
+	const char *tool_name;
+	va_list extra_params;
+	int verbose_level;
+	bool queued;
+	int error;
+
+	error = errno;
+
+	if (tracee == NULL) {
+		verbose_level = global_verbose_level;
+		tool_name     = global_tool_name ?: "";
+	}
+	else {
+		verbose_level = tracee->verbose;
+		tool_name     = tracee->tool_name;
+	}
+
+	if (verbose_level < 0 && severity != ERROR)
+		return;
+
+	/* Helper threads, the child process before execve(2), and
+	 * signal handlers interrupting note() write synchronously.  */
+	if (!ring.started || is_reentrant
+	    || !pthread_equal(pthread_self(), ring.producer) || getpid() != ring.pid)
+		goto synchronous;
+
+	/* Errors usually precede the end of PRoot: write them, after
+	 * all the pending notices, right now.  */
+	if (severity == ERROR) {
+		flush_ring();
+		goto synchronous;
+	}
+
+	is_reentrant = true;
+
+	if (severity == WARNING) {
+		if (is_rate_limited(__builtin_return_address(0), message, &suppressed)) {
+			is_reentrant = false;
+			return;
+		}
+
+		if (suppressed > 0)
+			queue_internal_note(tool_name, "%u similar warnings suppressed", suppressed);
+	}
+
+	va_start(extra_params, message);
+	queued = queue_note(tool_name, severity, origin, error, message, extra_params);
+	va_end(extra_params);
+
+	is_reentrant = false;
+
+	if (queued)
+		return;
+
+	flush_ring();
+
+synchronous:
+	errno = error;
+	va_start(extra_params, message);
+	print_note(tool_name, severity, origin, message, extra_params);
+	va_end(extra_params);
+}
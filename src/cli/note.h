@@ -47,6 +47,8 @@ typedef enum {
 	} while (0)
 
 extern void note(const Tracee *tracee, Severity severity, Origin origin, const char *message, ...) FORMAT(printf, 4, 5);
+extern void start_note_writer();
+extern void stop_note_writer();
 
 extern int global_verbose_level;
 extern const char *global_tool_name;
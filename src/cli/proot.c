@@ -28,7 +28,11 @@
 #include "cli/cli.h"
 #include "cli/note.h"
 #include "extension/extension.h"
+#include "extension/care/extract.h"
+#include "extension/fake_id0/db.h"
 #include "path/binding.h"
+#include "path/kernel.h"
+#include "execve/shim.h"
 #include "attribute.h"
 
 /* These should be included last.  */
@@ -197,12 +201,40 @@ static int handle_option_0(Tracee *tracee, const Cli *cli, const char *value UNU
 	return handle_option_i(tracee, cli, "0:0");
 }
 
+static int handle_option_db(Tracee *tracee, const Cli *cli UNUSED, const char *value)
+{
+	return use_fake_id0_database(tracee, value);
+}
+
 static int handle_option_kill_on_exit(Tracee *tracee, const Cli *cli UNUSED, const char *value UNUSED)
 {
 	tracee->killall_on_exit = true;
 	return 0;
 }
 
+static int handle_option_kernel_bindings(Tracee *tracee, const Cli *cli UNUSED, const char *value UNUSED)
+{
+	tracee->kernel_bindings = true;
+	return 0;
+}
+
+static int handle_option_preload_shim(Tracee *tracee, const Cli *cli UNUSED, const char *value UNUSED)
+{
+	tracee->preload_shim = true;
+	return 0;
+}
+
+static int handle_option_syscall_batch(Tracee *tracee, const Cli *cli UNUSED, const char *value UNUSED)
+{
+#if defined(HAS_SYSCALL_BATCH)
+	tracee->syscall_batch = true;
+#else
+	note(tracee, WARNING, USER,
+		"--syscall-batch: it is not supported on this architecture");
+#endif
+	return 0;
+}
+
 static int handle_option_v(Tracee *tracee, const Cli *cli UNUSED, const char *value)
 {
 	int status;
@@ -341,6 +373,31 @@ static int handle_option_l(Tracee *tracee, const Cli *cli UNUSED, const char *va
 	return initialize_extension(tracee, link2symlink_callback, NULL);
 }
 
+static int handle_option_O(Tracee *tracee, const Cli *cli UNUSED, const char *value)
+{
+	return initialize_extension(tracee, overlay_callback, value);
+}
+
+static int handle_option_trace(Tracee *tracee, const Cli *cli UNUSED, const char *value)
+{
+	return initialize_extension(tracee, trace_callback, value);
+}
+
+static int handle_option_trace_replay(Tracee *tracee, const Cli *cli UNUSED, const char *value)
+{
+	return initialize_extension(tracee, trace_replay_callback, value);
+}
+
+static int handle_option_care_index(Tracee *tracee, const Cli *cli UNUSED, const char *value)
+{
+	if (care_lazy_callback == NULL) {
+		note(tracee, ERROR, USER, "--care-index: CARE support is not built in");
+		return -1;
+	}
+
+	return initialize_extension(tracee, care_lazy_callback, value);
+}
+
 /**
  * Initialize @tracee->qemu.
  */
@@ -401,6 +458,19 @@ static int pre_initialize_bindings(Tracee *tracee, const Cli *cli,
 	return cursor;
 }
 
+/**
+ * Hand the bindings over to the kernel or to the preload shim if it
+ * was requested, see enable_kernel_bindings() and
+ * initialize_preload_shim().
+ */
+static int post_initialize_bindings(Tracee *tracee, const Cli *cli UNUSED,
+			size_t argc UNUSED, char *const argv[] UNUSED, size_t cursor)
+{
+	enable_kernel_bindings(tracee);
+	initialize_preload_shim(tracee);
+	return cursor;
+}
+
 const Cli *get_proot_cli(TALLOC_CTX *context UNUSED)
 {
 	global_tool_name = proot_cli.name;
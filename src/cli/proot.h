@@ -59,17 +59,26 @@ static int handle_option_h(Tracee *tracee, const Cli *cli, const char *value);
 static int handle_option_k(Tracee *tracee, const Cli *cli, const char *value);
 static int handle_option_0(Tracee *tracee, const Cli *cli, const char *value);
 static int handle_option_i(Tracee *tracee, const Cli *cli, const char *value);
+static int handle_option_db(Tracee *tracee, const Cli *cli, const char *value);
 static int handle_option_p(Tracee *tracee, const Cli *cli, const char *value);
 static int handle_option_n(Tracee *tracee, const Cli *cli, const char *value);
 #ifdef HAVE_PYTHON_EXTENSION
 static int handle_option_P(Tracee *tracee, const Cli *cli, const char *value);
 #endif
 static int handle_option_l(Tracee *tracee, const Cli *cli, const char *value);
+static int handle_option_O(Tracee *tracee, const Cli *cli, const char *value);
+static int handle_option_trace(Tracee *tracee, const Cli *cli, const char *value);
+static int handle_option_trace_replay(Tracee *tracee, const Cli *cli, const char *value);
+static int handle_option_care_index(Tracee *tracee, const Cli *cli, const char *value);
 static int handle_option_R(Tracee *tracee, const Cli *cli, const char *value);
 static int handle_option_S(Tracee *tracee, const Cli *cli, const char *value);
 static int handle_option_kill_on_exit(Tracee *tracee, const Cli *cli, const char *value);
+static int handle_option_kernel_bindings(Tracee *tracee, const Cli *cli, const char *value);
+static int handle_option_preload_shim(Tracee *tracee, const Cli *cli, const char *value);
+static int handle_option_syscall_batch(Tracee *tracee, const Cli *cli, const char *value);
 
 static int pre_initialize_bindings(Tracee *, const Cli *, size_t, char *const *, size_t);
+static int post_initialize_bindings(Tracee *, const Cli *, size_t, char *const *, size_t);
 static int post_initialize_exe(Tracee *, const Cli *, size_t, char *const *, size_t);
 
 static Cli proot_cli = {
@@ -86,6 +95,7 @@ Copyright (C) 2023 PRoot Developers, licensed under GPL v2 or later.",
 |__|  |__|__\\_____/\\_____/\\____|",
 
 	.pre_initialize_bindings = pre_initialize_bindings,
+	.post_initialize_bindings = post_initialize_bindings,
 	.post_initialize_exe = post_initialize_exe,
 
 	.options = {
@@ -169,6 +179,51 @@ Copyright (C) 2023 PRoot Developers, licensed under GPL v2 or later.",
 	  .detail = "\tWhen the executed command leaves orphean or detached processes\n\
 \taround, proot waits until all processes possibly terminate. This option forces\n\
 \tthe immediate termination of all tracee processes when the main command exits.",
+	},
+	{ .class = "Regular options",
+	  .arguments = {
+		{ .name = "--kernel-bindings", .separator = '\0', .value = NULL },
+		{ .name = NULL, .separator = '\0', .value = NULL } },
+	  .handler = handle_option_kernel_bindings,
+	  .description = "Let the kernel handle bindings when possible.",
+	  .detail = "\tWhen unprivileged user and mount namespaces are available, the\n\
+\tguest rootfs and the bindings are set up with bind mounts, and\n\
+\tPRoot only intercepts the few system calls it still has to handle\n\
+\t(execve, ptrace, ...) plus the ones required by the extensions.\n\
+\tThis requires all bindings to point to existing paths of the same\n\
+\ttype in the guest rootfs, and both /proc and the temporary\n\
+\tdirectory to be bound as-is (like with -R).  Note that files\n\
+\towned by other users than the current one then appear as owned\n\
+\tby the overflow user.  PRoot falls back to the usual mode when\n\
+\tany of these requirements is not met.",
+	},
+	{ .class = "Regular options",
+	  .arguments = {
+		{ .name = "--preload-shim", .separator = '\0', .value = NULL },
+		{ .name = NULL, .separator = '\0', .value = NULL } },
+	  .handler = handle_option_preload_shim,
+	  .description = "Translate common path accesses within the programs.",
+	  .detail = "\tA small library is preloaded into dynamically linked programs of\n\
+\tthe native ABI to translate the paths given to open(2), stat(2),\n\
+\tand access(2) according to the bindings, without the overhead of\n\
+\ta round-trip to PRoot.  Anything else -- relative paths, /proc,\n\
+\terrors, statically linked programs, ... -- is still handled by\n\
+\tPRoot.  This is only available on x86_64 and it is disabled when\n\
+\tQEMU, glued paths, extensions, or --kernel-bindings are in use.",
+	},
+	{ .class = "Regular options",
+	  .arguments = {
+		{ .name = "--syscall-batch", .separator = '\0', .value = NULL },
+		{ .name = NULL, .separator = '\0', .value = NULL } },
+	  .handler = handle_option_syscall_batch,
+	  .description = "Run the syscalls chained by extensions in a single batch.",
+	  .detail = "\tSome extensions, like -k, complete a syscall with a few extra\n\
+\tsyscalls.  These are run in a row by a small trampoline of the\n\
+\tloader, instead of stopping the program for each of them.  Note\n\
+\tthat syscalls made from this trampoline are not checked by PRoot,\n\
+\tso a program could bypass the path translation by jumping into\n\
+\tit: use this option with trusted programs only.  This is only\n\
+\tavailable on x86_64.",
 	},
 	{ .class = "Regular options",
 	  .arguments = {
@@ -241,6 +296,20 @@ Copyright (C) 2023 PRoot Developers, licensed under GPL v2 or later.",
 \tgid.  Likewise, files actually owned by the current user and\n\
 \tgroup appear as if they were owned by uid and gid instead.\n\
 \tNote that the -0 option is the same as -i 0:0.",
+	},
+	{ .class = "Extension options",
+	  .arguments = {
+		{ .name = "--db", .separator = '=', .value = "path" },
+		{ .name = NULL, .separator = '\0', .value = NULL } },
+	  .handler = handle_option_db,
+	  .description = "Keep the ownership and device nodes faked by -0/-i in *path*.",
+	  .detail = "\tWith -0 or -i, the ownership set by chown(2), the modes that\n\
+\tcan't be set on the host, and the device nodes created by\n\
+\tmknod(2) are faked: they are reported by stat(2) but not\n\
+\tapplied to host files.  This option stores them into the database\n\
+\t*path* -- created if needed -- so they persist across runs, for\n\
+\tinstance when installing then packing a rootfs.  It must be\n\
+\tspecified after -0, -S, or -i.",
 	},
 	{ .class = "Extension options",
 	  .arguments = {
@@ -281,7 +350,10 @@ Copyright (C) 2023 PRoot Developers, licensed under GPL v2 or later.",
 		{ .name = NULL, .separator = '\0', .value = NULL } },
 	  .handler = handle_option_P,
 	  .description = "Allow to access tracee information from python (experimental).",
-	  .detail = "\tThis option allow to launch a python script as an extension (experimental).",
+	  .detail = "\tThis option allow to launch a python script as an extension (experimental).\n\
+\tThe script can restrict the events it is notified about with\n\
+\tset_event_filter(), and observe some of them asynchronously from\n\
+\tits own thread with fetch_events().",
 	},
 #endif
 	{ .class = "Extension options",
@@ -294,6 +366,54 @@ Copyright (C) 2023 PRoot Developers, licensed under GPL v2 or later.",
 	  .detail = "\tThis extension causes proot to create a symlink when a hardlink\n\
 \tshould be created. Some environments don't let the user create a hardlink, this\n\
 \toption should be used to fix it.",
+	},
+	{ .class = "Extension options",
+	  .arguments = {
+		{ .name = "-O", .separator = ' ', .value = "path" },
+		{ .name = "--overlay", .separator = '=', .value = "path" },
+		{ .name = NULL, .separator = '\0', .value = NULL } },
+	  .handler = handle_option_O,
+	  .description = "Write all changes of the guest rootfs into *path*.",
+	  .detail = "\tThe guest rootfs is used as a read-only lower layer and *path*,\n\
+\tcreated if needed, as a private upper layer: files are copied up\n\
+\tinto *path* right before they are modified, and deletions are\n\
+\trecorded there as \".wh.name\" whiteout files.  The guest rootfs\n\
+\tis left untouched, so it can be shared by several jobs, each one\n\
+\tusing its own *path*.  Bindings are not affected by this option.",
+	},
+	{ .class = "Extension options",
+	  .arguments = {
+		{ .name = "--trace", .separator = '=', .value = "path" },
+		{ .name = NULL, .separator = '\0', .value = NULL } },
+	  .handler = handle_option_trace,
+	  .description = "Record the syscalls handled by PRoot into *path*, in binary form.",
+	  .detail = "\tEach syscall is recorded as a fixed-size record -- timestamp,\n\
+\tpid, syscall, arguments, translated paths, result and time spent by\n\
+\tPRoot -- into a ring buffer mapped in memory, so the overhead stays\n\
+\tsmall, unlike the verbose mode.  Only the latest records are kept.\n\
+\tTranslated paths are stored once in *path*.paths.  Use the script\n\
+\tcontrib/proot-trace.py to print and filter these records.",
+	},
+	{ .class = "Extension options",
+	  .arguments = {
+		{ .name = "--trace-replay", .separator = '=', .value = "path" },
+		{ .name = NULL, .separator = '\0', .value = NULL } },
+	  .handler = handle_option_trace_replay,
+	  .description = "Write the inputs of all path translations into *path*.",
+	  .detail = "\tOne line is written per translation, so this is much slower\n\
+\tthan --trace.  See \"make -C test bench\" to replay them against\n\
+\tthe path translation engine, without any tracee.",
+	},
+	{ .class = "Extension options",
+	  .arguments = {
+		{ .name = "--care-index", .separator = '=', .value = "path" },
+		{ .name = NULL, .separator = '\0', .value = NULL } },
+	  .handler = handle_option_care_index,
+	  .description = "Extract files from a CARE archive on demand, as listed in *path*.",
+	  .detail = "\tThis option is used by the \"re-execute.sh\" script of CARE\n\
+\tarchives extracted with \"care -X\": the content of a file of the\n\
+\trootfs is extracted from the archive only when this file is\n\
+\topened for the first time.",
 	},
 	{ .class = "Alias options",
 	  .arguments = {
@@ -37,6 +37,7 @@
 #include "execve/aoxp.h"
 #include "execve/ldso.h"
 #include "execve/elf.h"
+#include "execve/shim.h"
 #include "path/path.h"
 #include "path/temp.h"
 #include "path/binding.h"
@@ -669,6 +670,10 @@ int translate_execve_enter(Tracee *tracee)
 
 	compute_load_addresses(tracee);
 
+	status = inject_preload_shim(tracee);
+	if (status < 0)
+		return status;
+
 	/* Execute the loader instead of the program.  */
 	loader_path = get_loader_path(tracee);
 	if (loader_path == NULL)
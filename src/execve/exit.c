@@ -451,7 +451,10 @@ void translate_execve_exit(Tracee *tracee)
 	if ((int) syscall_result < 0)
 		return;
 
-	/* Execve happened; commit the new "/proc/self/exe".  */
+	/* Execve happened through the loader.  */
+	tracee->loader_mapped = true;
+
+	/* Commit the new "/proc/self/exe".  */
 	if (tracee->new_exe != NULL) {
 		(void) talloc_unlink(tracee, tracee->exe);
 		tracee->exe = talloc_reference(tracee, tracee->new_exe);
@@ -0,0 +1,352 @@
+/* -*- c-set-style: "K&R"; c-basic-offset: 8 -*-
+ *
+ * This file is part of PRoot.
+ *
+ * Copyright (C) 2015 STMicroelectronics
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <sys/types.h>  /* open(2), */
+#include <sys/stat.h>   /* open(2), */
+#include <fcntl.h>      /* open(2), */
+#include <unistd.h>     /* write(2), close(2), */
+#include <string.h>     /* str*(3), mem*(3), */
+#include <strings.h>    /* bzero(3), */
+#include <errno.h>      /* E*, */
+#include <talloc.h>     /* talloc_*, */
+
+#include "execve/shim.h"
+#include "execve/ldso.h"
+#include "execve/aoxp.h"
+#include "execve/elf.h"
+#include "execve/execve.h"
+#include "path/binding.h"
+#include "path/temp.h"
+#include "shim/snapshot.h"
+#include "cli/note.h"
+#include "arch.h"
+
+/* Host path to the snapshot of the bindings, see
+ * write_snapshot().  */
+static const char *snapshot_path = NULL;
+
+#if defined(HAS_PRELOAD_SHIM)
+
+extern unsigned char _binary_shim_so_start[];
+extern unsigned char _binary_shim_so_end[];
+
+/**
+ * Extract the built-in preload shim.  This function returns NULL if
+ * an error occurred, otherwise it returns the host path to the
+ * extracted shim.
+ */
+static const char *extract_shim(const Tracee *tracee)
+{
+	const char *path;
+	ssize_t status;
+	size_t size;
+	int fd;
+
+	path = create_temp_file(talloc_autofree_context(), "prooted");
+	if (path == NULL)
+		return NULL;
+
+	fd = open(path, O_WRONLY | O_TRUNC);
+	if (fd < 0) {
+		note(tracee, ERROR, SYSTEM, "can't open the preload shim");
+		return NULL;
+	}
+
+	size = (size_t) (_binary_shim_so_end - _binary_shim_so_start);
+	status = write(fd, _binary_shim_so_start, size);
+	close(fd);
+	if (status < 0 || (size_t) status != size) {
+		note(tracee, ERROR, SYSTEM, "can't write the preload shim");
+		return NULL;
+	}
+
+	return path;
+}
+
+#endif /* HAS_PRELOAD_SHIM */
+
+/**
+ * Write into a temporary file the snapshot of @tracee's bindings, as
+ * described in shim/snapshot.h.  This function returns NULL if an
+ * error occurred, otherwise it returns the host path to the snapshot.
+ */
+static const char *write_snapshot(const Tracee *tracee)
+{
+	const Binding *binding;
+	SnapshotBinding *entries;
+	SnapshotHeader *header;
+	const char *path;
+	size_t nb_bindings;
+	size_t offset;
+	size_t size;
+	char *buffer;
+	ssize_t status;
+	size_t i;
+	int fd;
+
+	nb_bindings = 0;
+	size = 0;
+	CIRCLEQ_FOREACH(binding, tracee->fs->bindings.guest, link.guest) {
+		nb_bindings++;
+		size += strlen(binding->guest.path) + 1;
+		size += strlen(binding->host.path) + 1;
+	}
+
+	offset = sizeof(SnapshotHeader) + nb_bindings * sizeof(SnapshotBinding);
+	size  += offset;
+
+	buffer = talloc_zero_size(tracee->ctx, size);
+	if (buffer == NULL)
+		return NULL;
+
+	header = (SnapshotHeader *) buffer;
+	header->magic       = SHIM_SNAPSHOT_MAGIC;
+	header->version     = SHIM_SNAPSHOT_VERSION;
+	header->size        = size;
+	header->nb_bindings = nb_bindings;
+
+	entries = (SnapshotBinding *) (header + 1);
+
+	i = 0;
+	CIRCLEQ_FOREACH(binding, tracee->fs->bindings.guest, link.guest) {
+		size_t length;
+
+		length = strlen(binding->guest.path);
+		memcpy(buffer + offset, binding->guest.path, length + 1);
+		entries[i].guest_offset = offset;
+		entries[i].guest_length = length;
+		offset += length + 1;
+
+		length = strlen(binding->host.path);
+		memcpy(buffer + offset, binding->host.path, length + 1);
+		entries[i].host_offset = offset;
+		entries[i].host_length = length;
+		offset += length + 1;
+
+		i++;
+	}
+
+	path = create_temp_file(talloc_autofree_context(), "prooted");
+	if (path == NULL)
+		return NULL;
+
+	fd = open(path, O_WRONLY | O_TRUNC);
+	if (fd < 0) {
+		note(tracee, ERROR, SYSTEM, "can't open the bindings snapshot");
+		return NULL;
+	}
+
+	status = write(fd, buffer, size);
+	close(fd);
+	if (status < 0 || (size_t) status != size) {
+		note(tracee, ERROR, SYSTEM, "can't write the bindings snapshot");
+		return NULL;
+	}
+
+	TALLOC_FREE(buffer);
+	return path;
+}
+
+/**
+ * Enable the preload shim for @tracee, if it was requested and if
+ * its configuration allows it.  The shim only handles bindings, that
+ * is, it can't emulate anything else PRoot provides.
+ */
+void initialize_preload_shim(Tracee *tracee)
+{
+#if defined(HAS_PRELOAD_SHIM)
+	char guest_path[PATH_MAX];
+	const char *shim_path;
+	Binding *binding;
+#endif
+	const char *reason = NULL;
+
+	if (!tracee->preload_shim)
+		return;
+
+#if defined(HAS_PRELOAD_SHIM)
+	if (tracee->kernel_bindings)
+		reason = "the kernel handles bindings";
+	else if (tracee->qemu != NULL)
+		reason = "QEMU is in use";
+	else if (tracee->glue != NULL || tracee->glue_dentries != NULL)
+		reason = "glued paths are in use";
+	else if (tracee->extensions != NULL)
+		reason = "extensions are in use";
+	if (reason != NULL)
+		goto disable;
+
+	shim_path = extract_shim(tracee);
+	if (shim_path == NULL) {
+		reason = "it can't be extracted";
+		goto disable;
+	}
+
+	/* insort_binding3() expects a buffer of PATH_MAX bytes.  */
+	strcpy(guest_path, SHIM_GUEST_PATH);
+	binding = insort_binding3(tracee, tracee->fs, shim_path, guest_path);
+	if (binding == NULL) {
+		reason = "it can't be bound";
+		goto disable;
+	}
+
+	snapshot_path = write_snapshot(tracee);
+	if (snapshot_path == NULL) {
+		reason = "the bindings can't be published";
+		goto disable;
+	}
+
+	VERBOSE(tracee, 1, "preload shim: %s (bindings: %s)", shim_path, snapshot_path);
+	return;
+#else
+	reason = "it is not supported on this architecture";
+	goto disable;
+#endif
+
+disable:
+	VERBOSE(tracee, 0, "preload shim disabled: %s", reason);
+	tracee->preload_shim = false;
+}
+
+/**
+ * Remove the preload shim from the LD_PRELOAD @value, in place.
+ */
+static void strip_shim(char *value)
+{
+	size_t length = strlen(SHIM_GUEST_PATH);
+	char *cursor = value;
+
+	while (*cursor != '\0') {
+		char *end = cursor + strcspn(cursor, ": ");
+
+		if ((size_t) (end - cursor) == length
+		    && strncmp(cursor, SHIM_GUEST_PATH, length) == 0) {
+			if (*end != '\0')
+				end++;
+			else if (cursor > value)
+				cursor--;
+			memmove(cursor, end, strlen(end) + 1);
+			continue;
+		}
+
+		cursor = (*end != '\0' ? end + 1 : end);
+	}
+}
+
+/**
+ * Set the environment variable @name to @value in @envp, either by
+ * replacing its current definition or by adding a new one.  This
+ * function returns -errno if an error occurred, otherwise 0.
+ */
+static int set_env(const Tracee *tracee, ArrayOfXPointers *envp, const char *name, const char *value)
+{
+	char *variable;
+	size_t index;
+	int status;
+
+	variable = talloc_asprintf(tracee->ctx, "%s=%s", name, value);
+	if (variable == NULL)
+		return -ENOMEM;
+
+	status = find_xpointee(envp, name);
+	if (status < 0)
+		return status;
+	index = (size_t) status;
+
+	if (index == envp->length) {
+		index = (envp->length > 0 ? envp->length - 1 : 0);
+		status = resize_array_of_xpointers(envp, index, 1);
+		if (status < 0)
+			return status;
+	}
+
+	return write_xpointee(envp, index, variable);
+}
+
+/**
+ * Make the dynamic linker of the program described by
+ * @tracee->load_info preload the shim -- only if it is a dynamically
+ * linked program of the native ABI -- or remove it from LD_PRELOAD
+ * otherwise, since it was likely inherited from the parent process.
+ * This function returns -errno if an error occurred, otherwise 0.
+ */
+int inject_preload_shim(Tracee *tracee)
+{
+	ArrayOfXPointers *envp;
+	char *preload = NULL;
+	bool wants_shim;
+	size_t index;
+	int status;
+
+	if (!tracee->preload_shim || snapshot_path == NULL)
+		return 0;
+
+	wants_shim = (tracee->load_info->interp != NULL
+		&& !IS_CLASS32(tracee->load_info->elf_header));
+
+	status = fetch_array_of_xpointers(tracee, &envp, SYSARG_3, 0);
+	if (status < 0)
+		return status;
+
+	/* Environment variables should be compared with the "name"
+	 * part of the "name=value" string format.  */
+	envp->compare_xpointee = (compare_xpointee_t) compare_xpointee_env;
+
+	status = find_xpointee(envp, "LD_PRELOAD");
+	if (status < 0)
+		return status;
+	index = (size_t) status;
+
+	if (index < envp->length) {
+		char *env;
+
+		status = read_xpointee_as_string(envp, index, &env);
+		if (status < 0)
+			return status;
+
+		preload = talloc_strdup(tracee->ctx, env + strlen("LD_PRELOAD="));
+		if (preload == NULL)
+			return -ENOMEM;
+
+		strip_shim(preload);
+	}
+
+	if (wants_shim) {
+		preload = (preload == NULL || preload[0] == '\0'
+			? talloc_strdup(tracee->ctx, SHIM_GUEST_PATH)
+			: talloc_asprintf(tracee->ctx, "%s:%s", SHIM_GUEST_PATH, preload));
+		if (preload == NULL)
+			return -ENOMEM;
+
+		status = set_env(tracee, envp, SHIM_SNAPSHOT_ENV, snapshot_path);
+		if (status < 0)
+			return status;
+	}
+	else if (preload == NULL)
+		return 0;
+
+	status = set_env(tracee, envp, "LD_PRELOAD", preload);
+	if (status < 0)
+		return status;
+
+	return push_array_of_xpointers(envp, SYSARG_3);
+}
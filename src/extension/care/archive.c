@@ -23,25 +23,69 @@
 #include <sys/types.h>   /* open(2), lseek(2), */
 #include <sys/stat.h>    /* open(2), */
 #include <fcntl.h>       /* open(2), */
-#include <unistd.h>      /* read(2), readlink(2), close(2), lseek(2), */
+#include <unistd.h>      /* read(2), readlink(2), close(2), lseek(2), syscall(2), */
+#include <sys/ioctl.h>   /* ioctl(2), */
+#include <sys/syscall.h> /* SYS_copy_file_range, */
+#include <linux/fs.h>    /* FICLONE, */
 #include <errno.h>       /* errno, EACCES, */
 #include <assert.h>      /* assert(3), */
 #include <linux/limits.h> /* PATH_MAX, */
 #include <string.h>      /* strlen(3), strcmp(3), */
+#include <stdio.h>       /* snprintf(3), */
 #include <stdbool.h>     /* bool, true, false, */
+#include <stdlib.h>      /* malloc(3), free(3), */
+#include <sys/param.h>   /* MIN(), */
+#include <strings.h>     /* bzero(3), */
+#include <pthread.h>     /* pthread_*(3), */
 #include <talloc.h>      /* talloc(3), */
 #include <archive.h>     /* archive_*(3), */
 #include <archive_entry.h> /* archive_entry*(3), */
 
 #include "extension/care/archive.h"
+#include "extension/care/dedup.h"
 #include "tracee/tracee.h"
 #include "cli/note.h"
 
+/* Archiving jobs, see prepare_job().  */
+typedef struct {
+	char *path;
+	char *location;
+	char *target;
+	struct stat statl;
+	int fd;
+
+	/* Expected hash of the content, see archive_unless_same().  */
+	uint64_t same_hash;
+	bool *is_same;
+} Job;
+
+#define ARCHIVING_QUEUE_SIZE 256
+
+/* Bounded FIFO of jobs for the archiving worker.  Serial numbers
+ * start at 1: "tail" is the number of queued jobs, "head" the number
+ * of jobs taken by the worker, and "done" the number of jobs
+ * completed.  */
+typedef struct archiving_queue {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+	pthread_cond_t progress;
+
+	Job jobs[ARCHIVING_QUEUE_SIZE];
+	uint64_t head;
+	uint64_t tail;
+	uint64_t done;
+
+	bool stopping;
+} ArchivingQueue;
+
 typedef struct {
 	int (*set_format)(struct archive *);
 	int (*add_filter)(struct archive *);
 	int hardlink_resolver_strategy;
 	const char *options;
+	const char *threaded_filter;
 	enum { NOT_SPECIAL = 0, SELF_EXTRACTING, RAW } special;
 } Format;
 
@@ -122,6 +166,23 @@ parse_filter:
 		goto parse_format;
 	}
 
+	found = slurp_suffix(string, &cursor, ".xz");
+	if (found) {
+		format->add_filter = archive_write_add_filter_xz;
+		format->options    = "xz:compression-level=1";
+		format->threaded_filter = "xz";
+		goto parse_format;
+	}
+
+#if ARCHIVE_VERSION_NUMBER >= 3003003
+	found = slurp_suffix(string, &cursor, ".zst");
+	if (found) {
+		format->add_filter = archive_write_add_filter_zstd;
+		format->threaded_filter = "zstd";
+		goto parse_format;
+	}
+#endif
+
 	found = slurp_suffix(string, &cursor, ".tgz");
 	if (found) {
 		format->add_filter = archive_write_add_filter_gzip;
@@ -140,6 +201,27 @@ parse_filter:
 		goto sanity_checks;
 	}
 
+	found = slurp_suffix(string, &cursor, ".txz");
+	if (found) {
+		format->add_filter = archive_write_add_filter_xz;
+		format->options    = "xz:compression-level=1";
+		format->threaded_filter = "xz";
+		format->set_format = archive_write_set_format_gnutar;
+		format->hardlink_resolver_strategy = ARCHIVE_FORMAT_TAR_GNUTAR;
+		goto sanity_checks;
+	}
+
+#if ARCHIVE_VERSION_NUMBER >= 3003003
+	found = slurp_suffix(string, &cursor, ".tzst");
+	if (found) {
+		format->add_filter = archive_write_add_filter_zstd;
+		format->threaded_filter = "zstd";
+		format->set_format = archive_write_set_format_gnutar;
+		format->hardlink_resolver_strategy = ARCHIVE_FORMAT_TAR_GNUTAR;
+		goto sanity_checks;
+	}
+#endif
+
 	no_filter_found = true;
 
 parse_format:
@@ -257,6 +339,404 @@ end:
 	return output_fd;
 }
 
+/**
+ * Fill @job with what is needed to put @path into an archive later,
+ * with the specified @statl status, at the given @alternate_path
+ * (NULL if unchanged).  In particular the content of regular files
+ * is pinned through an opened file descriptor, so it can't be
+ * replaced in the meantime.  This function returns -1 if an error
+ * occurred, otherwise 0.  Note: this function can be called with
+ * @tracee == NULL.
+ */
+static int prepare_job(const Tracee *tracee, Job *job, const char *path,
+		const char *alternate_path, const struct stat *statl)
+{
+	ssize_t status;
+
+	bzero(job, sizeof(Job));
+	job->fd = -1;
+	job->statl = *statl;
+
+	job->path = strdup(path);
+	job->location = strdup(alternate_path ?: path);
+	if (job->path == NULL || job->location == NULL) {
+		note(tracee, WARNING, INTERNAL, "can't allocate archiving job for '%s'", path);
+		return -1;
+	}
+
+	if (S_ISLNK(statl->st_mode)) {
+		char target[PATH_MAX];
+
+		status = readlink(path, target, PATH_MAX);
+		if (status >= PATH_MAX) {
+			status = -1;
+			errno = ENAMETOOLONG;
+		}
+		if (status < 0) {
+			note(tracee, WARNING, SYSTEM, "can't readlink '%s'", path);
+			return -1;
+		}
+		target[status] = '\0';
+
+		job->target = strdup(target);
+		if (job->target == NULL) {
+			note(tracee, WARNING, INTERNAL, "can't allocate archiving job for '%s'", path);
+			return -1;
+		}
+	}
+	else if (S_ISREG(statl->st_mode) && statl->st_size > 0) {
+		job->fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (job->fd < 0 && errno != EACCES)
+			note(tracee, WARNING, SYSTEM, "can't open '%s'", path);
+	}
+
+	return 0;
+}
+
+/**
+ * Release the resources held by @job.
+ */
+static void release_job(Job *job)
+{
+	if (job->fd >= 0)
+		(void) close(job->fd);
+
+	free(job->path);
+	free(job->location);
+	free(job->target);
+
+	bzero(job, sizeof(Job));
+	job->fd = -1;
+}
+
+/* Contents bigger than this are read by chunks of LARGE_CHUNK
+ * bytes, thus saving a lot of read(2) and small archive writes.
+ * They are not mapped in memory since a concurrent truncation would
+ * then raise SIGBUS in the tracer, whereas read(2) only returns less
+ * data.  */
+#define LARGE_THRESHOLD (1024 * 1024)
+#define LARGE_CHUNK     (1024 * 1024)
+
+/**
+ * Copy the content described by @job into @archive, through the
+ * given @buffer of @size bytes.  The copied data are fed into @hash
+ * if not NULL.  This function returns -1 if an error occurred,
+ * otherwise 0.
+ */
+static int copy_with_read(const Tracee* tracee, Archive *archive, const Job *job,
+			uint8_t *buffer, size_t size, ContentHash *hash)
+{
+	ssize_t status;
+	size_t written;
+
+	do {
+		status = read(job->fd, buffer, size);
+		if (status < 0) {
+			note(tracee, WARNING, SYSTEM, "can't read '%s'", job->path);
+			return -1;
+		}
+
+		written = archive_write_data(archive->handle, buffer, status);
+		if ((size_t) status != written) {
+			note(tracee, WARNING, INTERNAL, "can't archive '%s' content: %s",
+				job->path, archive_error_string(archive->handle));
+			return -1;
+		}
+
+		if (hash != NULL)
+			hash_update(hash, buffer, status);
+	} while (status > 0);
+
+	return 0;
+}
+
+/**
+ * Copy @size bytes from the content described by @job into the file
+ * just created by the directory output @archive, without passing
+ * through user space: by sharing the extents of the original content
+ * if the file system supports it, or with copy_file_range(2).  This
+ * function returns -1 if the content couldn't be copied this way,
+ * otherwise 0.
+ */
+static int copy_on_disk(const Tracee* tracee, const Job *job, size_t size)
+{
+	int status = -1;
+	int fd;
+
+	/* libarchive sets the final mode, ownership and times of this
+	 * file only once the entry is finished.  */
+	fd = open(job->location, O_WRONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+#if defined(FICLONE)
+	/* The clone might be bigger than the original size if the
+	 * content has grown, libarchive truncates it when the entry is
+	 * finished.  */
+	status = ioctl(fd, FICLONE, job->fd);
+	if (status == 0)
+		goto end;
+#endif
+
+#if defined(SYS_copy_file_range)
+	{
+		loff_t in_offset = 0;
+		loff_t out_offset = 0;
+
+		while ((size_t) out_offset < size) {
+			long length;
+
+			length = syscall(SYS_copy_file_range, job->fd, &in_offset,
+					fd, &out_offset, size - out_offset, 0);
+			if (length <= 0)
+				break;
+		}
+
+		status = ((size_t) out_offset == size ? 0 : -1);
+	}
+#endif
+
+	if (status < 0)
+		VERBOSE(tracee, 2, "can't copy '%s' without user space: %s",
+			job->path, strerror(errno));
+#if defined(FICLONE)
+end:
+#endif
+	(void) close(fd);
+	return status;
+}
+
+/**
+ * Put the content described by @job into @archive.  This function
+ * returns -1 if an error occurred, otherwise 0.  Note: this function
+ * can be called with @tracee == NULL, it is always the case from the
+ * archiving worker.
+ */
+static int write_job(const Tracee* tracee, Archive *archive, const Job *job)
+{
+	struct archive_entry *entry = NULL;
+	const char *duplicate = NULL;
+	uint8_t buffer[64 * 1024];
+	ContentHash content_hash;
+	uint8_t *large_buffer;
+	bool deduplicate;
+	ssize_t status;
+	uint64_t hash;
+	mode_t type;
+	size_t size;
+
+	if (archive == NULL || archive->handle == NULL)
+		return -1;
+
+	/* Don't archive a content that is already available
+	 * elsewhere, for instance in a base archive.  */
+	if (job->is_same != NULL && job->fd >= 0) {
+		status = hash_fd(job->fd, &hash);
+		if (status == 0 && hash == job->same_hash) {
+			*job->is_same = true;
+			return 0;
+		}
+	}
+
+	entry = archive_entry_new();
+	if (entry == NULL) {
+		note(tracee, WARNING, INTERNAL, "can't create archive entry for '%s': %s",
+			job->path, archive_error_string(archive->handle));
+		status = -1;
+		goto end;
+	}
+
+	archive_entry_set_pathname(entry, job->location);
+	archive_entry_copy_stat(entry, &job->statl);
+
+	if (archive->hardlink_resolver != NULL) {
+		struct archive_entry *unused;
+		archive_entry_linkify(archive->hardlink_resolver, &entry, &unused);
+	}
+
+	/* Get status only once hardlinks were resolved.  */
+	size = archive_entry_size(entry);
+	type = archive_entry_filetype(entry);
+
+	/* Must be done before archive_write_header().  */
+	if (type == AE_IFLNK && job->target != NULL)
+		archive_entry_set_symlink(entry, job->target);
+
+	deduplicate = (archive->dedup != NULL
+		&& type == AE_IFREG && size > 0 && job->fd >= 0
+		&& archive_entry_hardlink(entry) == NULL);
+
+	/* Contents of different sizes can't be duplicates, so hash
+	 * this one beforehand only if it is worth it.  */
+	if (deduplicate && dedup_has_size(archive->dedup, job->statl.st_size)) {
+		status = hash_fd(job->fd, &hash);
+		if (status == 0)
+			duplicate = dedup_lookup(archive->dedup, &job->statl, hash, job->fd);
+	}
+
+	if (type == AE_IFREG) {
+		archive->stats.nb_files++;
+		archive->stats.content_size += size;
+	}
+
+	/* Store a duplicate as a hardlink to the first archived
+	 * occurence of this content.  */
+	if (duplicate != NULL) {
+		archive_entry_set_hardlink(entry, duplicate);
+		archive_entry_set_size(entry, 0);
+
+		archive->stats.nb_duplicates++;
+		archive->stats.saved_size += size;
+		size = 0;
+	}
+
+	status = archive_write_header(archive->handle, entry);
+	if (status == ARCHIVE_WARN) {
+		note(tracee, WARNING, INTERNAL, "write header for '%s': %s",
+			job->path, archive_error_string(archive->handle));
+	}
+	else if (status != ARCHIVE_OK) {
+		note(tracee, ERROR, INTERNAL, "can't write header for '%s': %s",
+			job->path, archive_error_string(archive->handle));
+		status = -1;
+		goto end;
+	}
+
+	/* No content to archive?  */
+	if (type != AE_IFREG || size == 0) {
+		status = 0;
+		goto end;
+	}
+
+	if (job->fd < 0) {
+		status = -1;
+		goto end;
+	}
+
+	if (archive->is_directory) {
+		status = copy_on_disk(tracee, job, size);
+		if (status == 0)
+			goto end;
+	}
+
+	hash_init(&content_hash);
+
+	/* Copy the content from the file into the archive.  Note: the
+	 * archiving worker must not use talloc.  */
+	large_buffer = (size >= LARGE_THRESHOLD ? malloc(LARGE_CHUNK) : NULL);
+	if (large_buffer != NULL) {
+		status = copy_with_read(tracee, archive, job, large_buffer, LARGE_CHUNK,
+					deduplicate ? &content_hash : NULL);
+		free(large_buffer);
+	}
+	else
+		status = copy_with_read(tracee, archive, job, buffer, sizeof(buffer),
+					deduplicate ? &content_hash : NULL);
+	if (status < 0)
+		goto end;
+
+	if (deduplicate && (off_t) content_hash.total == job->statl.st_size)
+		dedup_register(archive->dedup, &job->statl, hash_final(&content_hash),
+			job->location, job->path);
+
+end:
+	if (entry != NULL)
+		archive_entry_free(entry);
+
+	return status;
+}
+
+/**
+ * Archive the jobs queued in @archive_, until the queue is stopped
+ * and empty.  This is the entry point of the archiving worker.
+ */
+static void *archiving_worker(void *archive_)
+{
+	Archive *archive = archive_;
+	ArchivingQueue *queue = archive->queue;
+	Job job;
+
+	pthread_mutex_lock(&queue->lock);
+	while (1) {
+		while (queue->head == queue->tail && !queue->stopping)
+			pthread_cond_wait(&queue->not_empty, &queue->lock);
+
+		if (queue->head == queue->tail)
+			break;
+
+		/* Work on a copy so the slot can be reused as soon as
+		 * possible.  */
+		job = queue->jobs[queue->head % ARCHIVING_QUEUE_SIZE];
+		queue->head++;
+		pthread_cond_signal(&queue->not_full);
+		pthread_mutex_unlock(&queue->lock);
+
+		(void) write_job(NULL, archive, &job);
+		release_job(&job);
+
+		pthread_mutex_lock(&queue->lock);
+		queue->done++;
+		pthread_cond_broadcast(&queue->progress);
+	}
+	pthread_mutex_unlock(&queue->lock);
+
+	return NULL;
+}
+
+/**
+ * Start the archiving worker of @archive: from now on, this latter
+ * must be accessed only through archive(), archive_async(),
+ * wait_for_archiving() and finalize_archive().  This function
+ * returns -1 if an error occurred -- then @archive is still usable
+ * synchronously -- otherwise 0.
+ */
+static int start_archiving_worker(const Tracee *tracee, Archive *archive)
+{
+	ArchivingQueue *queue;
+	int status;
+
+	queue = talloc_zero(archive, ArchivingQueue);
+	if (queue == NULL)
+		return -1;
+
+	pthread_mutex_init(&queue->lock, NULL);
+	pthread_cond_init(&queue->not_empty, NULL);
+	pthread_cond_init(&queue->not_full, NULL);
+	pthread_cond_init(&queue->progress, NULL);
+
+	archive->queue = queue;
+
+	status = pthread_create(&queue->thread, NULL, archiving_worker, archive);
+	if (status != 0) {
+		VERBOSE(tracee, 1, "can't create the archiving worker: %s", strerror(status));
+		archive->queue = NULL;
+		TALLOC_FREE(queue);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Stop the archiving worker of @archive once all the queued jobs are
+ * done.
+ */
+static void stop_archiving_worker(Archive *archive)
+{
+	ArchivingQueue *queue = archive->queue;
+
+	if (queue == NULL)
+		return;
+
+	pthread_mutex_lock(&queue->lock);
+	queue->stopping = true;
+	pthread_cond_signal(&queue->not_empty);
+	pthread_mutex_unlock(&queue->lock);
+
+	pthread_join(queue->thread, NULL);
+	archive->queue = NULL;
+}
+
 /**
  * Create a new archive structure (memory allocation attached to
  * @context) for the given @output file.  This function returns NULL
@@ -326,6 +806,11 @@ Archive *new_archive(TALLOC_CTX *context, const Tracee* tracee,
 			archive_entry_linkresolver_set_strategy(archive->hardlink_resolver,
 								ARCHIVE_FORMAT_TAR);
 
+		/* Contents are copied without passing through user
+		 * space, so they aren't deduplicated.  */
+		archive->is_directory = true;
+
+		(void) start_archiving_worker(tracee, archive);
 		return archive;
 	}
 
@@ -354,6 +839,11 @@ Archive *new_archive(TALLOC_CTX *context, const Tracee* tracee,
 								format.hardlink_resolver_strategy);
 	}
 
+	/* Duplicates are stored as hardlinks, this doesn't fit the
+	 * way the CPIO format handles them.  */
+	if (format.hardlink_resolver_strategy != ARCHIVE_FORMAT_CPIO_POSIX)
+		archive->dedup = new_dedup();
+
 	if (format.add_filter != NULL) {
 		status = format.add_filter(archive->handle);
 		if (status == ARCHIVE_WARN) {
@@ -380,6 +870,22 @@ Archive *new_archive(TALLOC_CTX *context, const Tracee* tracee,
 		}
 	}
 
+	/* Compress with as many threads as there are CPUs, if
+	 * supported by this version of libarchive.  */
+	if (format.threaded_filter != NULL) {
+		char threads[32];
+		long nb_cpus;
+
+		nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		snprintf(threads, sizeof(threads), "%ld", MAX(nb_cpus, 1));
+
+		status = archive_write_set_filter_option(archive->handle,
+							format.threaded_filter, "threads", threads);
+		if (status != ARCHIVE_OK)
+			VERBOSE(tracee, 1, "can't compress with %s threads: %s", threads,
+				archive_error_string(archive->handle) ?: "unsupported");
+	}
+
 	switch (format.special) {
 	case SELF_EXTRACTING:
 		archive->fd = copy_self_exe(tracee, output);
@@ -426,6 +932,7 @@ Archive *new_archive(TALLOC_CTX *context, const Tracee* tracee,
 		return NULL;
 	}
 
+	(void) start_archiving_worker(tracee, archive);
 	return archive;
 }
 
@@ -440,9 +947,14 @@ int finalize_archive(Archive *archive)
 	if (archive == NULL || archive->handle == NULL)
 		return -1;
 
+	stop_archiving_worker(archive);
+
 	if (archive->hardlink_resolver != NULL)
 		archive_entry_linkresolver_free(archive->hardlink_resolver);
 
+	free_dedup(archive->dedup);
+	archive->dedup = NULL;
+
 	status = archive_write_close(archive->handle);
 	if (status != ARCHIVE_OK && status != ARCHIVE_WARN)
 		return -1;
@@ -455,114 +967,143 @@ int finalize_archive(Archive *archive)
 }
 
 /**
- * Put the content of @path into @archive, with the specified @statl
- * status, at the given @alternate_path (NULL if unchanged).  This
- * function returns -1 if an error occurred, otherwise 0.  Note: this
- * function can be called with @tracee == NULL.
+ * Queue the prepared @job into @archive.  This function returns -1
+ * if an error occurred, otherwise the serial number of this job.
+ * Note: this function can be called with @tracee == NULL.
  */
-int archive(const Tracee* tracee, Archive *archive,
-	const char *path, const char *alternate_path, const struct stat *statl)
+static int64_t queue_job(const Tracee* tracee, Archive *archive, Job *job)
 {
-	struct archive_entry *entry = NULL;
-	ssize_t status;
-	mode_t type;
-	size_t size;
-	int fd = -1;
+	ArchivingQueue *queue;
+	int64_t serial;
+	int status;
+
+	queue = archive->queue;
+	if (queue == NULL) {
+		status = write_job(tracee, archive, job);
+		release_job(job);
+		return status < 0 ? -1 : 0;
+	}
+
+	pthread_mutex_lock(&queue->lock);
+
+	/* The queue is bounded to limit both the memory and the
+	 * file descriptors held by pending jobs.  */
+	while (queue->tail - queue->head >= ARCHIVING_QUEUE_SIZE)
+		pthread_cond_wait(&queue->not_full, &queue->lock);
+
+	queue->jobs[queue->tail % ARCHIVING_QUEUE_SIZE] = *job;
+	queue->tail++;
+	serial = queue->tail;
+	pthread_cond_signal(&queue->not_empty);
+
+	pthread_mutex_unlock(&queue->lock);
+
+	return serial;
+}
+
+/**
+ * Queue the archiving of @path into @archive, with the specified
+ * @statl status, at the given @alternate_path (NULL if unchanged).
+ * This function returns -1 if an error occurred, otherwise the
+ * serial number of this job, to be used with wait_for_archiving().
+ * Note: this function can be called with @tracee == NULL.
+ */
+int64_t archive_async(const Tracee* tracee, Archive *archive,
+		const char *path, const char *alternate_path, const struct stat *statl)
+{
+	Job job;
+	int status;
 
 	if (archive == NULL || archive->handle == NULL)
 		return -1;
 
-	entry = archive_entry_new();
-	if (entry == NULL) {
-		note(tracee, WARNING, INTERNAL, "can't create archive entry for '%s': %s",
-			path, archive_error_string(archive->handle));
-		status = -1;
-		goto end;
+	status = prepare_job(tracee, &job, path, alternate_path, statl);
+	if (status < 0) {
+		release_job(&job);
+		return -1;
 	}
 
-	archive_entry_set_pathname(entry, alternate_path ?: path);
-	archive_entry_copy_stat(entry, statl);
+	return queue_job(tracee, archive, &job);
+}
 
-	if (archive->hardlink_resolver != NULL) {
-		struct archive_entry *unused;
-		archive_entry_linkify(archive->hardlink_resolver, &entry, &unused);
+/**
+ * Like archive_async(), but the content of @path is not archived if
+ * its hash is @hash; in this case *@is_same is set to true by the
+ * archiving worker, so the content is hashed off the tracer.  It can
+ * be read safely once the job is done, see wait_for_archiving().
+ */
+int64_t archive_unless_same(const Tracee* tracee, Archive *archive,
+		const char *path, const char *alternate_path, const struct stat *statl,
+		uint64_t hash, bool *is_same)
+{
+	Job job;
+	int status;
+
+	if (archive == NULL || archive->handle == NULL)
+		return -1;
+
+	status = prepare_job(tracee, &job, path, alternate_path, statl);
+	if (status < 0) {
+		release_job(&job);
+		return -1;
 	}
 
-	/* Get status only once hardlinks were resolved.  */
-	size = archive_entry_size(entry);
-	type = archive_entry_filetype(entry);
+	job.same_hash = hash;
+	job.is_same = is_same;
 
-	if (type == AE_IFLNK) {
-		char target[PATH_MAX];
-		status = readlink(path, target, PATH_MAX);
-		if (status >= PATH_MAX) {
-			status = -1;
-			errno = ENAMETOOLONG;
-		}
-		if (status < 0) {
-			note(tracee, WARNING, SYSTEM, "can't readlink '%s'", path);
-			status = -1;
-			goto end;
-		}
-		target[status] = '\0';
+	return queue_job(tracee, archive, &job);
+}
 
-		/* Must be done before archive_write_header().  */
-		archive_entry_set_symlink(entry, target);
-	}
+/**
+ * Wait until the job @serial, as returned by archive_async(), and all
+ * the jobs queued before it are done.
+ */
+void wait_for_archiving(Archive *archive, int64_t serial)
+{
+	ArchivingQueue *queue;
 
-	status = archive_write_header(archive->handle, entry);
-	if (status == ARCHIVE_WARN) {
-		note(tracee, WARNING, INTERNAL, "write header for '%s': %s",
-			path, archive_error_string(archive->handle));
-	}
-	else if (status != ARCHIVE_OK) {
-		note(tracee, ERROR, INTERNAL, "can't write header for '%s': %s",
-			path, archive_error_string(archive->handle));
-		status = -1;
-		goto end;
-	}
+	if (archive == NULL || archive->queue == NULL || serial <= 0)
+		return;
+	queue = archive->queue;
 
-	/* No content to archive?  */
-	if (type != AE_IFREG || size == 0) {
-		status = 0;
-		goto end;
-	}
+	pthread_mutex_lock(&queue->lock);
+	while (queue->done < (uint64_t) serial)
+		pthread_cond_wait(&queue->progress, &queue->lock);
+	pthread_mutex_unlock(&queue->lock);
+}
 
-	fd = open(path, O_RDONLY);
-	if (fd < 0) {
-		if (errno != EACCES)
-			note(tracee, WARNING, SYSTEM, "can't open '%s'", path);
-		status = -1;
-		goto end;
-	}
+/**
+ * Wait until all the jobs queued so far in @archive are done.
+ */
+void wait_for_all_archiving(Archive *archive)
+{
+	int64_t serial;
 
-	/* Copy the content from the file into the archive.  */
-	do {
-		uint8_t buffer[4096];
+	if (archive == NULL || archive->queue == NULL)
+		return;
 
-		status = read(fd, buffer, sizeof(buffer));
-		if (status < 0) {
-			note(tracee, WARNING, SYSTEM, "can't read '%s'", path);
-			status = -1;
-			goto end;
-		}
+	pthread_mutex_lock(&archive->queue->lock);
+	serial = archive->queue->tail;
+	pthread_mutex_unlock(&archive->queue->lock);
 
-		size = archive_write_data(archive->handle, buffer, status);
-		if ((size_t) status != size) {
-			note(tracee, WARNING, INTERNAL, "can't archive '%s' content: %s",
-				path, archive_error_string(archive->handle));
-			status = -1;
-			goto end;
-		}
-	} while (status > 0);
-	status = 0;
+	wait_for_archiving(archive, serial);
+}
 
-end:
-	if (fd >= 0)
-		(void) close(fd);
+/**
+ * Put the content of @path into @archive, with the specified @statl
+ * status, at the given @alternate_path (NULL if unchanged).  This
+ * function returns -1 if an error occurred, otherwise 0.  Note: this
+ * function can be called with @tracee == NULL.
+ */
+int archive(const Tracee* tracee, Archive *archive,
+	const char *path, const char *alternate_path, const struct stat *statl)
+{
+	int64_t serial;
 
-	if (entry != NULL)
-		archive_entry_free(entry);
+	serial = archive_async(tracee, archive, path, alternate_path, statl);
+	if (serial < 0)
+		return -1;
 
-	return status;
+	wait_for_archiving(archive, serial);
+	return 0;
 }
@@ -26,6 +26,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 #include "tracee/tracee.h"
 
@@ -36,6 +37,25 @@ typedef struct {
 	/* Information used to create an self-extracting archive.  */
 	off_t offset;
 	int fd;
+
+	/* Whether the archive is written as a directory.  */
+	bool is_directory;
+
+	/* Jobs for the archiving worker, or NULL if the archive is
+	 * written synchronously.  */
+	struct archiving_queue *queue;
+
+	/* Contents already archived, or NULL if duplicates are not
+	 * detected.  */
+	struct dedup *dedup;
+
+	/* Only meaningful once the archive is finalized.  */
+	struct {
+		uint64_t nb_files;
+		uint64_t nb_duplicates;
+		uint64_t content_size;
+		uint64_t saved_size;
+	} stats;
 } Archive;
 
 extern Archive *new_archive(TALLOC_CTX *context, const Tracee* tracee,
@@ -43,5 +63,12 @@ extern Archive *new_archive(TALLOC_CTX *context, const Tracee* tracee,
 extern int finalize_archive(Archive *archive);
 extern int archive(const Tracee* tracee, Archive *archive,
 		const char *path, const char *alternate_path, const struct stat *statl);
+extern int64_t archive_async(const Tracee* tracee, Archive *archive,
+		const char *path, const char *alternate_path, const struct stat *statl);
+extern int64_t archive_unless_same(const Tracee* tracee, Archive *archive,
+		const char *path, const char *alternate_path, const struct stat *statl,
+		uint64_t hash, bool *is_same);
+extern void wait_for_archiving(Archive *archive, int64_t serial);
+extern void wait_for_all_archiving(Archive *archive);
 
 #endif /* ARCHIVE_H */
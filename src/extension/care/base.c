@@ -0,0 +1,244 @@
+/* -*- c-set-style: "K&R"; c-basic-offset: 8 -*-
+ *
+ * This file is part of PRoot.
+ *
+ * Copyright (C) 2015 STMicroelectronics
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <sys/types.h>  /* struct stat, */
+#include <sys/stat.h>   /* struct stat, */
+#include <unistd.h>     /* readlink(2), */
+#include <stdlib.h>     /* realpath(3), */
+#include <string.h>     /* strstr(3), strcmp(3), */
+#include <limits.h>     /* PATH_MAX, */
+#include <talloc.h>     /* talloc*, */
+#include <archive.h>    /* archive_*(3), */
+#include <archive_entry.h> /* archive_entry*(3), */
+
+#include "extension/care/base.h"
+#include "extension/care/extract.h"
+#include "extension/care/dedup.h"
+#include "cli/note.h"
+
+/* Rootfs entries are archived as "<prefix>/rootfs/<path>".  */
+#define ROOTFS "/rootfs"
+
+/**
+ * Return the path within the rootfs of the archive entry @name, and
+ * set @prefix_length to the length of its prefix.  This function
+ * returns NULL if @name is not in the rootfs.
+ */
+static const char *get_rootfs_path(const char *name, size_t *prefix_length)
+{
+	const char *cursor;
+
+	cursor = strchr(name, '/');
+	if (cursor == NULL || strncmp(cursor, ROOTFS "/", strlen(ROOTFS "/")) != 0)
+		return NULL;
+
+	*prefix_length = cursor - name;
+	return cursor + strlen(ROOTFS);
+}
+
+/**
+ * Hash the content of the current @entry of @archive into @hash.
+ * This function returns -1 if an error occurred, otherwise 0.
+ */
+static int hash_entry(struct archive *archive, uint64_t *hash)
+{
+	ContentHash state;
+	const void *buffer;
+	la_int64_t offset;
+	size_t size;
+	int status;
+
+	hash_init(&state);
+
+	while (1) {
+		status = archive_read_data_block(archive, &buffer, &size, &offset);
+		if (status == ARCHIVE_EOF)
+			break;
+		if (status != ARCHIVE_OK)
+			return -1;
+
+		/* Sparse files aren't produced by CARE.  */
+		if ((uint64_t) offset != state.total)
+			return -1;
+
+		hash_update(&state, buffer, size);
+	}
+
+	*hash = hash_final(&state);
+	return 0;
+}
+
+/**
+ * Index the regular files and symlinks of the rootfs archived in
+ * @path.  The returned index is attached to @context.  This function
+ * returns NULL if an error occurred.
+ */
+Base *load_base(TALLOC_CTX *context, const char *path)
+{
+	struct archive_entry *entry;
+	struct archive *archive;
+	char real_path[PATH_MAX];
+	TALLOC_CTX *temporary;
+	size_t prefix_length;
+	Base *base;
+	int status;
+
+	if (realpath(path, real_path) == NULL) {
+		note(NULL, ERROR, SYSTEM, "can't get the real path of '%s'", path);
+		return NULL;
+	}
+
+	base = talloc_zero(context, Base);
+	if (base == NULL)
+		return NULL;
+
+	base->archive = talloc_strdup(base, real_path);
+	if (base->archive == NULL)
+		return NULL;
+
+	/* The archive handle isn't needed once indexed.  */
+	temporary = talloc_new(base);
+	if (temporary == NULL)
+		return NULL;
+
+	archive = open_archive_from_file(temporary, path);
+	if (archive == NULL)
+		return NULL;
+
+	while (archive_read_next_header(archive, &entry) == ARCHIVE_OK) {
+		const char *name = archive_entry_pathname(entry);
+		const char *hardlink;
+		BaseEntry *base_entry;
+		const char *rootfs_path;
+
+		rootfs_path = get_rootfs_path(name, &prefix_length);
+		if (rootfs_path == NULL)
+			continue;
+
+		if (base->prefix == NULL) {
+			base->prefix = talloc_strndup(base, name, prefix_length);
+			if (base->prefix == NULL)
+				return NULL;
+		}
+
+		switch (archive_entry_filetype(entry)) {
+		case AE_IFREG:
+		case AE_IFLNK:
+			break;
+
+		default:
+			continue;
+		}
+
+		base_entry = talloc_zero(base, BaseEntry);
+		if (base_entry == NULL)
+			return NULL;
+
+		base_entry->path = talloc_strdup(base_entry, rootfs_path);
+		if (base_entry->path == NULL)
+			return NULL;
+
+		base_entry->mode  = archive_entry_mode(entry);
+		base_entry->size  = archive_entry_size(entry);
+		base_entry->mtime = archive_entry_mtime(entry);
+
+		hardlink = archive_entry_hardlink(entry);
+		if (hardlink != NULL) {
+			/* Hardlinks share the content of their target,
+			 * which is archived before them.  */
+			const char *target_path;
+			BaseEntry *target;
+
+			target_path = get_rootfs_path(hardlink, &prefix_length);
+			if (target_path == NULL)
+				continue;
+
+			HASH_FIND_STR(base->entries, target_path, target);
+			if (target == NULL)
+				continue;
+
+			base_entry->size = target->size;
+			base_entry->hash = target->hash;
+		}
+		else if (archive_entry_filetype(entry) == AE_IFLNK) {
+			base_entry->target = talloc_strdup(base_entry, archive_entry_symlink(entry));
+			if (base_entry->target == NULL)
+				return NULL;
+		}
+		else {
+			status = hash_entry(archive, &base_entry->hash);
+			if (status < 0) {
+				note(NULL, WARNING, INTERNAL, "can't read '%s' from '%s'", name, path);
+				continue;
+			}
+		}
+
+		HASH_ADD_KEYPTR(hh, base->entries, base_entry->path,
+				strlen(base_entry->path), base_entry);
+	}
+
+	TALLOC_FREE(temporary);
+
+	if (base->prefix == NULL) {
+		note(NULL, ERROR, USER, "'%s' doesn't look like a CARE archive", path);
+		return NULL;
+	}
+
+	return base;
+}
+
+/**
+ * Return the entry of @path in the @base archive if the file at
+ * @path, with the given @statl status, has the same metadata -- and
+ * the same target if it is a symlink.  Note: the content of regular
+ * files is not compared here since it would be too slow for the
+ * tracer, see archive_unless_same().  Otherwise this function
+ * returns NULL.
+ */
+BaseEntry *lookup_base(Base *base, const char *path, const struct stat *statl)
+{
+	BaseEntry *entry;
+
+	HASH_FIND_STR(base->entries, path, entry);
+	if (entry == NULL)
+		return NULL;
+
+	if (entry->mode != statl->st_mode || entry->mtime != statl->st_mtime)
+		return NULL;
+
+	if (S_ISLNK(statl->st_mode)) {
+		char target[PATH_MAX];
+		ssize_t length;
+
+		length = readlink(path, target, PATH_MAX);
+		if (length < 0 || length >= PATH_MAX)
+			return NULL;
+		target[length] = '\0';
+
+		if (entry->target == NULL || strcmp(entry->target, target) != 0)
+			return NULL;
+	}
+	else if (entry->size != statl->st_size)
+		return NULL;
+
+	return entry;
+}
@@ -0,0 +1,62 @@
+/* -*- c-set-style: "K&R"; c-basic-offset: 8 -*-
+ *
+ * This file is part of PRoot.
+ *
+ * Copyright (C) 2015 STMicroelectronics
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef CARE_BASE_H
+#define CARE_BASE_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <talloc.h>
+
+#include "uthash.h"
+
+#define BASE_MANIFEST_NAME "base-manifest.txt"
+
+/* Regular file or symlink of the rootfs of a base archive.  */
+typedef struct base_entry {
+	UT_hash_handle hh;
+	char *path;
+
+	mode_t mode;
+	int64_t size;
+	time_t mtime;
+	uint64_t hash;
+	char *target;
+
+	/* Whether it was not re-archived since unchanged.  */
+	bool is_reused;
+} BaseEntry;
+
+/* Index of a previous archive.  */
+typedef struct {
+	const char *archive;
+	const char *prefix;
+	BaseEntry *entries;
+	size_t nb_reused;
+} Base;
+
+extern Base *load_base(TALLOC_CTX *context, const char *path);
+extern BaseEntry *lookup_base(Base *base, const char *path, const struct stat *statl);
+
+#endif /* CARE_BASE_H */
@@ -23,8 +23,10 @@
 #include <sys/types.h>    /* struct stat, */
 #include <sys/stat.h>     /* struct stat, */
 #include <unistd.h>       /* lstat(2), */
+#include <fcntl.h>        /* O_*, */
 #include <linux/limits.h> /* PATH_MAX, */
 #include <string.h>       /* strlen(3), */
+#include <stdio.h>        /* snprintf(3), */
 #include <assert.h>       /* assert(3), */
 #include <time.h>         /* time(2), localtime(3), */
 #include <stddef.h>       /* offsetof(3), */
@@ -40,6 +42,7 @@
 #include "extension/extension.h"
 #include "tracee/tracee.h"
 #include "tracee/mem.h"
+#include "tracee/reg.h"
 #include "execve/auxv.h"
 #include "path/canon.h"
 #include "path/path.h"
@@ -52,12 +55,6 @@
 #define uthash_malloc(size) talloc_size(care, size)
 #define uthash_free(pointer, size) TALLOC_FREE(pointer)
 
-/* Hash entry.  */
-typedef struct Entry {
-	UT_hash_handle hh;
-	char *path;
-} Entry;
-
 /**
  * Add a copy of @value at the end if the given @list.  All the newly
  * talloc'ed elements (duplicated value, item, list head) are attached
@@ -132,6 +129,8 @@ static int generate_care(Extension *extension, const Options *options)
 	size_t suffix_length;
 	const char *cursor;
 	Tracee *tracee;
+	size_t length;
+	int status;
 	Item *item2;
 	Item *item;
 	Care *care;
@@ -177,10 +176,38 @@ static int generate_care(Extension *extension, const Options *options)
 		return -1;
 	}
 
+	care->volatile_index = new_trie(care);
+	care->bindings_index = new_trie(care);
+	if (care->volatile_index == NULL || care->bindings_index == NULL) {
+		note(tracee, WARNING, INTERNAL, "can't allocate path indexes");
+		return -1;
+	}
+
+	/* Index the host side of the bindings: concealed paths are
+	 * the asymmetric ones, revealed paths the symmetric ones.
+	 * Note: bindings are already initialized at this point.  */
+	if (tracee->fs->bindings.host != NULL) {
+		Binding *binding;
+
+		CIRCLEQ_FOREACH(binding, tracee->fs->bindings.host, link.host) {
+			/* Bindings are sorted from the longest host
+			 * path, keep the first one as get_binding()
+			 * does.  */
+			if (trie_lookup(care->bindings_index, binding->host.path, &length) != NULL
+			    && length == binding->host.length)
+				continue;
+
+			status = trie_insert(care->bindings_index, binding->host.path, binding);
+			if (status < 0) {
+				note(tracee, WARNING, INTERNAL, "can't index binding");
+				return -1;
+			}
+		}
+	}
+
 	/* Copy & canonicalize volatile paths.  */
 	if (options->volatile_paths != NULL) {
 		char path[PATH_MAX];
-		int status;
 
 		STAILQ_FOREACH(item, options->volatile_paths, link) {
 			/* Initial state before canonicalization.  */
@@ -213,6 +240,10 @@ static int generate_care(Extension *extension, const Options *options)
 			if (item2 == NULL)
 				continue;
 
+			status = trie_insert(care->volatile_index, item2->load, item2);
+			if (status < 0)
+				continue;
+
 			/* Preserve the non expanded form.  */
 			talloc_set_name_const(item2, talloc_get_name(item));
 
@@ -231,6 +262,17 @@ static int generate_care(Extension *extension, const Options *options)
 		}
 	}
 
+	if (options->base != NULL) {
+		care->base = load_base(care, options->base);
+		if (care->base == NULL) {
+			note(tracee, ERROR, USER, "can't use '%s' as base", options->base);
+			return -1;
+		}
+
+		VERBOSE(tracee, 0, "base: %s (%u files indexed)", care->base->archive,
+			HASH_COUNT(care->base->entries));
+	}
+
 	/* Convert the limit from megabytes to bytes, as expected by
 	 * handle_host_path().  */
 	care->max_size = options->max_size * 1024 * 1024;
@@ -243,24 +285,30 @@ static int generate_care(Extension *extension, const Options *options)
 }
 
 /**
- * Add @path_ to the list of @care->concealed_accesses.  This function
- * does *not* check for duplicated entries.
+ * Add @host_path to the set of @care->concealed_accesses if it was
+ * actually concealed.
  */
-static void register_concealed_access(const Tracee *tracee, Care *care, const char *path_)
+static void register_concealed_access(const Tracee *tracee, Care *care, const char *host_path)
 {
+	const Binding *binding;
 	char path[PATH_MAX];
+	Entry *entry;
 	size_t length;
 	int status;
 
-	length = strlen(path_);
-	if (length >= PATH_MAX)
-		return;
-	memcpy(path, path_, length + 1);
-
 	/* It was a concealed access if, and only if, the path was
 	 * part of a asymmetric binding.  */
-	status = substitute_binding(tracee, HOST, path);
-	if (status != 1)
+	binding = trie_lookup(care->bindings_index, host_path, &length);
+	if (binding == NULL || !binding->need_substitution)
+		return;
+
+	/* Substitute the host part with the guest one.  */
+	status = snprintf(path, PATH_MAX, "%s%s", binding->guest.path, host_path + length);
+	if (status < 0 || status >= PATH_MAX)
+		return;
+
+	HASH_FIND_STR(care->concealed_accesses, path, entry);
+	if (entry != NULL)
 		return;
 
 	/* Do not register accesses that would not succeed even if the
@@ -269,19 +317,62 @@ static void register_concealed_access(const Tracee *tracee, Care *care, const ch
 	if (status < 0)
 		return;
 
-	queue_item(care, &care->concealed_accesses, path);
+	entry = talloc_zero(care, Entry);
+	if (entry == NULL)
+		return;
+
+	entry->path = talloc_strdup(entry, path);
+	if (entry->path == NULL)
+		return;
+
+	HASH_ADD_KEYPTR(hh, care->concealed_accesses, entry->path, strlen(entry->path), entry);
 	VERBOSE(tracee, 1, "concealed: %s", path);
 }
 
 /**
- * Archive @path if needed.
+ * Check whether the current syscall of @tracee might modify in place
+ * the content of its final path, that is, without creating a new
+ * file.
+ */
+static bool modifies_in_place(const Tracee *tracee)
+{
+	word_t flags;
+
+	switch (get_sysnum(tracee, ORIGINAL)) {
+	case PR_open:
+		flags = peek_reg(tracee, CURRENT, SYSARG_2);
+		break;
+
+	case PR_openat:
+		flags = peek_reg(tracee, CURRENT, SYSARG_3);
+		break;
+
+	case PR_creat:
+	case PR_truncate:
+	case PR_truncate64:
+		return true;
+
+	default:
+		return false;
+	}
+
+	return (flags & O_ACCMODE) != O_RDONLY || (flags & O_TRUNC) != 0;
+}
+
+/**
+ * Archive @path if needed.  The content is archived asynchronously
+ * unless it might be modified in place by the current syscall, as
+ * indicated by @is_final.
  */
-static void handle_host_path(Extension *extension, const char *path)
+static void handle_host_path(Extension *extension, const char *path, bool is_final)
 {
+	BaseEntry *base_entry;
 	struct stat statl;
 	bool as_dentries;
+	bool is_emptied;
 	char *location;
 	Tracee *tracee;
+	size_t length;
 	Entry *entry;
 	Care *care;
 	int status;
@@ -296,8 +387,13 @@ static void handle_host_path(Extension *extension, const char *path)
 	 * This ensures the rootfs is re-created as it was
 	 * before any file creation or modification. */
 	HASH_FIND_STR(care->entries, path, entry);
-	if (entry != NULL)
+	if (entry != NULL) {
+		/* Its archiving might still be pending, in this case
+		 * wait for it before this content is modified.  */
+		if (is_final && modifies_in_place(tracee))
+			wait_for_archiving(care->archive, entry->serial);
 		return;
+	}
 
 	switch (get_sysnum(tracee, ORIGINAL)) {
 	case PR_getdents:
@@ -346,7 +442,7 @@ static void handle_host_path(Extension *extension, const char *path)
 	if (S_ISFIFO(statl.st_mode) || S_ISSOCK(statl.st_mode)) {
 		if (care->ipc_are_volatile) {
 			Item *item = queue_item(care, &care->volatile_paths, path);
-			if (item != NULL)
+			if (item != NULL && trie_insert(care->volatile_index, item->load, item) == 0)
 				VERBOSE(tracee, 0, "volatile path: %s", path);
 			else
 				note(tracee, WARNING, USER,
@@ -360,30 +456,20 @@ static void handle_host_path(Extension *extension, const char *path)
 
 	/* Don't archive the content of dentries, this save a lot of
 	 * space!  */
+	is_emptied = as_dentries;
 	if (as_dentries)
 		statl.st_size = 0;
 
-	if (care->volatile_paths != NULL) {
-		Item *item;
-
-		STAILQ_FOREACH(item, care->volatile_paths, link) {
-			switch (compare_paths(item->load, path)) {
-			case PATHS_ARE_EQUAL:
-				/* It's a volatile path, archive it as
-				 * empty to preserve its dentry.  */
-				statl.st_size = 0;
-				break;
-
-			case PATH1_IS_PREFIX:
-				/* Don't archive it's a sub-part of a
-				 * volatile path.  */
-				return;
-
-			default:
-				continue;
-			}
-			break;
+	if (trie_lookup(care->volatile_index, path, &length) != NULL) {
+		/* It's a volatile path, archive it as empty to
+		 * preserve its dentry.  */
+		if (path[length] == '\0') {
+			statl.st_size = 0;
+			is_emptied = true;
 		}
+		/* Don't archive it's a sub-part of a volatile path.  */
+		else
+			return;
 	}
 
 	if (care->max_size >= 0 && statl.st_size > care->max_size) {
@@ -392,6 +478,25 @@ static void handle_host_path(Extension *extension, const char *path)
 			PRIi64 "MB, you can specify an alternate limit with the option -m.",
 			path, care->max_size / 1024 / 1024);
 		statl.st_size = 0;
+		is_emptied = true;
+	}
+
+	/* Don't archive files that can be reused from the base
+	 * archive.  An emptied content would shadow the one from the
+	 * base archive, so the latter is reused as-is.  */
+	base_entry = NULL;
+	if (care->base != NULL) {
+		if (is_emptied)
+			HASH_FIND_STR(care->base->entries, path, base_entry);
+		else
+			base_entry = lookup_base(care->base, path, &statl);
+	}
+
+	if (base_entry != NULL
+	    && (is_emptied || !S_ISREG(statl.st_mode) || statl.st_size == 0)) {
+		base_entry->is_reused = true;
+		VERBOSE(tracee, 1, "unchanged: %s", path);
+		return;
 	}
 
 	/* Format the location within the archive.  */
@@ -403,9 +508,22 @@ static void handle_host_path(Extension *extension, const char *path)
 		return;
 	}
 
-	status = archive(tracee, care->archive, path, location, &statl);
-	if (status == 0)
+	/* The content of a regular file that might be reused from the
+	 * base archive is compared by the archiving worker.  */
+	if (base_entry != NULL)
+		entry->serial = archive_unless_same(tracee, care->archive, path, location,
+						&statl, base_entry->hash, &base_entry->is_reused);
+	else
+		entry->serial = archive_async(tracee, care->archive, path, location, &statl);
+	if (entry->serial < 0)
+		return;
+
+	if (is_final && modifies_in_place(tracee)) {
+		wait_for_archiving(care->archive, entry->serial);
 		VERBOSE(tracee, 1, "archived: %s", path);
+	}
+	else
+		VERBOSE(tracee, 1, "archiving: %s", path);
 }
 
 typedef struct {
@@ -568,7 +686,7 @@ int care_callback(Extension *extension, ExtensionEvent event,
 	}
 
 	case HOST_PATH:
-		handle_host_path(extension, (const char *) data1);
+		handle_host_path(extension, (const char *) data1, (bool) data2);
 		return 0;
 
 	case SYSCALL_EXIT_START:
@@ -26,7 +26,11 @@
 #include <stdbool.h>
 #include <sys/queue.h> /* STAILQ_*, */
 
+#include "uthash.h"     /* UT_hash_handle, */
+
 #include "extension/care/archive.h"
+#include "extension/care/trie.h"
+#include "extension/care/base.h"
 
 /* Generic item for a STAILQ list.  */
 typedef struct item {
@@ -36,6 +40,15 @@ typedef struct item {
 
 typedef STAILQ_HEAD(list, item) List;
 
+/* Element of a set of paths.  */
+typedef struct Entry {
+	UT_hash_handle hh;
+	char *path;
+
+	/* Serial number of the archiving job, see archive_async().  */
+	int64_t serial;
+} Entry;
+
 /* CARE CLI configuration.  */
 typedef struct {
 	const char *output;
@@ -49,17 +62,23 @@ typedef struct {
 	bool ignore_default_config;
 
 	int max_size;
+	const char *base;
 } Options;
 
 /* CARE internal configuration.  */
 typedef struct {
-	struct Entry *entries;
-	struct Entry *dentries;
+	Entry *entries;
+	Entry *dentries;
 
 	char *const *command;
 	List *volatile_paths;
 	List *volatile_envars;
-	List *concealed_accesses;
+	Entry *concealed_accesses;
+
+	/* Volatile paths, and host paths of the bindings, indexed by
+	 * their components.  */
+	Trie *volatile_index;
+	Trie *bindings_index;
 
 	const char *prefix;
 	const char *output;
@@ -69,6 +88,9 @@ typedef struct {
 	Archive *archive;
 	int64_t max_size;
 
+	/* Previous archive this one is a delta of, or NULL.  */
+	Base *base;
+
 	int last_exit_status;
 
 	bool is_ready;
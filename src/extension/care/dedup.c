@@ -0,0 +1,421 @@
+/* -*- c-set-style: "K&R"; c-basic-offset: 8 -*-
+ *
+ * This file is part of PRoot.
+ *
+ * Copyright (C) 2015 STMicroelectronics
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stdlib.h>    /* malloc(3), calloc(3), free(3), */
+#include <string.h>    /* memcpy(3), strlen(3), */
+#include <unistd.h>    /* pread(2), close(2), */
+#include <fcntl.h>     /* open(2), O_*, */
+#include <errno.h>     /* errno, EINTR, */
+
+#include "uthash.h"    /* HASH*, UT_hash_handle, */
+#include "extension/care/dedup.h"
+
+/* The content hash is XXH64: it consumes 32-byte stripes with four
+ * independent 64-bit lanes, so compilers can keep them in vector
+ * registers.  */
+#define PRIME1 0x9E3779B185EBCA87ULL
+#define PRIME2 0xC2B2AE3D27D4EB4FULL
+#define PRIME3 0x165667B19E3779F9ULL
+#define PRIME4 0x85EBCA77C2B2AE63ULL
+#define PRIME5 0x27D4EB2F165667C5ULL
+
+#define ROTATE(value, count) (((value) << (count)) | ((value) >> (64 - (count))))
+
+static inline uint64_t read64(const uint8_t *data)
+{
+	uint64_t value;
+	memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+static inline uint32_t read32(const uint8_t *data)
+{
+	uint32_t value;
+	memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+static inline uint64_t round64(uint64_t lane, uint64_t input)
+{
+	lane += input * PRIME2;
+	lane  = ROTATE(lane, 31);
+	return lane * PRIME1;
+}
+
+static inline uint64_t merge64(uint64_t hash, uint64_t lane)
+{
+	hash ^= round64(0, lane);
+	return hash * PRIME1 + PRIME4;
+}
+
+/**
+ * Consume all the complete stripes from @data (@size bytes) into
+ * @lanes, and return the number of bytes consumed.
+ */
+static size_t consume_stripes(uint64_t lanes[4], const uint8_t *data, size_t size)
+{
+	uint64_t lane0 = lanes[0];
+	uint64_t lane1 = lanes[1];
+	uint64_t lane2 = lanes[2];
+	uint64_t lane3 = lanes[3];
+	size_t offset;
+
+	for (offset = 0; offset + 32 <= size; offset += 32) {
+		lane0 = round64(lane0, read64(data + offset));
+		lane1 = round64(lane1, read64(data + offset + 8));
+		lane2 = round64(lane2, read64(data + offset + 16));
+		lane3 = round64(lane3, read64(data + offset + 24));
+	}
+
+	lanes[0] = lane0;
+	lanes[1] = lane1;
+	lanes[2] = lane2;
+	lanes[3] = lane3;
+
+	return offset;
+}
+
+/**
+ * Initialize the content hash @state.
+ */
+void hash_init(ContentHash *state)
+{
+	memset(state, 0, sizeof(ContentHash));
+	state->lanes[0] = PRIME1 + PRIME2;
+	state->lanes[1] = PRIME2;
+	state->lanes[2] = 0;
+	state->lanes[3] = -PRIME1;
+}
+
+/**
+ * Feed the content hash @state with @data (@size bytes).
+ */
+void hash_update(ContentHash *state, const void *data_, size_t size)
+{
+	const uint8_t *data = data_;
+	size_t length;
+
+	state->total += size;
+
+	/* Complete the pending stripe first.  */
+	if (state->buffered > 0) {
+		length = sizeof(state->buffer) - state->buffered;
+		if (length > size)
+			length = size;
+
+		memcpy(state->buffer + state->buffered, data, length);
+		state->buffered += length;
+		data += length;
+		size -= length;
+
+		if (state->buffered < sizeof(state->buffer))
+			return;
+
+		(void) consume_stripes(state->lanes, state->buffer, sizeof(state->buffer));
+		state->buffered = 0;
+	}
+
+	length = consume_stripes(state->lanes, data, size);
+	data += length;
+	size -= length;
+
+	memcpy(state->buffer, data, size);
+	state->buffered = size;
+}
+
+/**
+ * Return the hash of all the data fed into @state so far.
+ */
+uint64_t hash_final(const ContentHash *state)
+{
+	const uint8_t *data = state->buffer;
+	size_t size = state->buffered;
+	uint64_t hash;
+
+	if (state->total >= 32) {
+		hash = ROTATE(state->lanes[0], 1) + ROTATE(state->lanes[1], 7)
+			+ ROTATE(state->lanes[2], 12) + ROTATE(state->lanes[3], 18);
+		hash = merge64(hash, state->lanes[0]);
+		hash = merge64(hash, state->lanes[1]);
+		hash = merge64(hash, state->lanes[2]);
+		hash = merge64(hash, state->lanes[3]);
+	}
+	else
+		hash = state->lanes[2] + PRIME5;
+
+	hash += state->total;
+
+	for (; size >= 8; data += 8, size -= 8) {
+		hash ^= round64(0, read64(data));
+		hash  = ROTATE(hash, 27) * PRIME1 + PRIME4;
+	}
+
+	if (size >= 4) {
+		hash ^= (uint64_t) read32(data) * PRIME1;
+		hash  = ROTATE(hash, 23) * PRIME2 + PRIME3;
+		data += 4;
+		size -= 4;
+	}
+
+	for (; size > 0; data++, size--) {
+		hash ^= (*data) * PRIME5;
+		hash  = ROTATE(hash, 11) * PRIME1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= PRIME2;
+	hash ^= hash >> 29;
+	hash *= PRIME3;
+	hash ^= hash >> 32;
+
+	return hash;
+}
+
+/**
+ * Compute in @hash the hash of the whole content of @fd, without
+ * changing its file offset.  This function returns -errno if an
+ * error occured, otherwise 0.
+ */
+int hash_fd(int fd, uint64_t *hash)
+{
+	uint8_t buffer[64 * 1024];
+	ContentHash state;
+	off_t offset = 0;
+	ssize_t status;
+
+	hash_init(&state);
+
+	do {
+		status = pread(fd, buffer, sizeof(buffer), offset);
+		if (status < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		hash_update(&state, buffer, status);
+		offset += status;
+	} while (status > 0);
+
+	*hash = hash_final(&state);
+	return 0;
+}
+
+/* Identity of an archived content.  Metadata are part of the key
+ * since duplicates share the inode -- hence the status -- of their
+ * original once extracted.  */
+typedef struct {
+	uint64_t hash;
+	off_t size;
+	mode_t mode;
+	uid_t uid;
+	gid_t gid;
+	struct timespec mtime;
+} Key;
+
+/* The content is at @location in the archive, and it was read from
+ * the host @path.  Both strings are stored in @strings.  */
+typedef struct {
+	UT_hash_handle hh;
+	Key key;
+	const char *location;
+	const char *path;
+	char strings[];
+} Content;
+
+typedef struct {
+	UT_hash_handle hh;
+	off_t size;
+} Size;
+
+/* Archived contents, and their sizes to avoid hashing contents that
+ * can't be duplicates.  */
+struct dedup {
+	Content *contents;
+	Size *sizes;
+};
+
+/**
+ * Fill @key for the content with the given @hash and @statl status.
+ */
+static void fill_key(Key *key, const struct stat *statl, uint64_t hash)
+{
+	/* Zero the padding since the whole structure is hashed.  */
+	memset(key, 0, sizeof(Key));
+	key->hash = hash;
+	key->size = statl->st_size;
+	key->mode = statl->st_mode;
+	key->uid  = statl->st_uid;
+	key->gid  = statl->st_gid;
+	key->mtime = statl->st_mtim;
+}
+
+/**
+ * Check whether the content of @fd is the same as the @size first
+ * bytes of the file at @path.  A hash collision must not replace a
+ * content with another one.
+ */
+static bool same_content(int fd, const char *path, off_t size)
+{
+	uint8_t buffer1[32 * 1024];
+	uint8_t buffer2[32 * 1024];
+	off_t offset = 0;
+	bool result = false;
+	int fd2;
+
+	fd2 = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd2 < 0)
+		return false;
+
+	while (offset < size) {
+		ssize_t length1;
+		ssize_t length2;
+
+		length1 = pread(fd, buffer1, sizeof(buffer1), offset);
+		if (length1 < 0 && errno == EINTR)
+			continue;
+		if (length1 <= 0)
+			goto end;
+
+		/* Short reads of regular files only happen at their end.  */
+		do
+			length2 = pread(fd2, buffer2, length1, offset);
+		while (length2 < 0 && errno == EINTR);
+		if (length2 != length1 || memcmp(buffer1, buffer2, length1) != 0)
+			goto end;
+
+		offset += length1;
+	}
+
+	result = (offset == size);
+end:
+	close(fd2);
+	return result;
+}
+
+/**
+ * Allocate a new, empty, deduplication table.  Note: it uses
+ * malloc(3) since the archiving worker must not use talloc.
+ */
+Dedup *new_dedup(void)
+{
+	return calloc(1, sizeof(Dedup));
+}
+
+/**
+ * Free @dedup and all its entries.
+ */
+void free_dedup(Dedup *dedup)
+{
+	Content *content;
+	Content *content_tmp;
+	Size *size;
+	Size *size_tmp;
+
+	if (dedup == NULL)
+		return;
+
+	HASH_ITER(hh, dedup->contents, content, content_tmp) {
+		HASH_DEL(dedup->contents, content);
+		free(content);
+	}
+
+	HASH_ITER(hh, dedup->sizes, size, size_tmp) {
+		HASH_DEL(dedup->sizes, size);
+		free(size);
+	}
+
+	free(dedup);
+}
+
+/**
+ * Check whether a content of @size bytes was already registered in
+ * @dedup.  If not, there's no need to hash the new content before
+ * archiving it.
+ */
+bool dedup_has_size(Dedup *dedup, off_t size)
+{
+	Size *entry;
+
+	HASH_FIND(hh, dedup->sizes, &size, sizeof(off_t), entry);
+	return entry != NULL;
+}
+
+/**
+ * Return the location of the content already archived with the same
+ * @hash and @statl status, and with the same bytes as @fd, otherwise
+ * NULL.
+ */
+const char *dedup_lookup(Dedup *dedup, const struct stat *statl, uint64_t hash, int fd)
+{
+	Content *content;
+	Key key;
+
+	fill_key(&key, statl, hash);
+
+	HASH_FIND(hh, dedup->contents, &key, sizeof(Key), content);
+	if (content == NULL || !same_content(fd, content->path, statl->st_size))
+		return NULL;
+
+	return content->location;
+}
+
+/**
+ * Register in @dedup the content archived at @location, read from
+ * the host @path, with the given @hash and @statl status.
+ */
+void dedup_register(Dedup *dedup, const struct stat *statl, uint64_t hash,
+		const char *location, const char *path)
+{
+	size_t location_length;
+	Content *content;
+	Size *size;
+	Key key;
+
+	fill_key(&key, statl, hash);
+
+	HASH_FIND(hh, dedup->contents, &key, sizeof(Key), content);
+	if (content != NULL)
+		return;
+
+	location_length = strlen(location) + 1;
+	content = malloc(sizeof(Content) + location_length + strlen(path) + 1);
+	if (content == NULL)
+		return;
+
+	content->key = key;
+	content->location = content->strings;
+	content->path = content->strings + location_length;
+	strcpy(content->strings, location);
+	strcpy(content->strings + location_length, path);
+	HASH_ADD(hh, dedup->contents, key, sizeof(Key), content);
+
+	if (dedup_has_size(dedup, statl->st_size))
+		return;
+
+	size = malloc(sizeof(Size));
+	if (size == NULL)
+		return;
+
+	size->size = statl->st_size;
+	HASH_ADD(hh, dedup->sizes, size, sizeof(off_t), size);
+}
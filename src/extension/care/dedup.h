@@ -0,0 +1,53 @@
+/* -*- c-set-style: "K&R"; c-basic-offset: 8 -*-
+ *
+ * This file is part of PRoot.
+ *
+ * Copyright (C) 2015 STMicroelectronics
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef CARE_DEDUP_H
+#define CARE_DEDUP_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* State of the content hash, see hash_update().  */
+typedef struct {
+	uint64_t lanes[4];
+	uint64_t total;
+	uint8_t buffer[32];
+	size_t buffered;
+} ContentHash;
+
+extern void hash_init(ContentHash *state);
+extern void hash_update(ContentHash *state, const void *data, size_t size);
+extern uint64_t hash_final(const ContentHash *state);
+extern int hash_fd(int fd, uint64_t *hash);
+
+typedef struct dedup Dedup;
+
+extern Dedup *new_dedup(void);
+extern void free_dedup(Dedup *dedup);
+extern bool dedup_has_size(Dedup *dedup, off_t size);
+extern const char *dedup_lookup(Dedup *dedup, const struct stat *statl, uint64_t hash, int fd);
+extern void dedup_register(Dedup *dedup, const struct stat *statl, uint64_t hash,
+			const char *location, const char *path);
+
+#endif /* CARE_DEDUP_H */
@@ -23,16 +23,22 @@
 #include <sys/types.h>  /* open(2), fstat(2), lseek(2), */
 #include <sys/stat.h>   /* open(2), fstat(2), */
 #include <sys/stat.h>   /* open(2), */
-#include <fcntl.h>      /* open(2), */
+#include <fcntl.h>      /* open(2), posix_fadvise(2), */
 #include <stdint.h>     /* *int*_t, *INT*_MAX, */
 #include <unistd.h>     /* fstat(2), read(2), lseek(2), */
 #include <sys/mman.h>   /* mmap(2), MAP_*, */
+#include <stdlib.h>     /* realpath(3), qsort(3), */
+#include <stdio.h>      /* snprintf(3), */
+#include <limits.h>     /* PATH_MAX, */
 #include <stdbool.h>    /* bool, true, false, */
 #include <assert.h>     /* assert(3), */
 #include <errno.h>      /* errno(3), */
 #include <string.h>     /* strerror(3), */
 #include <inttypes.h>   /* PRI*, */
 #include <endian.h>     /* be64toh(3), */
+#include <time.h>       /* clock_gettime(3), */
+#include <pthread.h>    /* pthread_*(3), */
+#include <sys/param.h>  /* MIN(), MAX(), */
 #include <archive.h>    /* archive_*(3), */
 #include <archive_entry.h> /* archive_entry*(3), */
 
@@ -40,15 +46,10 @@
 #include "cli/note.h"
 
 /**
- * Extract the given @archive into the current working directory.
- * This function returns -1 if an error occured, otherwise 0.
+ * Return the flags used to extract entries with archive_read_extract().
  */
-static int extract_archive(struct archive *archive)
+static int get_extract_flags(void)
 {
-	struct archive_entry *entry;
-	int result = 0;
-	int status;
-
 	int flags = ARCHIVE_EXTRACT_PERM
 		  | ARCHIVE_EXTRACT_TIME
 		  | ARCHIVE_EXTRACT_ACL
@@ -60,34 +61,390 @@ static int extract_archive(struct archive *archive)
 	if (geteuid() == 0)
 		flags |= ARCHIVE_EXTRACT_OWNER;
 
-	while (archive_read_next_header(archive, &entry) == ARCHIVE_OK) {
-		status = archive_read_extract(archive, entry, flags);
-		switch (status) {
-		case ARCHIVE_WARN:
-			note(NULL, WARNING, INTERNAL, "%s: %s",
-				archive_error_string(archive),
-				strerror(archive_errno(archive)));
-			/* FALLTHROUGH */
-		case ARCHIVE_OK:
-			note(NULL, INFO, USER, "extracted: %s", archive_entry_pathname(entry));
+	return flags;
+}
+
+/**
+ * Extract the given @entry of @archive with the given @flags.  This
+ * function returns -1 if an error occured, otherwise 0.
+ */
+static int extract_entry(struct archive *archive, struct archive_entry *entry, int flags)
+{
+	int status;
+
+	status = archive_read_extract(archive, entry, flags);
+	switch (status) {
+	case ARCHIVE_WARN:
+		note(NULL, WARNING, INTERNAL, "%s: %s",
+			archive_error_string(archive),
+			strerror(archive_errno(archive)));
+		/* FALLTHROUGH */
+	case ARCHIVE_OK:
+		note(NULL, INFO, USER, "extracted: %s", archive_entry_pathname(entry));
+		return 0;
+
+	default:
+		note(NULL, ERROR, INTERNAL, "%s: %s",
+			archive_error_string(archive),
+			strerror(archive_errno(archive)));
+		return -1;
+	}
+}
+
+/* Regular files up to this size are read into memory and written by
+ * the extraction threads, bigger ones are directly extracted.  */
+#define MAX_JOB_SIZE (8 * 1024 * 1024)
+
+/* Limits of what the extraction threads have pending.  */
+#define MAX_PENDING_SIZE (64 * 1024 * 1024)
+#define NB_JOB_SLOTS 128
+#define MAX_NB_THREADS 16
+
+/* A regular file to be written by an extraction thread.  */
+typedef struct {
+	struct archive_entry *entry;
+	void *data;
+	size_t size;
+} Job;
+
+/* Pipeline between the thread that decompresses the archive and the
+ * threads that create the files.  */
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+	pthread_cond_t idle;
+
+	Job jobs[NB_JOB_SLOTS];
+	size_t head;
+	size_t tail;
+	size_t nb_busy;
+	size_t pending_size;
+	bool stopping;
+
+	pthread_t threads[MAX_NB_THREADS];
+	size_t nb_threads;
+
+	int flags;
+	int result;
+
+	/* Per-phase timings, in seconds.  */
+	double decompression_time;
+	double creation_time;
+	double waiting_time;
+} Pipeline;
+
+/**
+ * Return the current time of a monotonic clock, in seconds.
+ */
+static double now(void)
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/**
+ * Write @job on disk through @disk.  This function returns -1 if an
+ * error occured, otherwise 0.
+ */
+static int write_job(struct archive *disk, const Job *job)
+{
+	const char *path = archive_entry_pathname(job->entry);
+	la_ssize_t size;
+	int status;
+
+	status = archive_write_header(disk, job->entry);
+	if (status == ARCHIVE_WARN)
+		note(NULL, WARNING, INTERNAL, "%s: %s", path, archive_error_string(disk));
+	else if (status != ARCHIVE_OK) {
+		note(NULL, ERROR, INTERNAL, "%s: %s", path, archive_error_string(disk));
+		return -1;
+	}
+
+	if (job->size > 0) {
+		size = archive_write_data(disk, job->data, job->size);
+		if (size < 0 || (size_t) size != job->size) {
+			note(NULL, ERROR, INTERNAL, "%s: %s", path, archive_error_string(disk));
+			return -1;
+		}
+	}
+
+	status = archive_write_finish_entry(disk);
+	if (status == ARCHIVE_WARN)
+		note(NULL, WARNING, INTERNAL, "%s: %s", path, archive_error_string(disk));
+	else if (status != ARCHIVE_OK) {
+		note(NULL, ERROR, INTERNAL, "%s: %s", path, archive_error_string(disk));
+		return -1;
+	}
+
+	note(NULL, INFO, USER, "extracted: %s", path);
+	return 0;
+}
+
+/**
+ * Write the jobs of the pipeline @pipeline_ until it is stopped and
+ * empty.  This is the entry point of the extraction threads.
+ */
+static void *extraction_thread(void *pipeline_)
+{
+	Pipeline *pipeline = pipeline_;
+	struct archive *disk;
+	double start;
+	int status;
+	Job job;
+
+	/* Each thread has its own handle since they are not
+	 * thread-safe.  */
+	disk = archive_write_disk_new();
+	if (disk != NULL) {
+		(void) archive_write_disk_set_options(disk, pipeline->flags);
+		(void) archive_write_disk_set_standard_lookup(disk);
+	}
+
+	pthread_mutex_lock(&pipeline->lock);
+	while (1) {
+		while (pipeline->head == pipeline->tail && !pipeline->stopping)
+			pthread_cond_wait(&pipeline->not_empty, &pipeline->lock);
+
+		if (pipeline->head == pipeline->tail)
 			break;
 
-		default:
-			result = -1;
-			note(NULL, ERROR, INTERNAL, "%s: %s",
-				archive_error_string(archive),
-				strerror(archive_errno(archive)));
+		job = pipeline->jobs[pipeline->head % NB_JOB_SLOTS];
+		pipeline->head++;
+		pipeline->nb_busy++;
+		pthread_mutex_unlock(&pipeline->lock);
+
+		start = now();
+		status = (disk != NULL ? write_job(disk, &job) : -1);
+
+		archive_entry_free(job.entry);
+		free(job.data);
+
+		pthread_mutex_lock(&pipeline->lock);
+		pipeline->creation_time += now() - start;
+		pipeline->pending_size -= job.size;
+		pipeline->nb_busy--;
+		if (status < 0)
+			pipeline->result = -1;
+
+		pthread_cond_signal(&pipeline->not_full);
+		pthread_cond_broadcast(&pipeline->idle);
+	}
+	pthread_mutex_unlock(&pipeline->lock);
+
+	if (disk != NULL) {
+		(void) archive_write_close(disk);
+		(void) archive_write_free(disk);
+	}
+
+	return NULL;
+}
+
+/**
+ * Start the extraction threads of @pipeline.  This function returns
+ * the number of started threads.
+ */
+static size_t start_pipeline(Pipeline *pipeline)
+{
+	long nb_cpus;
+	size_t i;
+
+	pthread_mutex_init(&pipeline->lock, NULL);
+	pthread_cond_init(&pipeline->not_empty, NULL);
+	pthread_cond_init(&pipeline->not_full, NULL);
+	pthread_cond_init(&pipeline->idle, NULL);
+
+	/* One CPU is used for the decompression.  */
+	nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	nb_cpus = MIN(MAX(nb_cpus - 1, 1), MAX_NB_THREADS);
+
+	for (i = 0; i < (size_t) nb_cpus; i++) {
+		int status = pthread_create(&pipeline->threads[i], NULL,
+					extraction_thread, pipeline);
+		if (status != 0)
 			break;
+	}
+	pipeline->nb_threads = i;
+
+	return pipeline->nb_threads;
+}
+
+/**
+ * Stop the extraction threads of @pipeline once all the queued jobs
+ * are done.
+ */
+static void stop_pipeline(Pipeline *pipeline)
+{
+	size_t i;
+
+	pthread_mutex_lock(&pipeline->lock);
+	pipeline->stopping = true;
+	pthread_cond_broadcast(&pipeline->not_empty);
+	pthread_mutex_unlock(&pipeline->lock);
+
+	for (i = 0; i < pipeline->nb_threads; i++)
+		pthread_join(pipeline->threads[i], NULL);
+}
+
+/**
+ * Wait until all the jobs of @pipeline are done.
+ */
+static void drain_pipeline(Pipeline *pipeline)
+{
+	double start = now();
+
+	pthread_mutex_lock(&pipeline->lock);
+	while (pipeline->head != pipeline->tail || pipeline->nb_busy > 0)
+		pthread_cond_wait(&pipeline->idle, &pipeline->lock);
+	pthread_mutex_unlock(&pipeline->lock);
+
+	pipeline->waiting_time += now() - start;
+}
+
+/**
+ * Read the content of the current @entry of @archive and queue it in
+ * @pipeline.  This function returns -1 if an error occured, otherwise
+ * 0.
+ */
+static int queue_job(Pipeline *pipeline, struct archive *archive, struct archive_entry *entry)
+{
+	size_t size = archive_entry_size(entry);
+	size_t offset = 0;
+	la_ssize_t status;
+	double start;
+	Job job;
+
+	start = now();
+
+	job.size  = size;
+	job.data  = NULL;
+	job.entry = archive_entry_clone(entry);
+	if (job.entry == NULL) {
+		note(NULL, ERROR, INTERNAL, "can't allocate memory");
+		return -1;
+	}
+
+	if (size > 0) {
+		job.data = malloc(size);
+		if (job.data == NULL) {
+			note(NULL, ERROR, INTERNAL, "can't allocate memory");
+			archive_entry_free(job.entry);
+			return -1;
+		}
+	}
+
+	while (offset < size) {
+		status = archive_read_data(archive, (uint8_t *) job.data + offset, size - offset);
+		if (status <= 0) {
+			note(NULL, ERROR, INTERNAL, "%s: %s", archive_entry_pathname(entry),
+				archive_error_string(archive) ?: "truncated archive");
+			archive_entry_free(job.entry);
+			free(job.data);
+			return -1;
+		}
+		offset += status;
+	}
+
+	pipeline->decompression_time += now() - start;
+	start = now();
+
+	pthread_mutex_lock(&pipeline->lock);
+
+	while (pipeline->tail - pipeline->head >= NB_JOB_SLOTS
+	       || (pipeline->pending_size > 0
+		   && pipeline->pending_size + size > MAX_PENDING_SIZE))
+		pthread_cond_wait(&pipeline->not_full, &pipeline->lock);
+
+	pipeline->jobs[pipeline->tail % NB_JOB_SLOTS] = job;
+	pipeline->tail++;
+	pipeline->pending_size += size;
+	pthread_cond_signal(&pipeline->not_empty);
+
+	pthread_mutex_unlock(&pipeline->lock);
+
+	pipeline->waiting_time += now() - start;
+	return 0;
+}
+
+/**
+ * Extract the given @archive into the current working directory.
+ * The archive is decompressed by the current thread whereas regular
+ * files are created by extraction threads.  This function returns -1
+ * if an error occured, otherwise 0.
+ */
+static int extract_archive(struct archive *archive)
+{
+	struct archive_entry *entry;
+	Pipeline *pipeline;
+	double start_time;
+	double start;
+	int result = 0;
+	int status;
+
+	start_time = now();
+
+	pipeline = talloc_zero(NULL, Pipeline);
+	if (pipeline != NULL) {
+		pipeline->flags = get_extract_flags();
+		(void) start_pipeline(pipeline);
+	}
+
+	while (1) {
+		start = now();
+		status = archive_read_next_header(archive, &entry);
+		if (pipeline != NULL)
+			pipeline->decompression_time += now() - start;
+		if (status != ARCHIVE_OK)
+			break;
+
+		if (   pipeline != NULL
+		    && pipeline->nb_threads > 0
+		    && archive_entry_filetype(entry) == AE_IFREG
+		    && archive_entry_hardlink(entry) == NULL
+		    && archive_entry_size(entry) <= MAX_JOB_SIZE) {
+			status = queue_job(pipeline, archive, entry);
+			if (status < 0)
+				result = -1;
+			continue;
 		}
+
+		/* The target of a hardlink has to be completely
+		 * written first.  */
+		if (pipeline != NULL && archive_entry_hardlink(entry) != NULL)
+			drain_pipeline(pipeline);
+
+		start = now();
+		status = extract_entry(archive, entry, get_extract_flags());
+		if (status < 0)
+			result = -1;
+		if (pipeline != NULL)
+			pipeline->creation_time += now() - start;
 	}
 
+	if (pipeline == NULL)
+		return result;
+
+	stop_pipeline(pipeline);
+	if (pipeline->result < 0)
+		result = -1;
+
+	note(NULL, INFO, USER,
+		"extraction time: %.2fs (decompression: %.2fs, file creation: %.2fs"
+		" on %zu threads, waiting: %.2fs)", now() - start_time,
+		pipeline->decompression_time, pipeline->creation_time,
+		pipeline->nb_threads + 1, pipeline->waiting_time);
+
+	TALLOC_FREE(pipeline);
 	return result;
 }
 
-/* Data used by archive_[open/read/close] callbacks.  */
+/* Data used by archive_[open/read/skip/close] callbacks.  */
 typedef struct
 {
-	uint8_t buffer[4096];
+	uint8_t buffer[1024 * 1024];
+	struct archive *archive;
 	const char *path;
 	size_t size_remaining;
 	int fd;
@@ -169,6 +526,10 @@ static int open_callback(struct archive *archive, void *data_)
 		return ARCHIVE_FATAL;
 	}
 
+	/* Let the kernel read ahead aggressively while the archive is
+	 * being decompressed.  */
+	(void) posix_fadvise(data->fd, offset, 0, POSIX_FADV_SEQUENTIAL);
+
 	return ARCHIVE_OK;
 }
 
@@ -209,6 +570,30 @@ static ssize_t read_callback(struct archive *archive, void *data_, const void **
 	return size;
 }
 
+/**
+ * This callback is invoked whenever the library wants to skip raw
+ * bytes from the archive, typically the content of uninteresting
+ * entries.  It returns the number of bytes actually skipped, 0 lets
+ * the library read and drop them instead.
+ *
+ *  -- man 3 archive_read_open.
+ */
+static int64_t skip_callback(struct archive *archive UNUSED, void *data_, int64_t request)
+{
+	CallbackData *data = talloc_get_type_abort(data_, CallbackData);
+	off_t offset;
+
+	if ((uint64_t) request > data->size_remaining)
+		request = data->size_remaining;
+
+	offset = lseek(data->fd, request, SEEK_CUR);
+	if (offset == (off_t) -1)
+		return 0;
+
+	data->size_remaining -= request;
+	return request;
+}
+
 /**
  * This callback is invoked by archive_close() when the archive
  * processing is complete.  The callback returns ARCHIVE_OK on
@@ -232,23 +617,63 @@ static int close_callback(struct archive *archive, void *data_)
 }
 
 /**
- * Extract the archive stored at the given @path.  This function
- * returns -1 if an error occurred, otherwise 0.
+ * Close and free the archive handled by @data.
  */
-int extract_archive_from_file(const char *path)
+static int free_archive(CallbackData *data)
+{
+	int status;
+
+	if (data->archive == NULL)
+		return 0;
+
+	status = archive_read_close(data->archive);
+	if (status != ARCHIVE_OK) {
+		note(NULL, WARNING, INTERNAL, "can't close archive: %s",
+			archive_error_string(data->archive));
+	}
+
+	status = archive_read_free(data->archive);
+	if (status != ARCHIVE_OK) {
+		note(NULL, WARNING, INTERNAL, "can't free archive: %s",
+			archive_error_string(data->archive));
+	}
+
+	data->archive = NULL;
+	return 0;
+}
+
+/**
+ * Open the archive stored at the given @path for reading.  The
+ * returned handle is closed and freed when @context is freed.  This
+ * function returns NULL if an error occurred.
+ */
+struct archive *open_archive_from_file(TALLOC_CTX *context, const char *path)
 {
-	struct archive *archive = NULL;
-	CallbackData *data = NULL;
-	int status2;
+	struct archive *archive;
+	CallbackData *data;
 	int status;
 
+	data = talloc_zero(context, CallbackData);
+	if (data == NULL) {
+		note(NULL, ERROR, INTERNAL, "can't allocate callback data");
+		return NULL;
+	}
+
+	data->path = talloc_strdup(data, path);
+	if (data->path == NULL) {
+		note(NULL, ERROR, INTERNAL, "can't allocate callback data path");
+		return NULL;
+	}
+
 	archive = archive_read_new();
 	if (archive == NULL) {
 		note(NULL, ERROR, INTERNAL, "can't initialize archive structure");
-		status = -1;
-		goto end;
+		return NULL;
 	}
 
+	data->archive = archive;
+	talloc_set_destructor(data, free_archive);
+
 	status = archive_read_support_format_cpio(archive);
 	if (status == ARCHIVE_WARN) {
 		note(NULL, WARNING, INTERNAL, "set archive format: %s",
@@ -257,8 +682,7 @@ int extract_archive_from_file(const char *path)
 	else if (status != ARCHIVE_OK) {
 		note(NULL, ERROR, INTERNAL, "can't set archive format: %s",
 			archive_error_string(archive));
-		status = -1;
-		goto end;
+		return NULL;
 	}
 
 	status = archive_read_support_format_gnutar(archive);
@@ -269,8 +693,7 @@ int extract_archive_from_file(const char *path)
 	else if (status != ARCHIVE_OK) {
 		note(NULL, ERROR, INTERNAL, "can't set archive format: %s",
 			archive_error_string(archive));
-		status = -1;
-		goto end;
+		return NULL;
 	}
 
 	status = archive_read_support_filter_gzip(archive);
@@ -281,8 +704,7 @@ int extract_archive_from_file(const char *path)
 	else if (status != ARCHIVE_OK) {
 		note(NULL, ERROR, INTERNAL, "can't add archive filter: %s",
 			archive_error_string(archive));
-		status = -1;
-		goto end;
+		return NULL;
 	}
 
 	status = archive_read_support_filter_lzop(archive);
@@ -293,27 +715,18 @@ int extract_archive_from_file(const char *path)
 	else if (status != ARCHIVE_OK) {
 		note(NULL, ERROR, INTERNAL, "can't add archive filter: %s",
 			archive_error_string(archive));
-		status = -1;
-		goto end;
+		return NULL;
 	}
 
-	data = talloc_zero(NULL, CallbackData);
-	if (data == NULL) {
-		note(NULL, ERROR, INTERNAL, "can't allocate callback data");
-		status = -1;
-		goto end;
+	/* These filters are optional, libarchive might rely on
+	 * external programs for them, or not support them at all.  */
+	(void) archive_read_support_filter_xz(archive);
+#if ARCHIVE_VERSION_NUMBER >= 3003003
+	(void) archive_read_support_filter_zstd(archive);
+#endif
 
-	}
-
-	data->path = talloc_strdup(data, path);
-	if (data->path == NULL) {
-		note(NULL, ERROR, INTERNAL, "can't allocate callback data path");
-		status = -1;
-		goto end;
-
-	}
-
-	status = archive_read_open(archive, data, open_callback, read_callback, close_callback);
+	status = archive_read_open2(archive, data, open_callback, read_callback,
+				skip_callback, close_callback);
 	if (status == ARCHIVE_WARN) {
 		if (archive_error_string(archive) != NULL)
 			note(NULL, WARNING, INTERNAL, "read archive: %s",
@@ -325,27 +738,300 @@ int extract_archive_from_file(const char *path)
 		if (archive_error_string(archive) != NULL)
 			note(NULL, ERROR, INTERNAL, "can't read archive: %s",
 				archive_error_string(archive));
+		return NULL;
+	}
+
+	return archive;
+}
+
+/**
+ * Extract the archive stored at the given @path.  This function
+ * returns -1 if an error occurred, otherwise 0.
+ */
+int extract_archive_from_file(const char *path)
+{
+	struct archive *archive;
+	TALLOC_CTX *context;
+	int status;
+
+	context = talloc_new(NULL);
+	if (context == NULL) {
+		note(NULL, ERROR, INTERNAL, "can't allocate memory");
+		return -1;
+	}
+
+	archive = open_archive_from_file(context, path);
+	if (archive == NULL)
 		status = -1;
-		goto end;
+	else
+		status = extract_archive(archive);
+
+	TALLOC_FREE(context);
+
+	return status;
+}
+
+/**
+ * Create the missing parent directories of @path.
+ */
+static void create_parent_directories(const char *path)
+{
+	char parent[PATH_MAX];
+	char *cursor;
+
+	if (strlen(path) >= PATH_MAX)
+		return;
+	strcpy(parent, path);
+
+	for (cursor = strchr(parent + 1, '/'); cursor != NULL; cursor = strchr(cursor + 1, '/')) {
+		*cursor = '\0';
+		(void) mkdir(parent, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+		*cursor = '/';
 	}
+}
 
-	status = extract_archive(archive);
-end:
-	if (archive != NULL) {
-		status2 = archive_read_close(archive);
-		if (status2 != ARCHIVE_OK) {
-			note(NULL, WARNING, INTERNAL, "can't close archive: %s",
-				archive_error_string(archive));
+/**
+ * Create an empty placeholder in place of the regular file described
+ * by @entry.  It has the same size, ownership, permissions and times
+ * but it doesn't occupy any disk space since it is sparse.  Its
+ * status is stored in @statf.  This function returns -1 if an error
+ * occurred, otherwise 0.
+ */
+static int create_placeholder(struct archive_entry *entry, struct stat *statf)
+{
+	const char *path = archive_entry_pathname(entry);
+	struct timespec times[2];
+	int status;
+	int fd;
+
+	(void) unlink(path);
+
+	fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+	if (fd < 0 && errno == ENOENT) {
+		create_parent_directories(path);
+		fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+	}
+	if (fd < 0) {
+		note(NULL, ERROR, SYSTEM, "can't create %s", path);
+		return -1;
+	}
+
+	status = ftruncate(fd, archive_entry_size(entry));
+	if (status < 0)
+		goto error;
+
+	if (geteuid() == 0)
+		(void) fchown(fd, archive_entry_uid(entry), archive_entry_gid(entry));
+
+	status = fchmod(fd, archive_entry_perm(entry));
+	if (status < 0)
+		goto error;
+
+	times[0].tv_sec  = archive_entry_atime(entry);
+	times[0].tv_nsec = archive_entry_atime_nsec(entry);
+	times[1].tv_sec  = archive_entry_mtime(entry);
+	times[1].tv_nsec = archive_entry_mtime_nsec(entry);
+
+	status = futimens(fd, times);
+	if (status < 0)
+		goto error;
+
+	status = fstat(fd, statf);
+	if (status < 0)
+		goto error;
+
+	close(fd);
+	return 0;
+
+error:
+	note(NULL, ERROR, SYSTEM, "can't create placeholder for %s", path);
+	close(fd);
+	return -1;
+}
+
+/**
+ * Return the length of the "<prefix>/" part of @path if this latter
+ * lies in "<prefix>/rootfs/", otherwise 0.
+ */
+static size_t get_rootfs_prefix_length(const char *path)
+{
+	const char *slash;
+
+	slash = strchr(path, '/');
+	if (slash == NULL || strncmp(slash, "/rootfs/", strlen("/rootfs/")) != 0)
+		return 0;
+
+	return slash - path + 1;
+}
+
+static int compare_lazy_index_entries(const void *a, const void *b)
+{
+	const LazyIndexEntry *entry_a = a;
+	const LazyIndexEntry *entry_b = b;
+
+	if (entry_a->inode < entry_b->inode)
+		return -1;
+	if (entry_a->inode > entry_b->inode)
+		return 1;
+	return 0;
+}
+
+/**
+ * Write in "<@prefix>/lazy-index" the @header and its @entries.
+ * This function returns -1 if an error occurred, otherwise 0.
+ */
+static int write_lazy_index(const char *prefix, LazyIndexHeader *header,
+			LazyIndexEntry *entries)
+{
+	char path[PATH_MAX];
+	size_t size;
+	int status;
+	int fd;
+
+	status = snprintf(path, PATH_MAX, "%s" LAZY_INDEX_NAME, prefix);
+	if (status < 0 || status >= PATH_MAX) {
+		note(NULL, ERROR, INTERNAL, "path to the lazy index is too long");
+		return -1;
+	}
+
+	qsort(entries, header->nb_entries, sizeof(LazyIndexEntry), compare_lazy_index_entries);
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+	if (fd < 0) {
+		note(NULL, ERROR, SYSTEM, "can't create %s", path);
+		return -1;
+	}
+
+	size = header->nb_entries * sizeof(LazyIndexEntry);
+	if (   write(fd, header, sizeof(LazyIndexHeader)) != sizeof(LazyIndexHeader)
+	    || write(fd, entries, size) != (ssize_t) size) {
+		note(NULL, ERROR, SYSTEM, "can't write %s", path);
+		close(fd);
+		return -1;
+	}
+
+	close(fd);
+	note(NULL, INFO, USER, "indexed: %s (%" PRIu64 " entries)", path, header->nb_entries);
+	return 0;
+}
+
+/**
+ * Extract the given @archive into the current working directory,
+ * except the content of the regular files of the rootfs: they are
+ * replaced with placeholders and they are indexed so as the content
+ * is extracted on demand by the "care_lazy" extension.  This
+ * function returns -1 if an error occured, otherwise 0.
+ */
+static int lazy_extract_archive(struct archive *archive, LazyIndexHeader *header)
+{
+	LazyIndexEntry *entries = NULL;
+	struct archive_entry *entry;
+	char *prefix = NULL;
+	int flags = get_extract_flags();
+	int result = 0;
+	int status;
+
+	while (archive_read_next_header(archive, &entry) == ARCHIVE_OK) {
+		const char *path = archive_entry_pathname(entry);
+		size_t prefix_length;
+		struct stat statf;
+		size_t length;
+
+		prefix_length = get_rootfs_prefix_length(path);
+
+		/* Hard links and everything that isn't a non-empty
+		 * regular file from the rootfs are extracted as
+		 * usual.  */
+		if (   prefix_length == 0
+		    || archive_entry_filetype(entry) != AE_IFREG
+		    || archive_entry_hardlink(entry) != NULL
+		    || archive_entry_size(entry) <= 0) {
+			status = extract_entry(archive, entry, flags);
+			if (status < 0)
+				result = -1;
+			continue;
 		}
 
-		status2 = archive_read_free(archive);
-		if (status2 != ARCHIVE_OK) {
-			note(NULL, WARNING, INTERNAL, "can't free archive: %s",
-				archive_error_string(archive));
+		/* Its content is skipped by the next call to
+		 * archive_read_next_header().  */
+		status = create_placeholder(entry, &statf);
+		if (status < 0) {
+			result = -1;
+			continue;
+		}
+
+		if (prefix == NULL) {
+			prefix = talloc_strndup(NULL, path, prefix_length);
+			if (prefix == NULL) {
+				note(NULL, ERROR, INTERNAL, "can't allocate memory");
+				result = -1;
+				break;
+			}
 		}
+
+		length = talloc_array_length(entries);
+		if (header->nb_entries == length) {
+			entries = talloc_realloc(prefix, entries, LazyIndexEntry, 2 * length + 64);
+			if (entries == NULL) {
+				note(NULL, ERROR, INTERNAL, "can't allocate memory");
+				result = -1;
+				break;
+			}
+		}
+
+		entries[header->nb_entries].inode = statf.st_ino;
+		entries[header->nb_entries].position = archive_read_header_position(archive);
+		entries[header->nb_entries].size = statf.st_size;
+		entries[header->nb_entries].mtime_sec = statf.st_mtim.tv_sec;
+		entries[header->nb_entries].mtime_nsec = statf.st_mtim.tv_nsec;
+		header->nb_entries++;
+
+		note(NULL, INFO, USER, "deferred: %s", path);
 	}
 
-	TALLOC_FREE(data);
+	if (result == 0 && prefix != NULL)
+		result = write_lazy_index(prefix, header, entries);
+
+	TALLOC_FREE(prefix);
+
+	return result;
+}
+
+/**
+ * Extract lazily the archive stored at the given @path, see
+ * lazy_extract_archive().  This function returns -1 if an error
+ * occurred, otherwise 0.
+ */
+int lazy_extract_archive_from_file(const char *path)
+{
+	LazyIndexHeader header;
+	struct archive *archive;
+	TALLOC_CTX *context;
+	int status;
+
+	memset(&header, 0, sizeof(header));
+	strcpy(header.signature, LAZY_INDEX_SIGNATURE);
+
+	/* The archive will be read again from the rootfs, wherever
+	 * it is.  */
+	if (realpath(path, header.archive) == NULL) {
+		note(NULL, ERROR, SYSTEM, "can't resolve %s", path);
+		return -1;
+	}
+
+	context = talloc_new(NULL);
+	if (context == NULL) {
+		note(NULL, ERROR, INTERNAL, "can't allocate memory");
+		return -1;
+	}
+
+	archive = open_archive_from_file(context, header.archive);
+	if (archive == NULL)
+		status = -1;
+	else
+		status = lazy_extract_archive(archive, &header);
+
+	TALLOC_FREE(context);
 
 	return status;
 }
@@ -24,6 +24,10 @@
 #define EXTRACT_H
 
 #include <stdint.h>
+#include <limits.h>
+#include <talloc.h>
+
+#include "extension/extension.h"
 #include "attribute.h"
 
 #define AUTOEXTRACT_SIGNATURE "I_LOVE_PIZZA"
@@ -33,6 +37,34 @@ typedef struct {
 	uint64_t size;
 } PACKED AutoExtractInfo;
 
+/* Index of the regular files left unextracted by
+ * lazy_extract_archive_from_file(), stored next to "rootfs/".  */
+#define LAZY_INDEX_NAME "lazy-index"
+#define LAZY_INDEX_SIGNATURE "CARE_LAZY_INDEX_2"
+
+typedef struct {
+	char signature[sizeof(LAZY_INDEX_SIGNATURE)];
+	char archive[PATH_MAX];
+	uint64_t nb_entries;
+} PACKED LazyIndexHeader;
+
+/* Entries are sorted by inode.  The size and the modification time
+ * of the placeholder tell it apart from a new file that reuses the
+ * same inode.  */
+typedef struct {
+	uint64_t inode;
+	uint64_t position;
+	uint64_t size;
+	int64_t  mtime_sec;
+	int64_t  mtime_nsec;
+} PACKED LazyIndexEntry;
+
+struct archive;
+
 extern int WEAK extract_archive_from_file(const char *path);
+extern int WEAK lazy_extract_archive_from_file(const char *path);
+extern struct archive *open_archive_from_file(TALLOC_CTX *context, const char *path);
+extern int WEAK care_lazy_callback(Extension *extension, ExtensionEvent event,
+				intptr_t d1, intptr_t d2);
 
 #endif /* EXTRACT_H */
@@ -30,6 +30,8 @@
 #include <string.h>       /* strcpy(3), */
 #include <endian.h>       /* htobe64(3), */
 #include <assert.h>       /* assert(3), */
+#include <inttypes.h>     /* PRI*, */
+#include <sys/param.h>    /* MAX(), */
 
 #include "extension/care/final.h"
 #include "extension/care/care.h"
@@ -198,6 +200,24 @@ static int archive_re_execute_sh(Care *care)
 	N("fi");
 	N("");
 
+	/* The rootfs of a delta archive is layered over the one of its
+	 * base archive, expected to be extracted alongside.  */
+	if (care->base != NULL) {
+		N("BASE=\"${CARE_BASE-$(dirname $0)/../%s}\"", care->base->prefix);
+		N("if [ ! -d \"$BASE/rootfs\" ]; then");
+		N("    echo \"care: this archive is a delta of '%s',\"", care->base->archive);
+		N("    echo \"care: please extract it alongside, or set CARE_BASE to its directory.\"");
+		N("    exit 1");
+		N("fi");
+		N("");
+	}
+
+	N("LAZY_INDEX=");
+	N("if [ -e \"$(dirname $0)/%s\" ]; then", LAZY_INDEX_NAME);
+	N("    LAZY_INDEX=\"$(dirname $0)/%s\"", LAZY_INDEX_NAME);
+	N("fi");
+	N("");
+
 	N("if [ x$PROOT_NO_SECCOMP != x ]; then");
 	N("    PROOT_NO_SECCOMP=\"PROOT_NO_SECCOMP=$PROOT_NO_SECCOMP\"");
 	N("fi");
@@ -220,6 +240,7 @@ static int archive_re_execute_sh(Care *care)
 	}
 
 	C("\"${PROOT-$(dirname $0)/proot}\"");
+	C("${LAZY_INDEX:+--care-index=\"$LAZY_INDEX\"}");
 
 	if (care->volatile_paths != NULL) {
 		/* If a volatile path is relative to $HOME, use an
@@ -255,7 +276,12 @@ static int archive_re_execute_sh(Care *care)
 
 	C("-i %d:%d", getuid(), getgid());
 	C("-w '%s' ", care->initial_cwd);
-	C("-r \"$(dirname $0)/rootfs\"");
+	if (care->base != NULL) {
+		C("-r \"$BASE/rootfs\"");
+		C("-O \"$(dirname $0)/rootfs\"");
+	}
+	else
+		C("-r \"$(dirname $0)/rootfs\"");
 
 	/* In case the program retrieves its DSOs from /proc/self/maps
 	 * (eg. VLC). */
@@ -286,7 +312,7 @@ static int archive_re_execute_sh(Care *care)
  */
 static int archive_concealed_accesses_txt(const Care *care)
 {
-	const Item *item;
+	const Entry *entry;
 	FILE *file;
 
 	if (care->concealed_accesses == NULL)
@@ -299,12 +325,51 @@ static int archive_concealed_accesses_txt(const Care *care)
 		return -1;
 	}
 
-	STAILQ_FOREACH(item, care->concealed_accesses, link)
-		N("%s", (char *) item->load);
+	for (entry = care->concealed_accesses; entry != NULL; entry = entry->hh.next)
+		N("%s", entry->path);
 
 	return archive_close_file(care, file, "concealed-accesses.txt");
 }
 
+/**
+ * Archive the "base-manifest.txt" file in @care->archive, that is,
+ * the base archive and the files reused from it.  This function
+ * returns < 0 if an error occured, 0 otherwise.  Note: this function
+ * is called in @care's destructor.
+ */
+static int archive_base_manifest_txt(const Care *care)
+{
+	const BaseEntry *entry;
+	FILE *file;
+
+	if (care->base == NULL)
+		return 0;
+
+	file = open_temp_file(NULL, "care");
+	if (file == NULL) {
+		note(NULL, WARNING, INTERNAL,
+			"can't create temporary file for '%s'", BASE_MANIFEST_NAME);
+		return -1;
+	}
+
+	N("# base archive: %s", care->base->archive);
+	N("# base prefix: %s", care->base->prefix);
+
+	/* Contents are compared with the base archive by the
+	 * archiving worker.  */
+	wait_for_all_archiving(care->archive);
+
+	care->base->nb_reused = 0;
+	for (entry = care->base->entries; entry != NULL; entry = entry->hh.next) {
+		if (entry->is_reused) {
+			N("%s", entry->path);
+			care->base->nb_reused++;
+		}
+	}
+
+	return archive_close_file(care, file, BASE_MANIFEST_NAME);
+}
+
 /**
  * Archive the "README.txt" file in @care->archive.  This function
  * returns < 0 if an error occured, 0 otherwise.  Note: this function
@@ -419,6 +484,11 @@ int finalize_care(Care *care)
 	if (status < 0)
 		note(NULL, WARNING, INTERNAL, "can't archive 'concealed-accesses.txt'");
 
+	/* Generate & archive the "base-manifest.txt" file. */
+	status = archive_base_manifest_txt(care);
+	if (status < 0)
+		note(NULL, WARNING, INTERNAL, "can't archive '%s'", BASE_MANIFEST_NAME);
+
 	/* Generate & archive the "README.txt" file. */
 	status = archive_readme_txt(care);
 	if (status < 0)
@@ -463,6 +533,22 @@ int finalize_care(Care *care)
 	else
 		extractor = NULL;
 
+	if (care->archive->stats.nb_duplicates > 0) {
+		const Archive *archive = care->archive;
+		uint64_t stored_size;
+
+		stored_size = archive->stats.content_size - archive->stats.saved_size;
+
+		note(NULL, INFO, USER,
+			"----------------------------------------------------------------------");
+		note(NULL, INFO, USER,
+			"Deduplication: %" PRIu64 " of %" PRIu64 " files stored as hardlinks,"
+			" %" PRIu64 " KB saved (ratio %.2f).",
+			archive->stats.nb_duplicates, archive->stats.nb_files,
+			archive->stats.saved_size / 1024,
+			(double) archive->stats.content_size / (double) MAX(stored_size, 1));
+	}
+
 	note(NULL, INFO, USER,
 		"----------------------------------------------------------------------");
 	note(NULL, INFO, USER, "Hints:");
@@ -472,5 +558,10 @@ int finalize_care(Care *care)
 	if (extractor != NULL)
 		note(NULL, INFO, USER, "  - run %s to extract the output archive correctly.", extractor);
 
+	if (care->base != NULL)
+		note(NULL, INFO, USER,
+			"  - this is a delta of '%s' (%zu files reused), extract both alongside.",
+			care->base->archive, care->base->nb_reused);
+
 	return 0;
 }
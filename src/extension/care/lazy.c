@@ -0,0 +1,329 @@
+/* -*- c-set-style: "K&R"; c-basic-offset: 8 -*-
+ *
+ * This file is part of PRoot.
+ *
+ * Copyright (C) 2015 STMicroelectronics
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <sys/types.h>  /* open(2), lstat(2), */
+#include <sys/stat.h>   /* open(2), lstat(2), chmod(2), */
+#include <fcntl.h>      /* open(2), O_*, AT_*, */
+#include <unistd.h>     /* read(2), close(2), */
+#include <string.h>     /* str*(3), memcmp(3), */
+#include <errno.h>      /* E*, */
+#include <limits.h>     /* PATH_MAX, */
+#include <inttypes.h>   /* PRI*, */
+#include <archive.h>    /* archive_*(3), */
+#include <archive_entry.h> /* archive_entry*(3), */
+#include <talloc.h>     /* talloc_*, */
+
+#include "extension/care/extract.h"
+#include "extension/extension.h"
+#include "syscall/sysnum.h"
+#include "tracee/tracee.h"
+#include "cli/note.h"
+
+/* This extension extracts on demand the content of the files left
+ * unextracted by "care -X", see lazy_extract_archive_from_file().
+ * Everything else -- metadata, directories, symlinks, ... -- is
+ * already on the disk, hence served natively.  */
+
+typedef struct {
+	/* Content of the index.  */
+	LazyIndexHeader header;
+	LazyIndexEntry *entries;
+
+	/* The archive is kept opened since it might not be reachable
+	 * by its path anymore, for instance with --kernel-bindings.  */
+	int archive_fd;
+
+	/* Current reading position in the archive.  */
+	TALLOC_CTX *context;
+	struct archive *archive;
+	int64_t position;
+} Config;
+
+/**
+ * Close the archive referenced by @config.
+ *
+ * Note: this is a Talloc destructor.
+ */
+static int close_archive(Config *config)
+{
+	TALLOC_FREE(config->context);
+
+	if (config->archive_fd >= 0)
+		close(config->archive_fd);
+	config->archive_fd = -1;
+
+	return 0;
+}
+
+/**
+ * Load the index stored at the given @path into @config.  This
+ * function returns -1 if an error occurred, otherwise 0.
+ */
+static int load_index(const Tracee *tracee, Config *config, const char *path)
+{
+	struct stat statf;
+	size_t size;
+	int status = -1;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		note(tracee, ERROR, SYSTEM, "can't open %s", path);
+		return -1;
+	}
+
+	if (   read(fd, &config->header, sizeof(LazyIndexHeader)) != sizeof(LazyIndexHeader)
+	    || memcmp(config->header.signature, LAZY_INDEX_SIGNATURE,
+		      sizeof(LAZY_INDEX_SIGNATURE)) != 0
+	    || fstat(fd, &statf) < 0) {
+		note(tracee, ERROR, USER, "%s: not a valid lazy index", path);
+		goto end;
+	}
+
+	size = config->header.nb_entries * sizeof(LazyIndexEntry);
+	if (statf.st_size != (off_t) (sizeof(LazyIndexHeader) + size)) {
+		note(tracee, ERROR, USER, "%s: truncated lazy index", path);
+		goto end;
+	}
+
+	config->entries = talloc_array(config, LazyIndexEntry, config->header.nb_entries);
+	if (config->entries == NULL) {
+		note(tracee, ERROR, INTERNAL, "can't allocate memory");
+		goto end;
+	}
+
+	if (read(fd, config->entries, size) != (ssize_t) size) {
+		note(tracee, ERROR, SYSTEM, "can't read %s", path);
+		goto end;
+	}
+
+	config->header.archive[PATH_MAX - 1] = '\0';
+	config->archive_fd = open(config->header.archive, O_RDONLY | O_CLOEXEC);
+	if (config->archive_fd < 0) {
+		note(tracee, ERROR, SYSTEM, "can't open %s", config->header.archive);
+		goto end;
+	}
+
+	status = 0;
+end:
+	close(fd);
+	return status;
+}
+
+/**
+ * Return the index entry of the file with the given @inode, or NULL
+ * if it isn't indexed.
+ */
+static const LazyIndexEntry *lookup_index(const Config *config, uint64_t inode)
+{
+	size_t low = 0;
+	size_t high = config->header.nb_entries;
+
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+
+		if (config->entries[middle].inode == inode)
+			return &config->entries[middle];
+
+		if (config->entries[middle].inode < inode)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return NULL;
+}
+
+/**
+ * Move to the entry of the archive at the given @position.  The
+ * archive is read again from the beginning if this position was
+ * already passed.  This function returns -1 if an error occurred,
+ * otherwise 0.
+ */
+static int seek_archive(const Tracee *tracee, Config *config, int64_t position)
+{
+	struct archive_entry *entry;
+	char path[PATH_MAX];
+
+	if (config->archive == NULL || config->position >= position) {
+		TALLOC_FREE(config->context);
+
+		config->context = talloc_new(config);
+		if (config->context == NULL)
+			return -1;
+
+		snprintf(path, sizeof(path), "/proc/self/fd/%d", config->archive_fd);
+		config->archive = open_archive_from_file(config->context, path);
+		if (config->archive == NULL)
+			return -1;
+		config->position = -1;
+	}
+
+	while (config->position < position) {
+		if (archive_read_next_header(config->archive, &entry) != ARCHIVE_OK) {
+			note(tracee, ERROR, INTERNAL, "%s: %s", config->header.archive,
+				archive_error_string(config->archive) ?: "unexpected end");
+			config->archive = NULL;
+			return -1;
+		}
+		config->position = archive_read_header_position(config->archive);
+	}
+
+	if (config->position != position) {
+		note(tracee, ERROR, INTERNAL, "%s: no entry at %" PRId64,
+			config->header.archive, position);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Extract the content of the host @path -- described by @statl --
+ * from the archive at the given @position.  This function returns
+ * -1 if an error occurred, otherwise 0.
+ */
+static int extract_content(const Tracee *tracee, Config *config, const char *path,
+			const struct stat *statl, int64_t position)
+{
+	struct timespec times[2];
+	bool is_writable = true;
+	int status;
+	int fd;
+
+	status = seek_archive(tracee, config, position);
+	if (status < 0)
+		return -1;
+
+	fd = open(path, O_WRONLY | O_CLOEXEC);
+	if (fd < 0 && errno == EACCES) {
+		is_writable = false;
+		(void) chmod(path, statl->st_mode | S_IWUSR);
+		fd = open(path, O_WRONLY | O_CLOEXEC);
+	}
+	if (fd < 0) {
+		note(tracee, WARNING, SYSTEM, "can't extract %s", path);
+		return -1;
+	}
+
+	status = archive_read_data_into_fd(config->archive, fd);
+	if (status != ARCHIVE_OK)
+		note(tracee, WARNING, INTERNAL, "can't extract %s: %s", path,
+			archive_error_string(config->archive));
+
+	if (!is_writable)
+		(void) fchmod(fd, statl->st_mode & 07777);
+
+	times[0] = statl->st_atim;
+	times[1] = statl->st_mtim;
+	(void) futimens(fd, times);
+
+	close(fd);
+
+	VERBOSE(tracee, 1, "lazily extracted: %s", path);
+	return status == ARCHIVE_OK ? 0 : -1;
+}
+
+/**
+ * Extract the content of the host @path if it is a placeholder and
+ * if the current syscall of @tracee is about to read it.
+ */
+static void handle_translated_path(const Tracee *tracee, Config *config, const char *path)
+{
+	const LazyIndexEntry *entry;
+	struct stat statl;
+	int status;
+
+	switch (get_sysnum(tracee, ORIGINAL)) {
+	case PR_open:
+	case PR_openat:
+	case PR_creat:
+	case PR_execve:
+	case PR_truncate:
+	case PR_truncate64:
+	case PR_uselib:
+		break;
+
+	default:
+		return;
+	}
+
+	/* Placeholders are sparse, that is, they don't use any disk
+	 * block yet.  */
+	status = lstat(path, &statl);
+	if (status < 0 || !S_ISREG(statl.st_mode) || statl.st_size == 0 || statl.st_blocks != 0)
+		return;
+
+	entry = lookup_index(config, statl.st_ino);
+	if (entry == NULL)
+		return;
+
+	/* A file created since then may have reused the inode of a
+	 * placeholder that was removed.  */
+	if (   (uint64_t) statl.st_size != entry->size
+	    || statl.st_mtim.tv_sec     != entry->mtime_sec
+	    || statl.st_mtim.tv_nsec    != entry->mtime_nsec)
+		return;
+
+	(void) extract_content(tracee, config, path, &statl, entry->position);
+}
+
+/**
+ * Handler for this @extension.  It is triggered each time an @event
+ * occurred.  See ExtensionEvent for the meaning of @data1 and @data2.
+ */
+int care_lazy_callback(Extension *extension, ExtensionEvent event,
+		intptr_t data1, intptr_t data2 UNUSED)
+{
+	switch (event) {
+	case INITIALIZATION: {
+		Config *config;
+		int status;
+
+		extension->config = talloc_zero(extension, Config);
+		if (extension->config == NULL)
+			return -1;
+
+		config = extension->config;
+		config->archive_fd = -1;
+		talloc_set_destructor(config, close_archive);
+
+		status = load_index(TRACEE(extension), config, (const char *) data1);
+		if (status < 0)
+			return -1;
+
+		return 0;
+	}
+
+	case INHERIT_PARENT: /* Inheritable for sub reconfiguration ...  */
+		return 0;    /* ... and the configuration is shared.  */
+
+	case TRANSLATED_PATH: {
+		Config *config = talloc_get_type_abort(extension->config, Config);
+		handle_translated_path(TRACEE(extension), config, (const char *) data1);
+		return 0;
+	}
+
+	default:
+		return 0;
+	}
+}
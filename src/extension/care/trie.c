@@ -0,0 +1,153 @@
+/* -*- c-set-style: "K&R"; c-basic-offset: 8 -*-
+ *
+ * This file is part of PRoot.
+ *
+ * Copyright (C) 2015 STMicroelectronics
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <string.h>    /* strlen(3), strchrnul(3), */
+#include <talloc.h>    /* talloc*, */
+
+#include "uthash.h"    /* HASH*, UT_hash_handle, */
+#include "extension/care/trie.h"
+
+/* Node of a trie indexed by path components.  */
+struct trie {
+	UT_hash_handle hh;
+	const char *name;
+	struct trie *children;
+
+	/* Value associated to the path that ends here, if any.  */
+	const void *value;
+};
+
+/**
+ * Release the table of the children of @node, these latter are
+ * released by talloc.
+ */
+static int clear_children(Trie *node)
+{
+	HASH_CLEAR(hh, node->children);
+	return 0;
+}
+
+/**
+ * Allocate a new empty trie attached to the given @context.  This
+ * function returns NULL if an error occurred.
+ */
+Trie *new_trie(TALLOC_CTX *context)
+{
+	Trie *root;
+
+	root = talloc_zero(context, Trie);
+	if (root == NULL)
+		return NULL;
+
+	talloc_set_destructor(root, clear_children);
+	return root;
+}
+
+/**
+ * Associate @value to the canonicalized absolute @path in the trie
+ * @root.  This function returns -1 if an error occurred, otherwise 0.
+ */
+int trie_insert(Trie *root, const char *path, const void *value)
+{
+	const char *component = path;
+	Trie *node = root;
+
+	while (1) {
+		const char *end;
+		Trie *child;
+		size_t length;
+
+		while (*component == '/')
+			component++;
+		if (*component == '\0')
+			break;
+
+		end = strchrnul(component, '/');
+		length = end - component;
+
+		HASH_FIND(hh, node->children, component, length, child);
+		if (child == NULL) {
+			child = new_trie(node);
+			if (child == NULL)
+				return -1;
+
+			child->name = talloc_strndup(child, component, length);
+			if (child->name == NULL)
+				return -1;
+
+			HASH_ADD_KEYPTR(hh, node->children, child->name, length, child);
+		}
+
+		node = child;
+		component = end;
+	}
+
+	node->value = value;
+	return 0;
+}
+
+/**
+ * Return the value associated to the longest path of the trie @root
+ * that is equal to, or a parent of, the canonicalized absolute
+ * @path.  The length of this matching part of @path is stored in
+ * @length, if not NULL.  This function returns NULL if there's no
+ * such path.
+ */
+const void *trie_lookup(const Trie *root, const char *path, size_t *length)
+{
+	const char *component = path;
+	const Trie *node = root;
+	const void *value = NULL;
+
+	if (root->value != NULL) {
+		value = root->value;
+		if (length != NULL)
+			*length = 1;
+	}
+
+	while (1) {
+		const char *end;
+		Trie *child;
+
+		while (*component == '/')
+			component++;
+		if (*component == '\0')
+			break;
+
+		end = strchrnul(component, '/');
+
+		HASH_FIND(hh, node->children, component, (size_t) (end - component), child);
+		if (child == NULL)
+			break;
+
+		node = child;
+		component = end;
+
+		if (node->value != NULL) {
+			value = node->value;
+			if (length != NULL)
+				*length = end - path;
+		}
+	}
+
+	return value;
+}
@@ -0,0 +1,35 @@
+/* -*- c-set-style: "K&R"; c-basic-offset: 8 -*-
+ *
+ * This file is part of PRoot.
+ *
+ * Copyright (C) 2015 STMicroelectronics
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef CARE_TRIE_H
+#define CARE_TRIE_H
+
+#include <stddef.h>
+#include <talloc.h>
+
+typedef struct trie Trie;
+
+extern Trie *new_trie(TALLOC_CTX *context);
+extern int trie_insert(Trie *root, const char *path, const void *value);
+extern const void *trie_lookup(const Trie *root, const char *path, size_t *length);
+
+#endif /* CARE_TRIE_H */
@@ -135,6 +135,14 @@ typedef enum {
     /* Called for every already opened file descriptor:
      * "(const char *)" data1" is the path, "(int) data2" is the file descriptor" */
     ALREADY_OPENED_FD,
+
+	/* A host path is about to be detranslated, that is, converted
+	 * into a guest path: "(char *) data1" is the host path and
+	 * "(char *) data2" is the host path of the symlink it comes
+	 * from, or NULL.  Both can be substituted by the extension.
+	 * If the extension returns < 0, then PRoot reports this errno
+	 * as-is.  */
+	DETRANSLATE_PATH,
 } ExtensionEvent;
 
 #define CLONE_RECONF ((word_t) -1)
@@ -192,6 +200,9 @@ extern int fake_id0_callback(Extension *extension, ExtensionEvent event, intptr_
 extern int care_callback(Extension *extension, ExtensionEvent event, intptr_t d1, intptr_t d2);
 extern int python_callback(Extension *extension, ExtensionEvent event, intptr_t d1, intptr_t d2);
 extern int link2symlink_callback(Extension *extension, ExtensionEvent event, intptr_t d1, intptr_t d2);
+extern int overlay_callback(Extension *extension, ExtensionEvent event, intptr_t d1, intptr_t d2);
+extern int trace_callback(Extension *extension, ExtensionEvent event, intptr_t d1, intptr_t d2);
+extern int trace_replay_callback(Extension *extension, ExtensionEvent event, intptr_t d1, intptr_t d2);
 
 /* Added extensions.  */
 /**
@@ -0,0 +1,336 @@
+/* -*- c-set-style: "K&R"; c-basic-offset: 8 -*-
+ *
+ * This file is part of PRoot.
+ *
+ * Copyright (C) 2015 STMicroelectronics
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <sys/types.h> /* open(2), ftruncate(2), */
+#include <sys/stat.h>  /* open(2), fstat(2), */
+#include <sys/mman.h>  /* mmap(2), mremap(2), munmap(2), */
+#include <sys/file.h>  /* flock(2), */
+#include <fcntl.h>     /* open(2), */
+#include <unistd.h>    /* ftruncate(2), close(2), */
+#include <string.h>    /* memcpy(3), memset(3), memcmp(3), */
+#include <errno.h>     /* errno, */
+#include <talloc.h>    /* talloc*, */
+
+#include "extension/fake_id0/db.h"
+#include "cli/note.h"
+
+#define DB_INITIAL_CAPACITY 4096
+
+struct database {
+	int fd;		/* -1 for an in-memory database.  */
+	DbHeader *header;
+	FakeInode *inodes;
+	size_t mapping_size;
+};
+
+/**
+ * Return the size of the mapping of a database with @capacity slots.
+ */
+static size_t get_mapping_size(uint64_t capacity)
+{
+	return sizeof(DbHeader) + capacity * sizeof(FakeInode);
+}
+
+/**
+ * Return the first slot to probe for the inode (@dev, @ino) in
+ * @database.
+ */
+static uint64_t get_slot(const Database *database, uint64_t dev, uint64_t ino)
+{
+	uint64_t hash = ino ^ (dev * 0x9E3779B97F4A7C15ULL);
+
+	/* Finalizer of splitmix64.  */
+	hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+	hash ^= hash >> 31;
+
+	return hash & (database->header->capacity - 1);
+}
+
+/**
+ * Unmap and close @database.  Note: this is a Talloc destructor.
+ */
+static int close_database(Database *database)
+{
+	if (database->header != NULL)
+		(void) munmap(database->header, database->mapping_size);
+
+	if (database->fd >= 0)
+		(void) close(database->fd);
+
+	return 0;
+}
+
+/**
+ * Map @size bytes of @database, or resize its current mapping.  This
+ * function returns -errno if an error occurred, otherwise 0.
+ */
+static int map_database(Database *database, size_t size)
+{
+	void *mapping;
+	int status;
+
+	if (database->fd >= 0) {
+		status = ftruncate(database->fd, size);
+		if (status < 0)
+			return -errno;
+	}
+
+	if (database->header == NULL)
+		mapping = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			database->fd >= 0 ? MAP_SHARED : MAP_PRIVATE | MAP_ANONYMOUS,
+			database->fd, 0);
+	else
+		mapping = mremap(database->header, database->mapping_size, size, MREMAP_MAYMOVE);
+	if (mapping == MAP_FAILED)
+		return -errno;
+
+	database->header       = mapping;
+	database->inodes       = (FakeInode *) (database->header + 1);
+	database->mapping_size = size;
+
+	return 0;
+}
+
+/**
+ * Double the capacity of @database then re-insert all its inodes.
+ * This function returns -errno if an error occurred, otherwise 0.
+ */
+static int grow_database(Database *database)
+{
+	uint64_t capacity = database->header->capacity;
+	FakeInode *inodes;
+	uint64_t i;
+	int status;
+
+	inodes = talloc_memdup(database, database->inodes, capacity * sizeof(FakeInode));
+	if (inodes == NULL)
+		return -ENOMEM;
+
+	status = map_database(database, get_mapping_size(2 * capacity));
+	if (status < 0) {
+		TALLOC_FREE(inodes);
+		return status;
+	}
+
+	database->header->capacity   = 2 * capacity;
+	database->header->nb_entries = 0;
+	memset(database->inodes, 0, 2 * capacity * sizeof(FakeInode));
+
+	for (i = 0; i < capacity; i++) {
+		FakeInode *inode;
+
+		if (inodes[i].flags == 0)
+			continue;
+
+		inode = get_inode(database, inodes[i].dev, inodes[i].ino);
+		*inode = inodes[i];
+	}
+
+	TALLOC_FREE(inodes);
+	return 0;
+}
+
+/**
+ * Open the meta-data database stored in @path, or create it if it
+ * doesn't exist yet.  The database lives in memory only if @path is
+ * NULL.  This function returns NULL if an error occurred.
+ */
+Database *open_database(const Tracee *tracee, TALLOC_CTX *context, const char *path)
+{
+	Database *database;
+	struct stat statf;
+	int status;
+
+	database = talloc_zero(context, Database);
+	if (database == NULL)
+		return NULL;
+
+	database->fd = -1;
+	talloc_set_destructor(database, close_database);
+
+	if (path == NULL)
+		goto create;
+
+	database->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (database->fd < 0) {
+		note(tracee, ERROR, SYSTEM, "can't open '%s'", path);
+		goto error;
+	}
+
+	/* The database isn't designed to be shared.  */
+	status = flock(database->fd, LOCK_EX | LOCK_NB);
+	if (status < 0) {
+		note(tracee, ERROR, SYSTEM, "can't lock '%s'", path);
+		goto error;
+	}
+
+	status = fstat(database->fd, &statf);
+	if (status < 0) {
+		note(tracee, ERROR, SYSTEM, "can't stat '%s'", path);
+		goto error;
+	}
+
+	if (statf.st_size == 0)
+		goto create;
+
+	if ((size_t) statf.st_size < sizeof(DbHeader))
+		goto invalid;
+
+	status = map_database(database, statf.st_size);
+	if (status < 0) {
+		errno = -status;
+		note(tracee, ERROR, SYSTEM, "can't map '%s'", path);
+		goto error;
+	}
+
+	if (memcmp(database->header->signature, DB_SIGNATURE, sizeof(database->header->signature)) != 0
+	    || database->header->version != DB_VERSION
+	    || database->header->entry_size != sizeof(FakeInode)
+	    || database->header->capacity == 0
+	    || (database->header->capacity & (database->header->capacity - 1)) != 0
+	    || get_mapping_size(database->header->capacity) != (size_t) statf.st_size)
+		goto invalid;
+
+	return database;
+
+create:
+	status = map_database(database, get_mapping_size(DB_INITIAL_CAPACITY));
+	if (status < 0) {
+		errno = -status;
+		note(tracee, ERROR, SYSTEM, "can't map the meta-data database");
+		goto error;
+	}
+
+	memcpy(database->header->signature, DB_SIGNATURE, sizeof(database->header->signature));
+	database->header->version    = DB_VERSION;
+	database->header->entry_size = sizeof(FakeInode);
+	database->header->capacity   = DB_INITIAL_CAPACITY;
+	database->header->nb_entries = 0;
+
+	return database;
+
+invalid:
+	note(tracee, ERROR, USER, "'%s' is not a valid meta-data database", path);
+error:
+	TALLOC_FREE(database);
+	return NULL;
+}
+
+/**
+ * Return the number of inodes stored in @database.
+ */
+uint64_t get_nb_inodes(const Database *database)
+{
+	return database->header->nb_entries;
+}
+
+/**
+ * Return the entry of the inode (@dev, @ino) in @database, or NULL
+ * if it isn't stored.
+ */
+FakeInode *lookup_inode(Database *database, uint64_t dev, uint64_t ino)
+{
+	uint64_t mask = database->header->capacity - 1;
+	uint64_t slot;
+
+	for (slot = get_slot(database, dev, ino); ; slot = (slot + 1) & mask) {
+		FakeInode *inode = &database->inodes[slot];
+
+		if (inode->flags == 0)
+			return NULL;
+
+		if (inode->dev == dev && inode->ino == ino)
+			return inode;
+	}
+}
+
+/**
+ * Return the entry of the inode (@dev, @ino) in @database, it is
+ * created -- with no FAKE_* overrides -- if it isn't stored yet.  The returned
+ * pointer is valid until the next call to this function.  This
+ * function returns NULL if an error occurred.
+ */
+FakeInode *get_inode(Database *database, uint64_t dev, uint64_t ino)
+{
+	uint64_t mask;
+	uint64_t slot;
+	int status;
+
+	/* Keep the load factor below 1/2, so probe sequences stay
+	 * short and there's always a free slot.  */
+	if (2 * (database->header->nb_entries + 1) > database->header->capacity) {
+		status = grow_database(database);
+		if (status < 0)
+			return NULL;
+	}
+
+	mask = database->header->capacity - 1;
+	for (slot = get_slot(database, dev, ino); ; slot = (slot + 1) & mask) {
+		FakeInode *inode = &database->inodes[slot];
+
+		if (inode->flags != 0) {
+			if (inode->dev == dev && inode->ino == ino)
+				return inode;
+			continue;
+		}
+
+		memset(inode, 0, sizeof(FakeInode));
+		inode->dev   = dev;
+		inode->ino   = ino;
+		inode->flags = FAKE_USED;
+
+		database->header->nb_entries++;
+		return inode;
+	}
+}
+
+/**
+ * Remove the inode (@dev, @ino) from @database, if any.
+ */
+void remove_inode(Database *database, uint64_t dev, uint64_t ino)
+{
+	uint64_t mask = database->header->capacity - 1;
+	FakeInode *inode;
+	uint64_t hole;
+	uint64_t slot;
+
+	inode = lookup_inode(database, dev, ino);
+	if (inode == NULL)
+		return;
+
+	/* Backward shift deletion: move back the following entries
+	 * of the cluster that could have been stored in the hole.  */
+	hole = inode - database->inodes;
+	for (slot = (hole + 1) & mask; database->inodes[slot].flags != 0; slot = (slot + 1) & mask) {
+		uint64_t home = get_slot(database, database->inodes[slot].dev, database->inodes[slot].ino);
+
+		/* Unless @home is cyclically in ]hole, slot].  */
+		if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+			database->inodes[hole] = database->inodes[slot];
+			hole = slot;
+		}
+	}
+
+	memset(&database->inodes[hole], 0, sizeof(FakeInode));
+	database->header->nb_entries--;
+}
@@ -0,0 +1,79 @@
+/* -*- c-set-style: "K&R"; c-basic-offset: 8 -*-
+ *
+ * This file is part of PRoot.
+ *
+ * Copyright (C) 2015 STMicroelectronics
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef FAKE_ID0_DB_H
+#define FAKE_ID0_DB_H
+
+#include <stdint.h>
+#include <talloc.h>
+
+#include "tracee/tracee.h"
+#include "attribute.h"
+
+/* Layout of the file of the meta-data database, see "proot --db":
+ *
+ *   - DbHeader;
+ *   - FakeInode[capacity], an open-addressing hash table keyed by
+ *     (dev, ino) with linear probing.
+ *
+ * All fields use the host endianness.  */
+
+#define DB_SIGNATURE	"PRFAKEDB"
+#define DB_VERSION	1
+
+typedef struct {
+	char signature[8];
+	uint32_t version;
+	uint32_t entry_size;
+	uint64_t capacity;
+	uint64_t nb_entries;
+	uint8_t padding[32];
+} PACKED DbHeader;
+
+/* Which fields of a FakeInode override the host meta-data.  */
+#define FAKE_UID	0x1
+#define FAKE_GID	0x2
+#define FAKE_PERMS	0x4	/* Permission bits of "mode".  */
+#define FAKE_TYPE	0x8	/* File type of "mode", and "rdev".  */
+#define FAKE_USED	0x80	/* Slot in use.  */
+
+typedef struct {
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t rdev;
+	uint32_t uid;
+	uint32_t gid;
+	uint32_t mode;
+	uint32_t flags;		/* FAKE_*, 0 for a free slot.  */
+} PACKED FakeInode;
+
+typedef struct database Database;
+
+extern Database *open_database(const Tracee *tracee, TALLOC_CTX *context, const char *path);
+extern uint64_t get_nb_inodes(const Database *database);
+extern FakeInode *lookup_inode(Database *database, uint64_t dev, uint64_t ino);
+extern FakeInode *get_inode(Database *database, uint64_t dev, uint64_t ino);
+extern void remove_inode(Database *database, uint64_t dev, uint64_t ino);
+
+extern int use_fake_id0_database(Tracee *tracee, const char *path);
+
+#endif /* FAKE_ID0_DB_H */
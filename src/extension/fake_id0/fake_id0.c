@@ -25,13 +25,20 @@
 #include <errno.h>       /* E*, */
 #include <sys/stat.h>    /* chmod(2), stat(2) */
 #include <sys/types.h>   /* uid_t, gid_t, get*id(2), */
+#include <sys/sysmacros.h> /* makedev(3), major(3), minor(3), */
 #include <unistd.h>      /* get*id(2),  */
 #include <sys/ptrace.h>  /* linux.git:c0a3a20b  */
 #include <linux/audit.h> /* AUDIT_ARCH_*,  */
 #include <string.h>      /* memcpy(3), */
 #include <stdlib.h>      /* strtol(3), */
+#include <stdio.h>       /* snprintf(3), */
 #include <linux/auxvec.h>/* AT_,  */
+#include <fcntl.h>       /* O_*, */
+#include <time.h>        /* clock_gettime(2), */
+#include <limits.h>      /* PATH_MAX, */
+#include <talloc.h>      /* talloc*, */
 
+#include "uthash.h"
 #include "extension/extension.h"
 #include "syscall/syscall.h"
 #include "syscall/sysnum.h"
@@ -42,6 +49,8 @@
 #include "tracee/mem.h"
 #include "execve/auxv.h"
 #include "path/binding.h"
+#include "extension/fake_id0/db.h"
+#include "cli/note.h"
 #include "arch.h"
 
 typedef struct {
@@ -54,6 +63,26 @@ typedef struct {
 	gid_t egid;
 	gid_t sgid;
 	gid_t fsgid;
+
+	/* Ownership, modes and device nodes set by the tracees, shared
+	 * by all of them.  */
+	Database *database;
+
+	/* Inode the current syscall is removing, if it's stored in
+	 * the database.  */
+	struct {
+		uint64_t dev;
+		uint64_t ino;
+		bool pending;
+	} removed;
+
+	/* Device node the current syscall is creating, as a regular
+	 * file.  */
+	struct {
+		mode_t mode;
+		dev_t rdev;
+		bool pending;
+	} device;
 } Config;
 
 typedef struct {
@@ -78,20 +107,18 @@ static FilteredSysnum filtered_sysnums[] = {
 	{ PR_fstat,		FILTER_SYSEXIT },
 	{ PR_fstat64,		FILTER_SYSEXIT },
 	{ PR_fstatat64,		FILTER_SYSEXIT },
-	{ PR_getegid,		FILTER_SYSEXIT },
-	{ PR_getegid32,		FILTER_SYSEXIT },
-	{ PR_geteuid,		FILTER_SYSEXIT },
-	{ PR_geteuid32,		FILTER_SYSEXIT },
-	{ PR_getgid,		FILTER_SYSEXIT },
-	{ PR_getgid32,		FILTER_SYSEXIT },
-	{ PR_getgroups,		FILTER_SYSEXIT },
-	{ PR_getgroups32,	FILTER_SYSEXIT },
-	{ PR_getresgid,		FILTER_SYSEXIT },
-	{ PR_getresgid32,	FILTER_SYSEXIT },
-	{ PR_getresuid,		FILTER_SYSEXIT },
-	{ PR_getresuid32,	FILTER_SYSEXIT },
-	{ PR_getuid,		FILTER_SYSEXIT },
-	{ PR_getuid32,		FILTER_SYSEXIT },
+	{ PR_getegid,		0 },
+	{ PR_getegid32,		0 },
+	{ PR_geteuid,		0 },
+	{ PR_geteuid32,		0 },
+	{ PR_getgid,		0 },
+	{ PR_getgid32,		0 },
+	{ PR_getresgid,		0 },
+	{ PR_getresgid32,	0 },
+	{ PR_getresuid,		0 },
+	{ PR_getresuid32,	0 },
+	{ PR_getuid,		0 },
+	{ PR_getuid32,		0 },
 	{ PR_lchown,		FILTER_SYSEXIT },
 	{ PR_lchown32,		FILTER_SYSEXIT },
 	{ PR_lstat,		FILTER_SYSEXIT },
@@ -101,24 +128,28 @@ static FilteredSysnum filtered_sysnums[] = {
 	{ PR_newfstatat,	FILTER_SYSEXIT },
 	{ PR_oldlstat,		FILTER_SYSEXIT },
 	{ PR_oldstat,		FILTER_SYSEXIT },
-	{ PR_setfsgid,		FILTER_SYSEXIT },
-	{ PR_setfsgid32,	FILTER_SYSEXIT },
-	{ PR_setfsuid,		FILTER_SYSEXIT },
-	{ PR_setfsuid32,	FILTER_SYSEXIT },
-	{ PR_setgid,		FILTER_SYSEXIT },
-	{ PR_setgid32,		FILTER_SYSEXIT },
+	{ PR_rename,		FILTER_SYSEXIT },
+	{ PR_renameat,		FILTER_SYSEXIT },
+	{ PR_renameat2,		FILTER_SYSEXIT },
+	{ PR_rmdir,		FILTER_SYSEXIT },
+	{ PR_setfsgid,		0 },
+	{ PR_setfsgid32,	0 },
+	{ PR_setfsuid,		0 },
+	{ PR_setfsuid32,	0 },
+	{ PR_setgid,		0 },
+	{ PR_setgid32,		0 },
 	{ PR_setgroups,		FILTER_SYSEXIT },
 	{ PR_setgroups32,	FILTER_SYSEXIT },
-	{ PR_setregid,		FILTER_SYSEXIT },
-	{ PR_setregid32,	FILTER_SYSEXIT },
-	{ PR_setreuid,		FILTER_SYSEXIT },
-	{ PR_setreuid32,	FILTER_SYSEXIT },
-	{ PR_setresgid,		FILTER_SYSEXIT },
-	{ PR_setresgid32,	FILTER_SYSEXIT },
-	{ PR_setresuid,		FILTER_SYSEXIT },
-	{ PR_setresuid32,	FILTER_SYSEXIT },
-	{ PR_setuid,		FILTER_SYSEXIT },
-	{ PR_setuid32,		FILTER_SYSEXIT },
+	{ PR_setregid,		0 },
+	{ PR_setregid32,	0 },
+	{ PR_setreuid,		0 },
+	{ PR_setreuid32,	0 },
+	{ PR_setresgid,		0 },
+	{ PR_setresgid32,	0 },
+	{ PR_setresuid,		0 },
+	{ PR_setresuid32,	0 },
+	{ PR_setuid,		0 },
+	{ PR_setuid32,		0 },
 	{ PR_setxattr,		FILTER_SYSEXIT },
 	{ PR_setdomainname,	FILTER_SYSEXIT },
 	{ PR_sethostname,	FILTER_SYSEXIT },
@@ -129,9 +160,252 @@ static FilteredSysnum filtered_sysnums[] = {
 	{ PR_stat64,		FILTER_SYSEXIT },
 	{ PR_statfs,		FILTER_SYSEXIT },
 	{ PR_statfs64,		FILTER_SYSEXIT },
+	{ PR_unlink,		FILTER_SYSEXIT },
+	{ PR_unlinkat,		FILTER_SYSEXIT },
 	FILTERED_SYSNUM_END,
 };
 
+/* Modes of the host paths recently looked up by override_permissions(),
+ * shared by all tracees.  An entry is trusted for about one second,
+ * then looked up again since the host file-system might be changed by
+ * other processes.  */
+typedef struct {
+	UT_hash_handle hh;
+	char *path;
+	mode_t mode;
+	time_t stamp;
+} CachedMode;
+
+static struct {
+	TALLOC_CTX *context;
+	CachedMode *modes;
+	size_t nb_modes;
+} mode_cache;
+
+#define MODE_CACHE_MAX 4096
+
+/* Accesses required by the current syscall, see required_access().  */
+#define ACCESS_READ	0x1
+#define ACCESS_WRITE	0x2
+#define ACCESS_SEARCH	0x4
+#define ACCESS_PARENT	0x8	/* The parent directory is modified.  */
+
+/**
+ * Return the current time of a coarse monotonic clock, in seconds.
+ */
+static time_t now(void)
+{
+	struct timespec time;
+
+	if (clock_gettime(CLOCK_MONOTONIC_COARSE, &time) < 0)
+		return 0;
+
+	return time.tv_sec;
+}
+
+/**
+ * Return the cache entry for @path, or NULL if it isn't cached or was
+ * looked up too long ago.
+ */
+static CachedMode *lookup_cached_mode(const char *path)
+{
+	CachedMode *entry;
+
+	HASH_FIND_STR(mode_cache.modes, path, entry);
+	if (entry == NULL || entry->stamp != now())
+		return NULL;
+
+	return entry;
+}
+
+/**
+ * Remember that @path has @mode.
+ */
+static void cache_mode(const char *path, mode_t mode)
+{
+	CachedMode *entry;
+
+	HASH_FIND_STR(mode_cache.modes, path, entry);
+	if (entry != NULL) {
+		entry->mode  = mode;
+		entry->stamp = now();
+		return;
+	}
+
+	/* Start over when the cache is full, most of the entries are
+	 * stale anyway.  */
+	if (mode_cache.nb_modes >= MODE_CACHE_MAX || mode_cache.context == NULL) {
+		HASH_CLEAR(hh, mode_cache.modes);
+		TALLOC_FREE(mode_cache.context);
+		mode_cache.nb_modes = 0;
+
+		mode_cache.context = talloc_named_const(NULL, 0, "fake_id0 modes");
+		if (mode_cache.context == NULL)
+			return;
+	}
+
+	entry = talloc_zero(mode_cache.context, CachedMode);
+	if (entry == NULL)
+		return;
+
+	entry->path = talloc_strdup(entry, path);
+	if (entry->path == NULL) {
+		TALLOC_FREE(entry);
+		return;
+	}
+
+	entry->mode  = mode;
+	entry->stamp = now();
+	HASH_ADD_KEYPTR(hh, mode_cache.modes, entry->path, strlen(entry->path), entry);
+	mode_cache.nb_modes++;
+}
+
+/**
+ * Forget the mode of @path, typically because the tracee is changing
+ * it.
+ */
+static void uncache_mode(const char *path)
+{
+	CachedMode *entry;
+
+	HASH_FIND_STR(mode_cache.modes, path, entry);
+	if (entry != NULL)
+		entry->stamp = 0;
+}
+
+/**
+ * Put the mode of @path in @mode, from the cache if possible.  This
+ * function returns -errno if an error occurred, otherwise 0.
+ */
+static int get_mode(const char *path, mode_t *mode)
+{
+	struct stat perms;
+	CachedMode *entry;
+	int status;
+
+	entry = lookup_cached_mode(path);
+	if (entry != NULL) {
+		*mode = entry->mode;
+		return 0;
+	}
+
+	status = stat(path, &perms);
+	if (status < 0)
+		return -errno;
+
+	cache_mode(path, perms.st_mode);
+
+	*mode = perms.st_mode;
+	return 0;
+}
+
+/**
+ * Return the ACCESS_* the current syscall of @tracee requires on the
+ * final component of the path being translated.
+ */
+static int required_access(const Tracee *tracee)
+{
+	word_t flags;
+
+	switch (get_sysnum(tracee, ORIGINAL)) {
+	/* Only the search permission on the parent is required.  */
+	case PR_chmod:
+	case PR_fchmodat:
+	case PR_chown:
+	case PR_chown32:
+	case PR_lchown:
+	case PR_lchown32:
+	case PR_fchownat:
+	case PR_fstatat64:
+	case PR_lstat:
+	case PR_lstat64:
+	case PR_newfstatat:
+	case PR_oldlstat:
+	case PR_oldstat:
+	case PR_stat:
+	case PR_statx:
+	case PR_stat64:
+	case PR_statfs:
+	case PR_statfs64:
+	case PR_readlink:
+	case PR_readlinkat:
+	case PR_utime:
+	case PR_utimes:
+	case PR_utimensat:
+	case PR_futimesat:
+		return 0;
+
+	case PR_chdir:
+	case PR_chroot:
+		return ACCESS_SEARCH;
+
+	/* The final component is an entry of a directory being
+	 * modified.  */
+	case PR_mkdir:
+	case PR_mkdirat:
+	case PR_mknod:
+	case PR_mknodat:
+	case PR_symlink:
+	case PR_symlinkat:
+	case PR_link:
+	case PR_linkat:
+	case PR_unlink:
+	case PR_unlinkat:
+	case PR_rmdir:
+	case PR_rename:
+	case PR_renameat:
+	case PR_renameat2:
+		return ACCESS_PARENT;
+
+	case PR_truncate:
+	case PR_truncate64:
+	case PR_setxattr:
+	case PR_lsetxattr:
+	case PR_removexattr:
+	case PR_lremovexattr:
+		return ACCESS_WRITE;
+
+	case PR_getxattr:
+	case PR_lgetxattr:
+	case PR_listxattr:
+	case PR_llistxattr:
+		return ACCESS_READ;
+
+	case PR_access:
+		flags = peek_reg(tracee, ORIGINAL, SYSARG_2);
+		goto access;
+
+	case PR_faccessat:
+	case PR_faccessat2:
+		flags = peek_reg(tracee, ORIGINAL, SYSARG_3);
+	access:
+		return ((flags & R_OK) != 0 ? ACCESS_READ : 0)
+			| ((flags & W_OK) != 0 ? ACCESS_WRITE : 0)
+			| ((flags & X_OK) != 0 ? ACCESS_SEARCH : 0);
+
+	case PR_creat:
+		return ACCESS_WRITE | ACCESS_PARENT;
+
+	case PR_open:
+		flags = peek_reg(tracee, ORIGINAL, SYSARG_2);
+		goto open;
+
+	case PR_openat:
+		flags = peek_reg(tracee, ORIGINAL, SYSARG_3);
+	open:
+		if ((flags & O_PATH) != 0)
+			return 0;
+
+		return ((flags & O_ACCMODE) != O_WRONLY ? ACCESS_READ : 0)
+			| ((flags & O_ACCMODE) != O_RDONLY || (flags & O_TRUNC) != 0 ? ACCESS_WRITE : 0)
+			| ((flags & O_CREAT) != 0 ? ACCESS_PARENT : 0);
+
+	/* Don't know, be permissive as much as possible.  */
+	default:
+		return ACCESS_READ | ACCESS_WRITE | ACCESS_SEARCH;
+	}
+}
+
 /**
  * Restore the @node->mode for the given @node->path.
  *
@@ -140,81 +414,75 @@ static FilteredSysnum filtered_sysnums[] = {
 static int restore_mode(ModifiedNode *node)
 {
 	(void) chmod(node->path, node->mode);
+	uncache_mode(node->path);
 	return 0;
 }
 
 /**
- * Force permissions of @path to "rwx" during the path translation of
- * current @tracee's syscall, in order to simulate CAP_DAC_OVERRIDE.
- * The original permissions are restored through talloc destructors.
- * See canonicalize() for the meaning of @is_final.
+ * Return the permissions of @mode with the owner permissions
+ * required by @access added.
  */
-static void override_permissions(const Tracee *tracee, const char *path, bool is_final)
+static mode_t granted_permissions(mode_t mode, int access)
+{
+	mode_t permissions;
+
+	permissions = mode & (S_IRWXU | S_IRWXG | S_IRWXO);
+
+	if ((access & ACCESS_READ) != 0)
+		permissions |= S_IRUSR;
+
+	if ((access & ACCESS_WRITE) != 0)
+		permissions |= S_IWUSR;
+
+	/* Only directories can be searched with CAP_DAC_OVERRIDE.  */
+	if ((access & ACCESS_SEARCH) != 0 && S_ISDIR(mode))
+		permissions |= S_IXUSR;
+
+	return permissions;
+}
+
+/**
+ * Add the owner permissions required by @access to @path during the
+ * path translation of current @tracee's syscall.  The original
+ * permissions are restored through talloc destructors.
+ */
+static void grant_access(const Tracee *tracee, const char *path, int access)
 {
 	ModifiedNode *node;
 	struct stat perms;
 	mode_t new_mode;
+	mode_t mode;
 	int status;
 
-	/* Get the meta-data */
-	status = stat(path, &perms);
+	status = get_mode(path, &mode);
 	if (status < 0)
 		return;
 
-	/* Copy the current permissions */
-	new_mode = perms.st_mode & (S_IRWXU | S_IRWXG | S_IRWXO);
-
-	/* Add read and write permissions to everything.  */
-	new_mode |= (S_IRUSR | S_IWUSR);
+	/* The tracee would be granted this access: don't touch the
+	 * host file-system.  */
+	if (granted_permissions(mode, access) == (mode & (S_IRWXU | S_IRWXG | S_IRWXO)))
+		return;
 
-	/* Always add 'x' bit to directories */
-	if (S_ISDIR(perms.st_mode))
-		new_mode |= S_IXUSR;
+	/* The cached mode might be stale, whereas the mode restored
+	 * later has to be the current one.  */
+	status = stat(path, &perms);
+	if (status < 0) {
+		uncache_mode(path);
+		return;
+	}
+	mode = perms.st_mode;
 
-	/* Patch the permissions only if needed.  */
-	if (new_mode == (perms.st_mode & (S_IRWXU | S_IRWXG | S_IRWXO)))
+	new_mode = granted_permissions(mode, access);
+	if (new_mode == (mode & (S_IRWXU | S_IRWXG | S_IRWXO))) {
+		cache_mode(path, mode);
 		return;
+	}
 
 	node = talloc_zero(tracee->ctx, ModifiedNode);
 	if (node == NULL)
 		return;
 
-	if (!is_final) {
-		/* Restore the previous mode of any non final components.  */
-		node->mode = perms.st_mode;
-	}
-	else {
-		switch (get_sysnum(tracee, ORIGINAL)) {
-		/* For chmod syscalls: restore the new mode of the final component.  */
-		case PR_chmod:
-			node->mode = peek_reg(tracee, ORIGINAL, SYSARG_2);
-			break;
-
-		case PR_fchmodat:
-			node->mode = peek_reg(tracee, ORIGINAL, SYSARG_3);
-			break;
-
-		/* For stat syscalls: don't touch the mode of the final component.  */
-		case PR_fstatat64:
-		case PR_lstat:
-		case PR_lstat64:
-		case PR_newfstatat:
-		case PR_oldlstat:
-		case PR_oldstat:
-		case PR_stat:
-		case PR_statx:
-		case PR_stat64:
-		case PR_statfs:
-		case PR_statfs64:
-			return;
-
-		/* Otherwise: restore the previous mode of the final component.  */
-		default:
-			node->mode = perms.st_mode;
-			break;
-		}
-	}
-
+	node->mode = mode;
 	node->path = talloc_strdup(node, path);
 	if (node->path == NULL) {
 		/* Keep only consistent nodes.  */
@@ -226,40 +494,324 @@ static void override_permissions(const Tracee *tracee, const char *path, bool is
 	 * called in reverse order.  */
 	talloc_set_destructor(node, restore_mode);
 
-	(void) chmod(path, new_mode);
+	status = chmod(path, new_mode);
+	if (status == 0)
+		cache_mode(path, (mode & ~(S_IRWXU | S_IRWXG | S_IRWXO)) | new_mode);
+}
+
+/**
+ * Force the permissions of @path that current @tracee's syscall
+ * requires during its path translation, in order to simulate
+ * CAP_DAC_OVERRIDE.  The host file-system is left untouched unless
+ * the tracee would actually be denied the access, as decided from
+ * the cached mode of @path.  See canonicalize() for the meaning of
+ * @is_final.
+ */
+static void override_permissions(const Tracee *tracee, const char *path, bool is_final)
+{
+	char parent[PATH_MAX];
+	char *slash;
+	int access;
+
+	/* Intermediate directories have to be searched only.  */
+	if (!is_final) {
+		grant_access(tracee, path, ACCESS_SEARCH);
+		return;
+	}
+
+	access = required_access(tracee);
+
+	/* The tracee is changing the mode of the final component.  */
+	switch (get_sysnum(tracee, ORIGINAL)) {
+	case PR_chmod:
+	case PR_fchmodat:
+		uncache_mode(path);
+		break;
+
+	default:
+		break;
+	}
 
-	return;
+	if ((access & ACCESS_PARENT) != 0 && strlen(path) < PATH_MAX) {
+		strcpy(parent, path);
+		slash = strrchr(parent, '/');
+		if (slash != NULL && slash != parent) {
+			*slash = '\0';
+			grant_access(tracee, parent, ACCESS_WRITE | ACCESS_SEARCH);
+		}
+	}
+
+	access &= ~ACCESS_PARENT;
+	if (access != 0)
+		grant_access(tracee, path, access);
+}
+
+/**
+ * Put in @statl the meta-data of the file referenced by the path in
+ * the @sysarg of @tracee's current syscall, as translated by PRoot.
+ * This function returns -errno if an error occurred, otherwise 0.
+ */
+static int stat_path_sysarg(const Tracee *tracee, RegVersion version, Reg sysarg,
+			bool dereference, struct stat *statl)
+{
+	char path[PATH_MAX];
+	int status;
+
+	status = read_path(tracee, path, peek_reg(tracee, version, sysarg));
+	if (status < 0)
+		return status;
+
+	if (path[0] == '\0')
+		return -ENOENT;
+
+	status = (dereference ? stat(path, statl) : lstat(path, statl));
+	if (status < 0)
+		return -errno;
+
+	return 0;
+}
+
+/**
+ * Put in @statl the meta-data of the file referenced by the
+ * descriptor in the @sysarg of @tracee's current syscall.  This
+ * function returns -errno if an error occurred, otherwise 0.
+ */
+static int stat_fd_sysarg(const Tracee *tracee, Reg sysarg, struct stat *statl)
+{
+	char path[64];
+	int status;
+
+	(void) snprintf(path, sizeof(path), "/proc/%d/fd/%d", tracee->pid,
+			(int) peek_reg(tracee, ORIGINAL, sysarg));
+
+	status = stat(path, statl);
+	if (status < 0)
+		return -errno;
+
+	return 0;
+}
+
+/**
+ * Put in @statl the meta-data of the file @tracee's current syscall
+ * -- @sysnum -- changes or removes.  Its arguments are read from the
+ * registers @version.  This function returns -errno if an error
+ * occurred, otherwise 0.
+ */
+static int stat_target(const Tracee *tracee, RegVersion version, word_t sysnum, struct stat *statl)
+{
+	word_t flags;
+	int status;
+
+	switch (sysnum) {
+	case PR_chown:
+	case PR_chown32:
+	case PR_chmod:
+		return stat_path_sysarg(tracee, version, SYSARG_1, true, statl);
+
+	case PR_lchown:
+	case PR_lchown32:
+	case PR_mknod:
+	case PR_unlink:
+	case PR_rmdir:
+		return stat_path_sysarg(tracee, version, SYSARG_1, false, statl);
+
+	case PR_fchown:
+	case PR_fchown32:
+	case PR_fchmod:
+		return stat_fd_sysarg(tracee, SYSARG_1, statl);
+
+	case PR_fchownat:
+		flags = peek_reg(tracee, ORIGINAL, SYSARG_5);
+		status = stat_path_sysarg(tracee, version, SYSARG_2,
+					(flags & AT_SYMLINK_NOFOLLOW) == 0, statl);
+		if (status == -ENOENT && (flags & AT_EMPTY_PATH) != 0)
+			return stat_fd_sysarg(tracee, SYSARG_1, statl);
+		return status;
+
+	case PR_fchmodat:
+		return stat_path_sysarg(tracee, version, SYSARG_2, true, statl);
+
+	case PR_mknodat:
+	case PR_unlinkat:
+	case PR_rename:
+		return stat_path_sysarg(tracee, version, SYSARG_2, false, statl);
+
+	case PR_renameat:
+	case PR_renameat2:
+		return stat_path_sysarg(tracee, version, SYSARG_4, false, statl);
+
+	default:
+		return -ENOSYS;
+	}
+}
+
+/**
+ * Remember the inode @tracee's current syscall -- @sysnum -- is about
+ * to remove, if it is stored in the database of @config.  An inode
+ * number may be reused once its last link is removed.
+ */
+static void prepare_removal(const Tracee *tracee, Config *config, word_t sysnum)
+{
+	struct stat statl;
+	int status;
+
+	if (config->database == NULL || get_nb_inodes(config->database) == 0)
+		return;
+
+	status = stat_target(tracee, CURRENT, sysnum, &statl);
+	if (status < 0)
+		return;
+
+	if (!S_ISDIR(statl.st_mode) && statl.st_nlink > 1)
+		return;
+
+	if (lookup_inode(config->database, statl.st_dev, statl.st_ino) == NULL)
+		return;
+
+	config->removed.dev     = statl.st_dev;
+	config->removed.ino     = statl.st_ino;
+	config->removed.pending = true;
+}
+
+/**
+ * Store in the database of @config the ownership, the mode, or the
+ * device node @tracee's current syscall -- @sysnum -- has changed.
+ * The change wasn't done on the host side if @is_faked is true.
+ */
+static void record_metadata(const Tracee *tracee, Config *config, word_t sysnum, bool is_faked)
+{
+	FakeInode *inode;
+	struct stat statl;
+	Reg uid_sysarg;
+	Reg mode_sysarg;
+	uid_t uid;
+	gid_t gid;
+	int status;
+
+	switch (sysnum) {
+	case PR_chown:
+	case PR_chown32:
+	case PR_lchown:
+	case PR_lchown32:
+	case PR_fchown:
+	case PR_fchown32:
+	case PR_fchownat:
+		uid_sysarg = (sysnum == PR_fchownat ? SYSARG_3 : SYSARG_2);
+		uid = peek_reg(tracee, ORIGINAL, uid_sysarg);
+		gid = peek_reg(tracee, ORIGINAL, uid_sysarg + 1);
+
+		if (uid == (uid_t) -1 && gid == (gid_t) -1)
+			return;
+
+		status = stat_target(tracee, MODIFIED, sysnum, &statl);
+		if (status < 0)
+			return;
+
+		inode = get_inode(config->database, statl.st_dev, statl.st_ino);
+		if (inode == NULL)
+			return;
+
+		if (uid != (uid_t) -1) {
+			inode->uid = uid;
+			inode->flags |= FAKE_UID;
+		}
+
+		if (gid != (gid_t) -1) {
+			inode->gid = gid;
+			inode->flags |= FAKE_GID;
+		}
+		return;
+
+	case PR_chmod:
+	case PR_fchmod:
+	case PR_fchmodat:
+		mode_sysarg = (sysnum == PR_fchmodat ? SYSARG_3 : SYSARG_2);
+
+		status = stat_target(tracee, MODIFIED, sysnum, &statl);
+		if (status < 0)
+			return;
+
+		/* The host mode is right when the change was done.  */
+		if (!is_faked) {
+			inode = lookup_inode(config->database, statl.st_dev, statl.st_ino);
+			if (inode != NULL)
+				inode->flags &= ~FAKE_PERMS;
+			return;
+		}
+
+		inode = get_inode(config->database, statl.st_dev, statl.st_ino);
+		if (inode == NULL)
+			return;
+
+		inode->mode = (inode->mode & S_IFMT) | (peek_reg(tracee, ORIGINAL, mode_sysarg) & 07777);
+		inode->flags |= FAKE_PERMS;
+		return;
+
+	case PR_mknod:
+	case PR_mknodat:
+		if (!config->device.pending)
+			return;
+
+		status = stat_target(tracee, MODIFIED, sysnum, &statl);
+		if (status < 0)
+			return;
+
+		inode = get_inode(config->database, statl.st_dev, statl.st_ino);
+		if (inode == NULL)
+			return;
+
+		inode->mode  = (config->device.mode & S_IFMT) | (inode->mode & 07777);
+		inode->rdev  = config->device.rdev;
+		inode->flags |= FAKE_TYPE;
+		return;
+
+	default:
+		return;
+	}
 }
 
 /**
  * Adjust current @tracee's syscall parameters according to @config.
  * This function always returns 0.
  */
-static int handle_sysenter_end(Tracee *tracee, const Config *config)
+static int handle_sysenter_end(Tracee *tracee, Config *config)
 {
 	word_t sysnum;
 
+	config->removed.pending = false;
+	config->device.pending  = false;
+
 	sysnum = get_sysnum(tracee, ORIGINAL);
 	switch (sysnum) {
-	case PR_setuid:
-	case PR_setuid32:
-	case PR_setgid:
-	case PR_setgid32:
-	case PR_setreuid:
-	case PR_setreuid32:
-	case PR_setregid:
-	case PR_setregid32:
-	case PR_setresuid:
-	case PR_setresuid32:
-	case PR_setresgid:
-	case PR_setresgid32:
-	case PR_setfsuid:
-	case PR_setfsuid32:
-	case PR_setfsgid:
-	case PR_setfsgid32:
-		/* These syscalls are fully emulated.  */
-		set_sysnum(tracee, PR_void);
+	case PR_unlink:
+	case PR_unlinkat:
+	case PR_rmdir:
+	case PR_rename:
+	case PR_renameat:
+	case PR_renameat2:
+		prepare_removal(tracee, config, sysnum);
+		return 0;
+
+	case PR_mknod:
+	case PR_mknodat: {
+		Reg mode_sysarg = (sysnum == PR_mknodat ? SYSARG_3 : SYSARG_2);
+		mode_t mode = peek_reg(tracee, CURRENT, mode_sysarg);
+
+		if (config->database == NULL || config->euid != 0) /* TODO: || HAS_CAP(MKNOD) */
+			return 0;
+
+		if (!S_ISCHR(mode) && !S_ISBLK(mode))
+			return 0;
+
+		/* Unprivileged users can't create device nodes: create
+		 * a regular file instead and fake its type.  */
+		config->device.mode    = mode;
+		config->device.rdev    = peek_reg(tracee, CURRENT, mode_sysarg + 1);
+		config->device.pending = true;
+
+		poke_reg(tracee, mode_sysarg, S_IFREG | (mode & 07777));
 		return 0;
+	}
 
 	case PR_chown:
 	case PR_chown32:
@@ -311,6 +863,104 @@ static int handle_sysenter_end(Tracee *tracee, const Config *config)
 
 }
 
+/**
+ * Rewrite the 'stat' -- or 'statx' if @is_statx is true -- structure
+ * at @address in @tracee's memory, according to @config and to its
+ * database.  The 'stat' structure has to be laid out as the host
+ * one.  The structure is fetched and written back at once, the
+ * database is consulted without any syscall.  This function returns
+ * -errno if an error occurred, otherwise 0.
+ */
+static int rewrite_stat(const Tracee *tracee, const Config *config, word_t address, bool is_statx)
+{
+	union {
+		struct stat stat;
+		uint8_t statx[OFFSETOF_STATX_DEV_MINOR + sizeof(uint32_t)];
+	} buffer;
+	FakeInode *inode = NULL;
+	uint32_t major_minor[2];
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t rdev;
+	uint32_t mode;
+	uint16_t mode16;
+	uid_t uid;
+	gid_t gid;
+	size_t size;
+	int status;
+
+	size = (is_statx ? sizeof(buffer.statx) : sizeof(buffer.stat));
+	status = read_data(tracee, &buffer, address, size);
+	if (status < 0)
+		return 0; /* Not fatal.  */
+
+	if (is_statx) {
+		memcpy(&uid, &buffer.statx[OFFSETOF_STATX_UID], sizeof(uid));
+		memcpy(&gid, &buffer.statx[OFFSETOF_STATX_GID], sizeof(gid));
+		memcpy(&mode16, &buffer.statx[OFFSETOF_STATX_MODE], sizeof(mode16));
+		memcpy(&ino, &buffer.statx[OFFSETOF_STATX_INO], sizeof(ino));
+		memcpy(major_minor, &buffer.statx[OFFSETOF_STATX_DEV_MAJOR], sizeof(major_minor));
+		dev  = makedev(major_minor[0], major_minor[1]);
+		mode = mode16;
+		memcpy(major_minor, &buffer.statx[OFFSETOF_STATX_RDEV_MAJOR], sizeof(major_minor));
+		rdev = makedev(major_minor[0], major_minor[1]);
+	}
+	else {
+		uid  = buffer.stat.st_uid;
+		gid  = buffer.stat.st_gid;
+		mode = buffer.stat.st_mode;
+		ino  = buffer.stat.st_ino;
+		dev  = buffer.stat.st_dev;
+		rdev = buffer.stat.st_rdev;
+	}
+
+	/* Override only if the file is owned by the current user.  */
+	if (uid == getuid())
+		uid = config->suid;
+
+	if (gid == getgid())
+		gid = config->sgid;
+
+	if (config->database != NULL && get_nb_inodes(config->database) != 0)
+		inode = lookup_inode(config->database, dev, ino);
+
+	if (inode != NULL) {
+		if ((inode->flags & FAKE_UID) != 0)
+			uid = inode->uid;
+
+		if ((inode->flags & FAKE_GID) != 0)
+			gid = inode->gid;
+
+		if ((inode->flags & FAKE_PERMS) != 0)
+			mode = (mode & S_IFMT) | (inode->mode & 07777);
+
+		if ((inode->flags & FAKE_TYPE) != 0) {
+			mode = (inode->mode & S_IFMT) | (mode & 07777);
+			rdev = inode->rdev;
+		}
+	}
+
+	if (is_statx) {
+		mode16 = mode;
+		memcpy(&buffer.statx[OFFSETOF_STATX_UID], &uid, sizeof(uid));
+		memcpy(&buffer.statx[OFFSETOF_STATX_GID], &gid, sizeof(gid));
+		memcpy(&buffer.statx[OFFSETOF_STATX_MODE], &mode16, sizeof(mode16));
+		major_minor[0] = major(rdev);
+		major_minor[1] = minor(rdev);
+		memcpy(&buffer.statx[OFFSETOF_STATX_RDEV_MAJOR], major_minor, sizeof(major_minor));
+	}
+	else {
+		buffer.stat.st_uid  = uid;
+		buffer.stat.st_gid  = gid;
+		buffer.stat.st_mode = mode;
+		buffer.stat.st_rdev = rdev;
+	}
+
+	/* Errors are not fatal here.  */
+	(void) write_data(tracee, address, &buffer, size);
+	return 0;
+}
+
 /**
  * Copy config->@field to the tracee's memory location pointed to by @sysarg.
  */
@@ -502,17 +1152,15 @@ static int handle_sysenter_end(Tracee *tracee, const Config *config)
 } while (0)
 
 /**
- * Adjust current @tracee's syscall result according to @config.  This
- * function returns -errno if an error occured, otherwise 0.
+ * Emulate the current @tracee's syscall if it queries or changes
+ * user/group identities, according to -- and updating -- @config.
+ * The result is stored into the syscall result register.  This
+ * function returns -errno if an error occured, 1 if this syscall
+ * isn't emulated, otherwise 0.
  */
-static int handle_sysexit_end(Tracee *tracee, Config *config)
+static int emulate_id_syscall(Tracee *tracee, Config *config)
 {
-	word_t sysnum;
-	word_t result;
-
-	sysnum = get_sysnum(tracee, ORIGINAL);
-	switch (sysnum) {
-
+	switch (get_sysnum(tracee, ORIGINAL)) {
 	case PR_setuid:
 	case PR_setuid32:
 		SETXID(uid);
@@ -570,6 +1218,7 @@ static int handle_sysexit_end(Tracee *tracee, Config *config)
 		POKE_MEM_ID(SYSARG_1, ruid);
 		POKE_MEM_ID(SYSARG_2, euid);
 		POKE_MEM_ID(SYSARG_3, suid);
+		poke_reg(tracee, SYSARG_RESULT, 0);
 		return 0;
 
 	case PR_getresgid:
@@ -577,8 +1226,25 @@ static int handle_sysexit_end(Tracee *tracee, Config *config)
 		POKE_MEM_ID(SYSARG_1, rgid);
 		POKE_MEM_ID(SYSARG_2, egid);
 		POKE_MEM_ID(SYSARG_3, sgid);
+		poke_reg(tracee, SYSARG_RESULT, 0);
 		return 0;
 
+	default:
+		return 1;
+	}
+}
+
+/**
+ * Adjust current @tracee's syscall result according to @config.  This
+ * function returns -errno if an error occured, otherwise 0.
+ */
+static int handle_sysexit_end(Tracee *tracee, Config *config)
+{
+	word_t sysnum;
+	word_t result;
+
+	sysnum = get_sysnum(tracee, ORIGINAL);
+	switch (sysnum) {
 	case PR_setdomainname:
 	case PR_sethostname:
 	case PR_setgroups:
@@ -599,21 +1265,37 @@ static int handle_sysexit_end(Tracee *tracee, Config *config)
 	case PR_lchown32:
 	case PR_fchmodat:
 	case PR_fchownat: {
+		bool is_faked = false;
 		word_t result;
 
 		/* Override only permission errors.  */
 		result = peek_reg(tracee, CURRENT, SYSARG_RESULT);
-		if ((int) result != -EPERM)
-			return 0;
 
 		/* Force success if the tracee was supposed to have
 		 * the capability.  */
-		if (config->euid == 0) /* TODO: || HAS_CAP(...) */
+		if ((int) result == -EPERM && config->euid == 0) { /* TODO: || HAS_CAP(...) */
 			poke_reg(tracee, SYSARG_RESULT, 0);
+			is_faked = true;
+			result = 0;
+		}
+
+		if ((int) result == 0 && config->database != NULL)
+			record_metadata(tracee, config, sysnum, is_faked);
 
 		return 0;
 	}
 
+	case PR_unlink:
+	case PR_unlinkat:
+	case PR_rmdir:
+	case PR_rename:
+	case PR_renameat:
+	case PR_renameat2:
+		result = peek_reg(tracee, CURRENT, SYSARG_RESULT);
+		if ((int) result == 0 && config->removed.pending)
+			remove_inode(config->database, config->removed.dev, config->removed.ino);
+		return 0;
+
 	case PR_fstatat64:
 	case PR_newfstatat:
 	case PR_stat64:
@@ -652,6 +1334,16 @@ static int handle_sysexit_end(Tracee *tracee, Config *config)
 
 		address = peek_reg(tracee, ORIGINAL, sysarg);
 
+		/* The 'statx' structure has the same layout on every
+		 * ABI, whereas the host 'stat' structure matches the
+		 * one filled by the kernel only for native tracees on
+		 * 64-bit hosts: 32-bit ABIs use a smaller structure
+		 * for stat(2), lstat(2), and fstat(2).  Otherwise,
+		 * only the uid & gid fields are overridden.  */
+		if (sysnum == PR_statx
+		    || (!is_32on64_mode(tracee) && sizeof(word_t) == sizeof(uint64_t)))
+			return rewrite_stat(tracee, config, address, sysnum == PR_statx);
+
 		/* Sanity checks.  */
 		assert(__builtin_types_compatible_p(uid_t, uint32_t));
 		assert(__builtin_types_compatible_p(gid_t, uint32_t));
@@ -771,6 +1463,36 @@ static int adjust_elf_auxv(Tracee *tracee, Config *config)
 	return 0;
 }
 
+/**
+ * Make the fake_id0 extension of @tracee store the ownership, the
+ * modes and the device nodes set by the tracees into the file @path,
+ * so they persist across runs.  This function returns -1 if an error
+ * occurred, otherwise 0.
+ */
+int use_fake_id0_database(Tracee *tracee, const char *path)
+{
+	Extension *extension;
+	Database *database;
+	Config *config;
+
+	extension = get_extension(tracee, fake_id0_callback);
+	if (extension == NULL) {
+		note(tracee, ERROR, USER, "option --db requires -0, -S, or -i");
+		return -1;
+	}
+	config = talloc_get_type_abort(extension->config, Config);
+
+	database = open_database(tracee, config, path);
+	if (database == NULL)
+		return -1;
+
+	if (config->database != NULL)
+		talloc_unlink(config, config->database);
+	config->database = database;
+
+	return 0;
+}
+
 /**
  * Handler for this @extension.  It is triggered each time an @event
  * occurred.  See ExtensionEvent for the meaning of @data1 and @data2.
@@ -801,7 +1523,7 @@ int fake_id0_callback(Extension *extension, ExtensionEvent event, intptr_t data1
 		if (errno != 0)
 			gid = getgid();
 
-		extension->config = talloc(extension, Config);
+		extension->config = talloc_zero(extension, Config);
 		if (extension->config == NULL)
 			return -1;
 
@@ -815,6 +1537,12 @@ int fake_id0_callback(Extension *extension, ExtensionEvent event, intptr_t data1
 		config->sgid  = gid;
 		config->fsgid = gid;
 
+		/* In memory only, unless "--db" is specified.  */
+		config->database = open_database(TRACEE(extension), config, NULL);
+		if (config->database == NULL)
+			note(TRACEE(extension), WARNING, INTERNAL,
+				"ownership and device nodes won't be emulated");
+
 		extension->filtered_sysnums = filtered_sysnums;
 		return 0;
 	}
@@ -836,11 +1564,20 @@ int fake_id0_callback(Extension *extension, ExtensionEvent event, intptr_t data1
 		 */
 
 		Extension *parent = (Extension *) data1;
+		Config *config;
+
 		extension->config = talloc_zero(extension, Config);
 		if (extension->config == NULL)
 			return -1;
 
 		memcpy(extension->config, parent->config, sizeof(Config));
+
+		/* ... except the database, shared by all tracees.  */
+		config = talloc_get_type_abort(extension->config, Config);
+		if (config->database != NULL
+		    && talloc_reference(config, config->database) == NULL)
+			return -1;
+
 		return 0;
 	}
 
@@ -858,6 +1595,17 @@ int fake_id0_callback(Extension *extension, ExtensionEvent event, intptr_t data1
 	case SYSCALL_ENTER_END: {
 		Tracee *tracee = TRACEE(extension);
 		Config *config = talloc_get_type_abort(extension->config, Config);
+		int status;
+
+		/* Identity syscalls are fully emulated, there's no
+		 * need to wait for their sysexit stage.  */
+		status = emulate_id_syscall(tracee, config);
+		if (status <= 0) {
+			complete_syscall_at_enter(tracee, status < 0
+						? (word_t) status
+						: peek_reg(tracee, CURRENT, SYSARG_RESULT));
+			return 0;
+		}
 
 		return handle_sysenter_end(tracee, config);
 	}
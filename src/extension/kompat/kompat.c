@@ -38,6 +38,7 @@
 #include "syscall/seccomp.h"
 #include "syscall/sysnum.h"
 #include "syscall/chain.h"
+#include "syscall/syscall.h"
 #include "tracee/tracee.h"
 #include "tracee/reg.h"
 #include "tracee/abi.h"
@@ -162,13 +163,30 @@ static void discard_fd_flags(Tracee *tracee, const Config *config,
  * Replace current @tracee's syscall with an older and compatible one
  * whenever it's required, i.e. when the syscall is supported by the
  * kernel as specified by @config->virtual_release but it isn't
- * supported by the actual kernel.
+ * supported by the actual kernel.  The uname syscall is emulated
+ * here too.
  */
 static int handle_sysenter_end(Tracee *tracee, Config *config)
 {
 	/* Note: syscalls like "openat" can be replaced by "open" since PRoot
 	 * has canonicalized "fd + path" into "path".  */
 	switch (get_sysnum(tracee, ORIGINAL)) {
+	case PR_uname: {
+		word_t address;
+		int status;
+
+		address = peek_reg(tracee, CURRENT, SYSARG_1);
+
+		/* The layout of struct utsname does not depend on the
+		 * architecture, it only depends on the kernel
+		 * version.  In this regards, this structure is stable
+		 * since < 2.6.0.  Its content is fully emulated, so
+		 * the syscall is completed right now.  */
+		status = write_data(tracee, address, &config->utsname, sizeof(config->utsname));
+		complete_syscall_at_enter(tracee, (word_t) (status < 0 ? status : 0));
+		return 0;
+	}
+
 	case PR_accept4: {
 		Modif modif = {
 			.expected_release = KERNEL_VERSION(2,6,28),
@@ -742,21 +760,6 @@ static int handle_sysexit_end(Tracee *tracee, Config *config)
 		return 0;
 
 	switch (sysnum) {
-	case PR_uname: {
-		word_t address;
-
-		address = peek_reg(tracee, ORIGINAL, SYSARG_1);
-
-		/* The layout of struct utsname does not depend on the
-		 * architecture, it only depends on the kernel
-		 * version.  In this regards, this structure is stable
-		 * since < 2.6.0.  */
-		status = write_data(tracee, address, &config->utsname, sizeof(config->utsname));
-		if (status < 0)
-			return status;
-		return 0;
-	}
-
 	case PR_setdomainname:
 	case PR_sethostname: {
 		word_t address;
@@ -971,45 +974,96 @@ static int parse_utsname(Config *config, const char *string)
 	return 0;
 }
 
-/* List of syscalls handled by this extensions.  */
-static FilteredSysnum filtered_sysnums[] = {
-	{ PR_accept4,		FILTER_SYSEXIT },
-	{ PR_dup3,		FILTER_SYSEXIT },
-	{ PR_epoll_create1,	FILTER_SYSEXIT },
-	{ PR_epoll_pwait, 	0 },
-	{ PR_eventfd2, 		FILTER_SYSEXIT },
-	{ PR_execve, 		FILTER_SYSEXIT },
-	{ PR_faccessat, 	0 },
-	{ PR_fchmodat, 		0 },
-	{ PR_fchownat, 		0 },
-	{ PR_fcntl, 		FILTER_SYSEXIT },
-	{ PR_fstatat64, 	0 },
-	{ PR_futimesat, 	0 },
-	{ PR_futex, 		0 },
-	{ PR_inotify_init1, 	FILTER_SYSEXIT },
-	{ PR_linkat, 		0 },
-	{ PR_mkdirat, 		0 },
-	{ PR_mknodat, 		0 },
-	{ PR_newfstatat, 	0 },
-	{ PR_open, 		FILTER_SYSEXIT },
-	{ PR_openat, 		FILTER_SYSEXIT },
-	{ PR_pipe2, 		FILTER_SYSEXIT },
-	{ PR_pselect6, 		0 },
-	{ PR_readlinkat, 	0 },
-	{ PR_renameat, 		0 },
-	{ PR_renameat2,		0 },
-	{ PR_setdomainname,	FILTER_SYSEXIT },
-	{ PR_sethostname,	FILTER_SYSEXIT },
-	{ PR_signalfd4, 	FILTER_SYSEXIT },
-	{ PR_socket,		FILTER_SYSEXIT },
-	{ PR_socketpair,	FILTER_SYSEXIT },
-	{ PR_symlinkat, 	0 },
-	{ PR_timerfd_create,	FILTER_SYSEXIT },
-	{ PR_uname, 		FILTER_SYSEXIT },
-	{ PR_unlinkat, 		0 },
-	FILTERED_SYSNUM_END,
+/* List of syscalls handled by this extension, along with the kernel
+ * release they are emulated for, see needs_kompat().  Syscalls with
+ * no such release (0) are always handled.  A syscall can be listed
+ * several times when its sysexit stage is needed for a more recent
+ * release than its sysenter stage.  */
+static const struct {
+	FilteredSysnum sysnum;
+	int expected_release;
+} kompat_sysnums[] = {
+	{ { PR_accept4,		FILTER_SYSEXIT }, KERNEL_VERSION(2,6,28) },
+	{ { PR_dup3,		FILTER_SYSEXIT }, KERNEL_VERSION(2,6,27) },
+	{ { PR_epoll_create1,	FILTER_SYSEXIT }, KERNEL_VERSION(2,6,27) },
+	{ { PR_epoll_pwait, 	0 },		  KERNEL_VERSION(2,6,19) },
+	{ { PR_eventfd2, 	FILTER_SYSEXIT }, KERNEL_VERSION(2,6,27) },
+	{ { PR_execve, 		FILTER_SYSEXIT }, 0 },
+	{ { PR_faccessat, 	0 },		  KERNEL_VERSION(2,6,16) },
+	{ { PR_fchmodat, 	0 },		  KERNEL_VERSION(2,6,16) },
+	{ { PR_fchownat, 	0 },		  KERNEL_VERSION(2,6,16) },
+	{ { PR_fcntl, 		FILTER_SYSEXIT }, KERNEL_VERSION(2,6,24) },
+	{ { PR_fstatat64, 	0 },		  KERNEL_VERSION(2,6,16) },
+	{ { PR_futimesat, 	0 },		  KERNEL_VERSION(2,6,16) },
+	{ { PR_futex, 		0 },		  KERNEL_VERSION(2,6,22) },
+	{ { PR_inotify_init1, 	FILTER_SYSEXIT }, KERNEL_VERSION(2,6,27) },
+	{ { PR_linkat, 		0 },		  KERNEL_VERSION(2,6,16) },
+	{ { PR_mkdirat, 	0 },		  KERNEL_VERSION(2,6,16) },
+	{ { PR_mknodat, 	0 },		  KERNEL_VERSION(2,6,16) },
+	{ { PR_newfstatat, 	0 },		  KERNEL_VERSION(2,6,16) },
+	{ { PR_open, 		FILTER_SYSEXIT }, KERNEL_VERSION(2,6,23) },
+	{ { PR_openat, 		0 },		  KERNEL_VERSION(2,6,16) },
+	{ { PR_openat, 		FILTER_SYSEXIT }, KERNEL_VERSION(2,6,23) },
+	{ { PR_pipe2, 		FILTER_SYSEXIT }, KERNEL_VERSION(2,6,27) },
+	{ { PR_pselect6, 	0 },		  KERNEL_VERSION(2,6,16) },
+	{ { PR_readlinkat, 	0 },		  KERNEL_VERSION(2,6,16) },
+	{ { PR_renameat, 	0 },		  KERNEL_VERSION(2,6,16) },
+	{ { PR_renameat2,	0 },		  KERNEL_VERSION(3,15,0) },
+	{ { PR_setdomainname,	FILTER_SYSEXIT }, 0 },
+	{ { PR_sethostname,	FILTER_SYSEXIT }, 0 },
+	{ { PR_signalfd4, 	FILTER_SYSEXIT }, KERNEL_VERSION(2,6,27) },
+	{ { PR_socket,		FILTER_SYSEXIT }, KERNEL_VERSION(2,6,27) },
+	{ { PR_socketpair,	FILTER_SYSEXIT }, KERNEL_VERSION(2,6,27) },
+	{ { PR_symlinkat, 	0 },		  KERNEL_VERSION(2,6,16) },
+	{ { PR_timerfd_create,	FILTER_SYSEXIT }, KERNEL_VERSION(2,6,27) },
+	{ { PR_uname, 		0 },		  0 },
+	{ { PR_unlinkat, 	0 },		  KERNEL_VERSION(2,6,16) },
+	{ FILTERED_SYSNUM_END, 0 },
 };
 
+/**
+ * Allocate, in the given Talloc @context, the list of syscalls that
+ * actually need to be handled according to @config, that is, whose
+ * release is newer than the actual kernel and not newer than the
+ * virtual one.  This function returns NULL if an error occurred.
+ */
+static FilteredSysnum *new_filtered_sysnums(TALLOC_CTX *context, const Config *config)
+{
+	FilteredSysnum *sysnums;
+	size_t nb_sysnums = 0;
+	size_t i, j;
+
+	for (i = 0; kompat_sysnums[i].sysnum.value != PR_void; i++)
+		;
+
+	/* Worst case: all of them plus the terminator.  */
+	sysnums = talloc_array(context, FilteredSysnum, i + 1);
+	if (sysnums == NULL)
+		return NULL;
+
+	for (i = 0; kompat_sysnums[i].sysnum.value != PR_void; i++) {
+		if (   kompat_sysnums[i].expected_release != 0
+		    && !needs_kompat(config, kompat_sysnums[i].expected_release))
+			continue;
+
+		/* Merge the flags of a syscall listed several times.  */
+		for (j = 0; j < nb_sysnums; j++) {
+			if (sysnums[j].value == kompat_sysnums[i].sysnum.value)
+				break;
+		}
+
+		if (j < nb_sysnums)
+			sysnums[j].flags |= kompat_sysnums[i].sysnum.flags;
+		else
+			sysnums[nb_sysnums++] = kompat_sysnums[i].sysnum;
+	}
+
+	sysnums[nb_sysnums].value = PR_void;
+	sysnums[nb_sysnums].flags = 0;
+
+	return sysnums;
+}
+
 /**
  * Handler for this @extension.  It is triggered each time an @event
  * occured.  See ExtensionEvent for the meaning of @data1 and @data2.
@@ -1032,7 +1086,12 @@ int kompat_callback(Extension *extension, ExtensionEvent event,
 		if (status < 0)
 			return -1;
 
-		extension->filtered_sysnums = filtered_sysnums;
+		/* Don't trace syscalls that won't need any change
+		 * between the actual and the virtual kernels.  */
+		extension->filtered_sysnums = new_filtered_sysnums(extension, config);
+		if (extension->filtered_sysnums == NULL)
+			return -1;
+
 		return 0;
 	}
 
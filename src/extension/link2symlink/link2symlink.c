@@ -6,6 +6,9 @@
 #include <sys/stat.h>  /* lstat(2), */
 #include <errno.h>     /* E*, */
 #include <limits.h>    /* PATH_MAX, */
+#include <stdbool.h>   /* bool, true, false, */
+#include <talloc.h>    /* talloc_*, */
+#include "uthash.h"
 
 #include "extension/extension.h"
 #include "tracee/tracee.h"
@@ -37,6 +40,113 @@ static int my_readlink(const char symlink[PATH_MAX], char value[PATH_MAX])
 	return 0;
 }
 
+/* Index of the faked hard links: the final file each intermediate
+ * symlink points to, this latter's name encoding the link count.
+ * The file-system remains the reference: an entry is dropped as soon
+ * as its final file is missing, typically because another process
+ * changed the link count.  */
+typedef struct {
+	UT_hash_handle hh;
+	char *intermediate;
+	char *final;
+} IndexedLink;
+
+static struct {
+	TALLOC_CTX *context;
+	IndexedLink *links;
+	size_t nb_links;
+} link_index;
+
+#define LINK_INDEX_MAX 4096
+
+/**
+ * Remember that @intermediate points to @final.
+ */
+static void index_link(const char *intermediate, const char *final)
+{
+	IndexedLink *entry;
+
+	HASH_FIND_STR(link_index.links, intermediate, entry);
+	if (entry != NULL) {
+		char *copy = talloc_strdup(entry, final);
+		if (copy == NULL)
+			return;
+
+		talloc_free(entry->final);
+		entry->final = copy;
+		return;
+	}
+
+	/* Start over when the index is full.  */
+	if (link_index.nb_links >= LINK_INDEX_MAX || link_index.context == NULL) {
+		HASH_CLEAR(hh, link_index.links);
+		TALLOC_FREE(link_index.context);
+		link_index.nb_links = 0;
+
+		link_index.context = talloc_named_const(NULL, 0, "link2symlink index");
+		if (link_index.context == NULL)
+			return;
+	}
+
+	entry = talloc_zero(link_index.context, IndexedLink);
+	if (entry == NULL)
+		return;
+
+	entry->intermediate = talloc_strdup(entry, intermediate);
+	entry->final = talloc_strdup(entry, final);
+	if (entry->intermediate == NULL || entry->final == NULL) {
+		TALLOC_FREE(entry);
+		return;
+	}
+
+	HASH_ADD_KEYPTR(hh, link_index.links, entry->intermediate, strlen(entry->intermediate), entry);
+	link_index.nb_links++;
+}
+
+/**
+ * Forget the final file of @intermediate.
+ */
+static void unindex_link(const char *intermediate)
+{
+	IndexedLink *entry;
+
+	HASH_FIND_STR(link_index.links, intermediate, entry);
+	if (entry == NULL)
+		return;
+
+	HASH_DEL(link_index.links, entry);
+	talloc_free(entry);
+	link_index.nb_links--;
+}
+
+/**
+ * Copy the final file pointed to by @intermediate into @final, from
+ * the index if possible -- in this case @indexed is set to true --
+ * otherwise from the file-system.  This function returns -errno if an
+ * error occured, otherwise 0.
+ */
+static int lookup_final(const char intermediate[PATH_MAX], char final[PATH_MAX], bool *indexed)
+{
+	IndexedLink *entry;
+	int status;
+
+	HASH_FIND_STR(link_index.links, intermediate, entry);
+	if (entry != NULL) {
+		strcpy(final, entry->final);
+		*indexed = true;
+		return 0;
+	}
+
+	*indexed = false;
+
+	status = my_readlink(intermediate, final);
+	if (status < 0)
+		return status;
+
+	index_link(intermediate, final);
+	return 0;
+}
+
 /**
  * Move the path pointed to by @tracee's @sysarg to a new location,
  * symlink the original path to this new one, make @tracee's @sysarg
@@ -57,6 +167,7 @@ static int move_and_symlink_path(Tracee *tracee, Reg sysarg)
 	int link_count;
 	int first_link = 1;
 	int intermediate_suffix = 1;
+	bool indexed;
 
 	/* Note: this path was already canonicalized.  */
 	size = read_string(tracee, original, peek_reg(tracee, CURRENT, sysarg), PATH_MAX);
@@ -105,31 +216,39 @@ static int move_and_symlink_path(Tracee *tracee, Reg sysarg)
 	}
 
 	if (first_link) {
-		/*Move the original content to the new path. */
+		/* Symlink the first free intermediate name to the final
+		 * file; creating it directly is both cheaper and safer
+		 * than checking first whether it already exists.  */
 		do {
 			sprintf(new_intermediate, "%s%04d", intermediate, intermediate_suffix);
 			intermediate_suffix++;
-		} while ((access(new_intermediate,F_OK) != -1) && (intermediate_suffix < 1000));
-		strcpy(intermediate, new_intermediate);
 
-		strcpy(final, intermediate);
-		strcat(final, ".0002");
-		status = rename(original, final);
+			strcpy(final, new_intermediate);
+			strcat(final, ".0002");
+			status = symlink(final, new_intermediate);
+		} while (status < 0 && errno == EEXIST && intermediate_suffix < 1000);
 		if (status < 0)
-			return status;
+			return -errno;
+		strcpy(intermediate, new_intermediate);
 
-		/* Symlink the intermediate to the final file.  */
-		status = symlink(final, intermediate);
-		if (status < 0)
+		/*Move the original content to the new path. */
+		status = rename(original, final);
+		if (status < 0) {
+			status = -errno;
+			(void) unlink(intermediate);
 			return status;
+		}
 
 		/* Symlink the original path to the intermediate one.  */
 			status = symlink(intermediate, original);
 			if (status < 0)
 			return status;
+
+		index_link(intermediate, final);
 	} else {
 		/*Move the original content to new location, by incrementing count at end of path. */
-		size = my_readlink(intermediate, final);
+	retry:
+		size = lookup_final(intermediate, final, &indexed);
 		if (size < 0)
 			return size;
 
@@ -140,6 +259,10 @@ static int move_and_symlink_path(Tracee *tracee, Reg sysarg)
 		sprintf(new_final + strlen(final) - 4, "%04d", link_count);
 
 		status = rename(final, new_final);
+		if (status < 0 && indexed) {
+			unindex_link(intermediate);
+			goto retry;
+		}
 		if (status < 0)
 			return status;
 		strcpy(final, new_final);
@@ -150,6 +273,8 @@ static int move_and_symlink_path(Tracee *tracee, Reg sysarg)
 		status = symlink(final, intermediate);
 		if (status < 0)
 			return status;
+
+		index_link(intermediate, final);
 	}
 
 	status = set_sysarg_path(tracee, intermediate, sysarg);
@@ -176,6 +301,7 @@ static int decrement_link_count(Tracee *tracee, Reg sysarg)
 	ssize_t size;
 	int status;
 	int link_count;
+	bool indexed;
 
 	/* Note: this path was already canonicalized.  */
 	size = read_string(tracee, original, peek_reg(tracee, CURRENT, sysarg), PATH_MAX);
@@ -206,7 +332,8 @@ static int decrement_link_count(Tracee *tracee, Reg sysarg)
 	if (strncmp(name, PREFIX, strlen(PREFIX)) != 0)
 		return 0;
 
-	size = my_readlink(intermediate, final);
+retry:
+	size = lookup_final(intermediate, final, &indexed);
 	if (size < 0)
 		return size;
 
@@ -219,6 +346,10 @@ static int decrement_link_count(Tracee *tracee, Reg sysarg)
 		sprintf(new_final + strlen(final) - 4, "%04d", link_count);
 
 		status = rename(final, new_final);
+		if (status < 0 && indexed) {
+			unindex_link(intermediate);
+			goto retry;
+		}
 		if (status < 0)
 			return status;
 
@@ -232,8 +363,12 @@ static int decrement_link_count(Tracee *tracee, Reg sysarg)
 		status = symlink(final, intermediate);
 		if (status < 0)
 			return status;
+
+		index_link(intermediate, final);
 	} else {
 		/* If it is the last, delete the intermediate and final */
+		unindex_link(intermediate);
+
 		status = unlink(intermediate);
 		if (status < 0)
 			return status;
@@ -277,6 +412,7 @@ static int handle_sysexit_end(Tracee *tracee)
 		char final[PATH_MAX];
 		char * name;
 		struct stat finalStat;
+		bool indexed = false;
 
 		/* Override only if it succeed.  */
 		result = peek_reg(tracee, CURRENT, SYSARG_RESULT);
@@ -336,11 +472,15 @@ static int handle_sysexit_end(Tracee *tracee)
 		if (strncmp(name, PREFIX, strlen(PREFIX)) != 0)
 			return 0;
 
-		intermediate_proc: size = my_readlink(intermediate, final);
+		intermediate_proc: size = lookup_final(intermediate, final, &indexed);
 		if (size < 0)
 			return size;
 
 		final_proc: status = lstat(final,&finalStat);
+		if (status < 0 && indexed) {
+			unindex_link(intermediate);
+			goto intermediate_proc;
+		}
 		if (status < 0)
 			return status;
 
@@ -392,6 +532,7 @@ static void translated_path(char translated_path[PATH_MAX])
 	status = my_readlink(path, path2);
 	if (status < 0)
 		return;
+	index_link(path, path2);
 
 #if 0 /* Sanity check. */
 	component = strrchr(path, '/');
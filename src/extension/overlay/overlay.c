@@ -0,0 +1,1539 @@
+/* -*- c-set-style: "K&R"; c-basic-offset: 8 -*-
+ *
+ * This file is part of PRoot.
+ *
+ * Copyright (C) 2015 STMicroelectronics
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <sys/types.h>  /* lstat(2), mkdir(2), open(2), */
+#include <sys/stat.h>   /* lstat(2), mkdir(2), open(2), */
+#include <sys/queue.h>  /* LIST_*, */
+#include <sys/param.h>  /* MIN(), */
+#include <fcntl.h>      /* open(2), O_*, AT_*, */
+#include <unistd.h>     /* read(2), write(2), readlink(2), symlink(2), */
+#include <dirent.h>     /* opendir(3), readdir(3), */
+#include <stdlib.h>     /* realpath(3), */
+#include <stdio.h>      /* snprintf(3), */
+#include <string.h>     /* str*(3), */
+#include <errno.h>      /* E*, */
+#include <limits.h>     /* PATH_MAX, */
+#include <talloc.h>     /* talloc_*, */
+
+#include "extension/extension.h"
+#include "syscall/syscall.h"
+#include "syscall/sysnum.h"
+#include "syscall/dirent.h"
+#include "tracee/tracee.h"
+#include "tracee/abi.h"
+#include "tracee/mem.h"
+#include "path/binding.h"
+#include "path/path.h"
+#include "cli/note.h"
+#include "arch.h"
+#include "attribute.h"
+
+#ifndef RENAME_NOREPLACE
+#define RENAME_NOREPLACE (1 << 0)
+#endif
+
+#ifndef RENAME_EXCHANGE
+#define RENAME_EXCHANGE (1 << 1)
+#endif
+
+/* This extension stacks a private "upper" directory over the guest
+ * rootfs -- the "lower" layer, which is never modified.  Host paths
+ * under the lower layer are redirected to the upper layer when they
+ * exist there (see resolve_path()), files are copied up right before
+ * they are modified (see prepare_path()), and deletions are recorded
+ * as AUFS-like "whiteout" files in the upper layer.  */
+
+#define WHITEOUT_PREFIX ".wh."
+#define OPAQUE_MARKER   ".wh..wh..opq"
+
+typedef enum {
+	NO_LAYER,
+	LOWER_LAYER,
+	UPPER_LAYER,
+} Layer;
+
+/* How a syscall accesses a path, see prepare_path().  */
+typedef enum {
+	MODIFY,		/* chmod(2), truncate(2), open(2) for writing, ...  */
+	CREATE,		/* mkdir(2), symlink(2), ...  */
+	REPLACE,	/* new path of rename(2).  */
+	DELETE,		/* unlink(2).  */
+	DELETE_DIR,	/* rmdir(2).  */
+	MOVE,		/* old path of rename(2).  */
+	EXCHANGE,	/* both paths of renameat2(RENAME_EXCHANGE).  */
+} Access;
+
+/* Merged content of a directory opened by the tracee, see
+ * prepare_listing().  */
+typedef struct listing {
+	int fd;
+	char *path;
+	Dentry *dentries;
+	size_t index;
+	LIST_ENTRY(listing) link;
+} Listing;
+
+typedef LIST_HEAD(listings, listing) Listings;
+
+typedef struct {
+	/* Host paths to the layers.  */
+	char *lower;
+	char *upper;
+
+	/* Directories the tracee is currently reading.  */
+	Listings *listings;
+
+	/* Post-processing of the current syscall, see
+	 * handle_sysexit_end().  These paths are relative to the
+	 * layers.  */
+	struct {
+		char *whiteouts[2];
+		char *created[2];
+		char *placeholder;
+		bool has_result;
+		word_t result;
+	} pending;
+} Config;
+
+/**
+ * Return the lower layer of @config, that is, the guest rootfs of
+ * @tracee.  This function returns NULL if it is not usable.
+ */
+static const char *get_lower(const Tracee *tracee, Config *config)
+{
+	const char *root;
+
+	if (config->lower != NULL)
+		return config->lower;
+
+	root = get_root(tracee);
+	if (root == NULL)
+		return NULL;
+
+	switch (compare_paths(root, config->upper)) {
+	case PATHS_ARE_EQUAL:
+	case PATH2_IS_PREFIX:
+		note(tracee, ERROR, USER, "the overlay directory (%s) must not contain "
+			"the guest rootfs (%s)", config->upper, root);
+		return NULL;
+
+	default:
+		break;
+	}
+
+	config->lower = talloc_strdup(config, root);
+	return config->lower;
+}
+
+/**
+ * Check if the host @path belongs to a layer of @config from
+ * @tracee's point-of-view.  If it does, @relative points to the part
+ * of @path relative to this layer, either an empty string or an
+ * absolute path.
+ */
+static Layer split_path(const Tracee *tracee, const Config *config, const char *path,
+			const char **relative)
+{
+	const Binding *binding;
+	const char *prefix;
+	Layer layer;
+
+	if (config->lower == NULL || path[0] != '/')
+		return NO_LAYER;
+
+	switch (compare_paths(config->upper, path)) {
+	case PATHS_ARE_EQUAL:
+	case PATH1_IS_PREFIX:
+		prefix = config->upper;
+		layer  = UPPER_LAYER;
+		break;
+
+	default:
+		switch (compare_paths(config->lower, path)) {
+		case PATHS_ARE_EQUAL:
+		case PATH1_IS_PREFIX:
+			/* When the guest rootfs is "/", paths from
+			 * the other bindings aren't part of it.  */
+			binding = get_binding(tracee, HOST, path);
+			if (binding != NULL
+			    && (compare_paths(binding->host.path, config->lower) != PATHS_ARE_EQUAL
+				|| compare_paths(binding->guest.path, "/") != PATHS_ARE_EQUAL))
+				return NO_LAYER;
+
+			prefix = config->lower;
+			layer  = LOWER_LAYER;
+			break;
+
+		default:
+			return NO_LAYER;
+		}
+	}
+
+	*relative = path + strlen(prefix);
+	if (**relative != '\0' && **relative != '/')
+		(*relative)--; /* The layer is "/".  */
+
+	return layer;
+}
+
+/**
+ * Copy in @result the host path to @relative in the given @layer.
+ * This function returns -errno if an error occurred, otherwise 0.
+ */
+static int layer_path(const Config *config, Layer layer, const char *relative,
+		char result[PATH_MAX])
+{
+	const char *prefix;
+	int length;
+
+	prefix = (layer == UPPER_LAYER ? config->upper : config->lower);
+
+	/* Special case when the layer is "/".  */
+	if (prefix[1] == '\0' && relative[0] != '\0')
+		prefix = "";
+
+	length = snprintf(result, PATH_MAX, "%s%s", prefix, relative);
+	if (length < 0 || length >= PATH_MAX)
+		return -ENAMETOOLONG;
+
+	return 0;
+}
+
+/**
+ * Copy in @result the host path to the whiteout of @relative, that
+ * is, the file that hides @relative from the lower layer.  This
+ * function returns -errno if an error occurred, otherwise 0.
+ */
+static int whiteout_path(const Config *config, const char *relative, char result[PATH_MAX])
+{
+	const char *name;
+	int length;
+
+	name = strrchr(relative, '/');
+	if (name == NULL || name[1] == '\0')
+		return -EINVAL;
+	name++;
+
+	length = snprintf(result, PATH_MAX, "%s%.*s" WHITEOUT_PREFIX "%s", config->upper,
+			(int) (name - relative), relative, name);
+	if (length < 0 || length >= PATH_MAX)
+		return -ENAMETOOLONG;
+
+	return 0;
+}
+
+/**
+ * Copy in @result the host path to the marker that hides the whole
+ * content of the directory @relative from the lower layer.  This
+ * function returns -errno if an error occurred, otherwise 0.
+ */
+static int opaque_path(const Config *config, const char *relative, char result[PATH_MAX])
+{
+	int length;
+
+	length = snprintf(result, PATH_MAX, "%s%s/" OPAQUE_MARKER, config->upper, relative);
+	if (length < 0 || length >= PATH_MAX)
+		return -ENAMETOOLONG;
+
+	return 0;
+}
+
+static bool exists(const char *path)
+{
+	struct stat statl;
+
+	return lstat(path, &statl) == 0;
+}
+
+/**
+ * Check if @relative is hidden from the lower layer, either by a
+ * whiteout or by an opaque parent directory.
+ */
+static bool is_hidden(const Config *config, const char *relative)
+{
+	char parent[PATH_MAX];
+	char path[PATH_MAX];
+	const char *name;
+
+	if (relative[0] == '\0')
+		return false;
+
+	if (whiteout_path(config, relative, path) == 0 && exists(path))
+		return true;
+
+	name = strrchr(relative, '/');
+	if (name == NULL || name - relative >= PATH_MAX)
+		return false;
+
+	memcpy(parent, relative, name - relative);
+	parent[name - relative] = '\0';
+
+	return opaque_path(config, parent, path) == 0 && exists(path);
+}
+
+/**
+ * Redirect the host @path to the upper layer if it exists there, or
+ * if it was deleted from the merged view.
+ */
+static void resolve_path(const Tracee *tracee, Config *config, char path[PATH_MAX])
+{
+	char upper_path[PATH_MAX];
+	const char *relative;
+
+	if (get_lower(tracee, config) == NULL)
+		return;
+
+	if (split_path(tracee, config, path, &relative) != LOWER_LAYER)
+		return;
+
+	if (layer_path(config, UPPER_LAYER, relative, upper_path) < 0)
+		return;
+
+	if (exists(upper_path) || is_hidden(config, relative))
+		strcpy(path, upper_path);
+}
+
+/**
+ * Preserve the timestamps of @statl on the host @path.
+ */
+static void copy_times(const char *path, const struct stat *statl)
+{
+	struct timespec times[2];
+
+	times[0] = statl->st_atim;
+	times[1] = statl->st_mtim;
+
+	(void) utimensat(AT_FDCWD, path, times, AT_SYMLINK_NOFOLLOW);
+}
+
+/**
+ * Copy the content of the regular file @lower_path to the new file
+ * @upper_path, with the given @mode.  This function returns -errno
+ * if an error occurred, otherwise 0.
+ */
+static int copy_content(const char *lower_path, const char *upper_path, mode_t mode)
+{
+	char buffer[16 * 1024];
+	int input = -1;
+	int output = -1;
+	ssize_t size;
+	int status;
+
+	input = open(lower_path, O_RDONLY | O_CLOEXEC);
+	if (input < 0)
+		return -errno;
+
+	output = open(upper_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+	if (output < 0) {
+		status = -errno;
+		goto end;
+	}
+
+	while ((size = read(input, buffer, sizeof(buffer))) > 0) {
+		if (write(output, buffer, size) != size) {
+			status = -errno ?: -EIO;
+			goto end;
+		}
+	}
+	if (size < 0) {
+		status = -errno;
+		goto end;
+	}
+
+	status = fchmod(output, mode) < 0 ? -errno : 0;
+end:
+	if (output >= 0) {
+		close(output);
+		if (status < 0)
+			(void) unlink(upper_path);
+	}
+	close(input);
+
+	return status;
+}
+
+/**
+ * Make sure the directory @relative exists in the upper layer, by
+ * copying it up from the lower layer if needed.  This function
+ * returns -errno if an error occurred, otherwise 0.
+ */
+static int copy_up_directory(const Config *config, const char *relative)
+{
+	char upper_path[PATH_MAX];
+	char lower_path[PATH_MAX];
+	struct stat statl;
+	int status;
+
+	status = layer_path(config, UPPER_LAYER, relative, upper_path);
+	if (status < 0)
+		return status;
+
+	if (lstat(upper_path, &statl) == 0)
+		return S_ISDIR(statl.st_mode) ? 0 : -ENOTDIR;
+
+	status = layer_path(config, LOWER_LAYER, relative, lower_path);
+	if (status < 0)
+		return status;
+
+	if (lstat(lower_path, &statl) < 0)
+		return -errno;
+	if (!S_ISDIR(statl.st_mode))
+		return -ENOTDIR;
+
+	status = mkdir(upper_path, statl.st_mode & 07777);
+	if (status < 0 && errno != EEXIST)
+		return -errno;
+
+	copy_times(upper_path, &statl);
+	return 0;
+}
+
+/**
+ * Make sure all the parent directories of @relative exist in the
+ * upper layer.  This function returns -errno if an error occurred,
+ * otherwise 0.
+ */
+static int copy_up_parents(const Config *config, const char *relative)
+{
+	char parent[PATH_MAX];
+	const char *cursor;
+	int status;
+
+	for (cursor = strchr(relative + 1, '/'); cursor != NULL; cursor = strchr(cursor + 1, '/')) {
+		if (cursor - relative >= PATH_MAX)
+			return -ENAMETOOLONG;
+
+		memcpy(parent, relative, cursor - relative);
+		parent[cursor - relative] = '\0';
+
+		status = copy_up_directory(config, parent);
+		if (status < 0)
+			return status;
+	}
+
+	return 0;
+}
+
+/**
+ * Copy @relative -- described by @statl -- from the lower layer to
+ * the upper layer, as well as its parent directories.  Note that
+ * directories are copied up without their content since it is
+ * merged anyway.  This function returns -errno if an error occurred,
+ * otherwise 0.
+ */
+static int copy_up(const Config *config, const char *relative, const struct stat *statl)
+{
+	char upper_path[PATH_MAX];
+	char lower_path[PATH_MAX];
+	char target[PATH_MAX];
+	ssize_t size;
+	int status;
+
+	status = copy_up_parents(config, relative);
+	if (status < 0)
+		return status;
+
+	status = layer_path(config, UPPER_LAYER, relative, upper_path);
+	if (status < 0)
+		return status;
+
+	status = layer_path(config, LOWER_LAYER, relative, lower_path);
+	if (status < 0)
+		return status;
+
+	switch (statl->st_mode & S_IFMT) {
+	case S_IFREG:
+		status = copy_content(lower_path, upper_path, statl->st_mode & 07777);
+		break;
+
+	case S_IFDIR:
+		status = copy_up_directory(config, relative);
+		break;
+
+	case S_IFLNK:
+		size = readlink(lower_path, target, sizeof(target) - 1);
+		if (size < 0)
+			return -errno;
+		target[size] = '\0';
+
+		status = symlink(target, upper_path) < 0 ? -errno : 0;
+		break;
+
+	default:
+		status = mknod(upper_path, statl->st_mode, statl->st_rdev) < 0 ? -errno : 0;
+		break;
+	}
+	if (status < 0)
+		return status;
+
+	copy_times(upper_path, statl);
+	return 0;
+}
+
+/**
+ * Call @callback for each entry -- except "." and ".." -- of the
+ * directory @relative in the given @layer, until it returns != 0.
+ * This function returns -errno if an error occurred, otherwise the
+ * last value returned by @callback.
+ */
+static int foreach_dentry(const Config *config, Layer layer, const char *relative,
+			int (*callback)(const Config *, const char *, const struct dirent *, void *),
+			void *data)
+{
+	char path[PATH_MAX];
+	struct dirent *dirent;
+	int status;
+	DIR *dir;
+
+	status = layer_path(config, layer, relative, path);
+	if (status < 0)
+		return status;
+
+	dir = opendir(path);
+	if (dir == NULL)
+		return -errno;
+
+	status = 0;
+	while (status == 0 && (dirent = readdir(dir)) != NULL) {
+		if (strcmp(dirent->d_name, ".") == 0 || strcmp(dirent->d_name, "..") == 0)
+			continue;
+		status = callback(config, relative, dirent, data);
+	}
+
+	closedir(dir);
+	return status;
+}
+
+/**
+ * Check if @name is visible in the merged view of the directory
+ * @relative, assuming it is an entry of the lower layer.
+ */
+static bool is_visible_lower_dentry(const Config *config, const char *relative, const char *name)
+{
+	char upper_path[PATH_MAX];
+	char child[PATH_MAX];
+	int length;
+
+	length = snprintf(child, PATH_MAX, "%s/%s", relative, name);
+	if (length < 0 || length >= PATH_MAX)
+		return false;
+
+	/* Shadowed by the upper layer.  */
+	if (layer_path(config, UPPER_LAYER, child, upper_path) == 0 && exists(upper_path))
+		return false;
+
+	return whiteout_path(config, child, upper_path) < 0 || !exists(upper_path);
+}
+
+static int is_upper_dentry_visible(const Config *config UNUSED, const char *relative UNUSED,
+				const struct dirent *dirent, void *data UNUSED)
+{
+	return strncmp(dirent->d_name, WHITEOUT_PREFIX, strlen(WHITEOUT_PREFIX)) != 0;
+}
+
+static int is_lower_dentry_visible(const Config *config, const char *relative,
+				const struct dirent *dirent, void *data UNUSED)
+{
+	return is_visible_lower_dentry(config, relative, dirent->d_name);
+}
+
+static int remove_whiteout(const Config *config, const char *relative,
+			const struct dirent *dirent, void *data UNUSED)
+{
+	char path[PATH_MAX];
+	int length;
+
+	if (strncmp(dirent->d_name, WHITEOUT_PREFIX, strlen(WHITEOUT_PREFIX)) != 0)
+		return 0;
+
+	length = snprintf(path, PATH_MAX, "%s%s/%s", config->upper, relative, dirent->d_name);
+	if (length < 0 || length >= PATH_MAX)
+		return -ENAMETOOLONG;
+
+	return unlink(path) < 0 ? -errno : 0;
+}
+
+/**
+ * Check if the directory @relative is empty in the merged view, and
+ * if so remove its whiteouts from the upper layer so it can actually
+ * be removed.  This function returns -errno if an error occurred,
+ * -ENOTEMPTY if it is not empty, otherwise 0.
+ */
+static int empty_merged_directory(const Config *config, const char *relative)
+{
+	char path[PATH_MAX];
+	bool in_upper;
+	int status;
+
+	status = layer_path(config, UPPER_LAYER, relative, path);
+	if (status < 0)
+		return status;
+	in_upper = exists(path);
+
+	if (in_upper) {
+		status = foreach_dentry(config, UPPER_LAYER, relative, is_upper_dentry_visible, NULL);
+		if (status != 0)
+			return status < 0 ? status : -ENOTEMPTY;
+	}
+
+	status = opaque_path(config, relative, path);
+	if (status < 0)
+		return status;
+
+	if (!in_upper || !exists(path)) {
+		status = foreach_dentry(config, LOWER_LAYER, relative, is_lower_dentry_visible, NULL);
+		if (status > 0)
+			return -ENOTEMPTY;
+		if (status < 0 && status != -ENOENT)
+			return status;
+	}
+
+	if (in_upper) {
+		status = foreach_dentry(config, UPPER_LAYER, relative, remove_whiteout, NULL);
+		if (status < 0)
+			return status;
+	}
+
+	return 0;
+}
+
+/**
+ * Create in the upper layer an empty placeholder of the same kind as
+ * @statl for @relative, in order to let the kernel check and perform
+ * the current syscall.  This function returns -errno if an error
+ * occurred, otherwise 0.
+ */
+static int create_placeholder(Config *config, const char *relative, const struct stat *statl)
+{
+	char path[PATH_MAX];
+	int status;
+	int fd;
+
+	status = copy_up_parents(config, relative);
+	if (status < 0)
+		return status;
+
+	status = layer_path(config, UPPER_LAYER, relative, path);
+	if (status < 0)
+		return status;
+
+	if (S_ISDIR(statl->st_mode))
+		status = mkdir(path, S_IRWXU);
+	else {
+		fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+		if (fd >= 0)
+			close(fd);
+		status = fd;
+	}
+	if (status < 0)
+		return -errno;
+
+	config->pending.placeholder = talloc_strdup(config, relative);
+	return 0;
+}
+
+/**
+ * Remember @relative into the first free slot of the @pending array.
+ */
+static void add_pending(Config *config, char *pending[2], const char *relative)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if (pending[i] == NULL) {
+			pending[i] = talloc_strdup(config, relative);
+			return;
+		}
+	}
+}
+
+/**
+ * Prepare the layers for the given @access to the path pointed to by
+ * @tracee's @sysarg, then make it point to the upper layer if
+ * needed.  This function returns -errno if an error occurred,
+ * otherwise 0.
+ */
+static int prepare_path(Tracee *tracee, Config *config, Reg sysarg, Access access)
+{
+	char upper_path[PATH_MAX];
+	char lower_path[PATH_MAX];
+	char path[PATH_MAX];
+	struct stat upper_stat;
+	struct stat lower_stat;
+	const char *relative;
+	bool in_upper;
+	bool in_lower;
+	bool is_dir;
+	int status;
+
+	status = get_sysarg_path(tracee, path, sysarg);
+	if (status < 0)
+		return status;
+
+	if (split_path(tracee, config, path, &relative) == NO_LAYER || relative[0] == '\0')
+		return 0;
+
+	status = layer_path(config, UPPER_LAYER, relative, upper_path);
+	if (status < 0)
+		return status;
+
+	status = layer_path(config, LOWER_LAYER, relative, lower_path);
+	if (status < 0)
+		return status;
+
+	in_upper = (lstat(upper_path, &upper_stat) == 0);
+	in_lower = (lstat(lower_path, &lower_stat) == 0 && !is_hidden(config, relative));
+
+	/* Let the kernel report the error, if any.  */
+	if (!in_upper && !in_lower && access != CREATE && access != REPLACE)
+		return 0;
+
+	is_dir = S_ISDIR(in_upper ? upper_stat.st_mode : lower_stat.st_mode);
+
+	switch (access) {
+	case MODIFY:
+		if (!in_upper) {
+			status = copy_up(config, relative, &lower_stat);
+			if (status < 0)
+				return status;
+		}
+		break;
+
+	case CREATE:
+		/* Let the kernel report EEXIST.  */
+		if (in_upper || in_lower)
+			return 0;
+		/* Fall through.  */
+
+	case REPLACE:
+		if (!in_upper && in_lower) {
+			if (is_dir) {
+				status = empty_merged_directory(config, relative);
+				if (status < 0)
+					return status;
+			}
+
+			status = create_placeholder(config, relative, &lower_stat);
+		}
+		else
+			status = copy_up_parents(config, relative);
+		if (status < 0)
+			return status;
+
+		add_pending(config, config->pending.created, relative);
+		break;
+
+	case DELETE_DIR:
+		if (is_dir) {
+			status = empty_merged_directory(config, relative);
+			if (status < 0)
+				return status;
+		}
+		/* Fall through.  */
+
+	case DELETE:
+		if (!in_upper) {
+			status = create_placeholder(config, relative, &lower_stat);
+			if (status < 0)
+				return status;
+		}
+
+		if (in_lower)
+			add_pending(config, config->pending.whiteouts, relative);
+		break;
+
+	case MOVE:
+	case EXCHANGE:
+		/* The content of a merged directory can't be moved
+		 * atomically, programs like mv(1) fall back to a copy
+		 * in this case.  */
+		if (in_lower && is_dir)
+			return -EXDEV;
+
+		if (!in_upper) {
+			status = copy_up(config, relative, &lower_stat);
+			if (status < 0)
+				return status;
+		}
+
+		if (in_lower && access == MOVE)
+			add_pending(config, config->pending.whiteouts, relative);
+		break;
+	}
+
+	return set_sysarg_path(tracee, upper_path, sysarg);
+}
+
+/**
+ * Prepare the layers for open(2) with the given @flags, see
+ * prepare_path().
+ */
+static int prepare_open(Tracee *tracee, Config *config, Reg sysarg, int flags)
+{
+	int status;
+
+	if ((flags & O_ACCMODE) != O_RDONLY || (flags & O_TRUNC) != 0) {
+		status = prepare_path(tracee, config, sysarg, MODIFY);
+		if (status < 0)
+			return status;
+	}
+
+	if ((flags & O_CREAT) != 0)
+		return prepare_path(tracee, config, sysarg, CREATE);
+
+	return 0;
+}
+
+/**
+ * Append a dentry for @dirent to @listing.  This function returns
+ * -errno if an error occurred, otherwise 0.
+ */
+static int add_dentry(Listing *listing, const struct dirent *dirent)
+{
+	size_t length;
+
+	length = talloc_array_length(listing->dentries);
+	listing->dentries = talloc_realloc(listing, listing->dentries, Dentry, length + 1);
+	if (listing->dentries == NULL)
+		return -ENOMEM;
+
+	listing->dentries[length].inode = dirent->d_ino;
+	listing->dentries[length].type  = dirent->d_type;
+	listing->dentries[length].name  = talloc_strdup(listing->dentries, dirent->d_name);
+	if (listing->dentries[length].name == NULL)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static int add_upper_dentry(const Config *config UNUSED, const char *relative UNUSED,
+			const struct dirent *dirent, void *data)
+{
+	if (strncmp(dirent->d_name, WHITEOUT_PREFIX, strlen(WHITEOUT_PREFIX)) == 0)
+		return 0;
+
+	return add_dentry(data, dirent);
+}
+
+static int add_lower_dentry(const Config *config, const char *relative,
+			const struct dirent *dirent, void *data)
+{
+	if (!is_visible_lower_dentry(config, relative, dirent->d_name))
+		return 0;
+
+	return add_dentry(data, dirent);
+}
+
+/**
+ * Return the merged listing of the directory opened as @fd by
+ * @tracee, or NULL if this directory doesn't need to be merged.
+ */
+static Listing *get_listing(const Tracee *tracee, Config *config, int fd)
+{
+	char path[PATH_MAX];
+	struct dirent dot;
+	struct stat statl;
+	const char *relative;
+	Listing *listing;
+	int status;
+
+	status = readlink_proc_pid_fd(tracee->pid, fd, path);
+	if (status < 0)
+		return NULL;
+
+	LIST_FOREACH(listing, config->listings, link) {
+		if (listing->fd != fd)
+			continue;
+
+		/* The file descriptor was reused behind our back.  */
+		if (strcmp(listing->path, path) != 0) {
+			LIST_REMOVE(listing, link);
+			TALLOC_FREE(listing);
+			break;
+		}
+
+		return listing;
+	}
+
+	/* Only directories of the upper layer may contain whiteouts
+	 * or shadow directories of the lower layer.  */
+	if (split_path(tracee, config, path, &relative) != UPPER_LAYER)
+		return NULL;
+
+	listing = talloc_zero(config->listings, Listing);
+	if (listing == NULL)
+		return NULL;
+
+	listing->fd = fd;
+	listing->path = talloc_strdup(listing, path);
+	listing->dentries = talloc_array(listing, Dentry, 0);
+	if (listing->path == NULL || listing->dentries == NULL)
+		goto error;
+
+	/* From now on "path" is used as a scratch buffer.  */
+	relative = listing->path + (relative - path);
+
+	/* "." and ".." are skipped by foreach_dentry().  */
+	memset(&dot, 0, sizeof(dot));
+	dot.d_type = DT_DIR;
+	strcpy(dot.d_name, ".");
+	if (lstat(path, &statl) == 0)
+		dot.d_ino = statl.st_ino;
+	if (add_dentry(listing, &dot) < 0)
+		goto error;
+
+	strcpy(dot.d_name, "..");
+	if (strlen(path) + 3 < PATH_MAX && lstat(strcat(path, "/.."), &statl) == 0)
+		dot.d_ino = statl.st_ino;
+	if (add_dentry(listing, &dot) < 0)
+		goto error;
+
+	status = foreach_dentry(config, UPPER_LAYER, relative, add_upper_dentry, listing);
+	if (status < 0)
+		goto error;
+
+	status = opaque_path(config, relative, path);
+	if (status < 0)
+		goto error;
+
+	if (!exists(path)) {
+		status = foreach_dentry(config, LOWER_LAYER, relative, add_lower_dentry, listing);
+		if (status < 0 && status != -ENOENT && status != -ENOTDIR)
+			goto error;
+	}
+
+	LIST_INSERT_HEAD(config->listings, listing, link);
+	return listing;
+
+error:
+	TALLOC_FREE(listing);
+	return NULL;
+}
+
+/**
+ * Forget the listing of the directory opened as @fd, if any.
+ */
+static void drop_listing(Config *config, int fd)
+{
+	Listing *listing;
+
+	LIST_FOREACH(listing, config->listings, link) {
+		if (listing->fd == fd) {
+			LIST_REMOVE(listing, link);
+			TALLOC_FREE(listing);
+			return;
+		}
+	}
+}
+
+/**
+ * Emulate getdents(2), or getdents64(2) if @is_new_getdents is true,
+ * for merged directories.  This function returns -errno if an error
+ * occurred, otherwise 0.
+ */
+static int handle_getdents(Tracee *tracee, Config *config, bool is_new_getdents)
+{
+	Listing *listing;
+	size_t offset;
+	size_t count;
+	word_t address;
+	char *buffer;
+	int status;
+
+	listing = get_listing(tracee, config, peek_reg(tracee, CURRENT, SYSARG_1));
+	if (listing == NULL)
+		return 0;
+
+	address = peek_reg(tracee, CURRENT, SYSARG_2);
+	count   = peek_reg(tracee, CURRENT, SYSARG_3);
+
+	buffer = talloc_size(tracee->ctx, count);
+	if (buffer == NULL)
+		return -ENOMEM;
+
+	offset = 0;
+	while (listing->index < talloc_array_length(listing->dentries)) {
+		size_t size;
+
+		size = write_dentry(tracee, buffer + offset, count - offset,
+				&listing->dentries[listing->index], listing->index + 1,
+				is_new_getdents);
+		if (size == 0)
+			break;
+
+		offset += size;
+		listing->index++;
+	}
+
+	if (offset == 0 && listing->index < talloc_array_length(listing->dentries))
+		return -EINVAL;
+
+	status = write_data(tracee, address, buffer, offset);
+	if (status < 0)
+		return status;
+
+	set_sysnum(tracee, PR_void);
+	config->pending.has_result = true;
+	config->pending.result = offset;
+
+	return 0;
+}
+
+/**
+ * Emulate lseek(2) for merged directories.  This function returns
+ * -errno if an error occurred, otherwise 0.
+ */
+static int handle_lseek(Tracee *tracee, Config *config)
+{
+	Listing *listing;
+	off_t offset;
+	off_t index;
+
+	listing = get_listing(tracee, config, peek_reg(tracee, CURRENT, SYSARG_1));
+	if (listing == NULL)
+		return 0;
+
+	offset = (off_t) peek_reg(tracee, CURRENT, SYSARG_2);
+
+	switch (peek_reg(tracee, CURRENT, SYSARG_3)) {
+	case SEEK_SET:
+		index = offset;
+		break;
+
+	case SEEK_CUR:
+		index = listing->index + offset;
+		break;
+
+	default:
+		return -EINVAL;
+	}
+
+	if (index < 0)
+		return -EINVAL;
+
+	listing->index = MIN((size_t) index, talloc_array_length(listing->dentries));
+
+	set_sysnum(tracee, PR_void);
+	config->pending.has_result = true;
+	config->pending.result = index;
+
+	return 0;
+}
+
+/**
+ * Copy up the file opened as @fd by @tracee if it belongs to the
+ * lower layer, then convert the current fchmod(2) or fchown(2) into
+ * fchmodat(2) or fchownat(2) on the upper layer.  This function
+ * returns -errno if an error occurred, otherwise 0.
+ */
+static int handle_fchmod_fchown(Tracee *tracee, Config *config, bool is_fchown)
+{
+	char upper_path[PATH_MAX];
+	char path[PATH_MAX];
+	const char *relative;
+	struct stat statl;
+	word_t arg2;
+	word_t arg3;
+	int status;
+
+	status = readlink_proc_pid_fd(tracee->pid, peek_reg(tracee, CURRENT, SYSARG_1), path);
+	if (status < 0)
+		return 0;
+
+	if (split_path(tracee, config, path, &relative) != LOWER_LAYER || relative[0] == '\0')
+		return 0;
+
+	status = layer_path(config, UPPER_LAYER, relative, upper_path);
+	if (status < 0)
+		return status;
+
+	if (!exists(upper_path)) {
+		if (lstat(path, &statl) < 0)
+			return 0;
+
+		status = copy_up(config, relative, &statl);
+		if (status < 0)
+			return status;
+	}
+
+	arg2 = peek_reg(tracee, CURRENT, SYSARG_2);
+	arg3 = peek_reg(tracee, CURRENT, SYSARG_3);
+
+	set_sysnum(tracee, is_fchown ? PR_fchownat : PR_fchmodat);
+	poke_reg(tracee, SYSARG_1, AT_FDCWD);
+	poke_reg(tracee, SYSARG_3, arg2);
+	poke_reg(tracee, SYSARG_4, is_fchown ? arg3 : 0);
+	poke_reg(tracee, SYSARG_5, 0);
+
+	return set_sysarg_path(tracee, upper_path, SYSARG_2);
+}
+
+/**
+ * Prepare the layers for the current syscall of @tracee.  This
+ * function returns -errno if an error occurred, otherwise 0.
+ */
+static int handle_sysenter_end(Tracee *tracee, Config *config)
+{
+	word_t flags;
+	int status;
+
+	switch (get_sysnum(tracee, ORIGINAL)) {
+	case PR_open:
+		return prepare_open(tracee, config, SYSARG_1, peek_reg(tracee, CURRENT, SYSARG_2));
+
+	case PR_openat:
+		return prepare_open(tracee, config, SYSARG_2, peek_reg(tracee, CURRENT, SYSARG_3));
+
+	case PR_creat:
+		return prepare_open(tracee, config, SYSARG_1, O_CREAT | O_WRONLY | O_TRUNC);
+
+	case PR_chmod:
+	case PR_chown:
+	case PR_chown32:
+	case PR_lchown:
+	case PR_lchown32:
+	case PR_truncate:
+	case PR_truncate64:
+	case PR_utime:
+	case PR_utimes:
+	case PR_setxattr:
+	case PR_lsetxattr:
+	case PR_removexattr:
+	case PR_lremovexattr:
+		return prepare_path(tracee, config, SYSARG_1, MODIFY);
+
+	case PR_fchmodat:
+	case PR_fchownat:
+	case PR_futimesat:
+		return prepare_path(tracee, config, SYSARG_2, MODIFY);
+
+	case PR_utimensat:
+		/* The file descriptor itself is modified when the
+		 * path is NULL.  */
+		if (peek_reg(tracee, ORIGINAL, SYSARG_2) == 0)
+			return 0;
+		return prepare_path(tracee, config, SYSARG_2, MODIFY);
+
+	case PR_fchmod:
+		return handle_fchmod_fchown(tracee, config, false);
+
+	case PR_fchown:
+	case PR_fchown32:
+		return handle_fchmod_fchown(tracee, config, true);
+
+	case PR_mkdir:
+	case PR_mknod:
+		return prepare_path(tracee, config, SYSARG_1, CREATE);
+
+	case PR_mkdirat:
+	case PR_mknodat:
+	case PR_symlink:
+		return prepare_path(tracee, config, SYSARG_2, CREATE);
+
+	case PR_symlinkat:
+		return prepare_path(tracee, config, SYSARG_3, CREATE);
+
+	case PR_link:
+		status = prepare_path(tracee, config, SYSARG_1, MODIFY);
+		if (status < 0)
+			return status;
+		return prepare_path(tracee, config, SYSARG_2, CREATE);
+
+	case PR_linkat:
+		status = prepare_path(tracee, config, SYSARG_2, MODIFY);
+		if (status < 0)
+			return status;
+		return prepare_path(tracee, config, SYSARG_4, CREATE);
+
+	case PR_unlink:
+		return prepare_path(tracee, config, SYSARG_1, DELETE);
+
+	case PR_rmdir:
+		return prepare_path(tracee, config, SYSARG_1, DELETE_DIR);
+
+	case PR_unlinkat:
+		flags = peek_reg(tracee, CURRENT, SYSARG_3);
+		return prepare_path(tracee, config, SYSARG_2,
+				(flags & AT_REMOVEDIR) != 0 ? DELETE_DIR : DELETE);
+
+	case PR_rename:
+		status = prepare_path(tracee, config, SYSARG_1, MOVE);
+		if (status < 0)
+			return status;
+		return prepare_path(tracee, config, SYSARG_2, REPLACE);
+
+	case PR_renameat:
+		status = prepare_path(tracee, config, SYSARG_2, MOVE);
+		if (status < 0)
+			return status;
+		return prepare_path(tracee, config, SYSARG_4, REPLACE);
+
+	case PR_renameat2:
+		flags = peek_reg(tracee, CURRENT, SYSARG_5);
+		if ((flags & RENAME_EXCHANGE) != 0) {
+			status = prepare_path(tracee, config, SYSARG_2, EXCHANGE);
+			if (status < 0)
+				return status;
+			return prepare_path(tracee, config, SYSARG_4, EXCHANGE);
+		}
+
+		status = prepare_path(tracee, config, SYSARG_2, MOVE);
+		if (status < 0)
+			return status;
+		/* Let the kernel report EEXIST for RENAME_NOREPLACE.  */
+		return prepare_path(tracee, config, SYSARG_4, (flags & RENAME_NOREPLACE) != 0
+				? CREATE : REPLACE);
+
+	case PR_getdents:
+		return handle_getdents(tracee, config, false);
+
+	case PR_getdents64:
+		return handle_getdents(tracee, config, true);
+
+	case PR_lseek:
+		return handle_lseek(tracee, config);
+
+	case PR_close:
+		drop_listing(config, peek_reg(tracee, CURRENT, SYSARG_1));
+		return 0;
+
+	case PR_dup2:
+	case PR_dup3:
+		drop_listing(config, peek_reg(tracee, CURRENT, SYSARG_2));
+		return 0;
+
+	default:
+		return 0;
+	}
+}
+
+/**
+ * Undo the preparation of the layers made for the current syscall,
+ * since it failed.
+ */
+static void discard_pending(Config *config)
+{
+	char path[PATH_MAX];
+
+	if (config->pending.placeholder != NULL
+	    && layer_path(config, UPPER_LAYER, config->pending.placeholder, path) == 0) {
+		if (unlink(path) < 0 && errno == EISDIR)
+			(void) rmdir(path);
+	}
+}
+
+/**
+ * Record in the upper layer the changes made by the current syscall,
+ * since it succeed.
+ */
+static void commit_pending(Config *config)
+{
+	char lower_path[PATH_MAX];
+	char upper_path[PATH_MAX];
+	char path[PATH_MAX];
+	struct stat statl;
+	bool shadowed;
+	int fd;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		const char *relative = config->pending.whiteouts[i];
+
+		if (relative == NULL || whiteout_path(config, relative, path) < 0)
+			continue;
+
+		fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+		if (fd >= 0)
+			close(fd);
+	}
+
+	for (i = 0; i < 2; i++) {
+		const char *relative = config->pending.created[i];
+
+		if (relative == NULL || whiteout_path(config, relative, path) < 0)
+			continue;
+
+		shadowed = (unlink(path) == 0);
+
+		/* A new directory must not reveal the content of a
+		 * former directory from the lower layer.  */
+		if (layer_path(config, UPPER_LAYER, relative, upper_path) < 0
+		    || lstat(upper_path, &statl) < 0 || !S_ISDIR(statl.st_mode))
+			continue;
+
+		if (!shadowed && layer_path(config, LOWER_LAYER, relative, lower_path) == 0)
+			shadowed = exists(lower_path);
+
+		if (shadowed && opaque_path(config, relative, path) == 0) {
+			fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+			if (fd >= 0)
+				close(fd);
+		}
+	}
+}
+
+static void clear_pending(Config *config)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		TALLOC_FREE(config->pending.whiteouts[i]);
+		TALLOC_FREE(config->pending.created[i]);
+	}
+	TALLOC_FREE(config->pending.placeholder);
+	config->pending.has_result = false;
+}
+
+/**
+ * Record the changes made by the current syscall of @tracee, or
+ * undo the preparation of the layers if it failed.
+ */
+static void handle_sysexit_end(Tracee *tracee, Config *config)
+{
+	Listing *listing;
+	word_t result;
+
+	if (config->pending.has_result)
+		poke_reg(tracee, SYSARG_RESULT, config->pending.result);
+
+	result = peek_reg(tracee, CURRENT, SYSARG_RESULT);
+
+	if ((int) result < 0)
+		discard_pending(config);
+	else
+		commit_pending(config);
+
+	clear_pending(config);
+
+	switch (get_sysnum(tracee, ORIGINAL)) {
+	case PR_execve:
+		/* Directory streams don't survive execve(2).  */
+		if ((int) result < 0)
+			break;
+
+		while ((listing = LIST_FIRST(config->listings)) != NULL) {
+			LIST_REMOVE(listing, link);
+			TALLOC_FREE(listing);
+		}
+		break;
+
+	case PR_open:
+	case PR_openat:
+	case PR_creat:
+		if ((int) result >= 0)
+			drop_listing(config, result);
+		break;
+
+	default:
+		break;
+	}
+}
+
+/**
+ * Allocate a new configuration for @extension, using @upper as the
+ * upper layer.  This function returns -1 if an error occurred,
+ * otherwise 0.
+ */
+static int new_config(Extension *extension, const char *upper)
+{
+	Config *config;
+
+	extension->config = talloc_zero(extension, Config);
+	if (extension->config == NULL)
+		return -1;
+	config = extension->config;
+
+	config->upper = talloc_strdup(config, upper);
+	config->listings = talloc_zero(config, Listings);
+	if (config->upper == NULL || config->listings == NULL)
+		return -1;
+
+	LIST_INIT(config->listings);
+	return 0;
+}
+
+/* List of syscalls handled by this extensions.  */
+static FilteredSysnum filtered_sysnums[] = {
+	{ PR_chmod,		FILTER_SYSEXIT },
+	{ PR_chown,		FILTER_SYSEXIT },
+	{ PR_chown32,		FILTER_SYSEXIT },
+	{ PR_close,		0 },
+	{ PR_creat,		FILTER_SYSEXIT },
+	{ PR_dup2,		0 },
+	{ PR_dup3,		0 },
+	{ PR_execve,		FILTER_SYSEXIT },
+	{ PR_fchmod,		FILTER_SYSEXIT },
+	{ PR_fchmodat,		FILTER_SYSEXIT },
+	{ PR_fchown,		FILTER_SYSEXIT },
+	{ PR_fchown32,		FILTER_SYSEXIT },
+	{ PR_fchownat,		FILTER_SYSEXIT },
+	{ PR_futimesat,		FILTER_SYSEXIT },
+	{ PR_getdents,		FILTER_SYSEXIT },
+	{ PR_getdents64,	FILTER_SYSEXIT },
+	{ PR_lchown,		FILTER_SYSEXIT },
+	{ PR_lchown32,		FILTER_SYSEXIT },
+	{ PR_link,		FILTER_SYSEXIT },
+	{ PR_linkat,		FILTER_SYSEXIT },
+	{ PR_lremovexattr,	FILTER_SYSEXIT },
+	{ PR_lseek,		FILTER_SYSEXIT },
+	{ PR_lsetxattr,		FILTER_SYSEXIT },
+	{ PR_mkdir,		FILTER_SYSEXIT },
+	{ PR_mkdirat,		FILTER_SYSEXIT },
+	{ PR_mknod,		FILTER_SYSEXIT },
+	{ PR_mknodat,		FILTER_SYSEXIT },
+	{ PR_open,		FILTER_SYSEXIT },
+	{ PR_openat,		FILTER_SYSEXIT },
+	{ PR_removexattr,	FILTER_SYSEXIT },
+	{ PR_rename,		FILTER_SYSEXIT },
+	{ PR_renameat,		FILTER_SYSEXIT },
+	{ PR_renameat2,		FILTER_SYSEXIT },
+	{ PR_rmdir,		FILTER_SYSEXIT },
+	{ PR_setxattr,		FILTER_SYSEXIT },
+	{ PR_symlink,		FILTER_SYSEXIT },
+	{ PR_symlinkat,		FILTER_SYSEXIT },
+	{ PR_truncate,		FILTER_SYSEXIT },
+	{ PR_truncate64,	FILTER_SYSEXIT },
+	{ PR_unlink,		FILTER_SYSEXIT },
+	{ PR_unlinkat,		FILTER_SYSEXIT },
+	{ PR_utime,		FILTER_SYSEXIT },
+	{ PR_utimensat,		FILTER_SYSEXIT },
+	{ PR_utimes,		FILTER_SYSEXIT },
+	FILTERED_SYSNUM_END,
+};
+
+/**
+ * Handler for this @extension.  It is triggered each time an @event
+ * occurred.  See ExtensionEvent for the meaning of @data1 and @data2.
+ */
+int overlay_callback(Extension *extension, ExtensionEvent event, intptr_t data1, intptr_t data2)
+{
+	switch (event) {
+	case INITIALIZATION: {
+		char upper[PATH_MAX];
+		const char *path = (const char *) data1;
+		Tracee *tracee = TRACEE(extension);
+
+		if (path == NULL || path[0] == '\0') {
+			note(tracee, ERROR, USER, "--overlay: no directory specified");
+			return -1;
+		}
+
+		if (mkdir(path, S_IRWXU) < 0 && errno != EEXIST) {
+			note(tracee, ERROR, SYSTEM, "--overlay: can't create %s", path);
+			return -1;
+		}
+
+		if (realpath(path, upper) == NULL) {
+			note(tracee, ERROR, SYSTEM, "--overlay: can't resolve %s", path);
+			return -1;
+		}
+
+		if (new_config(extension, upper) < 0)
+			return -1;
+
+		extension->filtered_sysnums = filtered_sysnums;
+		return 0;
+	}
+
+	case INHERIT_PARENT: /* Inheritable for sub reconfiguration ...  */
+		return 1;
+
+	case INHERIT_CHILD: {
+		/* ... but the pending changes and the directory
+		 * listings are specific to each tracee.  */
+		Extension *parent = (Extension *) data1;
+		Config *parent_config = talloc_get_type_abort(parent->config, Config);
+
+		if (new_config(extension, parent_config->upper) < 0)
+			return -1;
+
+		if (parent_config->lower != NULL) {
+			Config *config = extension->config;
+
+			config->lower = talloc_strdup(config, parent_config->lower);
+			if (config->lower == NULL)
+				return -1;
+		}
+		return 0;
+	}
+
+	case HOST_PATH:
+	case TRANSLATED_PATH: {
+		Config *config = talloc_get_type_abort(extension->config, Config);
+		resolve_path(TRACEE(extension), config, (char *) data1);
+		return 0;
+	}
+
+	case DETRANSLATE_PATH: {
+		Tracee *tracee = TRACEE(extension);
+		Config *config = talloc_get_type_abort(extension->config, Config);
+		char *paths[2] = { (char *) data1, (char *) data2 };
+		char lower_path[PATH_MAX];
+		const char *relative;
+		int i;
+
+		/* The tracee has to see the upper layer as the guest
+		 * rootfs.  */
+		for (i = 0; i < 2; i++) {
+			if (paths[i] == NULL)
+				continue;
+
+			if (split_path(tracee, config, paths[i], &relative) != UPPER_LAYER)
+				continue;
+
+			if (layer_path(config, LOWER_LAYER, relative, lower_path) == 0)
+				strcpy(paths[i], lower_path);
+		}
+		return 0;
+	}
+
+	case SYSCALL_ENTER_END: {
+		Tracee *tracee = TRACEE(extension);
+		Config *config = talloc_get_type_abort(extension->config, Config);
+		int status;
+
+		/* PRoot couldn't translate the paths, nothing to
+		 * prepare.  */
+		if ((int) data1 < 0)
+			return 0;
+
+		if (get_lower(tracee, config) == NULL)
+			return 0;
+
+		status = handle_sysenter_end(tracee, config);
+		if (status < 0) {
+			discard_pending(config);
+			clear_pending(config);
+		}
+		return status;
+	}
+
+	case SYSCALL_EXIT_END: {
+		Config *config = talloc_get_type_abort(extension->config, Config);
+		handle_sysexit_end(TRACEE(extension), config);
+		return 0;
+	}
+
+	default:
+		return 0;
+	}
+}
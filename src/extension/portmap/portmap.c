@@ -4,27 +4,101 @@
 
 #include <stdint.h>         /* intptr_t, */
 #include <stdlib.h>         /* strtoul(3), */
+#include <stdio.h>          /* fopen(3), fgets(3), sscanf(3), */
 #include <string.h>			/* memset */
+#include <unistd.h>         /* readlink(2), */
+#include <limits.h>         /* PATH_MAX, INT_MAX, */
+#include <sched.h>          /* CLONE_FILES, */
 #include <sys/un.h>         /* strncpy */
 #include <sys/socket.h>	    /* AF_UNIX, AF_INET */
+#include <sys/syscall.h>    /* SYS_pidfd_*, */
 #include <arpa/inet.h>      /* inet_ntop */
 #include <linux/net.h>   	/* SYS_*, */
 #include "cli/note.h"
 #include "extension/extension.h"
 #include "tracee/mem.h"     /* read_data */
-#include "syscall/chain.h"  /* register_chained_syscall */
 #include "extension/portmap/portmap.h"
 
 Extension *global_portmap_extension = NULL;
 
+/* State of a socket bound in netcoop mode.  */
+typedef struct SocketState {
+	int family;          /* AF_INET or AF_INET6, 0 if unknown */
+	int type;            /* SOCK_STREAM, SOCK_DGRAM, ... 0 if unknown */
+	uint16_t port_in;    /* port requested by the guest */
+	uint16_t port_out;   /* port actually assigned by the host */
+	bool pending;        /* port_out is not known yet */
+	bool bound;          /* bind() succeeded */
+} SocketState;
+
+/* Sockets of a process, indexed by their file descriptor.  */
+typedef struct FdTable {
+	SocketState *sockets;
+} FdTable;
+
 typedef struct Config {
-	PortMap portmap;
-	bool netcoop_mode;
-	bool need_to_check_new_port;
-	uint16_t old_port;
-	word_t sockfd;
+	PortMap *portmap;    /* shared by all tracees */
+	FdTable *fds;        /* shared by tracees sharing their file descriptors */
 } Config;
 
+/**
+ * Return the state of the socket @sockfd in @config->fds.  A new
+ * empty state is created if @create is true, otherwise NULL is
+ * returned for unknown sockets.
+ */
+static SocketState *get_socket_state(Config *config, word_t sockfd, bool create)
+{
+	FdTable *fds = config->fds;
+	size_t nb_sockets = talloc_array_length(fds->sockets);
+	SocketState *sockets;
+	size_t new_nb_sockets;
+
+	if (sockfd < nb_sockets)
+		return &fds->sockets[sockfd];
+
+	if (!create || sockfd > INT_MAX)
+		return NULL;
+
+	new_nb_sockets = nb_sockets != 0 ? nb_sockets : 16;
+	while (new_nb_sockets <= sockfd)
+		new_nb_sockets *= 2;
+
+	sockets = talloc_realloc(fds, fds->sockets, SocketState, new_nb_sockets);
+	if (sockets == NULL)
+		return NULL;
+
+	memset(&sockets[nb_sockets], 0, (new_nb_sockets - nb_sockets) * sizeof(SocketState));
+	fds->sockets = sockets;
+
+	return &fds->sockets[sockfd];
+}
+
+/**
+ * Remember that @sockfd is about to be bound to a port assigned by
+ * the system instead of @port_in, see complete_bind().  Return 1 if
+ * the port can be changed, 0 otherwise.
+ */
+static int request_host_port(Config *config, word_t sockfd, int family, uint16_t port_in)
+{
+	SocketState *socket;
+
+	/* Nothing to map for ports already assigned by the system.  */
+	if (port_in == 0)
+		return 0;
+
+	socket = get_socket_state(config, sockfd, true);
+	if (socket == NULL)
+		return 0;
+
+	socket->family   = family;
+	socket->port_in  = port_in;
+	socket->port_out = 0;
+	socket->pending  = true;
+	socket->bound    = false;
+
+	return 1;
+}
+
 /**
  * Change the port of the socket address, if it maps with an entry.
  * Return 0 if no relevant entry is found, and 1 if the port has been changed.
@@ -33,15 +107,13 @@ int change_inet_socket_port(Tracee *tracee, Config *config, word_t sockfd, struc
 	uint16_t port_in, port_out;
 
 	port_in = sockaddr->sin_port;
-	port_out = get_port(&config->portmap, port_in);
+	port_out = get_port(config->portmap, port_in);
 
 	if(port_out == PORTMAP_DEFAULT_VALUE) {
-		if (bind_mode && config->netcoop_mode && !config->need_to_check_new_port) {
+		if (bind_mode && config->portmap->netcoop_mode
+		    && request_host_port(config, sockfd, AF_INET, port_in)) {
 			VERBOSE(tracee, PORTMAP_VERBOSITY, "ipv4 netcoop mode with: %d", htons(port_in));
 			sockaddr->sin_port = 0; // the system will assign an available port
-			config->old_port = port_in; // we keep this one for adding a new entry
-			config->need_to_check_new_port = true;
-			config->sockfd = sockfd;
 			return 1;
 		}
 
@@ -63,15 +135,13 @@ int change_inet6_socket_port(Tracee *tracee, Config *config, word_t sockfd, stru
 	uint16_t port_in, port_out;
 
 	port_in = sockaddr->sin6_port;
-	port_out = get_port(&config->portmap, port_in);
+	port_out = get_port(config->portmap, port_in);
 
 	if(port_out == PORTMAP_DEFAULT_VALUE) {
-		if (bind_mode && config->netcoop_mode && !config->need_to_check_new_port) {
+		if (bind_mode && config->portmap->netcoop_mode
+		    && request_host_port(config, sockfd, AF_INET6, port_in)) {
 			VERBOSE(tracee, PORTMAP_VERBOSITY, "ipv6 netcoop mode with: %d", htons(port_in));
 			sockaddr->sin6_port = 0; // the system will assign an available port
-			config->old_port = port_in; // we keep this one for adding a new entry
-			config->need_to_check_new_port = true;
-			config->sockfd = sockfd;
 			return 1;
 		}
 
@@ -85,81 +155,221 @@ int change_inet6_socket_port(Tracee *tracee, Config *config, word_t sockfd, stru
 	return 1;
 }
 
-int prepare_getsockname_chained_syscall(Tracee *tracee, Config *config, word_t sockfd, int is_socketcall) {
-	int status = 0;
-	word_t sock_addr, size_addr;
-	struct sockaddr_un sockaddr;
-	socklen_t size;
+/**
+ * Search the socket table @name of the @tracee's network namespace
+ * (see /proc/net/tcp in proc(5)) for the socket @inode, and store its
+ * local port -- in network byte order -- into @port.  Return 1 if
+ * found, 0 if not, and -errno if an error occured.
+ */
+static int search_socket_table(const Tracee *tracee, const char *name, unsigned long inode, uint16_t *port)
+{
+	char path[PATH_MAX];
+	char line[512];
+	unsigned long line_inode;
+	unsigned int line_port;
+	FILE *file;
+	int status;
 
-	size = sizeof(sockaddr);
+	status = snprintf(path, sizeof(path), "/proc/%d/net/%s", tracee->pid, name);
+	if (status < 0 || (size_t) status >= sizeof(path))
+		return -ENAMETOOLONG;
 
-	/* we check that it's the correct socket */
-	if(sockfd != config->sockfd)
-		return 0;
+	file = fopen(path, "r");
+	if (file == NULL)
+		return -errno;
 
-	/* we allocate a memory place to store the socket address.
-	 * This is a buffer that will be filled by the getsockname() syscall.
-	 */
-	sock_addr = alloc_mem(tracee, sizeof(sockaddr));
-	if (sock_addr == 0)
-		return -EFAULT;
-	size_addr = alloc_mem(tracee, sizeof(socklen_t));
-	if(size_addr == 0)
-		return -EFAULT;
+	status = 0;
+	while (fgets(line, sizeof(line), file) != NULL) {
+		/* sl local_address rem_address st tx_queue:rx_queue
+		 * tr:tm->when retrnsmt uid timeout inode ...  */
+		if (sscanf(line, " %*d: %*[0-9A-Fa-f]:%x %*[0-9A-Fa-f]:%*x %*x %*x:%*x %*x:%*x %*x %*u %*u %lu",
+			   &line_port, &line_inode) != 2)
+			continue;
+
+		if (line_inode == inode) {
+			*port = htons(line_port);
+			status = 1;
+			break;
+		}
+	}
 
-	memset(&sockaddr, '\0', sizeof(sockaddr));
+	fclose(file);
+	return status;
+}
 
-	/* we write the modified socket in this new address */
-	status = write_data(tracee, sock_addr, &sockaddr, sizeof(sockaddr));
+/**
+ * Get the local port -- in network byte order -- of the socket
+ * @sockfd of @tracee by duplicating this latter into PRoot, see
+ * pidfd_getfd(2).  Return -errno if an error occured, otherwise 0.
+ */
+static int getsockname_pidfd(const Tracee *tracee, word_t sockfd, uint16_t *port)
+{
+#if defined(SYS_pidfd_open) && defined(SYS_pidfd_getfd)
+	struct sockaddr_storage address;
+	socklen_t size = sizeof(address);
+	int pidfd;
+	int fd;
+	int status;
+
+	pidfd = syscall(SYS_pidfd_open, tracee->pid, 0);
+	if (pidfd < 0)
+		return -errno;
+
+	fd = syscall(SYS_pidfd_getfd, pidfd, (int) sockfd, 0);
+	status = (fd < 0 ? -errno : 0);
+	close(pidfd);
 	if (status < 0)
 		return status;
-	status = write_data(tracee, size_addr, &size, sizeof(size));
+
+	status = getsockname(fd, (struct sockaddr *) &address, &size);
+	status = (status < 0 ? -errno : 0);
+	close(fd);
 	if (status < 0)
 		return status;
 
-	/* Only by using getsockname can we retrieve the port automatically
-	 * assigned by the system to the socket.
-	 */
-	if (!is_socketcall) {
-		status = register_chained_syscall(
-				tracee, PR_getsockname,
-				sockfd,  // SYS_ARG1, socket file descriptor.
-				sock_addr,
-				size_addr,
-				0, 0, 0
-		);
-	} else {
-		unsigned long args[6];
-		
-		args[0] = sockfd;
-		args[1] = sock_addr;
-		args[2] = size_addr;
-		args[3] = 0;
-		args[4] = 0;
-		args[5] = 0;
-		
-		/* We allocate a little bloc of memory to store socketcall's arguments */
-		word_t args_addr = alloc_mem(tracee, 6 * sizeof_word(tracee));
-		
-		status = write_data(tracee, args_addr, &args, 6 * sizeof_word(tracee));
-	
-		status = register_chained_syscall(
-				tracee, PR_socketcall,
-				SYS_GETSOCKNAME,
-				args_addr,  // SYS_ARG1, socket file descriptor.
-				0,
-				0,
-				0, 0
-		);
+	switch (address.ss_family) {
+	case AF_INET:
+		*port = ((struct sockaddr_in *) &address)->sin_port;
+		return 0;
+
+	case AF_INET6:
+		*port = ((struct sockaddr_in6 *) &address)->sin6_port;
+		return 0;
+
+	default:
+		return -EAFNOSUPPORT;
 	}
-			
-	if (status < 0)
-		return status;
-	//status = restart_original_syscall(tracee);
-	//if (status < 0)
-	//    return status;
+#else
+	return -ENOSYS;
+#endif
+}
 
-	return 0;
+/**
+ * Get the port the system assigned to the @socket @sockfd of
+ * @tracee, and store it into @port.  This is done from the outside of
+ * @tracee to avoid chaining a getsockname() syscall.  Return -errno
+ * if an error occured, otherwise 0.
+ */
+static int get_host_port(const Tracee *tracee, word_t sockfd, const SocketState *socket, uint16_t *port)
+{
+	const char *tables[2];
+	char path[PATH_MAX];
+	char link[64];
+	unsigned long inode;
+	ssize_t length;
+	size_t i;
+	int status;
+
+	status = getsockname_pidfd(tracee, sockfd, port);
+	if (status == 0)
+		return 0;
+
+	/* Otherwise search the socket tables of the system.  Note
+	 * that TCP sockets appear there only once listening.  */
+
+	status = snprintf(path, sizeof(path), "/proc/%d/fd/%lu", tracee->pid, (unsigned long) sockfd);
+	if (status < 0 || (size_t) status >= sizeof(path))
+		return -ENAMETOOLONG;
+
+	length = readlink(path, link, sizeof(link) - 1);
+	if (length < 0)
+		return -errno;
+	link[length] = '\0';
+
+	if (sscanf(link, "socket:[%lu]", &inode) != 1)
+		return -ENOTSOCK;
+
+	/* Search the most likely table first.  */
+	if (socket->family == AF_INET6) {
+		tables[0] = "tcp6";
+		tables[1] = "udp6";
+	}
+	else {
+		tables[0] = "tcp";
+		tables[1] = "udp";
+	}
+
+	if (socket->type == SOCK_DGRAM) {
+		const char *tmp = tables[0];
+		tables[0] = tables[1];
+		tables[1] = tmp;
+	}
+
+	for (i = 0; i < 2; i++) {
+		status = search_socket_table(tracee, tables[i], inode, port);
+		if (status != 0)
+			return status < 0 ? status : 0;
+	}
+
+	return -ENOENT;
+}
+
+/**
+ * Add a port map entry for the socket @sockfd if it was bound to a
+ * port assigned by the system in netcoop mode.  Return -errno if an
+ * error occured, otherwise 0.
+ */
+static int add_host_port_entry(Tracee *tracee, Config *config, word_t sockfd)
+{
+	SocketState *socket;
+	uint16_t port_out;
+	int status;
+
+	socket = get_socket_state(config, sockfd, false);
+	if (socket == NULL || !socket->pending || !socket->bound)
+		return 0;
+
+	status = get_host_port(tracee, sockfd, socket, &port_out);
+	if (status < 0) {
+		VERBOSE(tracee, PORTMAP_VERBOSITY, "can't get the port assigned to socket %lu yet: %s",
+			(unsigned long) sockfd, strerror(-status));
+		return 0;
+	}
+
+	socket->port_out = port_out;
+	socket->pending  = false;
+
+	return add_entry(config->portmap, socket->port_in, socket->port_out);
+}
+
+/**
+ * Update the state of the socket @sockfd according to the @result of
+ * bind(), then add its port map entry if possible.  Return -errno if
+ * an error occured, otherwise 0.
+ */
+static int complete_bind(Tracee *tracee, Config *config, word_t sockfd, int result)
+{
+	SocketState *socket;
+
+	socket = get_socket_state(config, sockfd, false);
+	if (socket == NULL || !socket->pending)
+		return 0;
+
+	if (result < 0) {
+		socket->pending = false;
+		return 0;
+	}
+
+	socket->bound = true;
+
+	return add_host_port_entry(tracee, config, sockfd);
+}
+
+/**
+ * Reset the state of the socket @sockfd, just created with the given
+ * @family and @type.
+ */
+static void new_socket(Config *config, word_t sockfd, int family, int type)
+{
+	SocketState *socket;
+
+	socket = get_socket_state(config, sockfd, true);
+	if (socket == NULL)
+		return;
+
+	memset(socket, 0, sizeof(SocketState));
+	socket->family = family;
+	socket->type   = type & 0xF; /* ignore SOCK_NONBLOCK and SOCK_CLOEXEC */
 }
 
 int translate_port(Tracee *tracee, Config *config, word_t sockfd, word_t *sock_addr, int size, int is_bind_syscall) {
@@ -212,14 +422,6 @@ int translate_port(Tracee *tracee, Config *config, word_t sockfd, word_t *sock_a
 	return 0;
 }
 
-static int handle_sysenter_end(Tracee *tracee, Config *config)
-{
-	int status;
-	int sysnum;
-
-	sysnum = get_sysnum(tracee, CURRENT);
-
-	switch(sysnum) {
 #define SYSARG_ADDR(n) (args_addr + ((n) - 1) * sizeof_word(tracee))
 
 #define PEEK_WORD(addr, forced_errno)		\
@@ -235,7 +437,15 @@ static int handle_sysenter_end(Tracee *tracee, Config *config)
 		status = -errno;		\
 		break;				\
 	}
-	
+
+static int handle_sysenter_end(Tracee *tracee, Config *config)
+{
+	int status;
+	int sysnum;
+
+	sysnum = get_sysnum(tracee, CURRENT);
+
+	switch(sysnum) {
 	case PR_socketcall:	{
 		word_t sockfd;
 		word_t args_addr;
@@ -273,28 +483,11 @@ static int handle_sysenter_end(Tracee *tracee, Config *config)
 			POKE_WORD(SYSARG_ADDR(3), sizeof(struct sockaddr_un));
 			return 0;
 		}
-		case SYS_LISTEN: {
-			word_t sockfd;
-		
-			if(!config->netcoop_mode || !config->need_to_check_new_port)
-				return 0;
-
-			/* we retrieve this one from the listen() system call */
-			sockfd = PEEK_WORD(SYSARG_ADDR(1), 0);
-	
-			status = prepare_getsockname_chained_syscall(tracee, config, sockfd, true);
-			
-			return status;
-		}
 		default:
 			return 0;
 		}
 		break;
 	}
-	
-#undef SYSARG_ADDR
-#undef PEEK_WORD
-#undef POKE_WORD
 
 	case PR_connect:
 	case PR_bind: {
@@ -323,18 +516,6 @@ static int handle_sysenter_end(Tracee *tracee, Config *config)
 
 		return 0;
 	}
-	case PR_listen: {
-		word_t sockfd;
-		
-		if(!config->netcoop_mode || !config->need_to_check_new_port)
-			return 0;
-
-		/* we retrieve this one from the listen() system call */
-		sockfd = peek_reg(tracee, CURRENT, SYSARG_1);
-			
-		status = prepare_getsockname_chained_syscall(tracee, config, sockfd, false);
-		return status;
-	}
 	default:
 		return 0;
 	}
@@ -342,152 +523,125 @@ static int handle_sysenter_end(Tracee *tracee, Config *config)
 	return 0;
 }
 
-int add_changed_port_as_entry(Tracee *tracee, Config *config, word_t sockfd, word_t sock_addr, int result) {
+static int handle_sysexit_end(Tracee *tracee, Config *config)
+{
 	int status;
-	struct sockaddr_un sockaddr;
-	struct sockaddr_in *sockaddr_in;
-	struct sockaddr_in6 *sockaddr_in6;
-	uint16_t port_in, port_out;
+	int result;
+	int sysnum;
 
-	if(!config->need_to_check_new_port)
-		return 0;
+	sysnum = get_sysnum(tracee, ORIGINAL);
+	result = (int) peek_reg(tracee, CURRENT, SYSARG_RESULT);
 
+	switch(sysnum) {
+	case PR_socketcall:	{
+		word_t args_addr;
+		word_t call;
 
-	if (sock_addr == 0)
-		return 0;
+		call = peek_reg(tracee, ORIGINAL, SYSARG_1);
+		args_addr = peek_reg(tracee, ORIGINAL, SYSARG_2);
 
-	if (sockfd != config->sockfd)
-		return 0;
+		switch(call) {
+		case SYS_SOCKET: {
+			word_t family, type;
 
-	if (result < 0)
-		return -result;
+			if (result < 0)
+				return 0;
 
-	/* Essential step, we clean the structure before adding data to it */
-	memset(&sockaddr, '\0', sizeof(sockaddr));
+			/* Remember: PEEK_WORD puts -errno in status and breaks if an
+			 * error occured.  */
+			family = PEEK_WORD(SYSARG_ADDR(1), 0);
+			type   = PEEK_WORD(SYSARG_ADDR(2), 0);
 
-	/* Next, we read the socket address structure from the tracee's memory */
-	status = read_data(tracee, &sockaddr, sock_addr, sizeof(sockaddr));
-	if (status < 0)
-		return status;
+			new_socket(config, result, family, type);
+			return 0;
+		}
+		case SYS_BIND: {
+			word_t sockfd;
 
-	port_in = config->old_port;
+			sockfd = PEEK_WORD(SYSARG_ADDR(1), 0);
+			return complete_bind(tracee, config, sockfd, result);
+		}
+		case SYS_LISTEN: {
+			word_t sockfd;
 
-	if (sockaddr.sun_family == AF_INET) {
-		sockaddr_in = (struct sockaddr_in *) &sockaddr;
-		port_out = sockaddr_in->sin_port;
-	}
-	else if (sockaddr.sun_family == AF_INET6) {
-		sockaddr_in6 = (struct sockaddr_in6 *) &sockaddr;
-		port_out = sockaddr_in6->sin6_port;
+			if (result < 0)
+				return 0;
+
+			sockfd = PEEK_WORD(SYSARG_ADDR(1), 0);
+			return add_host_port_entry(tracee, config, sockfd);
+		}
+		default:
+			return 0;
+		}
+		break;
 	}
-	else
-		return 0;
 
-	add_portmap_entry(htons(port_in), htons(port_out));
-	config->need_to_check_new_port = false;
-	config->sockfd = 0;
+	case PR_socket:
+		if (result < 0)
+			return 0;
 
-	return 0;
-}
+		new_socket(config, result,
+			peek_reg(tracee, ORIGINAL, SYSARG_1),
+			peek_reg(tracee, ORIGINAL, SYSARG_2));
+		return 0;
 
-static int handle_syschained_exit(Tracee *tracee, Config *config)
-{
-	int sysnum;
+	case PR_bind:
+		// On AArch64 and ARM, SYSARG_1 is the same as SYSARG_RESULT (r0/x0)
+		// so the ORIGINAL version is used to get the fd.
+		return complete_bind(tracee, config, peek_reg(tracee, ORIGINAL, SYSARG_1), result);
 
-	sysnum = get_sysnum(tracee, CURRENT);
+	case PR_listen:
+		if (result < 0)
+			return 0;
 
-	switch(sysnum) {
-		
-#define SYSARG_ADDR(n) (args_addr + ((n) - 1) * sizeof_word(tracee))
+		return add_host_port_entry(tracee, config, peek_reg(tracee, ORIGINAL, SYSARG_1));
 
-#define PEEK_WORD(addr, forced_errno)		\
-	peek_word(tracee, addr);		\
-	if (errno != 0) {			\
-		status = forced_errno ?: -errno; \
-		break;				\
+	default:
+		return 0;
 	}
 
-#define POKE_WORD(addr, value)			\
-	poke_word(tracee, addr, value);		\
-	if (errno != 0) {			\
-		status = -errno;		\
-		break;				\
-	}
-	
-	case PR_socketcall:	{
-		word_t args_addr;
-		word_t call;
+	return status;
+}
 
-		call = peek_reg(tracee, CURRENT, SYSARG_1);
-		args_addr = peek_reg(tracee, CURRENT, SYSARG_2);
-	
-		switch(call) {
-			case SYS_GETSOCKNAME:{
-				word_t sockfd, sock_addr;
-				int result, status;
-			
-				sockfd = PEEK_WORD(SYSARG_ADDR(1), 0);
-				sock_addr = PEEK_WORD(SYSARG_ADDR(2), 0);
-				result = peek_reg(tracee, CURRENT, SYSARG_RESULT);
-		
-				status = add_changed_port_as_entry(tracee, config, sockfd, sock_addr, result);
-				return status;
-			}
-			default:
-				return 0;
-		}
-		return 0;
-	}
-	
 #undef SYSARG_ADDR
 #undef PEEK_WORD
 #undef POKE_WORD
 
-	case PR_getsockname:{
-		word_t sockfd, sock_addr;
-		int result;
-
-		// On AArch64 and ARM, SYSARG_1 is the same as SYSARG_RESULT (r0/x0)
-		// so `peek_reg(tracee, CURRENT, SYSARG_1)` would have returned
-		// the result of the syscall instead.
-		// Since the chained call is currently only used for syscall with
-		// `sockfd` as the first argument, we can just use
-		// the ORIGINAL version to get the fd.
-		sockfd = peek_reg(tracee, ORIGINAL, SYSARG_1);
-		sock_addr = peek_reg(tracee, CURRENT, SYSARG_2);
-		result = peek_reg(tracee, CURRENT, SYSARG_RESULT);
-	
-		return add_changed_port_as_entry(tracee, config, sockfd, sock_addr, result);
-	}
-	default:
-		return 0;
-	}
-}
-
 /* List of syscalls handled by this extension.  */
 static FilteredSysnum filtered_sysnums[] = {
 	{ PR_bind,         0 },
 	{ PR_connect,      0 },
-	{ PR_listen,       FILTER_SYSEXIT },  /* the exit stage is required to chain syscalls */
-//      { PR_getsockname,  FILTER_SYSEXIT },  /* not needed here, see CHAINED EXIT event */
 	{ PR_socketcall,   0 }, /* for x86 processors with kernel < 4.3 */
 	FILTERED_SYSNUM_END,
 };
 
+/* List of syscalls handled by this extension in netcoop mode: the
+ * exit stages are required to learn the port assigned by the system
+ * to each socket.  */
+static FilteredSysnum netcoop_filtered_sysnums[] = {
+	{ PR_bind,         FILTER_SYSEXIT },
+	{ PR_connect,      0 },
+	{ PR_listen,       FILTER_SYSEXIT },
+	{ PR_socket,       FILTER_SYSEXIT },
+	{ PR_socketcall,   FILTER_SYSEXIT }, /* for x86 processors with kernel < 4.3 */
+	FILTERED_SYSNUM_END,
+};
+
 int add_portmap_entry(uint16_t port_in, uint16_t port_out) {
 	if(global_portmap_extension == NULL)
 		return 0;
 	else {
 		Config *config = talloc_get_type_abort(global_portmap_extension->config, Config);
 		/* careful with little/big endian numbers */
-		return add_entry(&config->portmap, ntohs(port_in), ntohs(port_out));
+		return add_entry(config->portmap, ntohs(port_in), ntohs(port_out));
 	}
 }
 
 int activate_netcoop_mode() {
 	if(global_portmap_extension != NULL) {
 		Config *config = talloc_get_type_abort(global_portmap_extension->config, Config);
-		config->netcoop_mode = true;
+		config->portmap->netcoop_mode = true;
+		global_portmap_extension->filtered_sysnums = netcoop_filtered_sysnums;
 	}
 
 	return 0;
@@ -498,7 +652,7 @@ int activate_netcoop_mode() {
  * occured.  See ExtensionEvent for the meaning of @data1 and @data2.
  */
 int portmap_callback(Extension *extension, ExtensionEvent event,
-		     intptr_t data1 UNUSED, intptr_t data2 UNUSED)
+		     intptr_t data1, intptr_t data2)
 {
 	switch (event) {
 	case INITIALIZATION: {
@@ -512,10 +666,14 @@ int portmap_callback(Extension *extension, ExtensionEvent event,
 			return -1;
 
 		config = talloc_get_type_abort(extension->config, Config);
-		initialize_portmap(&config->portmap);
-		config->netcoop_mode = false;
-		config->need_to_check_new_port = false;
-		config->sockfd = 0;
+
+		config->portmap = talloc_zero(config, PortMap);
+		config->fds = talloc_zero(config, FdTable);
+		if (config->portmap == NULL || config->fds == NULL)
+			return -1;
+
+		initialize_portmap(config->portmap);
+		config->portmap->netcoop_mode = false;
 
 		extension->filtered_sysnums = filtered_sysnums;
 
@@ -530,14 +688,56 @@ int portmap_callback(Extension *extension, ExtensionEvent event,
 		Config *config = talloc_get_type_abort(extension->config, Config);
 		return handle_sysenter_end(tracee, config);
 	}
-	case SYSCALL_CHAINED_EXIT: {
+	case SYSCALL_EXIT_END: {
 		Tracee *tracee = TRACEE(extension);
 		Config *config = talloc_get_type_abort(extension->config, Config);
-		return handle_syschained_exit(tracee, config);
+
+		if (!config->portmap->netcoop_mode)
+			return 0;
+
+		return handle_sysexit_end(tracee, config);
 	}
 	case INHERIT_PARENT: {
-		/* Shared configuration with the parent,
-		 * as port maps do not change from tracee to tracee. */
+		/* The port map is shared by all tracees, however the
+		 * sockets are not, see INHERIT_CHILD.  */
+		return 1;
+	}
+	case INHERIT_CHILD: {
+		Extension *parent = (Extension *) data1;
+		Config *parent_config = talloc_get_type_abort(parent->config, Config);
+		word_t clone_flags = (word_t) data2;
+		Config *config;
+
+		extension->config = talloc_zero(extension, Config);
+		if (extension->config == NULL)
+			return -1;
+
+		config = talloc_get_type_abort(extension->config, Config);
+
+		config->portmap = talloc_reference(config, parent_config->portmap);
+		if (config->portmap == NULL)
+			return -1;
+
+		/* File descriptors are either shared with the
+		 * parent or copied from it, see clone(2).  */
+		if ((clone_flags & CLONE_FILES) != 0) {
+			config->fds = talloc_reference(config, parent_config->fds);
+			if (config->fds == NULL)
+				return -1;
+		}
+		else {
+			config->fds = talloc_zero(config, FdTable);
+			if (config->fds == NULL)
+				return -1;
+
+			if (parent_config->fds->sockets != NULL) {
+				config->fds->sockets = talloc_memdup(config->fds, parent_config->fds->sockets,
+							talloc_get_size(parent_config->fds->sockets));
+				if (config->fds->sockets == NULL)
+					return -1;
+			}
+		}
+
 		return 0;
 	}
 	default:
@@ -5,24 +5,23 @@
 #ifndef PORTMAP_H
 #define PORTMAP_H
 
+#include <stdint.h>         /* uint16_t, UINT16_MAX */
+#include <stdbool.h>        /* bool */
+
 #include "extension/extension.h"
 
-#define PORTMAP_SIZE 4096  /* must be a power of 2 */
+#define PORTMAP_SIZE (UINT16_MAX + 1)  /* one entry per port */
 #define PORTMAP_DEFAULT_VALUE 0  /* default value that indicates an unused entry */
 #define PORTMAP_VERBOSITY 1
 
-typedef struct PortMapEntry {
-	uint16_t port_in;
-	uint16_t port_out;
-} PortMapEntry;
-
+/* Ports are stored in network byte order, the map being indexed by
+ * port_in.  */
 typedef struct PortMap {
-	PortMapEntry map[PORTMAP_SIZE];
-	uint16_t table_mask;
+	uint16_t map[PORTMAP_SIZE];
+	bool netcoop_mode;
 } PortMap;
 
 void initialize_portmap(PortMap *portmap);
-uint16_t get_index(PortMap *portmap, uint16_t key);
 int add_entry(PortMap *portmap, uint16_t port_in, uint16_t port_out);
 uint16_t get_port(PortMap *portmap, uint16_t port_in);
 
@@ -94,6 +94,7 @@ typedef enum {
 	SYSCALL_ENTER_END,
 	SYSCALL_EXIT_START,
 	SYSCALL_EXIT_END,
+	TRANSLATED_PATH,
 	NEW_STATUS,
 	INHERIT_PARENT,
 	INHERIT_CHILD,
@@ -103,4 +104,15 @@ typedef enum {
 	REMOVED,
 	PRINT_CONFIG,
 	PRINT_USAGE,
+	ALREADY_OPENED_FD,
+	DETRANSLATE_PATH,
 } ExtensionEvent;
+
+/* extension/python/python.c */
+/* select forwarded events, see set_event_filter() in python.c */
+%{
+extern PyObject *set_event_filter(PyObject *sync_list, PyObject *async_list, PyObject *sysnums);
+extern PyObject *fetch_events(int max_events);
+%}
+extern PyObject *set_event_filter(PyObject *sync_list, PyObject *async_list, PyObject *sysnums);
+extern PyObject *fetch_events(int max_events);
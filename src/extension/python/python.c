@@ -1,9 +1,17 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include <Python.h>
 
 #include "extension/extension.h"
+#include "syscall/sysnum.h"
+#include "tracee/reg.h"
 #include "cli/note.h"
 #include "path/temp.h"
 
@@ -17,6 +25,78 @@ static FilteredSysnum filtered_sysnums[] = {
 	FILTERED_SYSNUM_END,
 };
 
+#define EVENT_BIT(event) (UINT64_C(1) << (event))
+
+/* Events forwarded to Python synchronously (the returned value is
+ * taken into account) or asynchronously (observe-only, see
+ * push_python_event()).  By default every event is synchronous.  */
+static uint64_t sync_events = ~UINT64_C(0);
+static uint64_t async_events = 0;
+
+/* Events that can be observed asynchronously: PRoot doesn't expect
+ * anything from Python for them.  */
+#define ASYNC_CAPABLE_EVENTS (EVENT_BIT(GUEST_PATH)		\
+			| EVENT_BIT(HOST_PATH)			\
+			| EVENT_BIT(TRANSLATED_PATH)		\
+			| EVENT_BIT(SYSCALL_ENTER_START)	\
+			| EVENT_BIT(SYSCALL_ENTER_END)		\
+			| EVENT_BIT(SYSCALL_EXIT_START)		\
+			| EVENT_BIT(SYSCALL_EXIT_END)		\
+			| EVENT_BIT(SYSCALL_CHAINED_ENTER)	\
+			| EVENT_BIT(SYSCALL_CHAINED_EXIT)	\
+			| EVENT_BIT(NEW_STATUS)			\
+			| EVENT_BIT(ALREADY_OPENED_FD)		\
+			| EVENT_BIT(DETRANSLATE_PATH))
+
+/* Events related to the current syscall of the tracee.  */
+#define SYSCALL_EVENTS (EVENT_BIT(SYSCALL_ENTER_START)		\
+			| EVENT_BIT(SYSCALL_ENTER_END)		\
+			| EVENT_BIT(SYSCALL_EXIT_START)		\
+			| EVENT_BIT(SYSCALL_EXIT_END)		\
+			| EVENT_BIT(SYSCALL_CHAINED_ENTER)	\
+			| EVENT_BIT(SYSCALL_CHAINED_EXIT))
+
+#define SYSEXIT_EVENTS (EVENT_BIT(SYSCALL_EXIT_START)		\
+			| EVENT_BIT(SYSCALL_EXIT_END)		\
+			| EVENT_BIT(SYSCALL_CHAINED_EXIT))
+
+/* Syscalls for which SYSCALL_* events are forwarded to Python, all
+ * of them if NULL.  This table is indexed by Sysnum.  */
+static bool *wanted_sysnums = NULL;
+
+/* Same as above, but in the format expected by the seccomp filter.  */
+static FilteredSysnum *python_sysnums = NULL;
+
+/* Observed events waiting to be consumed by a Python thread.  */
+typedef struct {
+	ExtensionEvent event;
+	pid_t pid;
+	uint64_t vpid;
+	Sysnum sysnum;
+	long value;
+	char *path;
+} PythonEvent;
+
+#define EVENTS_RING_SIZE   4096
+#define EVENTS_BATCH_SIZE  64
+#define EVENTS_TIMEOUT_MS  100
+
+static struct {
+	PythonEvent records[EVENTS_RING_SIZE];
+	size_t first;
+	size_t count;
+	size_t nb_dropped;
+	bool waiting;
+	bool closed;
+	pthread_mutex_t lock;
+	pthread_cond_t filled;
+	pthread_cond_t drained;
+} ring = {
+	.lock    = PTHREAD_MUTEX_INITIALIZER,
+	.filled  = PTHREAD_COND_INITIALIZER,
+	.drained = PTHREAD_COND_INITIALIZER,
+};
+
 /* build by swig */
 extern void init_proot(void);
 extern void PyInit__proot(void);
@@ -106,6 +186,11 @@ void init_python_env()
 				}
 			} else
 				note(NULL, ERROR, USER, "pName error\n");
+
+			/* Python threads -- like the consumer of observed
+			 * events -- can only run while the tracer doesn't
+			 * hold the GIL, see python_callback_func_wrapper().  */
+			(void) PyEval_SaveThread();
 			is_done = true;
 		}
 	}
@@ -114,10 +199,16 @@ void init_python_env()
 /* call python callback */
 static int python_callback_func_wrapper(Extension *extension, ExtensionEvent event, intptr_t data1, intptr_t data2)
 {
+	PyGILState_STATE gil_state;
 	int res = 0;
 	PyObject *pArgs;
 	PyObject *pValue;
 
+	if (python_callback_func == NULL)
+		return 0;
+
+	gil_state = PyGILState_Ensure();
+
 	pArgs = PyTuple_New(4);
 	if (pArgs) {
 		/* setargs */
@@ -154,9 +245,340 @@ static int python_callback_func_wrapper(Extension *extension, ExtensionEvent eve
 	} else
 		note(NULL, ERROR, USER, "pArgs allocation failure\n");
 
+	PyGILState_Release(gil_state);
+
 	return res;
 }
 
+/**
+ * Convert the Python sequence of ExtensionEvent @events into a mask.
+ * This function returns -1 and raises a Python exception if an error
+ * occurred, otherwise 0.
+ */
+static int events_to_mask(PyObject *events, uint64_t *mask)
+{
+	PyObject *sequence;
+	Py_ssize_t i;
+
+	sequence = PySequence_Fast(events, "a sequence of events is expected");
+	if (sequence == NULL)
+		return -1;
+
+	*mask = 0;
+	for (i = 0; i < PySequence_Fast_GET_SIZE(sequence); i++) {
+		long event = PyLong_AsLong(PySequence_Fast_GET_ITEM(sequence, i));
+
+		if (event == -1 && PyErr_Occurred())
+			goto error;
+
+		if (event < 0 || event > DETRANSLATE_PATH) {
+			PyErr_Format(PyExc_ValueError, "unknown event %ld", event);
+			goto error;
+		}
+
+		*mask |= EVENT_BIT(event);
+	}
+
+	Py_DECREF(sequence);
+	return 0;
+
+error:
+	Py_DECREF(sequence);
+	return -1;
+}
+
+/**
+ * Convert the Python sequence of Sysnum @sysnums into both the
+ * wanted_sysnums table and the python_sysnums list.  The latter asks
+ * for sysexit stops only if @mask contains an exit event.  This
+ * function returns -1 and raises a Python exception if an error
+ * occurred, otherwise 0.
+ */
+static int set_wanted_sysnums(PyObject *sysnums, uint64_t mask)
+{
+	FilteredSysnum *filtered;
+	PyObject *sequence;
+	Py_ssize_t nb_sysnums;
+	bool *wanted;
+	Py_ssize_t i;
+	size_t j;
+
+	sequence = PySequence_Fast(sysnums, "a sequence of sysnums is expected");
+	if (sequence == NULL)
+		return -1;
+
+	nb_sysnums = PySequence_Fast_GET_SIZE(sequence);
+
+	wanted = talloc_zero_array(talloc_autofree_context(), bool, PR_NB_SYSNUM);
+	filtered = talloc_zero_array(talloc_autofree_context(), FilteredSysnum, nb_sysnums + 1);
+	if (wanted == NULL || filtered == NULL) {
+		PyErr_NoMemory();
+		goto error;
+	}
+
+	j = 0;
+	for (i = 0; i < nb_sysnums; i++) {
+		long sysnum = PyLong_AsLong(PySequence_Fast_GET_ITEM(sequence, i));
+
+		if (sysnum == -1 && PyErr_Occurred())
+			goto error;
+
+		if (sysnum <= PR_void || sysnum >= PR_NB_SYSNUM) {
+			PyErr_Format(PyExc_ValueError, "unknown sysnum %ld", sysnum);
+			goto error;
+		}
+
+		if (wanted[sysnum])
+			continue;
+
+		wanted[sysnum] = true;
+		filtered[j].value = sysnum;
+		filtered[j].flags = (mask & SYSEXIT_EVENTS) != 0 ? FILTER_SYSEXIT : 0;
+		j++;
+	}
+	filtered[j] = (FilteredSysnum) FILTERED_SYSNUM_END;
+
+	TALLOC_FREE(wanted_sysnums);
+	TALLOC_FREE(python_sysnums);
+	wanted_sysnums = wanted;
+	python_sysnums = filtered;
+
+	Py_DECREF(sequence);
+	return 0;
+
+error:
+	TALLOC_FREE(wanted);
+	TALLOC_FREE(filtered);
+	Py_DECREF(sequence);
+	return -1;
+}
+
+/**
+ * Wait up to one second for the Python consumer to fetch all the
+ * observed events.  This function is called at exit.
+ */
+static void finalize_python_events(void)
+{
+	struct timespec deadline;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += 1;
+
+	pthread_mutex_lock(&ring.lock);
+
+	ring.closed = true;
+	pthread_cond_broadcast(&ring.filled);
+
+	while (ring.count > 0) {
+		if (pthread_cond_timedwait(&ring.drained, &ring.lock, &deadline) == ETIMEDOUT)
+			break;
+	}
+
+	if (ring.count > 0 || ring.nb_dropped > 0)
+		note(NULL, WARNING, USER,
+			"python extension: %zu observed events were lost",
+			ring.count + ring.nb_dropped);
+
+	pthread_mutex_unlock(&ring.lock);
+}
+
+/**
+ * Select the events forwarded to the Python callback: @sync_list ones
+ * are handled synchronously, as usual, whereas @async_list ones are
+ * only recorded and can be consumed from any Python thread with
+ * fetch_events().  When @sysnums is not None, only SYSCALL_* events
+ * related to these syscalls are forwarded, and PRoot doesn't stop
+ * the tracee for the other ones when seccomp is enabled.  This
+ * function has to be called from the INITIALIZATION event.
+ */
+PyObject *set_event_filter(PyObject *sync_list, PyObject *async_list, PyObject *sysnums)
+{
+	static bool is_atexit_registered = false;
+	uint64_t sync_mask;
+	uint64_t async_mask;
+
+	if (events_to_mask(sync_list, &sync_mask) < 0)
+		return NULL;
+
+	if (events_to_mask(async_list, &async_mask) < 0)
+		return NULL;
+
+	if ((async_mask & ~ASYNC_CAPABLE_EVENTS) != 0) {
+		PyErr_SetString(PyExc_ValueError, "these events can't be observed asynchronously");
+		return NULL;
+	}
+
+	if ((sync_mask & async_mask) != 0) {
+		PyErr_SetString(PyExc_ValueError, "events are either synchronous or asynchronous");
+		return NULL;
+	}
+
+	if (sysnums != Py_None && set_wanted_sysnums(sysnums, sync_mask | async_mask) < 0)
+		return NULL;
+
+	/* The Python callback is always told about the initialization
+	 * of the extension.  */
+	sync_events  = sync_mask | EVENT_BIT(INITIALIZATION);
+	async_events = async_mask;
+
+	if (async_events != 0 && !is_atexit_registered) {
+		atexit(finalize_python_events);
+		is_atexit_registered = true;
+	}
+
+	Py_RETURN_NONE;
+}
+
+/**
+ * Return a list of up to @max_events observed events, as tuples
+ * (event, pid, vpid, sysnum, value, path).  This function waits for
+ * a batch of events to be recorded, or for a short timeout to expire
+ * when at least one event is available.  It returns None once PRoot
+ * is exiting and all the events were consumed.
+ */
+PyObject *fetch_events(int max_events)
+{
+	PythonEvent *records;
+	struct timespec deadline;
+	PyObject *list;
+	size_t nb_records;
+	size_t i;
+
+	if (max_events <= 0 || max_events > EVENTS_RING_SIZE)
+		max_events = EVENTS_RING_SIZE;
+
+	records = malloc(max_events * sizeof(PythonEvent));
+	if (records == NULL)
+		return PyErr_NoMemory();
+
+	Py_BEGIN_ALLOW_THREADS
+
+	pthread_mutex_lock(&ring.lock);
+
+	ring.waiting = true;
+	while (!ring.closed && ring.count < EVENTS_BATCH_SIZE) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += EVENTS_TIMEOUT_MS * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+
+		if (pthread_cond_timedwait(&ring.filled, &ring.lock, &deadline) == ETIMEDOUT
+		    && ring.count > 0)
+			break;
+	}
+	ring.waiting = false;
+
+	nb_records = ring.count < (size_t) max_events ? ring.count : (size_t) max_events;
+	for (i = 0; i < nb_records; i++) {
+		records[i] = ring.records[ring.first];
+		ring.first = (ring.first + 1) % EVENTS_RING_SIZE;
+	}
+	ring.count -= nb_records;
+
+	if (ring.count == 0)
+		pthread_cond_broadcast(&ring.drained);
+
+	pthread_mutex_unlock(&ring.lock);
+
+	Py_END_ALLOW_THREADS
+
+	if (nb_records == 0) {
+		free(records);
+		Py_RETURN_NONE;
+	}
+
+	list = PyList_New(nb_records);
+	for (i = 0; i < nb_records; i++) {
+		if (list != NULL)
+			PyList_SET_ITEM(list, i, Py_BuildValue("(iiKils)",
+								records[i].event,
+								records[i].pid,
+								(unsigned long long) records[i].vpid,
+								records[i].sysnum,
+								records[i].value,
+								records[i].path));
+		free(records[i].path);
+	}
+	free(records);
+
+	return list;
+}
+
+/**
+ * Record @event -- see ExtensionEvent for the meaning of @data1 and
+ * @data2 -- so that it can be consumed later by fetch_events().  The
+ * event is dropped if the ring buffer is full: the tracee is never
+ * slowed down by a slow consumer.
+ */
+static void push_python_event(Extension *extension, ExtensionEvent event,
+			intptr_t data1, intptr_t data2)
+{
+	Tracee *tracee = TRACEE(extension);
+	PythonEvent record;
+	const char *path = NULL;
+
+	record.event  = event;
+	record.pid    = tracee->pid;
+	record.vpid   = tracee->vpid;
+	record.sysnum = get_sysnum(tracee, ORIGINAL);
+	record.value  = 0;
+
+	switch (event) {
+	case GUEST_PATH:
+		path = (const char *) data2;
+		break;
+
+	case HOST_PATH:
+		path = (const char *) data1;
+		record.value = data2;
+		break;
+
+	case TRANSLATED_PATH:
+	case DETRANSLATE_PATH:
+		path = (const char *) data1;
+		break;
+
+	case ALREADY_OPENED_FD:
+		path = (const char *) data1;
+		record.value = data2;
+		break;
+
+	case SYSCALL_ENTER_END:
+	case NEW_STATUS:
+		record.value = data1;
+		break;
+
+	case SYSCALL_EXIT_START:
+	case SYSCALL_EXIT_END:
+	case SYSCALL_CHAINED_EXIT:
+		record.value = peek_reg(tracee, CURRENT, SYSARG_RESULT);
+		break;
+
+	default:
+		break;
+	}
+
+	pthread_mutex_lock(&ring.lock);
+
+	if (ring.closed || ring.count == EVENTS_RING_SIZE) {
+		ring.nb_dropped++;
+		pthread_mutex_unlock(&ring.lock);
+		return;
+	}
+
+	record.path = path != NULL ? strdup(path) : NULL;
+	ring.records[(ring.first + ring.count) % EVENTS_RING_SIZE] = record;
+	ring.count++;
+
+	/* Wake the consumer up by batches only, see fetch_events().  */
+	if (ring.waiting && ring.count >= EVENTS_BATCH_SIZE)
+		pthread_cond_signal(&ring.filled);
+
+	pthread_mutex_unlock(&ring.lock);
+}
+
 /**
  * Handler for this @extension.  It is triggered each time an @event
  * occurred.  See ExtensionEvent for the meaning of @data1 and @data2.
@@ -179,11 +601,24 @@ int python_callback(Extension *extension, ExtensionEvent event, intptr_t data1,
 				init_python_env();
 				res = python_callback_func_wrapper(extension, event, data1, data2);
 
-				extension->filtered_sysnums = filtered_sysnums;
+				extension->filtered_sysnums = python_sysnums != NULL
+							? python_sysnums
+							: filtered_sysnums;
 			}
 			break;
 		default:
-			res = python_callback_func_wrapper(extension, event, data1, data2);
+			if (((sync_events | async_events) & EVENT_BIT(event)) == 0)
+				break;
+
+			if (wanted_sysnums != NULL
+			    && (EVENT_BIT(event) & SYSCALL_EVENTS) != 0
+			    && !wanted_sysnums[get_sysnum(TRACEE(extension), ORIGINAL)])
+				break;
+
+			if ((async_events & EVENT_BIT(event)) != 0)
+				push_python_event(extension, event, data1, data2);
+			else
+				res = python_callback_func_wrapper(extension, event, data1, data2);
 	}
 
 	return res;
@@ -0,0 +1,448 @@
+/* -*- c-set-style: "K&R"; c-basic-offset: 8 -*-
+ *
+ * This file is part of PRoot.
+ *
+ * Copyright (C) 2015 STMicroelectronics
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <sys/types.h>  /* open(2), ftruncate(2), */
+#include <sys/stat.h>   /* open(2), */
+#include <sys/mman.h>   /* mmap(2), munmap(2), */
+#include <fcntl.h>      /* open(2), */
+#include <unistd.h>     /* ftruncate(2), pwrite(2), close(2), */
+#include <stdio.h>      /* fopen(3), fputs(3), */
+#include <string.h>     /* strlen(3), memcpy(3), memset(3), */
+#include <time.h>       /* clock_gettime(3), */
+#include <talloc.h>     /* talloc*, */
+
+#include "uthash.h"
+#include "extension/extension.h"
+#include "extension/trace/trace.h"
+#include "syscall/sysnum.h"
+#include "tracee/tracee.h"
+#include "tracee/reg.h"
+#include "cli/note.h"
+
+/* Path already stored in the ".paths" file.  */
+typedef struct {
+	UT_hash_handle hh;
+	char *path;
+	uint32_t id;
+} Path;
+
+/* Trace file, shared by all tracees.  */
+typedef struct {
+	TraceHeader *header;
+	TraceRecord *records;
+	size_t mapping_size;
+
+	FILE *paths_file;
+	Path *paths;
+	uint32_t nb_paths;
+
+	uint64_t start;
+} Trace;
+
+/* Per-tracee state.  */
+typedef struct {
+	Trace *trace;
+
+	TraceRecord pending;
+	bool is_pending;
+	uint64_t stage_start;
+} Config;
+
+/**
+ * Return the current time of a monotonic clock, in nanoseconds.
+ */
+static uint64_t now(void)
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (uint64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+/**
+ * Unmap and close the files of @trace.  Note: this is a Talloc
+ * destructor.
+ */
+static int close_trace(Trace *trace)
+{
+	if (trace->header != NULL)
+		(void) munmap(trace->header, trace->mapping_size);
+
+	if (trace->paths_file != NULL)
+		(void) fclose(trace->paths_file);
+
+	HASH_CLEAR(hh, trace->paths);
+
+	return 0;
+}
+
+/**
+ * Create the trace file @path and its companion ".paths" file for
+ * @tracee.  This function returns NULL if an error occurred.
+ */
+static Trace *new_trace(const Tracee *tracee, TALLOC_CTX *context, const char *path)
+{
+	size_t names_size;
+	size_t ring_size;
+	Trace *trace;
+	char *cursor;
+	char *names;
+	size_t i;
+	int status;
+	int fd;
+
+	trace = talloc_zero(context, Trace);
+	if (trace == NULL)
+		return NULL;
+	talloc_set_destructor(trace, close_trace);
+
+	/* Syscall names are stored once for all, for the decoder.  */
+	names_size = 0;
+	for (i = 0; i < PR_NB_SYSNUM; i++)
+		names_size += strlen(stringify_sysnum(i)) + 1;
+
+	names = talloc_size(trace, names_size);
+	if (names == NULL)
+		return NULL;
+
+	cursor = names;
+	for (i = 0; i < PR_NB_SYSNUM; i++) {
+		size_t length = strlen(stringify_sysnum(i)) + 1;
+		memcpy(cursor, stringify_sysnum(i), length);
+		cursor += length;
+	}
+
+	ring_size = TRACE_NB_RECORDS * sizeof(TraceRecord);
+	trace->mapping_size = sizeof(TraceHeader) + ring_size;
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		note(tracee, ERROR, SYSTEM, "can't create '%s'", path);
+		return NULL;
+	}
+
+	status = ftruncate(fd, trace->mapping_size + names_size);
+	if (status == 0
+	    && pwrite(fd, names, names_size, trace->mapping_size) != (ssize_t) names_size)
+		status = -1;
+	if (status < 0) {
+		note(tracee, ERROR, SYSTEM, "can't write '%s'", path);
+		(void) close(fd);
+		return NULL;
+	}
+
+	/* Records are written directly into the page cache, this
+	 * also preserves them if PRoot crashes.  */
+	trace->header = mmap(NULL, trace->mapping_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, 0);
+	(void) close(fd);
+	if (trace->header == MAP_FAILED) {
+		trace->header = NULL;
+		note(tracee, ERROR, SYSTEM, "can't map '%s'", path);
+		return NULL;
+	}
+	trace->records = (TraceRecord *) (trace->header + 1);
+
+	memcpy(trace->header->signature, TRACE_SIGNATURE, sizeof(trace->header->signature));
+	trace->header->record_size = sizeof(TraceRecord);
+	trace->header->nb_records  = TRACE_NB_RECORDS;
+	trace->header->nb_sysnums  = PR_NB_SYSNUM;
+	trace->header->names_size  = names_size;
+
+	trace->paths_file = fopen(talloc_asprintf(trace, "%s.paths", path), "we");
+	if (trace->paths_file == NULL) {
+		note(tracee, ERROR, SYSTEM, "can't create '%s.paths'", path);
+		return NULL;
+	}
+	setvbuf(trace->paths_file, NULL, _IOLBF, 0);
+
+	trace->start = now();
+	return trace;
+}
+
+/**
+ * Return the identifier of @path in @trace, the path is stored in
+ * the ".paths" file the first time.  This function returns 0 if an
+ * error occurred.
+ */
+static uint32_t get_path_id(Trace *trace, const char *path)
+{
+	Path *entry;
+	char *cursor;
+
+	HASH_FIND_STR(trace->paths, path, entry);
+	if (entry != NULL)
+		return entry->id;
+
+	entry = talloc_zero(trace, Path);
+	if (entry == NULL)
+		return 0;
+
+	entry->path = talloc_strdup(entry, path);
+	if (entry->path == NULL)
+		return 0;
+
+	/* One path per line.  */
+	for (cursor = entry->path; *cursor != '\0'; cursor++) {
+		if (*cursor == '\n')
+			*cursor = '?';
+	}
+
+	if (fputs(entry->path, trace->paths_file) < 0 || fputc('\n', trace->paths_file) < 0)
+		return 0;
+
+	entry->id = ++trace->nb_paths;
+	HASH_ADD_KEYPTR(hh, trace->paths, entry->path, strlen(entry->path), entry);
+
+	return entry->id;
+}
+
+/**
+ * Append the pending record of @config to the ring buffer.
+ */
+static void commit_record(Config *config)
+{
+	TraceHeader *header = config->trace->header;
+
+	config->trace->records[header->nb_written % header->nb_records] = config->pending;
+	header->nb_written++;
+
+	config->is_pending = false;
+}
+
+/**
+ * Start a new record for the syscall @tracee enters.
+ */
+static void start_record(Tracee *tracee, Config *config)
+{
+	TraceRecord *record = &config->pending;
+	uint64_t start = now();
+
+	/* The exit stage of the previous syscall isn't always
+	 * reported, for instance when using seccomp.  */
+	if (config->is_pending)
+		commit_record(config);
+
+	memset(record, 0, sizeof(TraceRecord));
+	record->timestamp = start - config->trace->start;
+	record->vpid      = tracee->vpid;
+	record->sysnum    = get_sysnum(tracee, CURRENT);
+	record->args[0]   = peek_reg(tracee, CURRENT, SYSARG_1);
+	record->args[1]   = peek_reg(tracee, CURRENT, SYSARG_2);
+	record->args[2]   = peek_reg(tracee, CURRENT, SYSARG_3);
+	record->args[3]   = peek_reg(tracee, CURRENT, SYSARG_4);
+	record->args[4]   = peek_reg(tracee, CURRENT, SYSARG_5);
+	record->args[5]   = peek_reg(tracee, CURRENT, SYSARG_6);
+
+	config->is_pending  = true;
+	config->stage_start = start;
+}
+
+/**
+ * Account the time spent by PRoot since the start of the current
+ * stage into the pending record of @config.
+ */
+static void end_stage(Config *config)
+{
+	config->pending.latency += now() - config->stage_start;
+}
+
+/**
+ * Handler for this @extension.  It is triggered each time an @event
+ * occurred.  See ExtensionEvent for the meaning of @data1 and @data2.
+ */
+int trace_callback(Extension *extension, ExtensionEvent event,
+		intptr_t data1, intptr_t data2 UNUSED)
+{
+	Config *config;
+
+	switch (event) {
+	case INITIALIZATION:
+		config = talloc_zero(extension, Config);
+		if (config == NULL)
+			return -1;
+		extension->config = config;
+
+		config->trace = new_trace(TRACEE(extension), config, (const char *) data1);
+		if (config->trace == NULL)
+			return -1;
+
+		return 0;
+
+	case INHERIT_PARENT: /* Inheritable for sub reconfiguration ...  */
+		return 1;
+
+	case INHERIT_CHILD: {
+		/* ... but each tracee has its own pending record.  */
+		Extension *parent = (Extension *) data1;
+		Config *parent_config = talloc_get_type_abort(parent->config, Config);
+
+		config = talloc_zero(extension, Config);
+		if (config == NULL)
+			return -1;
+		extension->config = config;
+
+		config->trace = talloc_reference(config, parent_config->trace);
+		if (config->trace == NULL)
+			return -1;
+
+		return 0;
+	}
+
+	case SYSCALL_ENTER_START:
+		config = talloc_get_type_abort(extension->config, Config);
+		start_record(TRACEE(extension), config);
+		return 0;
+
+	case TRANSLATED_PATH: {
+		TraceRecord *record;
+
+		config = talloc_get_type_abort(extension->config, Config);
+		if (!config->is_pending)
+			return 0;
+
+		record = &config->pending;
+		if (record->paths[0] == 0)
+			record->paths[0] = get_path_id(config->trace, (const char *) data1);
+		else if (record->paths[1] == 0)
+			record->paths[1] = get_path_id(config->trace, (const char *) data1);
+		return 0;
+	}
+
+	case SYSCALL_ENTER_END:
+		config = talloc_get_type_abort(extension->config, Config);
+		if (config->is_pending)
+			end_stage(config);
+		return 0;
+
+	case SYSCALL_EXIT_START:
+		config = talloc_get_type_abort(extension->config, Config);
+		config->stage_start = now();
+		return 0;
+
+	case SYSCALL_EXIT_END: {
+		Tracee *tracee = TRACEE(extension);
+
+		config = talloc_get_type_abort(extension->config, Config);
+		if (!config->is_pending)
+			return 0;
+
+		end_stage(config);
+		config->pending.result = (int64_t) peek_reg(tracee, CURRENT, SYSARG_RESULT);
+		config->pending.flags |= TRACE_HAS_RESULT;
+		commit_record(config);
+		return 0;
+	}
+
+	case REMOVED:
+		config = talloc_get_type_abort(extension->config, Config);
+		if (config->is_pending)
+			commit_record(config);
+		return 0;
+
+	default:
+		return 0;
+	}
+}
+
+/* Replay file, shared by all tracees.  */
+typedef struct {
+	FILE *file;
+} Replay;
+
+/**
+ * Close the file of @replay.  Note: this is a Talloc destructor.
+ */
+static int close_replay(Replay *replay)
+{
+	if (replay->file != NULL)
+		(void) fclose(replay->file);
+
+	return 0;
+}
+
+/**
+ * Append the inputs of the translation of @user_path, relative to
+ * the guest path @base, to the file of @replay: these are replayed
+ * by proot-bench against the path translation engine.
+ */
+static void record_guest_path(const Tracee *tracee, Replay *replay,
+			const char *base, const char *user_path)
+{
+	/* One tab-separated entry per line.  */
+	if (strpbrk(base, "\t\n") != NULL || strpbrk(user_path, "\t\n") != NULL)
+		return;
+
+	(void) fprintf(replay->file, "%s\t%s\t%s\n",
+		stringify_sysnum(get_sysnum(tracee, ORIGINAL)), base, user_path);
+}
+
+/**
+ * Handler for this @extension.  It is triggered each time an @event
+ * occurred.  See ExtensionEvent for the meaning of @data1 and @data2.
+ */
+int trace_replay_callback(Extension *extension, ExtensionEvent event,
+			intptr_t data1, intptr_t data2)
+{
+	Replay *replay;
+
+	switch (event) {
+	case INITIALIZATION:
+		replay = talloc_zero(extension, Replay);
+		if (replay == NULL)
+			return -1;
+		talloc_set_destructor(replay, close_replay);
+		extension->config = replay;
+
+		replay->file = fopen((const char *) data1, "we");
+		if (replay->file == NULL) {
+			note(TRACEE(extension), ERROR, SYSTEM, "can't create '%s'",
+				(const char *) data1);
+			return -1;
+		}
+
+		return 0;
+
+	case INHERIT_PARENT: /* Inheritable for sub reconfiguration ...  */
+		return 1;
+
+	case INHERIT_CHILD: {
+		/* ... and the file is shared by all tracees.  */
+		Extension *parent = (Extension *) data1;
+
+		extension->config = talloc_reference(extension, parent->config);
+		if (extension->config == NULL)
+			return -1;
+
+		return 0;
+	}
+
+	case GUEST_PATH:
+		replay = talloc_get_type_abort(extension->config, Replay);
+		record_guest_path(TRACEE(extension), replay,
+				(const char *) data1, (const char *) data2);
+		return 0;
+
+	default:
+		return 0;
+	}
+}
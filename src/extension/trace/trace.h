@@ -0,0 +1,73 @@
+/* -*- c-set-style: "K&R"; c-basic-offset: 8 -*-
+ *
+ * This file is part of PRoot.
+ *
+ * Copyright (C) 2015 STMicroelectronics
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#include "attribute.h"
+
+/* Layout of the files written by the "trace" extension, also decoded
+ * by contrib/proot-trace.py:
+ *
+ *   - TraceHeader;
+ *   - TraceRecord[nb_records], used as a ring buffer;
+ *   - NUL-separated syscall names, indexed by TraceRecord.sysnum.
+ *
+ * Paths are stored once in the companion file "<file>.paths", the
+ * n-th line being the path with identifier n.
+ *
+ * With the option --trace-replay, the inputs of each path
+ * translation are appended to a separate text file, one
+ * "syscall<TAB>base<TAB>path" line each, where "base" is the guest
+ * path "path" is relative to.  This file is replayed by
+ * test/bench/replay.c.  */
+
+#define TRACE_SIGNATURE "PRTRACE1"
+#define TRACE_NB_RECORDS (256 * 1024)
+
+typedef struct {
+	char signature[8];
+	uint32_t record_size;
+	uint32_t nb_records;
+	uint64_t nb_written;
+	uint32_t nb_sysnums;
+	uint32_t names_size;
+} PACKED TraceHeader;
+
+/* Flags of a TraceRecord.  */
+#define TRACE_HAS_RESULT 0x1
+
+typedef struct {
+	uint64_t timestamp;	/* ns since the start of the trace.  */
+	int64_t result;
+	uint64_t args[6];
+	uint32_t latency;	/* ns spent by PRoot on this syscall.  */
+	int32_t vpid;
+	uint16_t sysnum;
+	uint16_t flags;
+	uint32_t paths[2];	/* 0 if none.  */
+	uint32_t padding;
+} PACKED TraceRecord;
+
+#endif /* TRACE_H */
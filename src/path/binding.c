@@ -552,11 +552,13 @@ static void initialize_binding(Tracee *tracee, Binding *binding)
 		/* Initial state before canonicalization.  */
 		strcpy(binding->guest.path, "/");
 
-		/* Remember the type of the final component, it will
-		 * be used in build_glue() later.  */
+		/* Remember the type and the inode of the final
+		 * component, these will be used in build_glue()
+		 * later.  */
 		status = lstat(binding->host.path, &statl);
 		tracee->glue_type = (status < 0 || S_ISBLK(statl.st_mode) || S_ISCHR(statl.st_mode)
 				? S_IFREG : statl.st_mode & S_IFMT);
+		tracee->glue_inode = (status < 0 ? 0 : statl.st_ino);
 
 		/* Sanitize the guest path of the binding within the
 		   alternate rootfs since it is assumed by
@@ -576,6 +578,7 @@ static void initialize_binding(Tracee *tracee, Binding *binding)
 		/* Disable definitively the creation of the glue for
 		 * this binding.  */
 		tracee->glue_type = 0;
+		tracee->glue_inode = 0;
 	}
 
 	binding->guest.length = strlen(binding->guest.path);
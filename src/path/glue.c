@@ -22,83 +22,285 @@
 
 #include <sys/types.h> /* mkdir(2), lstat(2), */
 #include <sys/stat.h> /* mkdir(2), lstat(2), */
-#include <fcntl.h>    /* mknod(2), */
-#include <unistd.h>   /* mknod(2), lstat(2), unlink(2), rmdir(2), */
+#include <sys/queue.h> /* LIST_*, */
+#include <dirent.h>   /* IFTODT, */
+#include <unistd.h>   /* lstat(2), */
 #include <string.h>   /* string(3),  */
 #include <assert.h>   /* assert(3), */
 #include <limits.h>   /* PATH_MAX, */
 #include <errno.h>    /* errno, E* */
 #include <talloc.h>   /* talloc_*, */
 
+#include "path/glue.h"
 #include "path/binding.h"
 #include "path/path.h"
 #include "path/temp.h"
+#include "syscall/dirent.h"
+#include "syscall/syscall.h"
+#include "tracee/mem.h"
 #include "cli/note.h"
 
 #include "compat.h"
 
+/* Component of the glue that doesn't exist on the host: it only
+ * shows up in the listing of its host @directory, see
+ * complete_glue_listing().  */
+typedef struct {
+	char *directory;
+	Dentry dentry;
+} GlueDentry;
+
+struct glue_dentries {
+	GlueDentry *dentries;
+};
+
+/* Directory read by a tracee, and how many glue dentries were
+ * already examined once the kernel reached its end.  */
+typedef struct glue_listing {
+	int fd;
+	char *directory;
+	size_t index;
+	LIST_ENTRY(glue_listing) link;
+} GlueListing;
+
+LIST_HEAD(glue_listings, glue_listing);
+
 /**
- * Remove @path if it is empty only.
- *
- * Note: this is a Talloc destructor.
+ * Add to @tracee's glue the dentry for @host_path, a node of type
+ * @type that doesn't exist on the host, and that is actually the
+ * host node with the given @inode.  This function returns -errno if
+ * an error occured, otherwise 0.
  */
-static int remove_placeholder(char *path)
+static int add_glue_dentry(Tracee *tracee, const char host_path[PATH_MAX], mode_t type,
+			ino_t inode)
 {
-	struct stat statl;
-	int status;
+	GlueDentry *dentries;
+	size_t directory_length;
+	const char *name;
+	size_t length;
+	size_t i;
 
-	status = lstat(path, &statl);
-	if (status)
-		return 0; /* Not fatal.  */
+	if (tracee->glue_dentries == NULL) {
+		tracee->glue_dentries = talloc_zero(tracee, struct glue_dentries);
+		if (tracee->glue_dentries == NULL)
+			return -ENOMEM;
 
-	if (!S_ISDIR(statl.st_mode)) {
-		if (statl.st_size != 0)
-			return 0; /* Not fatal.  */
-		status = unlink(path);
+		tracee->glue_dentries->dentries = talloc_array(tracee->glue_dentries, GlueDentry, 0);
+		if (tracee->glue_dentries->dentries == NULL)
+			return -ENOMEM;
 	}
-	else
-		status = rmdir(path);
-	if (status)
-		return 0; /* Not fatal.  */
+
+	name = strrchr(host_path, '/');
+	assert(name != NULL);
+
+	/* The parent of "/foo" is "/", not "".  */
+	directory_length = (name == host_path ? 1 : name - host_path);
+
+	dentries = tracee->glue_dentries->dentries;
+	length = talloc_array_length(dentries);
+
+	/* Several bindings may share the same glue.  */
+	for (i = 0; i < length; i++) {
+		if (strcmp(dentries[i].dentry.name, name + 1) == 0
+		    && strlen(dentries[i].directory) == directory_length
+		    && strncmp(dentries[i].directory, host_path, directory_length) == 0)
+			return 0;
+	}
+
+	dentries = talloc_realloc(tracee->glue_dentries, dentries, GlueDentry, length + 1);
+	if (dentries == NULL)
+		return -ENOMEM;
+	tracee->glue_dentries->dentries = dentries;
+
+	dentries[length].directory = talloc_strndup(dentries, host_path, directory_length);
+	dentries[length].dentry.name = talloc_strdup(dentries, name + 1);
+	if (dentries[length].directory == NULL || dentries[length].dentry.name == NULL)
+		return -ENOMEM;
+
+	/* Some libc skip dentries whose inode is 0.  */
+	dentries[length].dentry.inode = (inode != 0 ? inode : 1);
+	dentries[length].dentry.type  = IFTODT(type);
 
 	return 0;
 }
 
 /**
- * Attach a copy of @path to the autofree context, and set its
- * destructor to remove_placeholder().
+ * Return true if @directory contains glue dentries for @tracee.
  */
-static void set_placeholder_destructor(const char *path)
+static bool has_glue_dentries(const Tracee *tracee, const char *directory)
 {
-	TALLOC_CTX *autofreed;
-	char *placeholder;
+	const GlueDentry *dentries;
+	size_t length;
+	size_t i;
+
+	if (tracee->glue_dentries == NULL)
+		return false;
+
+	dentries = tracee->glue_dentries->dentries;
+	length = talloc_array_length(dentries);
+
+	for (i = 0; i < length; i++) {
+		if (strcmp(dentries[i].directory, directory) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * Return the listing of @directory opened as @fd by @tracee, or NULL
+ * if this directory doesn't contain glue dentries.
+ */
+static GlueListing *get_glue_listing(Tracee *tracee, int fd, const char *directory)
+{
+	GlueListing *listing;
+
+	if (!has_glue_dentries(tracee, directory))
+		return NULL;
+
+	if (tracee->glue_listings == NULL) {
+		tracee->glue_listings = talloc_zero(tracee, struct glue_listings);
+		if (tracee->glue_listings == NULL)
+			return NULL;
+	}
+
+	LIST_FOREACH(listing, tracee->glue_listings, link) {
+		if (listing->fd != fd)
+			continue;
+
+		/* The file descriptor was reused behind our back.  */
+		if (strcmp(listing->directory, directory) != 0) {
+			LIST_REMOVE(listing, link);
+			TALLOC_FREE(listing);
+			break;
+		}
+
+		return listing;
+	}
+
+	listing = talloc_zero(tracee->glue_listings, GlueListing);
+	if (listing == NULL)
+		return NULL;
+
+	listing->fd = fd;
+	listing->directory = talloc_strdup(listing, directory);
+	if (listing->directory == NULL) {
+		TALLOC_FREE(listing);
+		return NULL;
+	}
+
+	LIST_INSERT_HEAD(tracee->glue_listings, listing, link);
+	return listing;
+}
+
+/**
+ * Append the glue dentries of the directory read by the current
+ * getdents(2) -- or getdents64(2) if @is_new_getdents is true -- of
+ * @tracee to its output, once the kernel reached the end of this
+ * directory.  This function returns -errno if an error occured, 0 if
+ * the result of this syscall is unchanged, otherwise the new number
+ * of bytes it returns.
+ */
+int complete_glue_listing(Tracee *tracee, bool is_new_getdents)
+{
+	char directory[PATH_MAX];
+	char path[PATH_MAX];
+	const GlueDentry *dentries;
+	GlueListing *listing;
+	struct stat statl;
+	word_t address;
+	word_t result;
+	size_t length;
+	size_t offset;
+	size_t count;
+	char *buffer;
+	int status;
+	int fd;
+
+	result = peek_reg(tracee, CURRENT, SYSARG_RESULT);
+	if ((int) result < 0)
+		return 0;
+
+	fd = (int) peek_reg(tracee, ORIGINAL, SYSARG_1);
+	status = readlink_proc_pid_fd(tracee->pid, fd, directory);
+	if (status < 0)
+		return 0;
+
+	listing = get_glue_listing(tracee, fd, directory);
+	if (listing == NULL)
+		return 0;
+
+	/* Glue dentries are appended once the kernel reached the end
+	 * of the directory; reading it again, typically after
+	 * rewinddir(3), starts over.  */
+	if (result != 0) {
+		listing->index = 0;
+		return 0;
+	}
+
+	address = peek_reg(tracee, ORIGINAL, SYSARG_2);
+	count   = peek_reg(tracee, ORIGINAL, SYSARG_3);
 
-	autofreed = talloc_autofree_context();
-	if (autofreed == NULL)
-		return;
+	buffer = talloc_size(tracee->ctx, count);
+	if (buffer == NULL)
+		return -ENOMEM;
+
+	dentries = tracee->glue_dentries->dentries;
+	length = talloc_array_length(dentries);
+
+	offset = 0;
+	while (listing->index < length) {
+		const GlueDentry *glue = &dentries[listing->index];
+		size_t size;
+
+		if (strcmp(glue->directory, directory) != 0)
+			goto next;
+
+		/* Already reported by the kernel if it was created in
+		 * the meantime.  */
+		status = join_paths(2, path, directory, glue->dentry.name);
+		if (status < 0 || lstat(path, &statl) == 0)
+			goto next;
+
+		size = write_dentry(tracee, buffer + offset, count - offset,
+				&glue->dentry, listing->index + 1, is_new_getdents);
+		if (size == 0)
+			break;
+		offset += size;
+	next:
+		listing->index++;
+	}
 
-	placeholder = talloc_strdup(autofreed, path);
-	if (placeholder == NULL)
-		return;
+	if (offset == 0)
+		return (listing->index < length ? -EINVAL : 0);
 
-	talloc_set_destructor(placeholder, remove_placeholder);
+	status = write_data(tracee, address, buffer, offset);
+	if (status < 0)
+		return status;
+
+	return offset;
 }
 
 /**
- * Build in a temporary filesystem the glue between the guest part and
- * the host part of the @binding_path.  This function returns the type
- * of the bound path, otherwise 0 if an error occured.
+ * Build the glue between the guest part and the host part of the
+ * @binding_path.  This function returns the type of the bound path,
+ * otherwise 0 if an error occured.
  *
  * For example, assuming the host path "/opt" is mounted/bound to the
  * guest path "/black/holes/and/revelations", and assuming this path
- * can't be created in the guest rootfs (eg. permission denied), then
- * it is created in a temporary rootfs and all these paths are glued
+ * doesn't exist in the guest rootfs, then all these paths are glued
  * that way:
  *
- *   $GUEST/black/ --> $GLUE/black/
- *                               ./holes
- *                               ./holes/and
- *                               ./holes/and/revelations --> $HOST/opt/
+ *   $GUEST/black/ --> $GLUE/
+ *                          ./holes
+ *                          ./holes/and
+ *                          ./holes/and/revelations --> $HOST/opt/
+ *
+ * Only the intermediate directories of the glue rootfs -- a temporary
+ * directory -- are actually created, since the kernel needs them to
+ * resolve the paths below.  The other components, "black" and
+ * "revelations" from the example, are held in memory and added to the
+ * listing of their parent, see complete_glue_listing().
  *
  * This glue allows operations on paths that do not exist in the guest
  * rootfs but that were specified as the guest part of a binding.
@@ -108,70 +310,61 @@ mode_t build_glue(Tracee *tracee, const char *guest_path, char host_path[PATH_MA
 {
 	bool belongs_to_gluefs;
 	Comparison comparison;
+	struct stat statl;
 	Binding *binding;
 	mode_t type;
-	mode_t mode;
 	int status;
 
 	assert(tracee->glue_type != 0);
 
-	/* Create the temporary directory where the "glue" rootfs will
-	 * lie.  */
-	if (tracee->glue == NULL) {
-		tracee->glue = create_temp_directory(NULL, tracee->tool_name);
-		if (tracee->glue == NULL) {
-			note(tracee, ERROR, INTERNAL, "can't create glue rootfs");
-			return 0;
-		}
-		talloc_set_name_const(tracee->glue, "$glue");
+	if (tracee->glue != NULL) {
+		comparison = compare_paths(tracee->glue, host_path);
+		belongs_to_gluefs = (comparison == PATHS_ARE_EQUAL || comparison == PATH1_IS_PREFIX);
 	}
-
-	comparison = compare_paths(tracee->glue, host_path);
-	belongs_to_gluefs = (comparison == PATHS_ARE_EQUAL || comparison == PATH1_IS_PREFIX);
+	else
+		belongs_to_gluefs = false;
 
 	/* If it's not a final component then it is a directory.  I definitely
 	 * hate how the potential type of the final component is propagated
 	 * from initialize_binding() down to here, sadly there's no elegant way
 	 * to know its type at this stage.  */
+	type = (IS_FINAL(finality) ? tracee->glue_type : S_IFDIR);
+
+	/* Nothing else to do if it is the final component since it
+	 * will be pointed to by the binding being initialized (from
+	 * the example, "$GUEST/black/holes/and/revelations" ->
+	 * "$HOST/opt"), it only has to show up in the listing of its
+	 * parent.  */
 	if (IS_FINAL(finality)) {
-		type = tracee->glue_type;
-		mode = (belongs_to_gluefs ? 0777 : 0);
-	}
-	else {
-		type = S_IFDIR;
-		mode = 0777;
+		status = add_glue_dentry(tracee, host_path, type, tracee->glue_inode);
+		if (status < 0) {
+			note(tracee, WARNING, INTERNAL, "can't add glue dentry: %s", strerror(-status));
+			return 0;
+		}
+		return type;
 	}
 
-	if (getenv("PROOT_DONT_POLLUTE_ROOTFS") != NULL && !belongs_to_gluefs)
-		goto create_binding;
-
-	/* Try to create this component into the "guest" or "glue"
-	 * rootfs (depending if there were a glue previously).  */
-	if (S_ISDIR(type))
-		status = mkdir(host_path, mode);
-	else /* S_IFREG, S_IFCHR, S_IFBLK, S_IFIFO or S_IFSOCK.  */
-		status = mknod(host_path, mode | type, 0);
-
-	/* Remove placeholders from the guest rootfs once PRoot is
-	 * terminated.  */
-	if (status >= 0 && !belongs_to_gluefs)
-		set_placeholder_destructor(host_path);
-
-	/* Nothing else to do if the path already exists or if it is
-	 * the final component since it will be pointed to by the
-	 * binding being initialized (from the example,
-	 * "$GUEST/black/holes/and/revelations" -> "$HOST/opt").  */
-	if (status >= 0 || errno == EEXIST || IS_FINAL(finality))
+	/* mkdir is supposed to always succeed in tracee->glue.  */
+	if (belongs_to_gluefs) {
+		status = mkdir(host_path, 0777);
+		if (status < 0 && errno != EEXIST) {
+			note(tracee, WARNING, SYSTEM, "mkdir");
+			return 0;
+		}
 		return type;
+	}
 
-	/* mkdir/mknod are supposed to always succeed in
-	 * tracee->glue.  */
-	if (belongs_to_gluefs) {
-		note(tracee, WARNING, SYSTEM, "mkdir/mknod");
-		return 0;
+	/* Create the temporary directory where the "glue" rootfs will
+	 * lie.  */
+	if (tracee->glue == NULL) {
+		tracee->glue = create_temp_directory(NULL, tracee->tool_name);
+		if (tracee->glue == NULL) {
+			note(tracee, ERROR, INTERNAL, "can't create glue rootfs");
+			return 0;
+		}
+		talloc_set_name_const(tracee->glue, "$glue");
 	}
 
-create_binding:
 	/* Sanity checks.  */
 	if (   strnlen(tracee->glue, PATH_MAX) >= PATH_MAX
 	    || strnlen(guest_path, PATH_MAX) >= PATH_MAX) {
@@ -180,13 +373,19 @@ create_binding:
 	}
 
 	/* From the example, create the binding "/black" ->
-	 * "$GLUE/black".  */
+	 * "$GLUE".  */
 	binding = insort_binding3(tracee, tracee->glue, tracee->glue, guest_path);
 	if (binding == NULL)
 		return 0;
 
-	/* TODO: emulation of getdents(parent(guest_path)) to finalize
-	 * the glue, "black" in getdents("/") from the example.  */
+	/* From the example, "black" in getdents("/"), it is actually
+	 * the glue directory.  */
+	status = lstat(tracee->glue, &statl);
+	status = add_glue_dentry(tracee, host_path, type, status < 0 ? 0 : statl.st_ino);
+	if (status < 0) {
+		note(tracee, WARNING, INTERNAL, "can't add glue dentry: %s", strerror(-status));
+		return 0;
+	}
 
 	return type;
 }
@@ -30,5 +30,6 @@
 
 extern mode_t build_glue(Tracee *tracee, const char *guest_path, char host_path[PATH_MAX],
 			Finality finality);
+extern int complete_glue_listing(Tracee *tracee, bool is_new_getdents);
 
 #endif /* GLUE_H */
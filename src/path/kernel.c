@@ -0,0 +1,406 @@
+/* -*- c-set-style: "K&R"; c-basic-offset: 8 -*-
+ *
+ * This file is part of PRoot.
+ *
+ * Copyright (C) 2015 STMicroelectronics
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <sched.h>        /* unshare(2), CLONE_*, */
+#include <sys/mount.h>    /* mount(2), umount2(2), MS_*, MNT_*, */
+#include <sys/syscall.h>  /* SYS_pivot_root, */
+#include <sys/types.h>    /* lstat(2), open(2), */
+#include <sys/stat.h>     /* lstat(2), open(2), */
+#include <fcntl.h>        /* open(2), O_*, */
+#include <unistd.h>       /* syscall(2), chdir(2), getuid(2), readlink(2), */
+#include <stdio.h>        /* snprintf(3), */
+#include <stdlib.h>       /* exit(3), */
+#include <string.h>       /* str*(3), */
+#include <limits.h>       /* PATH_MAX, */
+#include <errno.h>        /* errno, E*, */
+#include <talloc.h>       /* talloc_*, */
+
+#include "path/kernel.h"
+#include "path/binding.h"
+#include "path/path.h"
+#include "path/temp.h"
+#include "extension/extension.h"
+#include "cli/note.h"
+
+#include "compat.h"
+
+/**
+ * Check the guest sees the host @path at the very same location.
+ * This is required for the files the tracer itself accesses once it
+ * lives in the guest rootfs (/proc) or gives to the tracee (loader,
+ * glue, ... in the temporary directory).
+ */
+static bool is_shared_as_is(const Tracee *tracee, const char *path)
+{
+	char guest_path[PATH_MAX];
+	int status;
+
+	if (strlen(path) >= PATH_MAX)
+		return false;
+	strcpy(guest_path, path);
+
+	status = substitute_binding(tracee, GUEST, guest_path);
+	if (status < 0)
+		return false;
+
+	return compare_paths(guest_path, path) == PATHS_ARE_EQUAL;
+}
+
+/**
+ * Check @binding can be applied by the kernel as a bind mount, that
+ * is, its guest path already exists in the guest rootfs (once
+ * shallower bindings are applied) with the same kind of file as its
+ * host path.  This function returns -1 if this is not the case,
+ * otherwise 0.
+ */
+static int check_binding(const Tracee *tracee, const Binding *binding)
+{
+	char parent[PATH_MAX];
+	char target[PATH_MAX];
+	struct stat host_stat;
+	struct stat target_stat;
+	size_t offset;
+	int status;
+
+	/* Where the guest path of this binding lies once its parent
+	 * directory is translated.  */
+	strcpy(parent, binding->guest.path);
+	offset = strrchr(parent, '/') - parent;
+	if (offset == 0)
+		strcpy(parent, "/");
+	else
+		parent[offset] = '\0';
+
+	status = substitute_binding(tracee, GUEST, parent);
+	if (status < 0)
+		return -1;
+
+	status = join_paths(2, target, parent, binding->guest.path + offset + 1);
+	if (status < 0)
+		return -1;
+
+	status = stat(binding->host.path, &host_stat);
+	if (status < 0)
+		return -1;
+
+	status = lstat(target, &target_stat);
+	if (status < 0) {
+		VERBOSE(tracee, 1, "kernel bindings: \"%s\" doesn't exist in the guest rootfs",
+			binding->guest.path);
+		return -1;
+	}
+
+	if (S_ISLNK(target_stat.st_mode)
+	    || S_ISDIR(target_stat.st_mode) != S_ISDIR(host_stat.st_mode)) {
+		VERBOSE(tracee, 1, "kernel bindings: \"%s\" has not the same type as \"%s\"",
+			binding->guest.path, binding->host.path);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Check all the bindings of @tracee can be handled by the kernel.
+ * This function returns -1 if this is not the case, otherwise 0.
+ */
+static int check_bindings(const Tracee *tracee)
+{
+	const Binding *binding;
+	int status;
+
+	if (tracee->qemu != NULL) {
+		VERBOSE(tracee, 1, "kernel bindings: not supported with -q");
+		return -1;
+	}
+
+	if (get_extension((Tracee *) tracee, overlay_callback) != NULL) {
+		VERBOSE(tracee, 1, "kernel bindings: not supported with --overlay");
+		return -1;
+	}
+
+	if (tracee->glue != NULL || tracee->glue_dentries != NULL) {
+		VERBOSE(tracee, 1, "kernel bindings: some bindings require a glue");
+		return -1;
+	}
+
+	if (!is_shared_as_is(tracee, "/proc") || !is_shared_as_is(tracee, get_temp_directory())) {
+		VERBOSE(tracee, 1, "kernel bindings: both /proc and %s have to be bound as-is",
+			get_temp_directory());
+		return -1;
+	}
+
+	CIRCLEQ_FOREACH(binding, tracee->fs->bindings.guest, link.guest) {
+		if (compare_paths(binding->guest.path, "/") == PATHS_ARE_EQUAL)
+			continue;
+
+		status = check_binding(tracee, binding);
+		if (status < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Write @content into the /proc file @path.  This function returns
+ * -errno if an error occurred, otherwise 0.
+ */
+static int write_proc_file(const char *path, const char *content)
+{
+	ssize_t length;
+	int status;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	length = strlen(content);
+	status = write(fd, content, length) == length ? 0 : -errno;
+	close(fd);
+
+	return status;
+}
+
+/**
+ * Make the current process live in new user and mount namespaces,
+ * where it keeps its identity.  This function returns -errno if an
+ * error occurred, otherwise 0.
+ */
+static int enter_namespaces(void)
+{
+	char map[64];
+	uid_t uid = getuid();
+	gid_t gid = getgid();
+	int status;
+
+	status = unshare(CLONE_NEWUSER | CLONE_NEWNS);
+	if (status < 0)
+		return -errno;
+
+	status = write_proc_file("/proc/self/setgroups", "deny");
+	if (status < 0 && status != -ENOENT)
+		return status;
+
+	snprintf(map, sizeof(map), "%u %u 1\n", uid, uid);
+	status = write_proc_file("/proc/self/uid_map", map);
+	if (status < 0)
+		return status;
+
+	snprintf(map, sizeof(map), "%u %u 1\n", gid, gid);
+	status = write_proc_file("/proc/self/gid_map", map);
+	if (status < 0)
+		return status;
+
+	/* Don't propagate anything to the host.  */
+	status = mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL);
+	if (status < 0)
+		return -errno;
+
+	return 0;
+}
+
+/**
+ * Apply the bindings of @tracee as bind mounts, then make the guest
+ * rootfs the actual rootfs.  This function returns -errno if an
+ * error occurred before the guest rootfs became the actual rootfs,
+ * otherwise 0.  It exits if an error occurred after that.
+ */
+static int mount_bindings(const Tracee *tracee)
+{
+	const Binding *binding;
+	char target[PATH_MAX];
+	const char *root;
+	bool is_host_rootfs;
+	int status;
+
+	root = get_root(tracee);
+	is_host_rootfs = (compare_paths(root, "/") == PATHS_ARE_EQUAL);
+
+	/* pivot_root(2) requires the new rootfs to be a mount point.  */
+	if (!is_host_rootfs) {
+		status = mount(root, root, NULL, MS_BIND | MS_REC, NULL);
+		if (status < 0)
+			return -errno;
+	}
+
+	/* Shallower bindings have to be mounted first, and "/" is the
+	 * last binding in the guest order.  */
+	for (binding = CIRCLEQ_PREV(CIRCLEQ_LAST(tracee->fs->bindings.guest), link.guest);
+	     binding != (void *) tracee->fs->bindings.guest;
+	     binding = CIRCLEQ_PREV(binding, link.guest)) {
+		status = join_paths(2, target, root, binding->guest.path);
+		if (status < 0)
+			return status;
+
+		status = mount(binding->host.path, target, NULL, MS_BIND | MS_REC, NULL);
+		if (status < 0) {
+			status = -errno;
+			VERBOSE(tracee, 1, "kernel bindings: can't mount \"%s\" on \"%s\": %s",
+				binding->host.path, target, strerror(-status));
+			return status;
+		}
+	}
+
+	if (is_host_rootfs)
+		return 0;
+
+	status = chdir(root);
+	if (status < 0)
+		return -errno;
+
+	/* Stack the guest rootfs over the host one, then detach this
+	 * latter.  */
+	status = syscall(SYS_pivot_root, ".", ".");
+	if (status < 0)
+		return -errno;
+
+	/* The guest rootfs is the actual one now, so the ptrace-only
+	 * mode can't be used as a fallback anymore: its bindings
+	 * would be applied on top of the kernel ones.  */
+	status = umount2(".", MNT_DETACH);
+	if (status == 0)
+		status = chdir("/");
+	if (status < 0) {
+		note(tracee, ERROR, SYSTEM, "kernel bindings: can't detach the host rootfs");
+		exit(EXIT_FAILURE);
+	}
+
+	return 0;
+}
+
+/**
+ * Replace all the bindings of @tracee with "/", since the kernel
+ * handles them now.  This function returns -1 if an error occurred,
+ * otherwise 0.
+ */
+static int reset_bindings(Tracee *tracee)
+{
+	Binding *binding;
+
+	TALLOC_FREE(tracee->fs->bindings.guest);
+	TALLOC_FREE(tracee->fs->bindings.host);
+
+	binding = new_binding(tracee, "/", "/", true);
+	if (binding == NULL)
+		return -1;
+
+	return initialize_bindings(tracee);
+}
+
+/**
+ * Make the kernel handle the bindings of @tracee, by the way of
+ * user and mount namespaces, so that PRoot doesn't have to translate
+ * paths anymore.  @tracee->kernel_bindings is cleared if this is not
+ * possible, in which case PRoot falls back to the usual ptrace-only
+ * mode.
+ */
+void enable_kernel_bindings(Tracee *tracee)
+{
+	char cwd[PATH_MAX];
+	char *tmp;
+	int status;
+
+	if (!tracee->kernel_bindings)
+		return;
+
+	status = check_bindings(tracee);
+	if (status < 0)
+		goto fallback;
+
+	/* The current working directory is relative to the host
+	 * rootfs, which is about to vanish.  */
+	if (tracee->fs->cwd[0] != '/') {
+		status = getcwd2(NULL, cwd);
+		if (status < 0)
+			goto fallback;
+
+		tmp = talloc_asprintf(tracee->fs, "%s/%s", cwd, tracee->fs->cwd);
+		if (tmp == NULL)
+			goto fallback;
+
+		TALLOC_FREE(tracee->fs->cwd);
+		tracee->fs->cwd = tmp;
+		talloc_set_name_const(tracee->fs->cwd, "$cwd");
+	}
+
+	status = enter_namespaces();
+	if (status < 0) {
+		VERBOSE(tracee, 1, "kernel bindings: can't create namespaces: %s",
+			strerror(-status));
+		goto fallback;
+	}
+
+	/* Note: on failure, the bind mounts already made in the
+	 * private mount namespace are transparent to the ptrace-only
+	 * mode since they are equivalent to the bindings.  */
+	status = mount_bindings(tracee);
+	if (status < 0)
+		goto fallback;
+
+	status = reset_bindings(tracee);
+	if (status < 0) {
+		/* The host rootfs isn't reachable anymore.  */
+		note(tracee, ERROR, INTERNAL, "kernel bindings: can't reset bindings");
+		exit(EXIT_FAILURE);
+	}
+
+	VERBOSE(tracee, 1, "kernel bindings: enabled");
+	return;
+
+fallback:
+	VERBOSE(tracee, 0, "kernel bindings are not available, falling back to ptrace");
+	tracee->kernel_bindings = false;
+}
+
+/**
+ * Update @tracee->fs->cwd from the kernel point-of-view, once a
+ * chdir-like syscall actually succeeded.  This function returns
+ * -errno if an error occurred, otherwise 0.
+ */
+int update_kernel_cwd(Tracee *tracee)
+{
+	char link[32];
+	char path[PATH_MAX];
+	ssize_t length;
+	char *tmp;
+
+	snprintf(link, sizeof(link), "/proc/%d/cwd", tracee->pid);
+
+	length = readlink(link, path, sizeof(path));
+	if (length < 0)
+		return -errno;
+	if (length >= PATH_MAX)
+		return -ENAMETOOLONG;
+	path[length] = '\0';
+
+	tmp = talloc_strdup(tracee->fs, path);
+	if (tmp == NULL)
+		return -ENOMEM;
+
+	TALLOC_FREE(tracee->fs->cwd);
+	tracee->fs->cwd = tmp;
+	talloc_set_name_const(tracee->fs->cwd, "$cwd");
+
+	return 0;
+}
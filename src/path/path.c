@@ -401,8 +401,10 @@ skip:
  */
 int detranslate_path(Tracee *tracee, char path[PATH_MAX], const char t_referrer[PATH_MAX])
 {
+	char referrer[PATH_MAX];
 	size_t prefix_length;
 	ssize_t new_length;
+	int status;
 
 	bool sanity_check;
 	bool follow_binding;
@@ -416,6 +418,18 @@ int detranslate_path(Tracee *tracee, char path[PATH_MAX], const char t_referrer[
 	if (path[0] != '/')
 		return 0;
 
+	if (tracee != NULL && tracee->extensions != NULL) {
+		if (t_referrer != NULL) {
+			strcpy(referrer, t_referrer);
+			t_referrer = referrer;
+		}
+
+		status = notify_extensions(tracee, DETRANSLATE_PATH, (intptr_t) path,
+					(intptr_t) t_referrer);
+		if (status < 0)
+			return status;
+	}
+
 	/* Is it a symlink?  */
 	if (t_referrer != NULL) {
 		Comparison comparison;
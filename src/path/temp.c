@@ -1,11 +1,16 @@
-#include <sys/types.h>  /* stat(2), opendir(3), */
-#include <sys/stat.h>   /* stat(2), chmod(2), */
-#include <unistd.h>     /* stat(2), rmdir(2), unlink(2), readlink(2), */
+#include <sys/types.h>  /* fstatat(2), open(2), */
+#include <sys/stat.h>   /* fstatat(2), chmod(2), fchmodat(2), */
+#include <sys/wait.h>   /* waitpid(2), W*, */
+#include <fcntl.h>      /* open(2), openat(2), O_*, AT_*, */
+#include <unistd.h>     /* rmdir(2), unlinkat(2), readlink(2), fork(2), setsid(2), dup2(2), syscall(2), */
+#include <sys/syscall.h> /* SYS_close_range, */
 #include <errno.h>      /* errno(2), */
-#include <dirent.h>     /* readdir(3), opendir(3), */
+#include <dirent.h>     /* readdir(3), fdopendir(3), opendir(3), dirfd(3), */
 #include <string.h>     /* strcmp(3), */
-#include <stdlib.h>     /* free(3), getenv(3), */
-#include <stdio.h>      /* P_tmpdir, */
+#include <stdlib.h>     /* free(3), getenv(3), atoi(3), EXIT_*, */
+#include <stdio.h>      /* P_tmpdir, sprintf(3), */
+#include <stdbool.h>    /* bool, true, false, */
+#include <limits.h>     /* PATH_MAX, */
 #include <talloc.h>     /* talloc(3), */
 
 #include "cli/note.h"
@@ -49,16 +54,18 @@ const char *get_temp_directory()
 
 /**
  * Handle the return of d_type = DT_UNKNOWN by readdir(3)
- * Not all filesystems support returning d_type in readdir(3)
+ * Not all filesystems support returning d_type in readdir(3), so
+ * this is the only case where the entry @de of the directory opened
+ * as @dirfd is stat'ed.
  */
-static int get_dtype(struct dirent *de)
+static int get_dtype(int dirfd, struct dirent *de)
 {
 	int dtype = de ? de->d_type : DT_UNKNOWN;
 	struct stat st;
 
 	if (dtype != DT_UNKNOWN)
 		return dtype;
-	if (lstat(de->d_name, &st))
+	if (fstatat(dirfd, de->d_name, &st, AT_SYMLINK_NOFOLLOW))
 		return dtype;
 	if (S_ISREG(st.st_mode))
 		return DT_REG;
@@ -70,58 +77,28 @@ static int get_dtype(struct dirent *de)
 }
 
 /**
- * Remove recursively the content of the current working directory.
- * This latter has to lie in temp_directory (ie. "/tmp" on most
- * systems).  This function returns -1 if a fatal error occured
- * (ie. the recursion must be stopped), the number of non-fatal errors
- * otherwise.
- *
- * WARNING: this function changes the current working directory for
- * the calling process.
+ * Remove recursively the content of the directory opened as @dirfd,
+ * then close this latter.  Entries are removed relatively to @dirfd
+ * and sub-directories are opened with O_NOFOLLOW, so the walk can't
+ * escape the directory checked by remove_temp_directory2().  This
+ * function returns the number of errors.
  */
-static int clean_temp_cwd()
+static int clean_temp_dirfd(int dirfd)
 {
-	const char *temp_directory = get_temp_directory();
-	const size_t length_temp_directory = strlen(temp_directory);
-	char *prefix = NULL;
 	int nb_errors = 0;
-	DIR *dir = NULL;
+	DIR *dir;
 	int status;
 
-	prefix = talloc_size(NULL, length_temp_directory + 1);
-	if (prefix == NULL) {
-		note(NULL, WARNING, INTERNAL, "can't allocate memory");
-		nb_errors++;
-		goto end;
-	}
-
-	/* Sanity check: ensure the current directory lies in
-	 * "/tmp".  */
-	status = readlink("/proc/self/cwd", prefix, length_temp_directory);
-	if (status < 0) {
-		note(NULL, WARNING, SYSTEM, "can't readlink '/proc/self/cwd'");
-		nb_errors++;
-		goto end;
-	}
-	prefix[status] = '\0';
-
-	if (strncmp(prefix, temp_directory, length_temp_directory) != 0) {
-		note(NULL, ERROR, INTERNAL,
-			"trying to remove a directory outside of '%s', "
-			"please report this error.\n", temp_directory);
-		nb_errors++;
-		goto end;
-	}
-
-	dir = opendir(".");
+	dir = fdopendir(dirfd);
 	if (dir == NULL) {
-		note(NULL, WARNING, SYSTEM, "can't open '.'");
-		nb_errors++;
-		goto end;
+		note(NULL, WARNING, SYSTEM, "can't open directory");
+		(void) close(dirfd);
+		return 1;
 	}
 
 	while (1) {
 		struct dirent *entry;
+		int subdirfd;
 
 		errno = 0;
 		entry = readdir(dir);
@@ -132,57 +109,47 @@ static int clean_temp_cwd()
 		    || strcmp(entry->d_name, "..") == 0)
 			continue;
 
-		status = chmod(entry->d_name, 0700);
+		if (get_dtype(dirfd, entry) != DT_DIR) {
+			status = unlinkat(dirfd, entry->d_name, 0);
+			if (status < 0 && errno != ENOENT) {
+				note(NULL, WARNING, SYSTEM, "can't remove '%s'", entry->d_name);
+				nb_errors++;
+			}
+			continue;
+		}
+
+		/* Make sure the sub-directory can be walked and
+		 * emptied.  */
+		status = fchmodat(dirfd, entry->d_name, 0700, 0);
 		if (status < 0) {
 			note(NULL, WARNING, SYSTEM, "cant chmod '%s'", entry->d_name);
 			nb_errors++;
 			continue;
 		}
 
-		if (get_dtype(entry) == DT_DIR) {
-			status = chdir(entry->d_name);
-			if (status < 0) {
-				note(NULL, WARNING, SYSTEM, "can't chdir '%s'", entry->d_name);
-				nb_errors++;
-				continue;
-			}
+		subdirfd = openat(dirfd, entry->d_name,
+				O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+		if (subdirfd < 0) {
+			note(NULL, WARNING, SYSTEM, "can't open '%s'", entry->d_name);
+			nb_errors++;
+			continue;
+		}
 
-			/* Recurse.  */
-			status = clean_temp_cwd();
-			if (status < 0) {
-				nb_errors = -1;
-				goto end;
-			}
-			nb_errors += status;
+		/* Recurse.  */
+		nb_errors += clean_temp_dirfd(subdirfd);
 
-			status = chdir("..");
-			if (status < 0) {
-				note(NULL, ERROR, SYSTEM, "can't chdir to '..'");
-				nb_errors = -1;
-				goto end;
-			}
-
-			status = rmdir(entry->d_name);
-		}
-		else {
-			status = unlink(entry->d_name);
-		}
-		if (status < 0) {
+		status = unlinkat(dirfd, entry->d_name, AT_REMOVEDIR);
+		if (status < 0 && errno != ENOENT) {
 			note(NULL, WARNING, SYSTEM, "can't remove '%s'", entry->d_name);
 			nb_errors++;
-			continue;
 		}
 	}
 	if (errno != 0) {
-		note(NULL, WARNING, SYSTEM, "can't readdir '.'");
+		note(NULL, WARNING, SYSTEM, "can't readdir");
 		nb_errors++;
 	}
 
-end:
-	TALLOC_FREE(prefix);
-
-	if (dir != NULL)
-		(void) closedir(dir);
+	(void) closedir(dir);
 
 	return nb_errors;
 }
@@ -194,73 +161,176 @@ end:
  */
 static int remove_temp_directory2(const char *path)
 {
+	const char *temp_directory = get_temp_directory();
+	const size_t length_temp_directory = strlen(temp_directory);
+	char prefix[PATH_MAX];
+	char proc_path[64];
 	int result;
 	int status;
-	char *cwd;
-
-#ifdef __ANDROID__
-	cwd = malloc(PATH_MAX);
-	getcwd(cwd, PATH_MAX);
-#else
-	cwd = get_current_dir_name();
-#endif
+	int dirfd;
 
 	status = chmod(path, 0700);
 	if (status < 0) {
 		note(NULL, ERROR, SYSTEM, "can't chmod '%s'", path);
-		result = -1;
-		goto end;
+		return -1;
+	}
+
+	dirfd = open(path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (dirfd < 0) {
+		note(NULL, ERROR, SYSTEM, "can't open '%s'", path);
+		return -1;
 	}
 
-	status = chdir(path);
+	/* Sanity check: ensure the opened directory lies in
+	 * "/tmp".  */
+	sprintf(proc_path, "/proc/self/fd/%d", dirfd);
+	status = readlink(proc_path, prefix, length_temp_directory);
 	if (status < 0) {
-		note(NULL, ERROR, SYSTEM, "can't chdir to '%s'", path);
-		result = -1;
-		goto end;
+		note(NULL, ERROR, SYSTEM, "can't readlink '%s'", proc_path);
+		(void) close(dirfd);
+		return -1;
 	}
+	prefix[status] = '\0';
 
-	status = clean_temp_cwd();
+	if (strncmp(prefix, temp_directory, length_temp_directory) != 0) {
+		note(NULL, ERROR, INTERNAL,
+			"trying to remove a directory outside of '%s', "
+			"please report this error.\n", temp_directory);
+		(void) close(dirfd);
+		return -1;
+	}
+
+	status = clean_temp_dirfd(dirfd);
 	result = (status == 0 ? 0 : -1);
 
 	/* Try to remove path even if something went wrong.  */
-	status = chdir("..");
-	if (status < 0) {
-		note(NULL, ERROR, SYSTEM, "can't chdir to '..'");
-		result = -1;
-		goto end;
-	}
-
 	status = rmdir(path);
 	if (status < 0) {
 		note(NULL, ERROR, SYSTEM, "cant remove '%s'", path);
 		result = -1;
-		goto end;
 	}
 
-end:
-	if (cwd != NULL) {
-		status = chdir(cwd);
-		if (status < 0) {
-			result = -1;
-			note(NULL, ERROR, SYSTEM, "can't chdir to '%s'", cwd);
-		}
-		free(cwd);
+	return result;
+}
+
+/* Whether temporary directories are removed by a detached process,
+ * see detach_temp_removal().  */
+static bool remove_in_background = false;
+
+/**
+ * Close all the file descriptors above the standard streams, so the
+ * detached process doesn't keep open the pipes, sockets, and files
+ * inherited from PRoot.
+ */
+static void close_inherited_fds()
+{
+	struct dirent *entry;
+	DIR *directory;
+	int fd;
+
+#if defined(SYS_close_range)
+	if (syscall(SYS_close_range, STDERR_FILENO + 1, ~0U, 0) == 0)
+		return;
+#endif
+
+	directory = opendir("/proc/self/fd");
+	if (directory == NULL)
+		return;
+
+	while ((entry = readdir(directory)) != NULL) {
+		fd = atoi(entry->d_name);
+		if (fd > STDERR_FILENO && fd != dirfd(directory))
+			(void) close(fd);
 	}
 
-	return result;
+	(void) closedir(directory);
 }
 
 /**
- * Like remove_temp_directory2() but always return 0.
+ * Fork a process that is immediately reparented to init, with its
+ * own session, with its standard streams redirected to "/dev/null",
+ * and without any other file descriptors, so neither the terminal
+ * nor the parent of PRoot wait for it.  This function returns 0 in
+ * the detached process, 1 in the calling one, and -1 if the detached
+ * process couldn't be created.
+ */
+static int fork_detached_process()
+{
+	int status;
+	pid_t pid;
+	int fd;
+
+	pid = fork();
+	if (pid < 0)
+		return -1;
+
+	if (pid > 0) {
+		pid = waitpid(pid, &status, 0);
+		if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+			return -1;
+		return 1;
+	}
+
+	/* Intermediate process.  */
+	(void) setsid();
+
+	pid = fork();
+	if (pid != 0)
+		_exit(pid < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+
+	/* Detached process.  */
+	fd = open("/dev/null", O_RDWR);
+	if (fd >= 0) {
+		(void) dup2(fd, STDIN_FILENO);
+		(void) dup2(fd, STDOUT_FILENO);
+		(void) dup2(fd, STDERR_FILENO);
+		if (fd > STDERR_FILENO)
+			(void) close(fd);
+	}
+
+	close_inherited_fds();
+
+	return 0;
+}
+
+/**
+ * Like remove_temp_directory2() but always return 0.  Once
+ * detach_temp_removal() was called, the removal is handed over to a
+ * detached process.
  *
  * Note: this is a talloc destructor.
  */
 static int remove_temp_directory(char *path)
 {
+	if (remove_in_background) {
+		switch (fork_detached_process()) {
+		case 0:
+			(void) remove_temp_directory2(path);
+			_exit(EXIT_SUCCESS);
+
+		case 1:
+			return 0;
+
+		default:
+			break;
+		}
+	}
+
 	(void) remove_temp_directory2(path);
 	return 0;
 }
 
+/**
+ * Remove the temporary directories that are still alive -- typically
+ * at PRoot termination -- in a detached process, so the exit status
+ * of PRoot is reported to its parent without waiting for the removal
+ * of huge glue or CARE trees.
+ */
+void detach_temp_removal()
+{
+	remove_in_background = true;
+}
+
 /**
  * Remove the file @path.  This function always returns 0.
  *
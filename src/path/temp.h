@@ -30,5 +30,6 @@ extern const char *create_temp_directory(TALLOC_CTX *context, const char *prefix
 extern const char *create_temp_file(TALLOC_CTX *context, const char *prefix);
 extern FILE* open_temp_file(TALLOC_CTX *context, const char *prefix);
 extern const char *get_temp_directory();
+extern void detach_temp_removal();
 
 #endif /* TEMP_H */
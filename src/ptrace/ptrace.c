@@ -28,6 +28,7 @@
 #include <sys/uio.h>    /* struct iovec, */
 #include <sys/param.h>  /* MIN(), MAX(), */
 #include <string.h>     /* memcpy(3), */
+#include <sys/wait.h>   /* WIFSTOPPED, */
 
 #include "ptrace/ptrace.h"
 #include "ptrace/user.h"
@@ -116,6 +117,61 @@ void detach_from_ptracer(Tracee *ptracee)
 	PTRACER.nb_ptracees--;
 }
 
+/**
+ * Check whether @event -- as reported by waitpid(2) -- is a seccomp
+ * stop.
+ */
+static bool is_seccomp_event(int event)
+{
+	int signal = (event & 0xfff00) >> 8;
+
+	return (WIFSTOPPED(event)
+		&& (   signal == (SIGTRAP | PTRACE_EVENT_SECCOMP << 8)
+		    || signal == (SIGTRAP | PTRACE_EVENT_SECCOMP2 << 8)));
+}
+
+/**
+ * Disable seccomp acceleration for @ptracee since its ptracer expects
+ * a stop at each syscall, whereas only the syscalls filtered by PRoot
+ * are reported under seccomp.  It will be re-enabled by
+ * resume_seccomp() once its ptracer doesn't expect them anymore.
+ */
+void suspend_seccomp(Tracee *ptracee)
+{
+	if (ptracee->seccomp != ENABLED)
+		return;
+
+	ptracee->seccomp = DISABLED;
+	ptracee->seccomp_suspended = true;
+
+	if (ptracee->restart_how == PTRACE_CONT)
+		ptracee->restart_how = PTRACE_SYSCALL;
+}
+
+/**
+ * Re-enable seccomp acceleration for @ptracee if it was disabled by
+ * suspend_seccomp() and if its ptracer -- if any -- doesn't expect
+ * syscall stops anymore.  This has to be called in between two
+ * syscalls, not to miss a sysexit stage.
+ */
+void resume_seccomp(Tracee *ptracee)
+{
+	if (!ptracee->seccomp_suspended || ptracee->seccomp != DISABLED)
+		return;
+
+	if (PTRACEE.ptracer != NULL && !PTRACEE.ignore_syscalls)
+		return;
+
+	assert(IS_IN_SYSENTER(ptracee));
+
+	ptracee->seccomp = ENABLED;
+	ptracee->seccomp_suspended = false;
+	ptracee->sysexit_pending = false;
+
+	if (ptracee->restart_how == PTRACE_SYSCALL)
+		ptracee->restart_how = PTRACE_CONT;
+}
+
 /**
  * Emulate the ptrace syscall made by @tracee.  This function returns
  * -errno if an error occured (unsupported request), otherwise 0.
@@ -124,6 +180,7 @@ int translate_ptrace_exit(Tracee *tracee)
 {
 	word_t request, pid, address, data, result;
 	Tracee *ptracee, *ptracer;
+	bool at_seccomp_stop;
 	int forced_signal = -1;
 	int signal;
 	int status;
@@ -164,12 +221,9 @@ int translate_ptrace_exit(Tracee *tracee)
 			}
 		}
 
-		/* Disable seccomp acceleration for this tracee and
-		 * all its children since we can't assume what are the
-		 * syscalls its tracer is interested with.  */
-		if (tracee->seccomp == ENABLED)
-			tracee->seccomp = DISABLING;
-
+		/* Seccomp acceleration is kept as long as its tracer
+		 * doesn't expect syscall stops, see
+		 * suspend_seccomp().  */
 		return 0;
 	}
 
@@ -258,13 +312,6 @@ int translate_ptrace_exit(Tracee *tracee)
 		break;  /* Restart the ptracee.  */
 
 	case PTRACE_SETOPTIONS:
-		if (data & PTRACE_O_TRACESECCOMP) {
-			/* We don't really support forwarding seccomp traps */
-			note(ptracer, WARNING, INTERNAL,
-			     "ptrace option PTRACE_O_TRACESECCOMP "
-			     "not supported yet");
-			return -EINVAL;
-		}
 		PTRACEE.options = data;
 		return 0;  /* Don't restart the ptracee.  */
 
@@ -654,11 +701,22 @@ int translate_ptrace_exit(Tracee *tracee)
 		return -ENOTSUP;
 	}
 
+	/* The sysexit stage is always hit after a seccomp stop that
+	 * was passed to the ptracer, see handle_ptracee_event().  */
+	at_seccomp_stop = (PTRACEE.event4.proot.pending
+			&& is_seccomp_event(PTRACEE.event4.proot.value));
+
 	/* Now, the initial tracee's event can be handled.  */
 	signal = PTRACEE.event4.proot.pending
 		? handle_tracee_event(ptracee, PTRACEE.event4.proot.value)
 		: PTRACEE.event4.proot.value;
 
+	/* Don't report more syscall stops than necessary to PRoot.  */
+	if (request == PTRACE_SYSCALL && !at_seccomp_stop)
+		suspend_seccomp(ptracee);
+	else if (request != PTRACE_SYSCALL && IS_IN_SYSENTER(ptracee))
+		resume_seccomp(ptracee);
+
 	/* The restarting signal from the ptracer overrides the
 	 * restarting signal from PRoot.  */
 	if (forced_signal != -1)
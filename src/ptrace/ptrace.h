@@ -29,6 +29,8 @@ extern int translate_ptrace_enter(Tracee *tracee);
 extern int translate_ptrace_exit(Tracee *tracee);
 extern void attach_to_ptracer(Tracee *ptracee, Tracee *ptracer);
 extern void detach_from_ptracer(Tracee *ptracee);
+extern void suspend_seccomp(Tracee *ptracee);
+extern void resume_seccomp(Tracee *ptracee);
 
 #define PTRACEE (ptracee->as_ptracee)
 #define PTRACER (ptracer->as_ptracer)
@@ -31,6 +31,7 @@
 #include "ptrace/ptrace.h"
 #include "syscall/sysnum.h"
 #include "syscall/chain.h"
+#include "syscall/seccomp.h"
 #include "tracee/tracee.h"
 #include "tracee/event.h"
 #include "tracee/reg.h"
@@ -285,10 +286,24 @@ bool handle_ptracee_event(Tracee *ptracee, int event)
 			assert(0);
 
 		case SIGTRAP | PTRACE_EVENT_SECCOMP2 << 8:
-		case SIGTRAP | PTRACE_EVENT_SECCOMP << 8:
-			/* These events are not supported [yet?] under
-			 * ptrace emulation.  */
-			return false;
+		case SIGTRAP | PTRACE_EVENT_SECCOMP << 8: {
+			unsigned long data = 0;
+			long status;
+
+			if ((PTRACEE.options & PTRACE_O_TRACESECCOMP) == 0)
+				return false;
+
+			/* Only the events raised by the filters of the
+			 * ptracee itself are expected by its ptracer,
+			 * not the ones raised by PRoot's filter.  */
+			status = ptrace(PTRACE_GETEVENTMSG, ptracee->pid, NULL, &data);
+			if (status < 0 || is_proot_seccomp_event(data))
+				return false;
+
+			event = __W_STOPCODE(SIGTRAP | PTRACE_EVENT_SECCOMP << 8);
+			PTRACEE.tracing_started = true;
+			break;
+		}
 
 		default:
 			PTRACEE.tracing_started = true;
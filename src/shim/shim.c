@@ -0,0 +1,609 @@
+/* -*- c-set-style: "K&R"; c-basic-offset: 8 -*-
+ *
+ * This file is part of PRoot.
+ *
+ * Copyright (C) 2015 STMicroelectronics
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+/* This library is preloaded in dynamically linked guest programs when
+ * PRoot is started with --preload-shim.  It translates the paths of
+ * the most common libc functions in-process, using the snapshot of
+ * the bindings published by PRoot, then performs the actual syscalls
+ * through a "gadget" that the seccomp filter lets pass through
+ * without notifying PRoot.  Anything it isn't sure about -- relative
+ * paths, /proc, errors, ... -- is handed over to PRoot by the way of
+ * regular syscalls.  It has to be built with -mno-red-zone since the
+ * gadget is reached with a "call" instruction.  */
+
+#include <stdint.h>       /* uint*_t, */
+#include <stdarg.h>       /* va_*, */
+#include <stddef.h>       /* NULL, size_t, */
+#include <linux/fcntl.h>  /* O_*, AT_*, */
+#include <linux/stat.h>   /* S_IS*, */
+#include <linux/mman.h>   /* PROT_*, MAP_*, */
+#include <linux/errno.h>  /* E*, */
+#include <asm/stat.h>     /* struct stat, */
+#include <asm/unistd.h>   /* __NR_*, */
+
+#define NO_LIBC_HEADER
+#include "shim/snapshot.h"
+#include "arch.h"
+
+#if !defined(ARCH_X86_64)
+#    error "Unsupported architecture"
+#endif
+
+#if !defined(MAP_FIXED_NOREPLACE)
+#    define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+#define SHIM_PATH_MAX 4096
+#define SHIM_MAX_SYMLINKS 40
+#define EXPORT __attribute__((visibility("default")))
+
+/* Provided by the guest libc.  */
+extern char *getenv(const char *name);
+extern int *__errno_location(void);
+
+static const SnapshotHeader *snapshot = NULL;
+
+/**
+ * Perform a regular syscall, PRoot translates it as usual.
+ */
+static long raw_syscall(long number, long arg1, long arg2, long arg3, long arg4)
+{
+	register long rax asm("rax") = number;
+	register long rdi asm("rdi") = arg1;
+	register long rsi asm("rsi") = arg2;
+	register long rdx asm("rdx") = arg3;
+	register long r10 asm("r10") = arg4;
+
+	asm volatile ("syscall"
+		: "+r" (rax)
+		: "r" (rdi), "r" (rsi), "r" (rdx), "r" (r10)
+		: "memory", "cc", "rcx", "r11");
+
+	return rax;
+}
+
+/**
+ * Perform a syscall through the gadget, PRoot doesn't see it.
+ */
+static long gadget_syscall(long number, long arg1, long arg2, long arg3, long arg4)
+{
+	register long rax asm("rax") = number;
+	register long rdi asm("rdi") = arg1;
+	register long rsi asm("rsi") = arg2;
+	register long rdx asm("rdx") = arg3;
+	register long r10 asm("r10") = arg4;
+
+	asm volatile ("call *%[gadget]"
+		: "+r" (rax)
+		: [gadget] "r" ((long) SHIM_GADGET_ADDRESS),
+		  "r" (rdi), "r" (rsi), "r" (rdx), "r" (r10)
+		: "memory", "cc", "rcx", "r11");
+
+	return rax;
+}
+
+static long raw_mmap(long addr, long length, long prot, long flags, long fd)
+{
+	register long rax asm("rax") = __NR_mmap;
+	register long rdi asm("rdi") = addr;
+	register long rsi asm("rsi") = length;
+	register long rdx asm("rdx") = prot;
+	register long r10 asm("r10") = flags;
+	register long r8  asm("r8")  = fd;
+	register long r9  asm("r9")  = 0;
+
+	asm volatile ("syscall"
+		: "+r" (rax)
+		: "r" (rdi), "r" (rsi), "r" (rdx), "r" (r10), "r" (r8), "r" (r9)
+		: "memory", "cc", "rcx", "r11");
+
+	return rax;
+}
+
+/**
+ * Set errno from the syscall @result, the libc way.
+ */
+static long errno_result(long result)
+{
+	if (result < 0 && result > -4096) {
+		*__errno_location() = (int) -result;
+		return -1;
+	}
+	return result;
+}
+
+static uint32_t length_of(const char *string)
+{
+	uint32_t length = 0;
+
+	while (string[length] != '\0')
+		length++;
+
+	return length;
+}
+
+/**
+ * Append @length bytes of @string to @path (@path_length bytes
+ * long).  This function returns -1 if there's not enough room,
+ * otherwise the new length of @path.
+ */
+static int append(char path[SHIM_PATH_MAX], int path_length, const char *string, int length)
+{
+	int i;
+
+	if (path_length + length >= SHIM_PATH_MAX)
+		return -1;
+
+	for (i = 0; i < length; i++)
+		path[path_length + i] = string[i];
+	path[path_length + length] = '\0';
+
+	return path_length + length;
+}
+
+/**
+ * Substitute the guest canonical @guest_path with its host
+ * counterpart into @host_path, according to the snapshot.  This
+ * function returns -1 if an error occurred, otherwise 0.
+ */
+static int substitute(const char *guest_path, char host_path[SHIM_PATH_MAX])
+{
+	const SnapshotBinding *bindings = (const SnapshotBinding *) (snapshot + 1);
+	const char *base = (const char *) snapshot;
+	uint32_t length = length_of(guest_path);
+	uint32_t i, j;
+
+	for (i = 0; i < snapshot->nb_bindings; i++) {
+		const char *guest = base + bindings[i].guest_offset;
+		const char *host  = base + bindings[i].host_offset;
+		uint32_t guest_length = bindings[i].guest_length;
+		uint32_t host_length  = bindings[i].host_length;
+		const char *rest;
+		int status;
+
+		if (guest_length == 1)
+			rest = guest_path;
+		else {
+			if (guest_length > length)
+				continue;
+
+			for (j = 0; j < guest_length && guest[j] == guest_path[j]; j++)
+				;
+			if (j != guest_length
+			    || (guest_path[j] != '\0' && guest_path[j] != '/'))
+				continue;
+
+			rest = guest_path + guest_length;
+		}
+
+		if (host_length == 1 && rest[0] != '\0')
+			host_length = 0;
+
+		status = append(host_path, 0, host, host_length);
+		if (status < 0)
+			return -1;
+
+		status = append(host_path, status, rest, length_of(rest));
+		if (status < 0)
+			return -1;
+
+		return 0;
+	}
+
+	return -1;
+}
+
+/**
+ * Remove the last component of the canonical @path (@length bytes
+ * long).  This function returns the new length of @path.
+ */
+static int pop_component(char path[SHIM_PATH_MAX], int length)
+{
+	while (length > 1 && path[length - 1] != '/')
+		length--;
+	if (length > 1)
+		length--;
+	path[length] = '\0';
+
+	return length;
+}
+
+/**
+ * Return 1 if the guest path @guest of @length bytes is "/proc" or
+ * lies under it, otherwise 0.
+ */
+static int is_proc(const char *guest, int length)
+{
+	return (length >= 5
+		&& guest[1] == 'p' && guest[2] == 'r' && guest[3] == 'o' && guest[4] == 'c'
+		&& (guest[5] == '\0' || guest[5] == '/'));
+}
+
+/**
+ * Canonicalize the guest @path -- its final component is dereferenced
+ * if @deref_final is not 0 -- then substitute it into @host_path.
+ * This function returns -1 if PRoot has to handle @path, otherwise 0.
+ */
+static int translate(const char *path, char host_path[SHIM_PATH_MAX], int deref_final)
+{
+	char pending[SHIM_PATH_MAX];
+	char guest[SHIM_PATH_MAX];
+	char link[SHIM_PATH_MAX];
+	int nb_symlinks = 0;
+	int trailing_slash;
+	int guest_length;
+	const char *cursor;
+	struct stat statl;
+	int length;
+
+	/* Relative paths depend on the cwd, which is emulated by
+	 * PRoot.  */
+	if (snapshot == NULL || path == NULL || path[0] != '/')
+		return -1;
+
+	length = append(pending, 0, path, length_of(path));
+	if (length < 0)
+		return -1;
+	trailing_slash = (length > 1 && pending[length - 1] == '/');
+
+	guest_length = append(guest, 0, "/", 1);
+	cursor = pending;
+
+	while (1) {
+		const char *component;
+		const char *next;
+		int is_final;
+		long status;
+
+		while (*cursor == '/')
+			cursor++;
+		if (*cursor == '\0')
+			break;
+
+		component = cursor;
+		for (next = cursor; *next != '\0' && *next != '/'; next++)
+			;
+		length = next - component;
+
+		for (cursor = next; *cursor == '/'; cursor++)
+			;
+		is_final = (*cursor == '\0');
+
+		if (length == 1 && component[0] == '.')
+			continue;
+
+		if (length == 2 && component[0] == '.' && component[1] == '.') {
+			guest_length = pop_component(guest, guest_length);
+			continue;
+		}
+
+		if (guest_length > 1)
+			guest_length = append(guest, guest_length, "/", 1);
+		if (guest_length >= 0)
+			guest_length = append(guest, guest_length, component, length);
+		if (guest_length < 0)
+			return -1;
+
+		/* Paths under /proc are specially handled by PRoot,
+		 * including the magic links it contains, so they must
+		 * not be dereferenced as regular symlinks.  */
+		if (is_proc(guest, guest_length))
+			return -1;
+
+		if (is_final && !deref_final && !trailing_slash)
+			break;
+
+		if (substitute(guest, host_path) < 0)
+			return -1;
+
+		status = gadget_syscall(__NR_newfstatat, AT_FDCWD, (long) host_path,
+					(long) &statl, AT_SYMLINK_NOFOLLOW);
+		if (status < 0) {
+			/* Let the kernel report the error, if any.  */
+			if (is_final && status == -ENOENT)
+				break;
+			return -1;
+		}
+
+		if (S_ISLNK(statl.st_mode)) {
+			if (++nb_symlinks > SHIM_MAX_SYMLINKS)
+				return -1;
+
+			status = gadget_syscall(__NR_readlinkat, AT_FDCWD, (long) host_path,
+						(long) link, SHIM_PATH_MAX - 1);
+			if (status <= 0)
+				return -1;
+			link[status] = '\0';
+
+			/* Symlinks are relative to the guest rootfs.  */
+			if (link[0] == '/')
+				guest_length = append(guest, 0, "/", 1);
+			else
+				guest_length = pop_component(guest, guest_length);
+
+			length = length_of(link);
+			if (*cursor != '\0') {
+				length = append(link, length, "/", 1);
+				if (length >= 0)
+					length = append(link, length, cursor, length_of(cursor));
+				if (length < 0)
+					return -1;
+			}
+
+			if (append(pending, 0, link, length) < 0)
+				return -1;
+			cursor = pending;
+			continue;
+		}
+
+		if (!is_final && !S_ISDIR(statl.st_mode))
+			return -1;
+	}
+
+	/* Paths under /proc are specially handled by PRoot.  */
+	if (is_proc(guest, guest_length))
+		return -1;
+
+	if (substitute(guest, host_path) < 0)
+		return -1;
+
+	if (trailing_slash) {
+		length = append(host_path, length_of(host_path), "/", 1);
+		if (length < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Map the gadget at its fixed address, then map the snapshot of the
+ * bindings.  The shim stays disabled if anything goes wrong.
+ */
+__attribute__((constructor)) static void initialize_shim(void)
+{
+	static const unsigned char gadget[] = { 0x0f, 0x05, 0xc3 }; /* syscall; ret */
+	const SnapshotHeader *header;
+	struct stat statl;
+	const char *path;
+	unsigned char *page;
+	long status;
+	long fd;
+	size_t i;
+
+	path = getenv(SHIM_SNAPSHOT_ENV);
+	if (path == NULL)
+		return;
+
+	status = raw_mmap(SHIM_GADGET_ADDRESS, 4096, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1);
+	if (status != SHIM_GADGET_ADDRESS) {
+		if (status > 0)
+			(void) raw_syscall(__NR_munmap, status, 4096, 0, 0);
+		return;
+	}
+
+	page = (unsigned char *) SHIM_GADGET_ADDRESS;
+	for (i = 0; i < sizeof(gadget); i++)
+		page[i] = gadget[i];
+
+	status = raw_syscall(__NR_mprotect, SHIM_GADGET_ADDRESS, 4096, PROT_READ | PROT_EXEC, 0);
+	if (status < 0)
+		return;
+
+	/* This is a host path.  */
+	fd = gadget_syscall(__NR_openat, AT_FDCWD, (long) path, O_RDONLY | O_CLOEXEC, 0);
+	if (fd < 0)
+		return;
+
+	status = raw_syscall(__NR_fstat, fd, (long) &statl, 0, 0);
+	if (status < 0 || statl.st_size < (long) sizeof(SnapshotHeader))
+		goto end;
+
+	status = raw_mmap(0, statl.st_size, PROT_READ, MAP_SHARED, fd);
+	if (status < 0 && status > -4096)
+		goto end;
+
+	header = (const SnapshotHeader *) status;
+	if (header->magic != SHIM_SNAPSHOT_MAGIC
+	    || header->version != SHIM_SNAPSHOT_VERSION
+	    || header->size != (uint64_t) statl.st_size) {
+		(void) raw_syscall(__NR_munmap, status, statl.st_size, 0, 0);
+		goto end;
+	}
+
+	snapshot = header;
+end:
+	(void) raw_syscall(__NR_close, fd, 0, 0, 0);
+}
+
+/**
+ * Should the final component of a path be dereferenced by open(2)
+ * with the given @flags?
+ */
+static int open_derefs_final(int flags)
+{
+	return (flags & O_NOFOLLOW) == 0
+		&& (flags & (O_CREAT | O_EXCL)) != (O_CREAT | O_EXCL);
+}
+
+static int shim_openat(int dirfd, const char *path, int flags, int mode)
+{
+	char host_path[SHIM_PATH_MAX];
+
+	if ((dirfd == AT_FDCWD || (path != NULL && path[0] == '/'))
+	    && translate(path, host_path, open_derefs_final(flags)) == 0)
+		return errno_result(gadget_syscall(__NR_openat, AT_FDCWD, (long) host_path,
+							flags, mode));
+
+	return errno_result(raw_syscall(__NR_openat, dirfd, (long) path, flags, mode));
+}
+
+static int shim_fstatat(int dirfd, const char *path, struct stat *buffer, int flags)
+{
+	char host_path[SHIM_PATH_MAX];
+
+	if ((dirfd == AT_FDCWD || (path != NULL && path[0] == '/'))
+	    && (flags & ~AT_SYMLINK_NOFOLLOW) == 0
+	    && translate(path, host_path, (flags & AT_SYMLINK_NOFOLLOW) == 0) == 0)
+		return errno_result(gadget_syscall(__NR_newfstatat, AT_FDCWD, (long) host_path,
+							(long) buffer, flags));
+
+	return errno_result(raw_syscall(__NR_newfstatat, dirfd, (long) path, (long) buffer, flags));
+}
+
+static int shim_faccessat(int dirfd, const char *path, int mode)
+{
+	char host_path[SHIM_PATH_MAX];
+
+	if ((dirfd == AT_FDCWD || (path != NULL && path[0] == '/'))
+	    && translate(path, host_path, 1) == 0)
+		return errno_result(gadget_syscall(__NR_faccessat, AT_FDCWD, (long) host_path,
+							mode, 0));
+
+	return errno_result(raw_syscall(__NR_faccessat, dirfd, (long) path, mode, 0));
+}
+
+#define OPEN_MODE(flags) ({						\
+	int mode_ = 0;							\
+	if (((flags) & O_CREAT) != 0 || ((flags) & __O_TMPFILE) == __O_TMPFILE) { \
+		va_list ap_;						\
+		va_start(ap_, flags);					\
+		mode_ = va_arg(ap_, int);				\
+		va_end(ap_);						\
+	}								\
+	mode_;								\
+})
+
+EXPORT int open(const char *path, int flags, ...)
+{
+	return shim_openat(AT_FDCWD, path, flags, OPEN_MODE(flags));
+}
+
+EXPORT int open64(const char *path, int flags, ...)
+{
+	return shim_openat(AT_FDCWD, path, flags | O_LARGEFILE, OPEN_MODE(flags));
+}
+
+EXPORT int openat(int dirfd, const char *path, int flags, ...)
+{
+	return shim_openat(dirfd, path, flags, OPEN_MODE(flags));
+}
+
+EXPORT int openat64(int dirfd, const char *path, int flags, ...)
+{
+	return shim_openat(dirfd, path, flags | O_LARGEFILE, OPEN_MODE(flags));
+}
+
+EXPORT int __open_2(const char *path, int flags)
+{
+	return shim_openat(AT_FDCWD, path, flags, 0);
+}
+
+EXPORT int __open64_2(const char *path, int flags)
+{
+	return shim_openat(AT_FDCWD, path, flags | O_LARGEFILE, 0);
+}
+
+EXPORT int __openat_2(int dirfd, const char *path, int flags)
+{
+	return shim_openat(dirfd, path, flags, 0);
+}
+
+EXPORT int __openat64_2(int dirfd, const char *path, int flags)
+{
+	return shim_openat(dirfd, path, flags | O_LARGEFILE, 0);
+}
+
+EXPORT int stat(const char *path, struct stat *buffer)
+{
+	return shim_fstatat(AT_FDCWD, path, buffer, 0);
+}
+
+EXPORT int lstat(const char *path, struct stat *buffer)
+{
+	return shim_fstatat(AT_FDCWD, path, buffer, AT_SYMLINK_NOFOLLOW);
+}
+
+EXPORT int fstatat(int dirfd, const char *path, struct stat *buffer, int flags)
+{
+	return shim_fstatat(dirfd, path, buffer, flags);
+}
+
+/* On x86_64, struct stat64 is struct stat and the "version" of the
+ * legacy __xstat() interfaces is ignored.  */
+
+EXPORT int stat64(const char *path, struct stat *buffer)
+{
+	return shim_fstatat(AT_FDCWD, path, buffer, 0);
+}
+
+EXPORT int lstat64(const char *path, struct stat *buffer)
+{
+	return shim_fstatat(AT_FDCWD, path, buffer, AT_SYMLINK_NOFOLLOW);
+}
+
+EXPORT int fstatat64(int dirfd, const char *path, struct stat *buffer, int flags)
+{
+	return shim_fstatat(dirfd, path, buffer, flags);
+}
+
+EXPORT int __xstat(int version, const char *path, struct stat *buffer)
+{
+	(void) version;
+	return shim_fstatat(AT_FDCWD, path, buffer, 0);
+}
+
+EXPORT int __lxstat(int version, const char *path, struct stat *buffer)
+{
+	(void) version;
+	return shim_fstatat(AT_FDCWD, path, buffer, AT_SYMLINK_NOFOLLOW);
+}
+
+EXPORT int __xstat64(int version, const char *path, struct stat *buffer)
+{
+	(void) version;
+	return shim_fstatat(AT_FDCWD, path, buffer, 0);
+}
+
+EXPORT int __lxstat64(int version, const char *path, struct stat *buffer)
+{
+	(void) version;
+	return shim_fstatat(AT_FDCWD, path, buffer, AT_SYMLINK_NOFOLLOW);
+}
+
+EXPORT int __fxstatat(int version, int dirfd, const char *path, struct stat *buffer, int flags)
+{
+	(void) version;
+	return shim_fstatat(dirfd, path, buffer, flags);
+}
+
+EXPORT int __fxstatat64(int version, int dirfd, const char *path, struct stat *buffer, int flags)
+{
+	(void) version;
+	return shim_fstatat(dirfd, path, buffer, flags);
+}
+
+EXPORT int access(const char *path, int mode)
+{
+	return shim_faccessat(AT_FDCWD, path, mode);
+}
@@ -0,0 +1,60 @@
+/* -*- c-set-style: "K&R"; c-basic-offset: 8 -*-
+ *
+ * This file is part of PRoot.
+ *
+ * Copyright (C) 2015 STMicroelectronics
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef SHIM_SNAPSHOT_H
+#define SHIM_SNAPSHOT_H
+
+#include <stdint.h>
+
+/* Read-only snapshot of the bindings published by PRoot for the
+ * preload shim, see execve/shim.c and shim/shim.c.  Its layout is:
+ *
+ *     SnapshotHeader
+ *     SnapshotBinding[nb_bindings], in the "guest" order
+ *     NUL-terminated strings
+ */
+
+#define SHIM_SNAPSHOT_MAGIC   0x50524f4f54534e50ULL /* "PROOTSNP" */
+#define SHIM_SNAPSHOT_VERSION 1
+
+/* Environment variable that gives the host path to the snapshot.  */
+#define SHIM_SNAPSHOT_ENV "PROOT_SHIM_SNAPSHOT"
+
+/* Guest path to the shim itself, as given to LD_PRELOAD.  */
+#define SHIM_GUEST_PATH "/.proot-shim.so"
+
+typedef struct {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t size;
+	uint32_t nb_bindings;
+	uint32_t padding;
+} SnapshotHeader;
+
+typedef struct {
+	uint32_t guest_offset;
+	uint32_t guest_length;
+	uint32_t host_offset;
+	uint32_t host_length;
+} SnapshotBinding;
+
+#endif /* SHIM_SNAPSHOT_H */
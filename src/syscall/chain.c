@@ -24,12 +24,23 @@
 #include <sys/queue.h>  /* STAILQ_*, */
 #include <errno.h>      /* E*, */
 #include <assert.h>     /* assert(3), */
+#include <string.h>     /* memcpy(3), */
+#include <stdbool.h>    /* bool, true, false, */
+#include <signal.h>     /* sig*(3), SIG*, NSIG, */
+#include <unistd.h>     /* syscall(2), */
+#include <sys/syscall.h> /* SYS_tkill, */
+#include <inttypes.h>   /* PRIu64, */
 
 #include "syscall/chain.h"
 #include "syscall/sysnum.h"
 #include "tracee/tracee.h"
 #include "tracee/reg.h"
+#include "tracee/mem.h"
+#include "tracee/abi.h"
+#include "extension/extension.h"
+#include "cli/note.h"
 #include "arch.h"
+#include "attribute.h"
 
 struct chained_syscall {
 	Sysnum sysnum;
@@ -78,6 +89,317 @@ int register_chained_syscall(Tracee *tracee, Sysnum sysnum,
 	return 0;
 }
 
+#if defined(HAS_SYSCALL_BATCH)
+
+/* Number of words per statement in a syscall-batch script: sysnum,
+ * 6 arguments, and result.  See loader/assembly.S.  */
+#define BATCH_STATEMENT_LENGTH 8
+
+struct syscall_batch {
+	/* Registers of the tracee once the batch is over.  */
+	struct user_regs_struct regs;
+
+	/* Copy of the script, and its address in the tracee memory.  */
+	word_t *script;
+	word_t address;
+
+	/* Status reported by the extensions for each statement.  */
+	int *statuses;
+
+	/* Signals held until the end of the batch, see
+	 * hold_batch_signal().  */
+	sigset_t held_signals;
+};
+
+/**
+ * Check whether the chained syscalls of @tracee can be run by the
+ * syscall-batch trampoline, that is, without stopping the tracee
+ * between them.  The syscalls made by this trampoline aren't
+ * reported by seccomp, so there is no point in batching them when
+ * every syscall is traced anyway.
+ */
+static bool can_batch_syscalls(const Tracee *tracee)
+{
+	return (tracee->syscall_batch
+		&& tracee->seccomp == ENABLED
+		&& tracee->loader_mapped
+		&& tracee->qemu == NULL
+		&& tracee->as_ptracee.ptracer == NULL
+		&& get_abi(tracee) == ABI_DEFAULT);
+}
+
+/**
+ * Notify the extensions about the end of each statement of the
+ * given @batch, then restore the @tracee's registers as they would
+ * have been at the end of the initial syscall.
+ */
+static void complete_syscall_batch(Tracee *tracee, const struct syscall_batch *batch)
+{
+	size_t nb_statements = talloc_array_length(batch->statuses);
+	size_t i;
+	Reg reg;
+
+	for (i = 0; i < nb_statements; i++) {
+		const word_t *statement = &batch->script[1 + i * BATCH_STATEMENT_LENGTH];
+
+		poke_reg(tracee, SYSARG_NUM, statement[0]);
+		for (reg = SYSARG_1; reg <= SYSARG_6; reg++)
+			poke_reg(tracee, reg, statement[1 + reg - SYSARG_1]);
+
+		poke_reg(tracee, SYSARG_RESULT, batch->statuses[i] < 0
+			? (word_t) batch->statuses[i]
+			: statement[BATCH_STATEMENT_LENGTH - 1]);
+
+		(void) notify_extensions(tracee, SYSCALL_CHAINED_EXIT, 0, 0);
+	}
+
+	memcpy(&tracee->_regs[CURRENT], &batch->regs, sizeof(batch->regs));
+	tracee->_regs_were_changed = true;
+	tracee->restore_original_regs = false;
+}
+
+/**
+ * Turn all the syscalls chained to the current one into a script
+ * run by the syscall-batch trampoline, that is, with a single stop
+ * of @tracee instead of two per chained syscall.  Extensions are
+ * notified about each chained syscall as usual, however all the
+ * SYSCALL_CHAINED_ENTER notifications happen before the first
+ * chained syscall is actually made, hence these can't depend on the
+ * result of a previous chained syscall.  This function returns false
+ * if the chained syscalls have to be made one by one instead.
+ */
+static bool start_syscall_batch(Tracee *tracee)
+{
+	struct chained_syscall *syscall;
+	struct syscall_batch *batch;
+	size_t nb_statements = 0;
+	word_t stack_pointer;
+	word_t size;
+	size_t i;
+	Reg reg;
+	int status;
+
+	STAILQ_FOREACH(syscall, tracee->chain.syscalls, link)
+		nb_statements++;
+
+	batch = talloc_zero(tracee, struct syscall_batch);
+	if (batch == NULL)
+		return false;
+	sigemptyset(&batch->held_signals);
+
+	batch->script = talloc_array(batch, word_t, 1 + nb_statements * BATCH_STATEMENT_LENGTH);
+	batch->statuses = talloc_zero_array(batch, int, nb_statements);
+	if (batch->script == NULL || batch->statuses == NULL) {
+		talloc_free(batch);
+		return false;
+	}
+
+	/* The script is stored below the buffers allocated for the
+	 * chained syscalls, see alloc_mem().  */
+	size = talloc_array_length(batch->script) * sizeof(word_t);
+	stack_pointer = peek_reg(tracee, CURRENT, STACK_POINTER);
+	if (stack_pointer == peek_reg(tracee, ORIGINAL, STACK_POINTER))
+		stack_pointer -= RED_ZONE_SIZE;
+	batch->address = (stack_pointer - size) & ~(word_t) (STACK_ALIGNMENT - 1);
+
+	/* Registers the tracee would get at the end of the last
+	 * chained syscall, see push_regs().  */
+	poke_reg(tracee, SYSARG_NUM, peek_reg(tracee, ORIGINAL, SYSARG_NUM));
+	for (reg = SYSARG_1; reg <= SYSARG_6; reg++)
+		poke_reg(tracee, reg, peek_reg(tracee, ORIGINAL, reg));
+	poke_reg(tracee, STACK_POINTER, peek_reg(tracee, ORIGINAL, STACK_POINTER));
+
+	if (tracee->chain.force_final_result)
+		poke_reg(tracee, SYSARG_RESULT, tracee->chain.final_result);
+
+	tracee->chain.force_final_result = false;
+	tracee->chain.final_result = 0;
+
+	memcpy(&batch->regs, &tracee->_regs[CURRENT], sizeof(batch->regs));
+
+	/* Let the extensions modify or cancel each chained syscall,
+	 * as if it was actually entered.  */
+	batch->script[0] = nb_statements;
+	for (i = 0; i < nb_statements; i++) {
+		word_t *statement = &batch->script[1 + i * BATCH_STATEMENT_LENGTH];
+
+		syscall = STAILQ_FIRST(tracee->chain.syscalls);
+		STAILQ_REMOVE_HEAD(tracee->chain.syscalls, link);
+
+		for (reg = SYSARG_1; reg <= SYSARG_6; reg++)
+			poke_reg(tracee, reg, syscall->sysargs[reg - SYSARG_1]);
+		poke_reg(tracee, SYSARG_NUM, detranslate_sysnum(get_abi(tracee), syscall->sysnum));
+
+		status = notify_extensions(tracee, SYSCALL_CHAINED_ENTER, 0, 0);
+		if (status < 0) {
+			set_sysnum(tracee, PR_void);
+			batch->statuses[i] = status;
+		}
+
+		statement[0] = peek_reg(tracee, CURRENT, SYSARG_NUM);
+		for (reg = SYSARG_1; reg <= SYSARG_6; reg++)
+			statement[1 + reg - SYSARG_1] = peek_reg(tracee, CURRENT, reg);
+		statement[BATCH_STATEMENT_LENGTH - 1] = 0;
+	}
+
+	TALLOC_FREE(tracee->chain.syscalls);
+
+	status = write_data(tracee, batch->address, batch->script, size);
+	if (status < 0) {
+		VERBOSE(tracee, 1, "can't write the syscall batch: %s", strerror(-status));
+
+		for (i = 0; i < nb_statements; i++)
+			batch->statuses[i] = status;
+
+		complete_syscall_batch(tracee, batch);
+		talloc_free(batch);
+		return true;
+	}
+
+	/* Jump into the trampoline.  The syscall number is cleared
+	 * to prevent the kernel from restarting the initial syscall
+	 * in the middle of nowhere.  */
+	memcpy(&tracee->_regs[CURRENT], &batch->regs, sizeof(batch->regs));
+	poke_reg(tracee, INSTR_POINTER, SYSCALL_BATCH_ENTRY);
+	poke_reg(tracee, STACK_POINTER, batch->address);
+	poke_reg(tracee, SYSARG_1, batch->address);
+	poke_reg(tracee, SYSARG_NUM, (word_t) -1);
+
+	tracee->restore_original_regs = false;
+	tracee->chain.batch = batch;
+
+	VERBOSE(tracee, 3, "vpid %" PRIu64 ": syscall batch of %zu chained syscalls",
+		tracee->vpid, nb_statements);
+
+	return true;
+}
+
+/**
+ * Leave the syscall batch of @tracee right now, with the registers
+ * restored as if the initial syscall was just made, and report
+ * @status as the result of each chained syscall.
+ */
+static void abort_syscall_batch(Tracee *tracee, int status)
+{
+	struct syscall_batch *batch = tracee->chain.batch;
+	size_t nb_statements;
+	size_t i;
+
+	tracee->chain.batch = NULL;
+
+	nb_statements = talloc_array_length(batch->statuses);
+	for (i = 0; i < nb_statements; i++)
+		batch->statuses[i] = status;
+
+	if (fetch_regs(tracee) == 0) {
+		complete_syscall_batch(tracee, batch);
+		(void) push_regs(tracee);
+	}
+
+	talloc_free(batch);
+}
+
+/**
+ * Check whether @signal is about to be delivered to @tracee in the
+ * middle of its syscall batch.  If so, this signal is held until the
+ * end of the batch, see end_syscall_batch(), since its handler might
+ * never return into the trampoline -- with longjmp(3) for instance --
+ * hence the chained syscalls would never be completed.  Signals
+ * raised by the trampoline itself can't be held, so the batch is
+ * aborted before they are delivered.  This function returns true if
+ * @signal is held, that is, it must not be delivered now.
+ */
+bool hold_batch_signal(Tracee *tracee, int signal)
+{
+	struct syscall_batch *batch = tracee->chain.batch;
+
+	if (batch == NULL || signal <= 0 || signal >= NSIG)
+		return false;
+
+	switch (signal) {
+	case SIGSEGV:
+	case SIGBUS:
+	case SIGILL:
+	case SIGFPE:
+	case SIGSYS:
+		VERBOSE(tracee, 1, "syscall batch aborted by signal %d", signal);
+		abort_syscall_batch(tracee, -EINTR);
+		return false;
+
+	default:
+		sigaddset(&batch->held_signals, signal);
+		return true;
+	}
+}
+
+/**
+ * Check whether @tracee has just trapped at the end of the
+ * syscall-batch trampoline.  If so, notify the extensions about the
+ * end of each chained syscall, then resume @tracee as if the last one
+ * was just made.  This function returns true if this trap was
+ * handled, otherwise false.
+ */
+bool end_syscall_batch(Tracee *tracee)
+{
+	struct syscall_batch *batch = tracee->chain.batch;
+	sigset_t held_signals;
+	size_t nb_statements;
+	size_t i;
+	int status;
+
+	if (batch == NULL)
+		return false;
+
+	status = fetch_regs(tracee);
+	if (status < 0)
+		return false;
+
+	/* The instruction pointer is right after int3, otherwise it
+	 * is a SIGTRAP sent in the middle of the batch.  */
+	if (peek_reg(tracee, CURRENT, INSTR_POINTER) != SYSCALL_BATCH_TRAP + 1)
+		return hold_batch_signal(tracee, SIGTRAP);
+
+	tracee->chain.batch = NULL;
+
+	/* Get all the results at once.  */
+	status = read_data(tracee, batch->script, batch->address,
+			talloc_array_length(batch->script) * sizeof(word_t));
+	if (status < 0) {
+		nb_statements = talloc_array_length(batch->statuses);
+		for (i = 0; i < nb_statements; i++)
+			batch->statuses[i] = status;
+	}
+
+	complete_syscall_batch(tracee, batch);
+	held_signals = batch->held_signals;
+	talloc_free(batch);
+
+	(void) push_regs(tracee);
+
+	/* Raise the held signals again, they are delivered as soon
+	 * as @tracee is restarted.  */
+	for (i = 1; i < NSIG; i++) {
+		if (sigismember(&held_signals, i) == 1)
+			(void) syscall(SYS_tkill, tracee->pid, i);
+	}
+
+	return true;
+}
+
+#else
+
+bool hold_batch_signal(Tracee *tracee UNUSED, int signal UNUSED)
+{
+	return false;
+}
+
+bool end_syscall_batch(Tracee *tracee UNUSED)
+{
+	return false;
+}
+
+#endif /* HAS_SYSCALL_BATCH */
+
 /**
  * Use/remove the first element of @tracee->chain.syscalls to forge a
  * new syscall.  This function should be called only at the end of in
@@ -105,6 +427,11 @@ void chain_next_syscall(Tracee *tracee)
 		return;
 	}
 
+#if defined(HAS_SYSCALL_BATCH)
+	if (can_batch_syscalls(tracee) && start_syscall_batch(tracee))
+		return;
+#endif
+
 	/* Original register values will be restored right after the
 	 * last chained syscall.  */
 	tracee->restore_original_regs = false;
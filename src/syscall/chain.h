@@ -37,5 +37,16 @@ extern int restart_original_syscall(Tracee *tracee);
 
 extern void chain_next_syscall(Tracee *tracee);
 
+extern bool end_syscall_batch(Tracee *tracee);
+extern bool hold_batch_signal(Tracee *tracee, int signal);
+
+#if defined(HAS_SYSCALL_BATCH)
+/* Addresses of the syscall-batch trampoline instructions, see
+ * loader/assembly.S.  */
+#define SYSCALL_BATCH_ENTRY  (SYSCALL_BATCH_ADDRESS + 0x00)
+#define SYSCALL_BATCH_TRAP   (SYSCALL_BATCH_ADDRESS + 0x10)
+#define SYSCALL_BATCH_GADGET (SYSCALL_BATCH_ADDRESS + 0x18)
+#endif
+
 
 #endif /* CHAIN_H */
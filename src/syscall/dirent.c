@@ -0,0 +1,112 @@
+/* -*- c-set-style: "K&R"; c-basic-offset: 8 -*-
+ *
+ * This file is part of PRoot.
+ *
+ * Copyright (C) 2015 STMicroelectronics
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#include <stddef.h>     /* offsetof(3), */
+#include <stdint.h>     /* *int*_t, */
+#include <string.h>     /* memset(3), memcpy(3), strlen(3), */
+
+#include "syscall/dirent.h"
+#include "tracee/tracee.h"
+#include "tracee/abi.h"
+
+typedef struct {
+	uint32_t d_ino;
+	uint32_t next;
+	uint16_t size;
+	char name[];
+} Dirent32;
+
+typedef struct {
+	uint64_t d_ino;
+	uint64_t next;
+	uint16_t size;
+	char name[];
+} Dirent64;
+
+typedef struct {
+	uint64_t inode;
+	int64_t  next;
+	uint16_t size;
+	uint8_t  type;
+	char name[];
+} NewDirent;
+
+#define ALIGN(size, alignment) (((size) + (alignment) - 1) & ~((alignment) - 1))
+
+/**
+ * Serialize in @buffer -- of @size bytes -- the @dentry as expected
+ * by getdents(2), or by getdents64(2) if @is_new_getdents is true.
+ * This function returns the number of bytes used, or 0 if @buffer
+ * is too small.
+ */
+size_t write_dentry(Tracee *tracee, char *buffer, size_t size, const Dentry *dentry,
+			uint64_t next, bool is_new_getdents)
+{
+	size_t length = strlen(dentry->name);
+	size_t record_size;
+
+	if (is_new_getdents) {
+		NewDirent *dirent = (NewDirent *) buffer;
+
+		record_size = ALIGN(offsetof(NewDirent, name) + length + 1, 8);
+		if (record_size > size)
+			return 0;
+
+		memset(buffer, 0, record_size);
+		dirent->inode = dentry->inode;
+		dirent->next  = next;
+		dirent->size  = record_size;
+		dirent->type  = dentry->type;
+		memcpy(dirent->name, dentry->name, length);
+	}
+	else if (is_32on64_mode(tracee) || sizeof(word_t) == 4) {
+		Dirent32 *dirent = (Dirent32 *) buffer;
+
+		/* The type is stored in the last byte of the record.  */
+		record_size = ALIGN(offsetof(Dirent32, name) + length + 2, 4);
+		if (record_size > size)
+			return 0;
+
+		memset(buffer, 0, record_size);
+		dirent->d_ino = dentry->inode;
+		dirent->next  = next;
+		dirent->size  = record_size;
+		memcpy(dirent->name, dentry->name, length);
+		buffer[record_size - 1] = dentry->type;
+	}
+	else {
+		Dirent64 *dirent = (Dirent64 *) buffer;
+
+		record_size = ALIGN(offsetof(Dirent64, name) + length + 2, 8);
+		if (record_size > size)
+			return 0;
+
+		memset(buffer, 0, record_size);
+		dirent->d_ino = dentry->inode;
+		dirent->next  = next;
+		dirent->size  = record_size;
+		memcpy(dirent->name, dentry->name, length);
+		buffer[record_size - 1] = dentry->type;
+	}
+
+	return record_size;
+}
@@ -0,0 +1,42 @@
+/* -*- c-set-style: "K&R"; c-basic-offset: 8 -*-
+ *
+ * This file is part of PRoot.
+ *
+ * Copyright (C) 2015 STMicroelectronics
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+#ifndef DIRENT_H
+#define DIRENT_H
+
+#include <stddef.h>  /* size_t, */
+#include <stdint.h>  /* *int*_t, */
+#include <stdbool.h> /* bool, */
+
+#include "tracee/tracee.h"
+
+/* Directory entry emulated by PRoot, see write_dentry().  */
+typedef struct {
+	uint64_t inode;
+	uint8_t type;
+	char *name;
+} Dentry;
+
+extern size_t write_dentry(Tracee *tracee, char *buffer, size_t size, const Dentry *dentry,
+			uint64_t next, bool is_new_getdents);
+
+#endif /* DIRENT_H */
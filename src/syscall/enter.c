@@ -140,7 +140,10 @@ int translate_syscall_enter(Tracee *tracee)
 		break;
 
 	case PR_getcwd:
-		set_sysnum(tracee, PR_void);
+		/* The kernel knows the actual cwd when it handles
+		 * the bindings.  */
+		if (!tracee->kernel_bindings)
+			set_sysnum(tracee, PR_void);
 		status = 0;
 		break;
 
@@ -149,6 +152,13 @@ int translate_syscall_enter(Tracee *tracee)
 		struct stat statl;
 		char *tmp;
 
+		/* Let the kernel change the cwd when it handles the
+		 * bindings, see translate_syscall_exit().  */
+		if (tracee->kernel_bindings) {
+			status = 0;
+			break;
+		}
+
 		/* The ending "." ensures an error will be reported if
 		 * path does not exist or if it is not a directory.  */
 		if (syscall_number == PR_chdir) {
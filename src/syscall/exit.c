@@ -37,6 +37,8 @@
 #include "tracee/mem.h"
 #include "tracee/abi.h"
 #include "path/path.h"
+#include "path/kernel.h"
+#include "path/glue.h"
 #include "ptrace/ptrace.h"
 #include "ptrace/wait.h"
 #include "extension/extension.h"
@@ -86,6 +88,9 @@ void translate_syscall_exit(Tracee *tracee)
 		size_t size;
 		word_t output;
 
+		if (tracee->kernel_bindings)
+			goto end;
+
 		size = (size_t) peek_reg(tracee, ORIGINAL, SYSARG_2);
 		if (size == 0) {
 			status = -EINVAL;
@@ -226,6 +231,15 @@ void translate_syscall_exit(Tracee *tracee)
 
 	case PR_fchdir:
 	case PR_chdir:
+		/* These syscalls are actually performed by the kernel
+		 * when it handles the bindings: keep track of the new
+		 * cwd, for path translation purpose.  */
+		if (tracee->kernel_bindings) {
+			if ((int) syscall_result >= 0)
+				(void) update_kernel_cwd(tracee);
+			goto end;
+		}
+
 		/* These syscalls are fully emulated, see enter.c for details
 		 * (like errors).  */
 		status = 0;
@@ -431,6 +445,16 @@ void translate_syscall_exit(Tracee *tracee)
 		translate_execve_exit(tracee);
 		goto end;
 
+	case PR_getdents:
+	case PR_getdents64:
+		if (tracee->glue_dentries == NULL)
+			goto end;
+
+		status = complete_glue_listing(tracee, syscall_number == PR_getdents64);
+		if (status == 0)
+			goto end;
+		break;
+
 	case PR_ptrace:
 		status = translate_ptrace_exit(tracee);
 		break;
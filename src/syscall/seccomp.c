@@ -43,6 +43,7 @@
 #include "tracee/tracee.h"
 #include "syscall/syscall.h"
 #include "syscall/sysnum.h"
+#include "syscall/chain.h"
 #include "extension/extension.h"
 #include "cli/note.h"
 
@@ -91,10 +92,11 @@ static int add_statements(struct sock_fprog *program, size_t nb_statements,
 
 /**
  * Append to @program->filter the statements required to notify PRoot
- * about the given @syscall made by a tracee, with the given @flag.
- * This function returns -errno if an error occurred, otherwise 0.
+ * about the given @syscall made by a tracee, with the given @flag --
+ * tagged with @tag.  This function returns -errno if an error
+ * occurred, otherwise 0.
  */
-static int add_trace_syscall(struct sock_fprog *program, word_t syscall, int flag)
+static int add_trace_syscall(struct sock_fprog *program, word_t syscall, int flag, word_t tag)
 {
 	int status;
 
@@ -109,7 +111,7 @@ static int add_trace_syscall(struct sock_fprog *program, word_t syscall, int fla
 		BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, syscall, 0, 1),
 
 		/* Notify the tracer.  */
-		BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_TRACE + flag)
+		BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_TRACE + (flag | tag))
 	};
 
 	DEBUG_FILTER("FILTER:     trace if syscall == %ld\n", syscall);
@@ -150,18 +152,53 @@ static int end_arch_section(struct sock_fprog *program, size_t nb_traced_syscall
 	return 0;
 }
 
+/**
+ * Append to @program->filter the statements that allow any syscall
+ * made from the given @gadget, that is, from the preload shim (see
+ * shim/shim.c) or from the syscall-batch trampoline (see
+ * loader/assembly.S).  This function returns -errno if an error
+ * occurred, otherwise 0.
+ */
+static int add_allow_gadget(struct sock_fprog *program, uint64_t gadget)
+{
+	const size_t ip_offset = offsetof(struct seccomp_data, instruction_pointer);
+
+	#define LENGTH_ALLOW_GADGET 5
+	struct sock_filter statements[LENGTH_ALLOW_GADGET] = {
+		/* Compare the lower then the upper halves of the
+		 * instruction pointer with the expected one: skip the
+		 * remaining statements if not equal.  */
+		BPF_STMT(BPF_LD + BPF_W + BPF_ABS, ip_offset),
+		BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, (uint32_t) gadget, 0, 3),
+		BPF_STMT(BPF_LD + BPF_W + BPF_ABS, ip_offset + sizeof(uint32_t)),
+		BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, (uint32_t) (gadget >> 32), 0, 1),
+
+		/* Don't notify the tracer.  */
+		BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_ALLOW)
+	};
+
+	DEBUG_FILTER("FILTER:     allow if ip == %lx\n", gadget);
+
+	return add_statements(program, LENGTH_ALLOW_GADGET, statements);
+}
+
 /**
  * Append to @program->filter the statements that check the current
- * @architecture.  Note that @nb_traced_syscalls is used to make a
- * sanity check.  This function returns -errno if an error occurred,
- * otherwise 0.
+ * @architecture, then that allow syscalls made from the @nb_gadgets
+ * addresses in @gadgets.  Note that @nb_traced_syscalls is used to
+ * make a sanity check.  This function returns -errno if an error
+ * occurred, otherwise 0.
  */
-static int start_arch_section(struct sock_fprog *program, uint32_t arch, size_t nb_traced_syscalls)
+static int start_arch_section(struct sock_fprog *program, uint32_t arch,
+			const uint64_t *gadgets, size_t nb_gadgets,
+			size_t nb_traced_syscalls)
 {
 	const size_t arch_offset    = offsetof(struct seccomp_data, arch);
 	const size_t syscall_offset = offsetof(struct seccomp_data, nr);
 	const size_t section_length = LENGTH_END_SECTION +
-					nb_traced_syscalls * LENGTH_TRACE_SYSCALL;
+					nb_traced_syscalls * LENGTH_TRACE_SYSCALL +
+					nb_gadgets * LENGTH_ALLOW_GADGET;
+	size_t i;
 	int status;
 
 	/* Sanity checks.  */
@@ -193,7 +230,17 @@ static int start_arch_section(struct sock_fprog *program, uint32_t arch, size_t
 	DEBUG_FILTER("FILTER: if arch == %ld, up to %zdth statement\n",
 		arch, nb_traced_syscalls);
 
-	status = add_statements(program, LENGTH_START_SECTION, statements);
+	status = add_statements(program, LENGTH_START_SECTION - 1, statements);
+	if (status < 0)
+		return status;
+
+	for (i = 0; i < nb_gadgets; i++) {
+		status = add_allow_gadget(program, gadgets[i]);
+		if (status < 0)
+			return status;
+	}
+
+	status = add_statements(program, 1, &statements[LENGTH_START_SECTION - 1]);
 	if (status < 0)
 		return status;
 
@@ -243,14 +290,18 @@ static void free_program_filter(struct sock_fprog *program)
  * all of its future children:
  *
  *     for each handled architectures
+ *         if native architecture and syscall made from one of @gadgets
+ *             allow
  *         for each filtered syscall
  *             trace
  *         allow
  *     kill
  *
+ * The data of each trace event is tagged with @tag, see FILTER_TAG.
  * This function returns -errno if an error occurred, otherwise 0.
  */
-static int set_seccomp_filters(const FilteredSysnum *sysnums)
+static int set_seccomp_filters(const FilteredSysnum *sysnums, const uint64_t *gadgets,
+			size_t nb_gadgets, word_t tag)
 {
 	SeccompArch seccomp_archs[] = SECCOMP_ARCHS;
 	size_t nb_archs = sizeof(seccomp_archs) / sizeof(SeccompArch);
@@ -279,8 +330,10 @@ static int set_seccomp_filters(const FilteredSysnum *sysnums)
 			}
 		}
 
-		/* Filter: if handled architecture */
-		status = start_arch_section(&program, seccomp_archs[i].value, nb_traced_syscalls);
+		/* Filter: if handled architecture, the native one
+		 * being the first.  */
+		status = start_arch_section(&program, seccomp_archs[i].value,
+					gadgets, i == 0 ? nb_gadgets : 0, nb_traced_syscalls);
 		if (status < 0)
 			goto end;
 
@@ -292,7 +345,7 @@ static int set_seccomp_filters(const FilteredSysnum *sysnums)
 					continue;
 
 				/* Filter: trace if handled syscall */
-				status = add_trace_syscall(&program, syscall, sysnums[k].flags);
+				status = add_trace_syscall(&program, syscall, sysnums[k].flags, tag);
 				if (status < 0)
 					goto end;
 			}
@@ -417,6 +470,33 @@ static FilteredSysnum proot_sysnums[] = {
 	FILTERED_SYSNUM_END,
 };
 
+/* List of sysnums handled by PRoot when the kernel handles the
+ * bindings, i.e. no path translation is required.  */
+static FilteredSysnum kernel_bindings_sysnums[] = {
+	{ PR_brk,		FILTER_SYSEXIT },
+	{ PR_chdir,		FILTER_SYSEXIT },
+	{ PR_execve,		FILTER_SYSEXIT },
+	{ PR_fchdir,		FILTER_SYSEXIT },
+	{ PR_prctl, 		0 },
+	{ PR_prlimit64,		FILTER_SYSEXIT },
+	{ PR_ptrace,		FILTER_SYSEXIT },
+	{ PR_readlink,		FILTER_SYSEXIT },
+	{ PR_readlinkat,	FILTER_SYSEXIT },
+	{ PR_setrlimit,		FILTER_SYSEXIT },
+	{ PR_uname,		FILTER_SYSEXIT },
+	{ PR_wait4,		FILTER_SYSEXIT },
+	{ PR_waitpid,		FILTER_SYSEXIT },
+	FILTERED_SYSNUM_END,
+};
+
+/* List of sysnums handled by PRoot when some components of the glue
+ * exist in memory only, see complete_glue_listing().  */
+static FilteredSysnum glue_sysnums[] = {
+	{ PR_getdents,		FILTER_SYSEXIT },
+	{ PR_getdents64,	FILTER_SYSEXIT },
+	FILTERED_SYSNUM_END,
+};
+
 /**
  * Add the @new_sysnums to the list of filtered @sysnums, using the
  * given Talloc @context.  This function returns -errno if an error
@@ -474,16 +554,28 @@ int enable_syscall_filtering(const Tracee *tracee)
 {
 	FilteredSysnum *filtered_sysnums = NULL;
 	Extension *extension;
+	uint64_t gadgets[2];
+	size_t nb_gadgets = 0;
 	int status;
 
 	assert(tracee != NULL && tracee->ctx != NULL);
 
 	/* Add the sysnums required by PRoot to the list of filtered
-	 * sysnums.  TODO: only if path translation is required.  */
-	status = merge_filtered_sysnums(tracee->ctx, &filtered_sysnums, proot_sysnums);
+	 * sysnums.  Most of them are useless when the kernel handles
+	 * the bindings.  */
+	status = merge_filtered_sysnums(tracee->ctx, &filtered_sysnums,
+					tracee->kernel_bindings
+					? kernel_bindings_sysnums
+					: proot_sysnums);
 	if (status < 0)
 		return status;
 
+	if (tracee->glue_dentries != NULL) {
+		status = merge_filtered_sysnums(tracee->ctx, &filtered_sysnums, glue_sysnums);
+		if (status < 0)
+			return status;
+	}
+
 	/* Merge the sysnums required by the extensions to the list
 	 * of filtered sysnums.  */
 	if (tracee->extensions != NULL) {
@@ -498,7 +590,24 @@ int enable_syscall_filtering(const Tracee *tracee)
 		}
 	}
 
-	status = set_seccomp_filters(filtered_sysnums);
+#if defined(HAS_PRELOAD_SHIM)
+	/* Syscalls made by the preload shim on behalf of the tracee
+	 * were already translated, see shim/shim.c.  */
+	if (tracee->preload_shim)
+		gadgets[nb_gadgets++] = SHIM_GADGET_ADDRESS + SYSTRAP_SIZE;
+#endif
+
+#if defined(HAS_SYSCALL_BATCH)
+	/* Chained syscalls run by the syscall-batch trampoline were
+	 * already translated, see chain_next_syscall().  Any program
+	 * could jump into it, hence this is enabled on demand only.  */
+	if (tracee->syscall_batch)
+		gadgets[nb_gadgets++] = SYSCALL_BATCH_GADGET + SYSTRAP_SIZE;
+#endif
+
+	/* This function is called by the first tracee right before
+	 * execve(2), that is, its parent is PRoot.  */
+	status = set_seccomp_filters(filtered_sysnums, gadgets, nb_gadgets, FILTER_TAG(getppid()));
 	if (status < 0)
 		return status;
 
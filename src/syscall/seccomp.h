@@ -23,6 +23,9 @@
 #ifndef SECCOMP_H
 #define SECCOMP_H
 
+#include <unistd.h>     /* getpid(2), */
+#include <stdbool.h>    /* bool, */
+
 #include "syscall/sysnum.h"
 #include "tracee/tracee.h"
 #include "attribute.h"
@@ -43,6 +46,22 @@ typedef struct {
 
 #define FILTER_SYSEXIT  0x1
 
+/* The data of the seccomp events raised by the filter of a PRoot
+ * instance are tagged with the pid of this latter, in order to tell
+ * them apart from the ones raised by filters the tracees install
+ * themselves (ptrace emulation, nested PRoot, ...).  */
+#define FILTER_TAG_MASK 0xFFFE
+#define FILTER_TAG(tracer_pid) ((((word_t) (tracer_pid) % 0x7FFF) + 1) << 1)
+
+/**
+ * Check whether the seccomp event carrying @data was raised by the
+ * filter of the current PRoot instance.
+ */
+static inline bool is_proot_seccomp_event(word_t data)
+{
+	return (data & FILTER_TAG_MASK) == FILTER_TAG(getpid());
+}
+
 extern int enable_syscall_filtering(const Tracee *tracee);
 
 #endif /* SECCOMP_H */
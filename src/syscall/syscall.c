@@ -99,6 +99,22 @@ int set_sysarg_path(Tracee *tracee, const char path[PATH_MAX], Reg reg)
 	return set_sysarg_data(tracee, path, strlen(path) + 1, reg);
 }
 
+/**
+ * Cancel the current syscall of @tracee and make it report @result
+ * right away.  This function must be called from the sysenter stage
+ * only: when seccomp is enabled the sysexit stage is then not hit at
+ * all, saving one stop of the tracee; otherwise it is still notified
+ * as usual.
+ */
+void complete_syscall_at_enter(Tracee *tracee, word_t result)
+{
+	assert(IS_IN_SYSENTER(tracee));
+
+	set_sysnum(tracee, PR_void);
+	poke_reg(tracee, SYSARG_RESULT, result);
+	tracee->completed_at_enter = true;
+}
+
 void translate_syscall(Tracee *tracee)
 {
 	const bool is_enter_stage = IS_IN_SYSENTER(tracee);
@@ -110,6 +126,17 @@ void translate_syscall(Tracee *tracee)
 	if (status < 0)
 		return;
 
+#if defined(HAS_PRELOAD_SHIM)
+	/* Syscalls made by the preload shim were already translated
+	 * in-process, see shim/shim.c.  They are reported here only
+	 * when seccomp is not in use.  */
+	if (   tracee->preload_shim
+	    && peek_reg(tracee, CURRENT, INSTR_POINTER) == SHIM_GADGET_ADDRESS + SYSTRAP_SIZE) {
+		tracee->status = (is_enter_stage && tracee->restart_how != PTRACE_CONT ? 1 : 0);
+		return;
+	}
+#endif
+
 	if (is_enter_stage) {
 		/* Never restore original register values at the end
 		 * of this stage.  */
@@ -121,9 +148,36 @@ void translate_syscall(Tracee *tracee)
 		 * requested by the tracee, it is not a syscall
 		 * chained by PRoot.  */
 		if (tracee->chain.syscalls == NULL) {
+			tracee->completed_at_enter = false;
+
 			save_current_regs(tracee, ORIGINAL);
 			status = translate_syscall_enter(tracee);
 			save_current_regs(tracee, MODIFIED);
+
+			/* Skip the sysexit stage of syscalls already
+			 * completed by an extension, see
+			 * complete_syscall_at_enter().  Their arguments
+			 * are restored now since the kernel preserves
+			 * these registers.  */
+			if (   tracee->completed_at_enter
+			    && status >= 0
+			    && tracee->seccomp == ENABLED) {
+				word_t result;
+				Reg reg;
+
+				result = peek_reg(tracee, CURRENT, SYSARG_RESULT);
+
+				for (reg = SYSARG_1; reg <= SYSARG_6; reg++)
+					poke_reg(tracee, reg, peek_reg(tracee, ORIGINAL, reg));
+
+				/* The result register is also the first
+				 * argument one on some architectures,
+				 * like ARM and AArch64.  */
+				poke_reg(tracee, SYSARG_RESULT, result);
+
+				tracee->restart_how = PTRACE_CONT;
+				tracee->sysexit_pending = false;
+			}
 		}
 		else {
 			status = notify_extensions(tracee, SYSCALL_CHAINED_ENTER, 0, 0);
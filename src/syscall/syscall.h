@@ -34,5 +34,6 @@ extern int set_sysarg_path(Tracee *tracee, const char path[PATH_MAX], Reg reg);
 extern void translate_syscall(Tracee *tracee);
 extern int  translate_syscall_enter(Tracee *tracee);
 extern void translate_syscall_exit(Tracee *tracee);
+extern void complete_syscall_at_enter(Tracee *tracee, word_t result);
 
 #endif /* SYSCALL_H */
@@ -43,6 +43,8 @@
 #include "path/binding.h"
 #include "syscall/syscall.h"
 #include "syscall/seccomp.h"
+#include "syscall/chain.h"
+#include "ptrace/ptrace.h"
 #include "ptrace/wait.h"
 #include "extension/extension.h"
 #include "execve/elf.h"
@@ -87,6 +89,14 @@ int launch_process(Tracee *tracee, char *const argv[])
 		 * does the same thing. */
 		kill(getpid(), SIGSTOP);
 
+		/* The initial cwd is emulated unless the kernel
+		 * handles the bindings.  */
+		if (tracee->kernel_bindings) {
+			status = chdir(tracee->fs->cwd);
+			if (status < 0)
+				note(tracee, WARNING, SYSTEM, "chdir(\"%s\")", tracee->fs->cwd);
+		}
+
 		/* Improve performance by using seccomp mode 2, unless
 		 * this support is explicitly disabled.  */
 		if (getenv("PROOT_NO_SECCOMP") == NULL)
@@ -117,6 +127,10 @@ static void kill_all_tracees2(int signum, siginfo_t *siginfo UNUSED, void *ucont
 		signum, siginfo->si_pid);
 	kill_all_tracees();
 
+	/* Don't wait for the pending notices here: neither
+	 * stop_note_writer() nor the standard error stream -- that
+	 * might be blocked -- are safe to use in a signal handler.  */
+
 	/* Exit immediately for system signals (segmentation fault,
 	 * illegal instruction, ...), otherwise exit cleanly through
 	 * the event loop.  */
@@ -284,6 +298,13 @@ int event_loop()
 	long status;
 	int signum;
 
+	/* Write notices asynchronously from now on, and write the
+	 * pending ones when exiting, after the tracees were killed.  */
+	status = atexit(stop_note_writer);
+	if (status != 0)
+		note(NULL, WARNING, INTERNAL, "atexit() failed");
+	start_note_writer();
+
 	/* Kill all tracees when exiting.  */
 	status = atexit(kill_all_tracees);
 	if (status != 0)
@@ -459,8 +480,15 @@ static int handle_tracee_event_kernel_4_8(Tracee *tracee, int tracee_status)
 			 * related to the tracing loop, others SIGTRAP
 			 * carry tracing information because of
 			 * TRACE*FORK/CLONE/EXEC.  */
-			if (deliver_sigtrap)
-				break;  /* Deliver this signal as-is.  */
+			if (deliver_sigtrap) {
+				/* Discard the trap that ends a
+				 * syscall batch, see
+				 * chain_next_syscall(), and deliver
+				 * any other one as-is.  */
+				if (end_syscall_batch(tracee))
+					signal = 0;
+				break;
+			}
 
 			deliver_sigtrap = true;
 
@@ -507,7 +535,10 @@ static int handle_tracee_event_kernel_4_8(Tracee *tracee, int tracee_status)
 				if (status < 0)
 					break;
 
-				if ((flags & FILTER_SYSEXIT) == 0) {
+				/* The sysexit stage is always handled for
+				 * events not raised by PRoot's filter
+				 * since their flags are unknown.  */
+				if ((flags & FILTER_SYSEXIT) == 0 && is_proot_seccomp_event(flags)) {
 					tracee->restart_how = PTRACE_CONT;
 					translate_syscall(tracee);
 
@@ -554,6 +585,10 @@ static int handle_tracee_event_kernel_4_8(Tracee *tracee, int tracee_status)
 					tracee->restart_how = PTRACE_SYSCALL;
 					tracee->seccomp = DISABLED;
 				}
+				/* Otherwise seccomp might be re-enabled
+				 * now this syscall is over.  */
+				else if (IS_IN_SYSENTER(tracee))
+					resume_seccomp(tracee);
 
 				break;
 
@@ -602,7 +637,10 @@ static int handle_tracee_event_kernel_4_8(Tracee *tracee, int tracee_status)
 			break;
 
 		default:
-			/* Deliver this signal as-is.  */
+			/* Deliver this signal as-is, unless it has to
+			 * wait for the end of a syscall batch.  */
+			if (hold_batch_signal(tracee, signal))
+				signal = 0;
 			break;
 		}
 	}
@@ -688,8 +726,15 @@ int handle_tracee_event(Tracee *tracee, int tracee_status)
 			 * related to the tracing loop, others SIGTRAP
 			 * carry tracing information because of
 			 * TRACE*FORK/CLONE/EXEC.  */
-			if (deliver_sigtrap)
-				break;  /* Deliver this signal as-is.  */
+			if (deliver_sigtrap) {
+				/* Discard the trap that ends a
+				 * syscall batch, see
+				 * chain_next_syscall(), and deliver
+				 * any other one as-is.  */
+				if (end_syscall_batch(tracee))
+					signal = 0;
+				break;
+			}
 
 			deliver_sigtrap = true;
 
@@ -742,6 +787,10 @@ int handle_tracee_event(Tracee *tracee, int tracee_status)
 					tracee->restart_how = PTRACE_SYSCALL;
 					tracee->seccomp = DISABLED;
 				}
+				/* Otherwise seccomp might be re-enabled
+				 * now this syscall is over.  */
+				else if (IS_IN_SYSENTER(tracee))
+					resume_seccomp(tracee);
 
 				break;
 
@@ -778,8 +827,10 @@ int handle_tracee_event(Tracee *tracee, int tracee_status)
 				break;
 
 			/* Use the common ptrace flow when
-			 * sysexit has to be handled.  */
-			if ((flags & FILTER_SYSEXIT) != 0) {
+			 * sysexit has to be handled, or might be
+			 * for events not raised by PRoot's
+			 * filter.  */
+			if ((flags & FILTER_SYSEXIT) != 0 || !is_proot_seccomp_event(flags)) {
 				tracee->restart_how = PTRACE_SYSCALL;
 				break;
 			}
@@ -831,7 +882,10 @@ int handle_tracee_event(Tracee *tracee, int tracee_status)
 			break;
 
 		default:
-			/* Deliver this signal as-is.  */
+			/* Deliver this signal as-is, unless it has to
+			 * wait for the end of a syscall batch.  */
+			if (hold_batch_signal(tracee, signal))
+				signal = 0;
 			break;
 		}
 	}
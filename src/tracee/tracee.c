@@ -430,12 +430,18 @@ int new_child(Tracee *parent, word_t clone_flags)
 	    && child->fs->bindings.host == NULL
 	    && child->qemu == NULL
 	    && child->glue == NULL
+	    && child->glue_dentries == NULL
 	    && child->parent == NULL
 	    && child->as_ptracee.ptracer == NULL);
 
 	child->verbose = parent->verbose;
 	child->seccomp = parent->seccomp;
+	child->seccomp_suspended = parent->seccomp_suspended;
 	child->sysexit_pending = parent->sysexit_pending;
+	child->kernel_bindings = parent->kernel_bindings;
+	child->preload_shim = parent->preload_shim;
+	child->syscall_batch = parent->syscall_batch;
+	child->loader_mapped = parent->loader_mapped;
 	child->restart_how = parent->restart_how;
 
 	/* If CLONE_VM is set, the calling process and the child
@@ -498,11 +504,16 @@ int new_child(Tracee *parent, word_t clone_flags)
 						| PTRACE_O_TRACEEXEC
 						| PTRACE_O_TRACEEXIT
 						| PTRACE_O_TRACEFORK
+						| PTRACE_O_TRACESECCOMP
 						| PTRACE_O_TRACESYSGOOD
 						| PTRACE_O_TRACEVFORK
 						| PTRACE_O_TRACEVFORKDONE));
 	}
 
+	/* Seccomp is suspended only while a ptracer expects syscall
+	 * stops, this might not be the case for this child.  */
+	resume_seccomp(child);
+
 	/* If CLONE_FS is set, the parent and the child process share
 	 * the same file system information.  This includes the root
 	 * of the file system, the current working directory, and the
@@ -548,6 +559,7 @@ int new_child(Tracee *parent, word_t clone_flags)
 
 	child->qemu = talloc_reference(child, parent->qemu);
 	child->glue = talloc_reference(child, parent->glue);
+	child->glue_dentries = talloc_reference(child, parent->glue_dentries);
 
 	child->host_ldso_paths  = talloc_reference(child, parent->host_ldso_paths);
 	child->guest_ldso_paths = talloc_reference(child, parent->guest_ldso_paths);
@@ -602,6 +614,7 @@ static void reparent_config(Tracee *new_parent, Tracee *old_parent)
 	REPARENT(exe);
 	REPARENT(qemu);
 	REPARENT(glue);
+	REPARENT(glue_dentries);
 	REPARENT(extensions);
 
 #undef REPARENT
@@ -51,6 +51,9 @@ struct bindings;
 struct load_info;
 struct extensions;
 struct chained_syscalls;
+struct syscall_batch;
+struct glue_dentries;
+struct glue_listings;
 
 /* Information related to a file-system name-space.  */
 typedef struct {
@@ -183,6 +186,10 @@ typedef struct tracee {
 	 * defined in bind_path() then used in build_glue().  */
 	mode_t glue_type;
 
+	/* Inode of the final component, used for its glue dentry.
+	 * See glue_type.  */
+	ino_t glue_inode;
+
 	/* During a sub-reconfiguration, the new setup is relatively
 	 * to @tracee's file-system name-space.  Also, @paths holds
 	 * its $PATH environment variable in order to emulate the
@@ -198,15 +205,27 @@ typedef struct tracee {
 		struct chained_syscalls *syscalls;
 		bool force_final_result;
 		word_t final_result;
+
+		/* Chained syscalls currently run by the
+		 * syscall-batch trampoline, if any.  */
+		struct syscall_batch *batch;
 	} chain;
 
 	/* Load info generated during execve sysenter and used during
 	 * execve sysexit.  */
 	struct load_info *load_info;
 
+	/* Whether the loader -- hence the syscall-batch trampoline --
+	 * is mapped in the memory of this tracee.  */
+	bool loader_mapped;
+
 	/* Disable mixed-execution (native host) check */
 	bool mixed_mode;
 
+	/* Directories this tracee is reading when they contain glue
+	 * dentries, see complete_glue_listing().  */
+	struct glue_listings *glue_listings;
+
 	/**********************************************************************
 	 * Private but inherited resources                                    *
 	 **********************************************************************/
@@ -217,9 +236,29 @@ typedef struct tracee {
 	/* State of the seccomp acceleration for this tracee.  */
 	enum { DISABLED = 0, DISABLING, ENABLED } seccomp;
 
+	/* Is seccomp disabled only while the ptracer emulated by
+	 * PRoot expects syscall stops?  See suspend_seccomp().  */
+	bool seccomp_suspended;
+
 	/* Ensure the sysexit stage is always hit under seccomp.  */
 	bool sysexit_pending;
 
+	/* Was the current syscall completed at its sysenter stage?
+	 * See complete_syscall_at_enter().  */
+	bool completed_at_enter;
+
+	/* Are bindings handled by the kernel (user & mount
+	 * namespaces) instead of PRoot?  See path/kernel.c.  */
+	bool kernel_bindings;
+
+	/* Is the preload shim injected into dynamically linked
+	 * programs?  See execve/shim.c.  */
+	bool preload_shim;
+
+	/* Are chained syscalls run by the syscall-batch trampoline?
+	 * See chain_next_syscall().  */
+	bool syscall_batch;
+
 
 	/**********************************************************************
 	 * Shared or private resources, depending on the CLONE_FS/VM flags.   *
@@ -251,6 +290,10 @@ typedef struct tracee {
 	/* Path to glue between the guest rootfs and the host rootfs.  */
 	const char *glue;
 
+	/* Components of the glue that exist in memory only, see
+	 * build_glue().  */
+	struct glue_dentries *glue_dentries;
+
 	/* List of extensions enabled for this tracee.  */
 	struct extensions *extensions;
 
@@ -0,0 +1,279 @@
+/* -*- c-set-style: "K&R"; c-basic-offset: 8 -*-
+ *
+ * This file is part of PRoot.
+ *
+ * Copyright (C) 2015 STMicroelectronics
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+/* Replay the path translations recorded with
+ * "proot --trace-replay=FILE" directly against translate_path(), that is,
+ * without any tracee, in order to measure the path translation
+ * engine reproducibly:
+ *
+ *     proot-bench [-r rootfs] [-b host[:guest]]... [-n iterations] FILE
+ *
+ * It reports the time and the number of allocations per translation.  */
+
+#include <stdio.h>     /* fprintf(3), getline(3), */
+#include <stdlib.h>    /* exit(3), strtol(3), */
+#include <string.h>    /* strcmp(3), strchr(3), */
+#include <stdbool.h>   /* bool, true, false, */
+#include <unistd.h>    /* getopt(3), */
+#include <fcntl.h>     /* AT_FDCWD, */
+#include <limits.h>    /* PATH_MAX, */
+#include <inttypes.h>  /* PRIu64, */
+#include <time.h>      /* clock_gettime(2), */
+#include <talloc.h>    /* talloc*, */
+
+#include "tracee/tracee.h"
+#include "path/binding.h"
+#include "path/path.h"
+#include "cli/note.h"
+
+/* Count the allocations made by PRoot -- including through Talloc --
+ * by interposing the allocator of the C library.  */
+#if defined(__GLIBC__)
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static uint64_t nb_allocations;
+
+void *malloc(size_t size)
+{
+	nb_allocations++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	nb_allocations++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	nb_allocations++;
+	return __libc_realloc(ptr, size);
+}
+#else
+static uint64_t nb_allocations;
+#endif
+
+typedef struct {
+	const char *base;
+	const char *path;
+	bool deref_final;
+} Translation;
+
+/* Syscalls that don't dereference the final component of their path
+ * arguments, see syscall/enter.c.  The replay file doesn't tell
+ * whether AT_SYMLINK_NOFOLLOW or O_NOFOLLOW were specified.  */
+static const char *nofollow_syscalls[] = {
+	"lstat", "lstat64", "oldlstat", "readlink", "readlinkat",
+	"unlink", "unlinkat", "rmdir", "rename", "renameat", "renameat2",
+	"symlink", "symlinkat", "link", "linkat", "lchown", "lchown32",
+	"lgetxattr", "lsetxattr", "llistxattr", "lremovexattr",
+	"mkdir", "mkdirat", "mknod", "mknodat", NULL,
+};
+
+static bool dereferences_final(const char *sysname)
+{
+	size_t i;
+
+	for (i = 0; nofollow_syscalls[i] != NULL; i++) {
+		if (strcmp(sysname, nofollow_syscalls[i]) == 0)
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Load the translations from the replay file @path.  This function
+ * returns the number of loaded translations, or -1 on error.
+ */
+static ssize_t load_translations(TALLOC_CTX *context, const char *path,
+				Translation **translations)
+{
+	size_t nb_translations = 0;
+	size_t size = 0;
+	ssize_t length;
+	char *line = NULL;
+	size_t capacity = 0;
+	FILE *file;
+
+	file = fopen(path, "r");
+	if (file == NULL) {
+		perror(path);
+		return -1;
+	}
+
+	*translations = NULL;
+	while ((length = getline(&line, &capacity, file)) > 0) {
+		char *sysname = line;
+		char *base;
+		char *user_path;
+
+		if (line[length - 1] == '\n')
+			line[length - 1] = '\0';
+
+		base = strchr(sysname, '\t');
+		if (base == NULL)
+			continue;
+		*base++ = '\0';
+
+		user_path = strchr(base, '\t');
+		if (user_path == NULL)
+			continue;
+		*user_path++ = '\0';
+
+		if (nb_translations == size) {
+			size = size * 2 ?: 1024;
+			*translations = talloc_realloc(context, *translations, Translation, size);
+			if (*translations == NULL)
+				return -1;
+		}
+
+		(*translations)[nb_translations].base = talloc_strdup(context, base);
+		(*translations)[nb_translations].path = talloc_strdup(context, user_path);
+		(*translations)[nb_translations].deref_final = dereferences_final(sysname);
+		nb_translations++;
+	}
+
+	free(line);
+	fclose(file);
+
+	return nb_translations;
+}
+
+static uint64_t now(void)
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (uint64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-r rootfs] [-b host[:guest]]... [-n iterations] FILE\n",
+		name);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *const argv[])
+{
+	Translation *translations;
+	ssize_t nb_translations;
+	const char *rootfs = "/";
+	uint64_t nb_allocations0;
+	char result[PATH_MAX];
+	uint64_t nb_errors = 0;
+	long nb_iterations = 10;
+	Tracee *tracee;
+	uint64_t start;
+	uint64_t end;
+	uint64_t nb_ops;
+	long i;
+	int option;
+	int status;
+
+	global_tool_name = "proot-bench";
+
+	tracee = new_dummy_tracee(NULL);
+	if (tracee == NULL)
+		return EXIT_FAILURE;
+	tracee->tool_name = global_tool_name;
+
+	while ((option = getopt(argc, argv, "r:b:n:")) != -1) {
+		switch (option) {
+		case 'r':
+			rootfs = optarg;
+			break;
+
+		case 'b': {
+			char *host = talloc_strdup(tracee->ctx, optarg);
+			char *guest = strchr(host, ':');
+
+			if (guest != NULL)
+				*guest++ = '\0';
+
+			if (new_binding(tracee, host, guest, true) == NULL)
+				return EXIT_FAILURE;
+			break;
+		}
+
+		case 'n':
+			nb_iterations = strtol(optarg, NULL, 10);
+			if (nb_iterations <= 0)
+				usage(argv[0]);
+			break;
+
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind != argc - 1)
+		usage(argv[0]);
+
+	/* Same as "proot -r": the binding to "/" comes last.  */
+	if (new_binding(tracee, rootfs, "/", true) == NULL)
+		return EXIT_FAILURE;
+
+	tracee->fs->cwd = talloc_strdup(tracee->fs, "/");
+	if (tracee->fs->cwd == NULL || initialize_bindings(tracee) < 0)
+		return EXIT_FAILURE;
+
+	nb_translations = load_translations(tracee, argv[optind], &translations);
+	if (nb_translations <= 0) {
+		fprintf(stderr, "%s: no translations to replay\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	nb_allocations0 = nb_allocations;
+	start = now();
+
+	for (i = 0; i < nb_iterations; i++) {
+		ssize_t j;
+
+		for (j = 0; j < nb_translations; j++) {
+			/* The base is either the cwd or the path of a
+			 * directory descriptor.  */
+			tracee->fs->cwd = (char *) translations[j].base;
+
+			status = translate_path(tracee, result, AT_FDCWD, translations[j].path,
+						translations[j].deref_final);
+			if (status < 0)
+				nb_errors++;
+		}
+	}
+
+	end = now();
+	tracee->fs->cwd = NULL;
+
+	nb_ops = (uint64_t) nb_translations * nb_iterations;
+	printf("%zd translations x %ld iterations: %.1f ns/op, %.2f allocs/op, %" PRIu64 " errors/iteration\n",
+		nb_translations, nb_iterations,
+		(double) (end - start) / nb_ops,
+		(double) (nb_allocations - nb_allocations0) / nb_ops,
+		nb_errors / nb_iterations);
+
+	return EXIT_SUCCESS;
+}
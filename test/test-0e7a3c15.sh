@@ -0,0 +1,48 @@
+if [ -z $(which mcookie) ] || [ -z $(which sh) ] || [ -z $(which cat) ] || [ -z $(which ls) ] || [ -z $(which grep) ] || [ -z $(which rm) ] || [ -z $(which mkdir) ] || [ -z $(which mv) ]; then
+    exit 125;
+fi
+
+TMP=/tmp/$(mcookie)
+LOWER=${TMP}/lower
+UPPER=${TMP}/upper
+
+mkdir -p ${LOWER}/dir/sub
+echo original > ${LOWER}/file
+echo other > ${LOWER}/other
+echo moved > ${LOWER}/moved
+echo content > ${LOWER}/dir/sub/file
+
+# Modifications are visible from the guest only.
+${PROOT} -O ${UPPER} sh -c "echo modified > ${LOWER}/file"
+${PROOT} -O ${UPPER} cat ${LOWER}/file | grep '^modified$'
+grep '^original$' ${LOWER}/file
+
+# Deletions are recorded as whiteouts, which are not listed.
+${PROOT} -O ${UPPER} rm ${LOWER}/other
+${PROOT} -O ${UPPER} sh -c "test ! -e ${LOWER}/other"
+test -e ${LOWER}/other
+! ${PROOT} -O ${UPPER} ls -a ${LOWER} | grep -e other -e '\.wh\.'
+[ $? -eq 0 ]
+${PROOT} -O ${UPPER} ls ${LOWER} | grep '^file$'
+
+# Renamed files.
+${PROOT} -O ${UPPER} mv ${LOWER}/moved ${LOWER}/renamed
+${PROOT} -O ${UPPER} cat ${LOWER}/renamed | grep '^moved$'
+${PROOT} -O ${UPPER} sh -c "test ! -e ${LOWER}/moved"
+test -e ${LOWER}/moved
+
+# Directories are merged, removed, and re-created empty.
+${PROOT} -O ${UPPER} sh -c "echo new > ${LOWER}/dir/new"
+${PROOT} -O ${UPPER} ls ${LOWER}/dir | grep '^new$'
+${PROOT} -O ${UPPER} ls ${LOWER}/dir | grep '^sub$'
+${PROOT} -O ${UPPER} rm -r ${LOWER}/dir
+${PROOT} -O ${UPPER} sh -c "test ! -e ${LOWER}/dir"
+test -e ${LOWER}/dir/sub/file
+${PROOT} -O ${UPPER} mkdir ${LOWER}/dir
+test -z "$(${PROOT} -O ${UPPER} ls -A ${LOWER}/dir)"
+
+# Another upper layer starts from the pristine rootfs.
+${PROOT} -O ${TMP}/upper2 cat ${LOWER}/file | grep '^original$'
+${PROOT} -O ${TMP}/upper2 cat ${LOWER}/dir/sub/file | grep '^content$'
+
+rm -fr ${TMP}
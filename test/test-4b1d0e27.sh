@@ -0,0 +1,17 @@
+if [ -z $(which mcookie) ] || [ -z $(which grep) ] || [ ! -x ${ROOTFS}/bin/pwd ] || [ ! -x ${ROOTFS}/bin/chdir_getcwd ] || [ ! -x ${ROOTFS}/bin/fchdir_getcwd ]; then
+    exit 125;
+fi
+
+# Results are the same whether the kernel actually handles the
+# bindings or PRoot falls back to ptrace.
+${PROOT} -v -1 --kernel-bindings -b /proc -b /tmp -r ${ROOTFS} true
+${PROOT} -v -1 --kernel-bindings -b /proc -b /tmp -w /tmp -r ${ROOTFS} pwd | grep '^/tmp$'
+${PROOT} -v -1 --kernel-bindings -b /proc -b /tmp -r ${ROOTFS} chdir_getcwd /bin | grep '^/bin$'
+${PROOT} -v -1 --kernel-bindings -b /proc -b /tmp -r ${ROOTFS} fchdir_getcwd /bin | grep '^/bin$'
+
+! ${PROOT} -v -1 --kernel-bindings -b /proc -b /tmp -r ${ROOTFS} chdir_getcwd /bin/true
+[ $? -eq 0 ]
+
+# This binding requires a glue, so PRoot has to fall back to ptrace.
+DOES_NOT_EXIST=/$(mcookie)
+${PROOT} -v -1 --kernel-bindings -b /tmp:${DOES_NOT_EXIST} -r ${ROOTFS} chdir_getcwd ${DOES_NOT_EXIST} | grep "^${DOES_NOT_EXIST}$"
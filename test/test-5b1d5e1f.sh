@@ -0,0 +1,24 @@
+if [ -z $(which mcookie) ] || [ -z $(which cat) ] || [ -z $(which ls) ] || [ -z $(which grep) ]; then
+    exit 125;
+fi
+
+TMP=/tmp/$(mcookie)
+mkdir -p ${TMP}/dir
+echo content > ${TMP}/dir/file
+ln -s /binding/dir/file ${TMP}/link
+
+# Results are the same whether the shim actually translates paths
+# in-process or PRoot handles everything.
+${PROOT} --preload-shim -b ${TMP}:/binding cat /binding/dir/file | grep '^content$'
+${PROOT} --preload-shim -b ${TMP}:/binding cat /binding/link | grep '^content$'
+${PROOT} --preload-shim -b ${TMP}:/binding cat /binding/dir/../dir/file | grep '^content$'
+${PROOT} --preload-shim -b ${TMP}:/binding -w /binding cat dir/file | grep '^content$'
+${PROOT} --preload-shim -b ${TMP}:/binding ls -l /binding/link | grep -- '-> /binding/dir/file'
+
+! ${PROOT} --preload-shim -b ${TMP}:/binding cat /binding/dir/file/
+[ $? -eq 0 ]
+
+! ${PROOT} --preload-shim -b ${TMP}:/binding cat /binding/does-not-exist
+[ $? -eq 0 ]
+
+rm -fr ${TMP}
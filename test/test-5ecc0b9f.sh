@@ -0,0 +1,15 @@
+if [ -z `which strace` ] || [ -z `which true` ] || [ -z `which grep` ] || [ -z `which wc` ]; then
+    exit 125;
+fi
+
+# --seccomp-bpf requires strace >= 5.3.
+strace --seccomp-bpf -f -e trace=execve true > /dev/null 2>&1 || exit 125
+
+${PROOT} strace --seccomp-bpf -f -e trace=execve true 2>&1 | grep '^execve.*= 0$'
+
+RESULT=$(${PROOT} strace --seccomp-bpf -f -e trace=execve true 2>&1 | grep '^execve' | wc -l)
+test "${RESULT}" = "1"
+
+# Syscalls filtered by PRoot only must not be reported.
+RESULT=$(${PROOT} strace --seccomp-bpf -f -e trace=execve cat /etc/passwd 2>&1 >/dev/null | grep -c 'open')
+test "${RESULT}" = "0"
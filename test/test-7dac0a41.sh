@@ -0,0 +1,33 @@
+if [ -z `which mcookie` ] || [ -z `which id` ] || [ -z `which mkdir` ] || [ -z `which chmod` ] || [ -z `which stat` ] || [ -z `which cat` ] || [ -z `which ls` ] || [ -z `which sleep` ]; then
+    exit 125;
+fi
+
+if [ `id -u` -eq 0 ]; then
+    exit 125;
+fi
+
+TMP=/tmp/$(mcookie)
+
+# Read-only files and directories are accessed as-is by a fake root:
+# their mode, and thus their ctime, are left untouched.
+mkdir -p ${TMP}/foo
+echo bar > ${TMP}/foo/bar
+chmod 0444 ${TMP}/foo/bar
+chmod 0555 ${TMP}/foo
+
+CTIME1=$(stat -c %Z ${TMP}/foo ${TMP}/foo/bar)
+sleep 1
+
+${PROOT} -0 cat ${TMP}/foo/bar | grep '^bar$'
+${PROOT} -0 ls ${TMP}/foo | grep '^bar$'
+
+CTIME2=$(stat -c %Z ${TMP}/foo ${TMP}/foo/bar)
+test "${CTIME1}" = "${CTIME2}"
+
+# Whereas a denied access is still granted.
+${PROOT} -0 sh -c "echo baz > ${TMP}/foo/bar"
+${PROOT} -0 cat ${TMP}/foo/bar | grep '^baz$'
+stat -c %a ${TMP}/foo/bar | grep '^444$'
+
+chmod -R +rwx ${TMP}
+rm -fr ${TMP}
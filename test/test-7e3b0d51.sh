@@ -0,0 +1,20 @@
+if [ -z `which mcookie` ] || [ -z `which mkdir` ] || [ -z `which ls` ] || [ -z `which rmdir` ] || [ -z `which sleep` ] || [ -z `which env` ] || [ -z `which true` ]; then
+    exit 125
+fi
+
+TMP=/tmp/$(mcookie)
+DOES_NOT_EXIST=/$(mcookie)/$(mcookie)/$(mcookie)
+
+mkdir ${TMP}
+
+# This binding requires a glue, this latter is removed by a detached
+# process once PRoot has exited.
+env PROOT_TMP_DIR=${TMP} ${PROOT} -b /tmp:${DOES_NOT_EXIST} true
+
+for i in 1 2 3 4 5 6 7 8 9 10; do
+    [ -z "$(ls -A ${TMP})" ] && break
+    sleep 1
+done
+[ -z "$(ls -A ${TMP})" ]
+
+rmdir ${TMP}
@@ -0,0 +1,41 @@
+if [ -z `which tar` ] || [ -z `which rm` ] || [ -z `which mcookie` ] || [ -z `which cat` ] || [ -z `which grep` ] || [ -z `which dd` ] || [ -z `which wc` ]; then
+    exit 125;
+fi
+
+if [ ! -e $CARE ]; then
+    exit 125;
+fi
+unset PROOT
+
+TMP=/tmp/$(mcookie)
+mkdir ${TMP}
+echo unchanged > ${TMP}/file1
+echo before > ${TMP}/file2
+dd if=/dev/zero of=${TMP}/file3 bs=1M count=2
+
+${CARE} -o ${TMP}-base.tar cat ${TMP}/file1 ${TMP}/file2 ${TMP}/file3
+
+echo after > ${TMP}/file2
+${CARE} -m 1 -B ${TMP}-base.tar -o ${TMP}-delta.tar cat ${TMP}/file1 ${TMP}/file2 ${TMP}/file3
+
+# Only the modified file is in the delta archive...
+tar -tf ${TMP}-delta.tar | grep "rootfs${TMP}/file2$"
+! tar -tf ${TMP}-delta.tar | grep "rootfs${TMP}/file1$"
+[ $? -eq 0 ]
+
+# ... the other one is reused from the base archive.
+tar -xOf ${TMP}-delta.tar $(basename ${TMP})-delta/base-manifest.txt | grep "^${TMP}/file1$"
+
+# A content emptied because of -m must not shadow the base one.
+! tar -tf ${TMP}-delta.tar | grep "rootfs${TMP}/file3$"
+[ $? -eq 0 ]
+tar -xOf ${TMP}-delta.tar $(basename ${TMP})-delta/base-manifest.txt | grep "^${TMP}/file3$"
+
+cd /tmp
+${CARE} -x ${TMP}-base.tar
+${CARE} -x ${TMP}-delta.tar
+${TMP}-delta/re-execute.sh | grep '^unchanged$'
+${TMP}-delta/re-execute.sh | grep '^after$'
+test $(${TMP}-delta/re-execute.sh | wc -c) -eq $((2 * 1024 * 1024 + 16))
+
+rm -fr ${TMP} ${TMP}-base.tar ${TMP}-base ${TMP}-delta.tar ${TMP}-delta
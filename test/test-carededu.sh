@@ -0,0 +1,36 @@
+if [ -z `which cmp` ] || [ -z `which seq` ] || [ -z `which tar` ] || [ -z `which rm` ] || [ -z `which mcookie` ] || [ -z `which cat` ] || [ -z `which grep` ] || [ -z `which touch` ]; then
+    exit 125;
+fi
+
+if [ ! -e $CARE ]; then
+    exit 125;
+fi
+unset PROOT
+
+TMP=/tmp/$(mcookie)
+mkdir ${TMP}
+seq 1 10000 > ${TMP}/file1
+seq 1 10000 > ${TMP}/file2
+seq 2 10001 > ${TMP}/file3
+seq 1 10000 > ${TMP}/file4
+
+# Duplicates share the status of their original once extracted, so
+# only files with the same modification time are deduplicated.
+touch -r ${TMP}/file1 ${TMP}/file2 ${TMP}/file3
+touch -d '2001-01-01' ${TMP}/file4
+
+${CARE} -o ${TMP}.tar cat ${TMP}/file1 ${TMP}/file2 ${TMP}/file3 ${TMP}/file4 2>&1 | grep '^care info: Deduplication: 1 of'
+
+# Only the second file is a duplicate.
+tar -tvf ${TMP}.tar | grep "${TMP#/}/file2 link to .*${TMP#/}/file1$"
+! tar -tvf ${TMP}.tar | grep "${TMP#/}/file3 link to"
+[ $? -eq 0 ]
+! tar -tvf ${TMP}.tar | grep "${TMP#/}/file4 link to"
+[ $? -eq 0 ]
+
+mkdir ${TMP}/extract
+tar -C ${TMP}/extract -xf ${TMP}.tar
+cmp ${TMP}/file1 ${TMP}/extract/*/rootfs${TMP}/file2
+cmp ${TMP}/file3 ${TMP}/extract/*/rootfs${TMP}/file3
+
+rm -fr ${TMP} ${TMP}.tar
@@ -0,0 +1,30 @@
+if [ -z `which cpio` ] || [ -z `which rm` ] || [ -z `which mcookie` ] || [ -z `which cat` ] || [ -z `which grep` ]; then
+    exit 125;
+fi
+
+if [ ! -e $CARE ]; then
+    exit 125;
+fi
+unset PROOT
+
+TMP=/tmp/$(mcookie)
+NAME=$(basename ${TMP})
+mkdir ${TMP}
+echo content > ${TMP}/file
+
+${CARE} -o ${TMP}.cpio cat ${TMP}/file
+
+cd /tmp
+${CARE} -X ${TMP}.cpio
+test -e ${TMP}/lazy-index
+
+# The content is not extracted yet...
+test -s ${TMP}/rootfs${TMP}/file
+! grep -q content ${TMP}/rootfs${TMP}/file
+[ $? -eq 0 ]
+
+# ... until it is opened.
+${TMP}/re-execute.sh | grep '^content$'
+grep '^content$' ${TMP}/rootfs${TMP}/file
+
+rm -fr ${TMP} ${TMP}.cpio
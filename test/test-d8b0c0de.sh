@@ -0,0 +1,37 @@
+if [ -z `which mcookie` ] || [ -z `which id` ] || [ -z `which touch` ] || [ -z `which chown` ] || [ -z `which mknod` ] || [ -z `which stat` ] || [ -z `which grep` ] || [ -z `which rm` ]; then
+    exit 125;
+fi
+
+if [ `id -u` -eq 0 ]; then
+    exit 125;
+fi
+
+TMP=/tmp/$(mcookie)
+mkdir ${TMP}
+touch ${TMP}/file
+
+# Ownership is remembered during a run...
+${PROOT} -0 sh -c "chown 123:456 ${TMP}/file; stat -c %u:%g ${TMP}/file" | grep '^123:456$'
+
+# ... but not applied to host files.
+stat -c %u ${TMP}/file | grep "^$(id -u)$"
+${PROOT} -0 stat -c %u:%g ${TMP}/file | grep '^0:0$'
+
+# It persists across runs with --db.
+${PROOT} -0 --db=${TMP}.db chown 123:456 ${TMP}/file
+${PROOT} -0 --db=${TMP}.db stat -c %u:%g ${TMP}/file | grep '^123:456$'
+
+# Device nodes are created as regular files.
+${PROOT} -0 --db=${TMP}.db mknod ${TMP}/null c 1 3
+test -f ${TMP}/null
+${PROOT} -0 --db=${TMP}.db stat -c %F:%t:%T ${TMP}/null | grep '^character special file:1:3$'
+
+# Removed inodes are forgotten.
+${PROOT} -0 --db=${TMP}.db rm ${TMP}/null
+${PROOT} -0 --db=${TMP}.db sh -c "touch ${TMP}/null2; stat -c %F ${TMP}/null2" | grep '^regular empty file$'
+
+# --db requires -0 or -i.
+! ${PROOT} --db=${TMP}.db true
+[ $? -eq 0 ]
+
+rm -fr ${TMP} ${TMP}.db
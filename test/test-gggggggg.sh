@@ -5,10 +5,10 @@ fi
 TMP=/tmp/$(mcookie)
 mkdir ${TMP}
 
-! env PROOT_DONT_POLLUTE_ROOTFS=1 ${PROOT} -b /bin:${TMP}/dont/create ${ROOTFS}/bin/readdir ${TMP} | grep -w dont
-[ $? -eq 0 ]
-
-env PROOT_DONT_POLLUTE_ROOTFS=1 ${PROOT} -b /bin:${TMP}/dont/create test -e ${TMP}/dont
+# The glue is listed in its parent directory without being created.
+${PROOT} -b /bin:${TMP}/dont/create ${ROOTFS}/bin/readdir ${TMP} | grep -w dont
+${PROOT} -b /bin:${TMP}/dont/create ${ROOTFS}/bin/readdir ${TMP}/dont | grep -w create
+${PROOT} -b /bin:${TMP}/dont ${ROOTFS}/bin/readdir ${TMP} | grep -w dont
 
 ${PROOT} -b /bin:${TMP}/dont/create test -e ${TMP}/dont
 
@@ -0,0 +1,67 @@
+#!/bin/sh
+# Test for event filtering in the Python Extension for PRoot
+set -eu
+
+# Check for test dependencies
+for cmd in mcookie cat grep rm sh ls sleep; do
+  if ! command -v "${cmd}" > /dev/null; then
+      exit 125
+  fi
+done
+
+# Check for PRoot binary
+if [ ! -e "${PROOT}" ]; then
+    exit 125
+fi
+
+# Check for python flag
+if ! "${PROOT}" --help | grep -- "-P string"; then
+    exit 125
+fi
+
+TMP="$(mcookie)_filter"
+
+# The following python script only asks for getdents syscalls
+# synchronously, and observes host paths from another thread.
+cat > "/tmp/${TMP}.py" <<EOF
+import threading
+
+from proot import *
+
+wanted = (PR_getdents, PR_getdents64)
+
+def consume():
+	with open("/tmp/${TMP}.paths", "w") as log:
+		while True:
+			events = fetch_events(0)
+			if events is None:
+				break
+			for (event, pid, vpid, sysnum, value, path) in events:
+				if event == HOST_PATH and path:
+					log.write(path + "\n")
+			log.flush()
+
+def python_callback(extension, event, data1, data2):
+	if event == INITIALIZATION:
+		set_event_filter([SYSCALL_EXIT_END], [HOST_PATH], wanted)
+		thread = threading.Thread(target=consume)
+		thread.daemon = True
+		thread.start()
+	elif event != SYSCALL_EXIT_END:
+		with open("/tmp/${TMP}.errors", "a") as log:
+			log.write("unexpected event %d\n" % event)
+	else:
+		tracee = get_tracee_from_extension(extension)
+		if get_sysnum(tracee, ORIGINAL) not in wanted:
+			with open("/tmp/${TMP}.errors", "a") as log:
+				log.write("unexpected syscall\n")
+
+	return 0
+EOF
+
+"${PROOT}" -P "/tmp/${TMP}.py" sh -c 'ls / > /dev/null; sleep 1'
+
+test ! -e "/tmp/${TMP}.errors"
+grep -q . "/tmp/${TMP}.paths"
+
+rm -f "/tmp/${TMP}.py" "/tmp/${TMP}.paths" "/tmp/${TMP}.errors"
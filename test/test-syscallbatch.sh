@@ -0,0 +1,28 @@
+if [ -z `which uname` ] || [ -z `which python3` ] || [ -z `which grep` ]; then
+    exit 125;
+fi
+
+if [ "$(uname -m)" != "x86_64" ]; then
+    exit 125;
+fi
+
+# With a forced kompat, pipe2(O_CLOEXEC | O_NONBLOCK) is emulated by
+# pipe(2) followed by four chained fcntl(2), run in a single batch
+# with --syscall-batch.
+SCRIPT='
+import os, fcntl
+r, w = os.pipe2(os.O_CLOEXEC | os.O_NONBLOCK)
+for fd in r, w:
+    assert fcntl.fcntl(fd, fcntl.F_GETFD) & fcntl.FD_CLOEXEC
+    assert fcntl.fcntl(fd, fcntl.F_GETFL) & os.O_NONBLOCK
+print("ok")
+'
+
+env PROOT_FORCE_KOMPAT=1 ${PROOT} -k $(uname -r) python3 -c "${SCRIPT}" | grep ^ok$
+
+env PROOT_FORCE_KOMPAT=1 ${PROOT} --syscall-batch -k $(uname -r) python3 -c "${SCRIPT}" | grep ^ok$
+env PROOT_FORCE_KOMPAT=1 ${PROOT} --syscall-batch -v 3 -k $(uname -r) python3 -c "${SCRIPT}" 2>&1 | grep 'syscall batch of 4 chained syscalls'
+
+# Without this option, chained syscalls are never batched.
+! env PROOT_FORCE_KOMPAT=1 ${PROOT} -v 3 -k $(uname -r) python3 -c "${SCRIPT}" 2>&1 | grep 'syscall batch of'
+[ $? -eq 0 ]
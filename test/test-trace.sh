@@ -0,0 +1,18 @@
+if [ -z `which mcookie` ] || [ -z `which head` ] || [ -z `which cat` ] || [ -z `which grep` ] || [ -z `which python3` ] || [ -z `which rm` ]; then
+    exit 125;
+fi
+
+TMP=/tmp/$(mcookie)
+echo content > ${TMP}.in
+
+${PROOT} --trace=${TMP} cat ${TMP}.in
+
+test "$(head -c 8 ${TMP})" = "PRTRACE1"
+test -e ${TMP}.paths
+
+# The execution and the opening of the input file are recorded with
+# their paths and results.
+python3 ../contrib/proot-trace.py --syscall execve ${TMP} | grep -E ' execve\(.*\) = 0 <.*>.*/cat( |$)'
+python3 ../contrib/proot-trace.py --path ${TMP}.in ${TMP} | grep -E ' (open|openat)\(.*\) = [0-9]+ <.*> '"${TMP}.in"'$'
+
+rm -f ${TMP} ${TMP}.paths ${TMP}.in